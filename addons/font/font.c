@@ -25,6 +25,10 @@
 ALLEGRO_DEBUG_CHANNEL("font")
 
 
+/* Number of glyphs collected before they are drawn as one batch. */
+#define GLYPH_RUN_SIZE  64
+
+
 typedef struct
 {
    ALLEGRO_USTR *extension;
@@ -71,18 +75,97 @@ static int font_descent(const ALLEGRO_FONT *f)
 
 
 
-/* length:
- *  (mono and color vtable entry)
+static ALLEGRO_BITMAP *_al_font_color_table_lookup(
+   const ALLEGRO_FONT_COLOR_TABLE *table, int ch)
+{
+    int page = ch >> _AL_FONT_PAGE_BITS;
+
+    if (ch >= 0 && page < table->num_pages && table->pages[page])
+        return table->pages[page][ch & _AL_FONT_PAGE_MASK];
+    return NULL;
+}
+
+
+/* _color_find_glyph:
+ *  Helper for color vtable entries, below. The missing glyph is looked up
+ *  once when the table is built, so a miss costs no more than a hit.
+ */
+static ALLEGRO_BITMAP* _al_font_color_find_glyph(const ALLEGRO_FONT* f, int ch)
+{
+    ALLEGRO_FONT_COLOR_TABLE *table = (ALLEGRO_FONT_COLOR_TABLE *)(f->data);
+    ALLEGRO_BITMAP *g = _al_font_color_table_lookup(table, ch);
+
+    return g ? g : table->missing;
+}
+
+
+
+/* _al_font_color_build_table:
+ *  Flattens the list of glyph ranges into the page table used by
+ *  _al_font_color_find_glyph. Where ranges overlap, the one grabbed
+ *  first wins.
+ */
+bool _al_font_color_build_table(ALLEGRO_FONT_COLOR_TABLE *table)
+{
+    ALLEGRO_FONT_COLOR_DATA *cf;
+    int max_ch = -1;
+    int ch;
+
+    for (cf = table->ranges; cf; cf = cf->next) {
+        if (cf->end - 1 > max_ch)
+            max_ch = cf->end - 1;
+    }
+
+    table->missing = NULL;
+    table->pages = NULL;
+    table->num_pages = 0;
+
+    /* A font without glyphs has an empty table. */
+    if (max_ch < 0)
+        return true;
+
+    table->num_pages = (max_ch >> _AL_FONT_PAGE_BITS) + 1;
+    table->pages = al_calloc(table->num_pages, sizeof(ALLEGRO_BITMAP **));
+    if (!table->pages) {
+        table->num_pages = 0;
+        return false;
+    }
+
+    for (cf = table->ranges; cf; cf = cf->next) {
+        for (ch = cf->begin; ch < cf->end; ch++) {
+            ALLEGRO_BITMAP ***page = &table->pages[ch >> _AL_FONT_PAGE_BITS];
+            if (!*page) {
+                *page = al_calloc(_AL_FONT_PAGE_SIZE, sizeof(ALLEGRO_BITMAP *));
+                if (!*page)
+                    return false;
+            }
+            if (!(*page)[ch & _AL_FONT_PAGE_MASK])
+                (*page)[ch & _AL_FONT_PAGE_MASK] = cf->bitmaps[ch - cf->begin];
+        }
+    }
+
+    table->missing = _al_font_color_table_lookup(table,
+        al_font_404_character);
+    return true;
+}
+
+
+
+/* color_length:
+ *  (color vtable entry)
  *  Returns the length, in pixels, of a string as rendered in a font.
  */
-static int length(const ALLEGRO_FONT* f, const ALLEGRO_USTR *text)
+static int color_length(const ALLEGRO_FONT *f, const ALLEGRO_USTR *text)
 {
+    ALLEGRO_BITMAP *g;
     int ch = 0, w = 0;
     int pos = 0;
     ASSERT(f);
 
     while ((ch = al_ustr_get_next(text, &pos)) >= 0) {
-        w += f->vtable->char_length(f, ch);
+        g = _al_font_color_find_glyph(f, ch);
+        if (g)
+            w += al_get_bitmap_width(g);
     }
 
     return w;
@@ -100,45 +183,12 @@ static void color_get_text_dimensions(ALLEGRO_FONT const *f,
    int h = al_get_font_line_height(f);
    if (bbx) *bbx = 0;
    if (bby) *bby = 0;
-   if (bbw) *bbw = length(f, text);
+   if (bbw) *bbw = color_length(f, text);
    if (bbh) *bbh = h;
 }
 
 
 
-static ALLEGRO_FONT_COLOR_DATA *_al_font_find_page(
-   ALLEGRO_FONT_COLOR_DATA *cf, int ch)
-{
-    while (cf) {
-        if (ch >= cf->begin && ch < cf->end)
-            return cf;
-        cf = cf->next;
-    }
-    return NULL;
-}
-
-
-/* _color_find_glyph:
- *  Helper for color vtable entries, below.
- */
-static ALLEGRO_BITMAP* _al_font_color_find_glyph(const ALLEGRO_FONT* f, int ch)
-{
-    ALLEGRO_FONT_COLOR_DATA* cf = (ALLEGRO_FONT_COLOR_DATA*)(f->data);
-
-    cf = _al_font_find_page(cf, ch);
-    if (cf) {
-        return cf->bitmaps[ch - cf->begin];
-    }
-
-    /* if we don't find the character, then search for the missing
-       glyph, but don't get stuck in a loop. */
-    if (ch != al_font_404_character)
-        return _al_font_color_find_glyph(f, al_font_404_character);
-    return 0;
-}
-
-
-
 /* color_char_length:
  *  (color vtable entry)
  *  Returns the length of a character, in pixels, as it would be rendered
@@ -184,20 +234,50 @@ static int color_render_char(const ALLEGRO_FONT* f,
  *  Renders a color font onto a bitmap, at the specified location, using
  *  the specified colors. If fg == -1, render as color, else render as
  *  mono; if bg == -1, render as transparent, else render as opaque.
+ *  Consecutive glyphs from the same glyph sheet are drawn as one run.
  */
 static int color_render(const ALLEGRO_FONT* f, ALLEGRO_COLOR color,
    const ALLEGRO_USTR *text,
     float x, float y)
 {
+    _AL_BITMAP_QUAD quads[GLYPH_RUN_SIZE];
+    ALLEGRO_BITMAP *sheet = NULL;
+    int num_quads = 0;
     int pos = 0;
     int advance = 0;
+    int h = f->vtable->font_height(f);
     int32_t ch;
     bool held = al_is_bitmap_drawing_held();
 
     al_hold_bitmap_drawing(true);
     while ((ch = al_ustr_get_next(text, &pos)) >= 0) {
-        advance += f->vtable->render_char(f, color, ch, x + advance, y);
+        ALLEGRO_BITMAP *g = _al_font_color_find_glyph(f, ch);
+        ALLEGRO_BITMAP *parent;
+        _AL_BITMAP_QUAD *q;
+
+        if (!g)
+            continue;
+
+        parent = g->parent ? g->parent : g;
+        if (parent != sheet || num_quads == GLYPH_RUN_SIZE) {
+            if (sheet)
+                _al_draw_tinted_bitmap_quads(sheet, color, quads, num_quads);
+            sheet = parent;
+            num_quads = 0;
+        }
+
+        q = &quads[num_quads++];
+        q->sx = g->parent ? g->xofs : 0;
+        q->sy = g->parent ? g->yofs : 0;
+        q->sw = g->w;
+        q->sh = g->h;
+        q->dx = x + advance;
+        q->dy = y + ((float)h - g->h)/2.0f;
+
+        advance += g->w;
     }
+    if (sheet)
+        _al_draw_tinted_bitmap_quads(sheet, color, quads, num_quads);
     al_hold_bitmap_drawing(held);
     return advance;
 }
@@ -210,13 +290,25 @@ static int color_render(const ALLEGRO_FONT* f, ALLEGRO_COLOR color,
  */
 static void color_destroy(ALLEGRO_FONT* f)
 {
+    ALLEGRO_FONT_COLOR_TABLE *table;
     ALLEGRO_FONT_COLOR_DATA* cf;
     ALLEGRO_BITMAP *glyphs = NULL;
+    int i;
 
     if (!f)
         return;
 
-    cf = (ALLEGRO_FONT_COLOR_DATA*)(f->data);
+    table = (ALLEGRO_FONT_COLOR_TABLE *)(f->data);
+    if (!table) {
+        al_free(f);
+        return;
+    }
+
+    for (i = 0; i < table->num_pages; i++)
+        al_free(table->pages[i]);
+    al_free(table->pages);
+
+    cf = table->ranges;
 
     if (cf)
         glyphs = cf->glyphs;
@@ -241,14 +333,34 @@ static void color_destroy(ALLEGRO_FONT* f)
         cf = next;
     }
 
+    al_free(table);
     al_free(f);
 }
 
 
+/* color_get_glyph_advance:
+ *  (color vtable entry)
+ *  Bitmap fonts have no kerning, so this is just the glyph width.
+ */
+static int color_get_glyph_advance(const ALLEGRO_FONT *f,
+   int codepoint1, int codepoint2)
+{
+   ALLEGRO_BITMAP *g;
+   (void)codepoint2;
+
+   if (codepoint1 == ALLEGRO_NO_KERNING)
+      return 0;
+
+   g = _al_font_color_find_glyph(f, codepoint1);
+   return g ? g->w : 0;
+}
+
+
 static int color_get_font_ranges(ALLEGRO_FONT *font, int ranges_count,
    int *ranges)
 {
-   ALLEGRO_FONT_COLOR_DATA *cf = font->data;
+   ALLEGRO_FONT_COLOR_TABLE *table = font->data;
+   ALLEGRO_FONT_COLOR_DATA *cf = table->ranges;
    int i = 0;
    while (cf) {
       if (i < ranges_count) {
@@ -271,12 +383,13 @@ ALLEGRO_FONT_VTABLE _al_font_vtable_color = {
     font_ascent,
     font_descent,
     color_char_length,
-    length,
+    color_length,
     color_render_char,
     color_render,
     color_destroy,
     color_get_text_dimensions,
     color_get_font_ranges,
+    color_get_glyph_advance,
 };
 
 
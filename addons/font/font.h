@@ -11,6 +11,23 @@ typedef struct ALLEGRO_FONT_COLOR_DATA
    struct ALLEGRO_FONT_COLOR_DATA *next;  /* linked list structure */
 } ALLEGRO_FONT_COLOR_DATA;
 
+/* Glyphs are looked up through a two-level table: the high bits of a code
+ * point select a page, the low bits a glyph within that page.
+ */
+#define _AL_FONT_PAGE_BITS  8
+#define _AL_FONT_PAGE_SIZE  (1 << _AL_FONT_PAGE_BITS)
+#define _AL_FONT_PAGE_MASK  (_AL_FONT_PAGE_SIZE - 1)
+
+typedef struct ALLEGRO_FONT_COLOR_TABLE
+{
+   ALLEGRO_FONT_COLOR_DATA *ranges;  /* the glyph ranges, in grab order */
+   int num_pages;                    /* pages covering [0, max char] */
+   ALLEGRO_BITMAP ***pages;          /* NULL for pages without glyphs */
+   ALLEGRO_BITMAP *missing;          /* what missing glyphs render as */
+} ALLEGRO_FONT_COLOR_TABLE;
+
+bool _al_font_color_build_table(ALLEGRO_FONT_COLOR_TABLE *table);
+
 ALLEGRO_FONT *_al_load_bitmap_font(const char *filename,
    int size, int flags);
 
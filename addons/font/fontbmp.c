@@ -203,6 +203,7 @@ ALLEGRO_FONT *al_grab_font_from_bitmap(ALLEGRO_BITMAP *bmp,
    int ranges_n, const int ranges[])
 {
    ALLEGRO_FONT *f;
+   ALLEGRO_FONT_COLOR_TABLE *table;
    ALLEGRO_FONT_COLOR_DATA *cf, *prev = NULL;
    ALLEGRO_STATE backup;
    int i;
@@ -218,7 +219,15 @@ ALLEGRO_FONT *al_grab_font_from_bitmap(ALLEGRO_BITMAP *bmp,
    h = al_get_bitmap_height(bmp);
 
    f = al_calloc(1, sizeof *f);
+   if (!f)
+      return NULL;
    f->vtable = &_al_font_vtable_color;
+   table = al_calloc(1, sizeof *table);
+   if (!table) {
+      al_free(f);
+      return NULL;
+   }
+   f->data = table;
    
    al_store_state(&backup, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
@@ -246,7 +255,7 @@ ALLEGRO_FONT *al_grab_font_from_bitmap(ALLEGRO_BITMAP *bmp,
       if (prev)
          prev->next = cf;
       else
-         f->data = cf;
+         table->ranges = cf;
       
       cf->bitmaps = al_malloc(sizeof(ALLEGRO_BITMAP*) * n);
       cf->bitmaps[0] = NULL;
@@ -272,9 +281,13 @@ ALLEGRO_FONT *al_grab_font_from_bitmap(ALLEGRO_BITMAP *bmp,
          prev = cf;
       }
    }
+
+   if (!_al_font_color_build_table(table))
+      goto cleanup_and_fail_on_error;
+
    al_restore_state(&backup);
-   
-   cf = f->data;
+
+   cf = table->ranges;
    if (cf && cf->bitmaps[0])
       f->height = al_get_bitmap_height(cf->bitmaps[0]);
 
@@ -263,6 +263,309 @@ void al_draw_justified_textf(const ALLEGRO_FONT *f,
 
 
 
+/* Callback for do_multiline_ustr. The width of the line is passed along
+ * so that callers need not measure it again.
+ */
+typedef bool (*MULTILINE_CB)(int line_num, const ALLEGRO_USTR *line,
+   int width, void *extra);
+
+
+static bool is_wrap_space(int32_t c)
+{
+   return c == ' ' || c == '\t';
+}
+
+
+static int glyph_advance(const ALLEGRO_FONT *font, int32_t c1, int32_t c2)
+{
+   if (c1 == ALLEGRO_NO_KERNING)
+      return 0;
+   return font->vtable->get_glyph_advance(font, c1, c2);
+}
+
+
+/* do_multiline_ustr:
+ *  Splits ustr into lines at newlines and, if max_width is positive, at
+ *  the spaces before words that would make a line wider than max_width.
+ *  Line widths are accumulated from the glyph advances while scanning, so
+ *  the only text measured twice is the part of a word which overflowed
+ *  before the line was broken. A word wider than max_width is given a line
+ *  of its own. Returns the number of lines passed to the callback.
+ */
+static int do_multiline_ustr(const ALLEGRO_FONT *font, float max_width,
+   const ALLEGRO_USTR *ustr, MULTILINE_CB cb, void *extra)
+{
+   ALLEGRO_USTR_INFO line_info;
+   const ALLEGRO_USTR *line;
+   int size = al_ustr_size(ustr);
+   int line_num = 0;
+   int line_start = 0;
+
+   for (;;) {
+      int32_t prev = ALLEGRO_NO_KERNING;
+      int prev_advance = 0;   /* advance of prev, without kerning */
+      int width = 0;          /* width of the line before prev */
+      int break_pos = -1;     /* end of the last word which fit */
+      int break_width = 0;
+      int next_start = -1;    /* start of the word after break_pos */
+      int pos = line_start;
+
+      for (;;) {
+         int cpos = pos;
+         int32_t c = al_ustr_get_next(ustr, &pos);
+         int kerned, advance;
+
+         if (cpos >= size || c == '\n') {
+            line = al_ref_ustr(&line_info, ustr, line_start, cpos);
+            if (!cb(line_num++, line, width + prev_advance, extra))
+               return line_num;
+            if (cpos >= size)
+               return line_num;
+            line_start = pos;
+            break;
+         }
+
+         kerned = glyph_advance(font, prev, c);
+         advance = glyph_advance(font, c, ALLEGRO_NO_KERNING);
+
+         if (is_wrap_space(c)) {
+            if (prev != ALLEGRO_NO_KERNING && !is_wrap_space(prev)) {
+               break_pos = cpos;
+               break_width = width + prev_advance;
+               next_start = -1;
+            }
+         }
+         else if (break_pos >= 0) {
+            if (next_start < 0)
+               next_start = cpos;
+            if (max_width > 0 && width + kerned + advance > max_width) {
+               line = al_ref_ustr(&line_info, ustr, line_start, break_pos);
+               if (!cb(line_num++, line, break_width, extra))
+                  return line_num;
+               line_start = next_start;
+               break;
+            }
+         }
+
+         width += kerned;
+         prev = c;
+         prev_advance = advance;
+      }
+   }
+}
+
+
+typedef struct DO_MULTILINE_USTR_EXTRA
+{
+   bool (*cb)(int line_num, const ALLEGRO_USTR *line, void *extra);
+   void *extra;
+} DO_MULTILINE_USTR_EXTRA;
+
+
+static bool do_multiline_ustr_cb(int line_num, const ALLEGRO_USTR *line,
+   int width, void *extra)
+{
+   DO_MULTILINE_USTR_EXTRA *s = extra;
+   (void)width;
+   return s->cb(line_num, line, s->extra);
+}
+
+
+/* Function: al_do_multiline_ustr
+ */
+void al_do_multiline_ustr(const ALLEGRO_FONT *font, float max_width,
+   const ALLEGRO_USTR *ustr,
+   bool (*cb)(int line_num, const ALLEGRO_USTR *line, void *extra),
+   void *extra)
+{
+   DO_MULTILINE_USTR_EXTRA s;
+   ASSERT(font);
+   ASSERT(ustr);
+   ASSERT(cb);
+
+   s.cb = cb;
+   s.extra = extra;
+   do_multiline_ustr(font, max_width, ustr, do_multiline_ustr_cb, &s);
+}
+
+
+typedef struct DO_MULTILINE_TEXT_EXTRA
+{
+   bool (*cb)(int line_num, const char *line, int size, void *extra);
+   void *extra;
+} DO_MULTILINE_TEXT_EXTRA;
+
+
+static bool do_multiline_text_cb(int line_num, const ALLEGRO_USTR *line,
+   int width, void *extra)
+{
+   DO_MULTILINE_TEXT_EXTRA *s = extra;
+   (void)width;
+   /* The line refers into the caller's string, so this points there too. */
+   return s->cb(line_num, al_cstr(line), al_ustr_size(line), s->extra);
+}
+
+
+/* Function: al_do_multiline_text
+ */
+void al_do_multiline_text(const ALLEGRO_FONT *font, float max_width,
+   const char *text,
+   bool (*cb)(int line_num, const char *line, int size, void *extra),
+   void *extra)
+{
+   DO_MULTILINE_TEXT_EXTRA s;
+   ALLEGRO_USTR_INFO info;
+   ASSERT(font);
+   ASSERT(text);
+   ASSERT(cb);
+
+   s.cb = cb;
+   s.extra = extra;
+   do_multiline_ustr(font, max_width, al_ref_cstr(&info, text),
+      do_multiline_text_cb, &s);
+}
+
+
+typedef struct DRAW_MULTILINE_EXTRA
+{
+   const ALLEGRO_FONT *font;
+   ALLEGRO_COLOR color;
+   float x;
+   float y;
+   float line_height;
+   int flags;
+} DRAW_MULTILINE_EXTRA;
+
+
+static bool draw_multiline_cb(int line_num, const ALLEGRO_USTR *line,
+   int width, void *extra)
+{
+   DRAW_MULTILINE_EXTRA *s = extra;
+   float x = s->x;
+   float y = s->y + s->line_height * line_num;
+
+   /* Same alignment as al_draw_ustr, without measuring the line again. */
+   if (s->flags & ALLEGRO_ALIGN_CENTRE) {
+      x -= width / 2;
+   }
+   else if (s->flags & ALLEGRO_ALIGN_RIGHT) {
+      x -= width;
+   }
+
+   if (s->flags & ALLEGRO_ALIGN_INTEGER)
+      align_to_integer_pixel(&x, &y);
+
+   s->font->vtable->render(s->font, s->color, line, x, y);
+   return true;
+}
+
+
+/* Function: al_draw_multiline_ustr
+ */
+void al_draw_multiline_ustr(const ALLEGRO_FONT *font,
+   ALLEGRO_COLOR color, float x, float y, float max_width, float line_height,
+   int flags, const ALLEGRO_USTR *ustr)
+{
+   DRAW_MULTILINE_EXTRA s;
+   bool held = al_is_bitmap_drawing_held();
+   ASSERT(font);
+   ASSERT(ustr);
+
+   s.font = font;
+   s.color = color;
+   s.x = x;
+   s.y = y;
+   s.line_height = line_height;
+   s.flags = flags;
+
+   al_hold_bitmap_drawing(true);
+   do_multiline_ustr(font, max_width, ustr, draw_multiline_cb, &s);
+   al_hold_bitmap_drawing(held);
+}
+
+
+/* Function: al_draw_multiline_text
+ */
+void al_draw_multiline_text(const ALLEGRO_FONT *font,
+   ALLEGRO_COLOR color, float x, float y, float max_width, float line_height,
+   int flags, const char *text)
+{
+   ALLEGRO_USTR_INFO info;
+   ASSERT(text);
+   al_draw_multiline_ustr(font, color, x, y, max_width, line_height, flags,
+      al_ref_cstr(&info, text));
+}
+
+
+/* Function: al_draw_multiline_textf
+ */
+void al_draw_multiline_textf(const ALLEGRO_FONT *font,
+   ALLEGRO_COLOR color, float x, float y, float max_width, float line_height,
+   int flags, const char *format, ...)
+{
+   ALLEGRO_USTR *buf;
+   va_list ap;
+   ASSERT(font);
+   ASSERT(format);
+
+   va_start(ap, format);
+   buf = al_ustr_new("");
+   al_ustr_vappendf(buf, format, ap);
+   va_end(ap);
+
+   al_draw_multiline_ustr(font, color, x, y, max_width, line_height, flags,
+      buf);
+
+   al_ustr_free(buf);
+}
+
+
+static bool measure_multiline_cb(int line_num, const ALLEGRO_USTR *line,
+   int width, void *extra)
+{
+   int *max_width = extra;
+   (void)line_num;
+   (void)line;
+   if (width > *max_width)
+      *max_width = width;
+   return true;
+}
+
+
+/* Function: al_get_multiline_ustr_dimensions
+ */
+int al_get_multiline_ustr_dimensions(const ALLEGRO_FONT *f,
+   float max_width, float line_height, const ALLEGRO_USTR *ustr,
+   int *bbw, int *bbh)
+{
+   int widest = 0;
+   int num_lines;
+   ASSERT(f);
+   ASSERT(ustr);
+
+   num_lines = do_multiline_ustr(f, max_width, ustr, measure_multiline_cb,
+      &widest);
+
+   if (bbw) *bbw = widest;
+   if (bbh) *bbh = line_height * (num_lines - 1) + al_get_font_line_height(f);
+   return num_lines;
+}
+
+
+/* Function: al_get_multiline_text_dimensions
+ */
+int al_get_multiline_text_dimensions(const ALLEGRO_FONT *f,
+   float max_width, float line_height, const char *text,
+   int *bbw, int *bbh)
+{
+   ALLEGRO_USTR_INFO info;
+   ASSERT(text);
+   return al_get_multiline_ustr_dimensions(f, max_width, line_height,
+      al_ref_cstr(&info, text), bbw, bbh);
+}
+
+
+
 /* Function: al_get_ustr_width
  */
 int al_get_ustr_width(const ALLEGRO_FONT *f, ALLEGRO_USTR const *ustr)
@@ -364,6 +667,15 @@ void al_destroy_font(ALLEGRO_FONT *f)
 }
 
 
+/* Function: al_get_glyph_advance
+ */
+int al_get_glyph_advance(const ALLEGRO_FONT *f, int codepoint1, int codepoint2)
+{
+   ASSERT(f);
+   return f->vtable->get_glyph_advance(f, codepoint1, codepoint2);
+}
+
+
 /* Function: al_get_font_ranges
  */
 int al_get_font_ranges(ALLEGRO_FONT *f, int ranges_count, int *ranges)
@@ -0,0 +1,779 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      A5TEX reader and writer.
+ *
+ *      A5TEX is a raw texture container which stores pixels in one of
+ *      Allegro's pixel formats so that loading is not limited by an
+ *      entropy decoder.  The layout, all values little endian, is:
+ *
+ *         char     magic[4]       "A5TX"
+ *         uint8    version        1
+ *         uint8    compression    0 = none, 1 = LZ4 blocks
+ *         uint16   flags          1 = straight (not premultiplied) alpha
+ *         uint32   format         ALLEGRO_PIXEL_FORMAT
+ *         uint32   width
+ *         uint32   height
+ *         uint32   block_size     bytes of pixel data per block, or 0
+ *
+ *      The pixel data follows as rows of width * al_get_pixel_size(format)
+ *      bytes, top row first, with multi-byte pixels in little endian
+ *      order.  When compressed, the rows are cut into blocks of block_size
+ *      bytes (the last one shorter) which are compressed independently in
+ *      the LZ4 block format, preceded by one uint32 for each block giving
+ *      its compressed size.  A block whose compressed size equals its
+ *      uncompressed size is stored as is.
+ *
+ *      Bitmaps are saved as premultiplied, which is how Allegro loads
+ *      images unless ALLEGRO_NO_PREMULTIPLIED_ALPHA is given.  The loader
+ *      converts the pixels when the file and the load flags disagree.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_image.h"
+#include "allegro5/internal/aintern_image.h"
+#include "allegro5/internal/aintern_system.h"
+
+#include "iio.h"
+
+ALLEGRO_DEBUG_CHANNEL("image")
+
+
+#define A5TEX_VERSION         1
+#define A5TEX_NONE            0
+#define A5TEX_LZ4             1
+#define A5TEX_STRAIGHT_ALPHA  1
+#define A5TEX_BLOCK_SIZE      (256 * 1024)
+
+/* LZ4 block format constraints. */
+#define LZ4_MIN_MATCH         4
+#define LZ4_LAST_LITERALS     5
+#define LZ4_MATCH_LIMIT       12
+#define LZ4_MAX_OFFSET        65535
+#define LZ4_HASH_BITS         14
+
+
+typedef struct A5TEX_HEADER
+{
+   int compression;
+   int flags;
+   int format;
+   int width;
+   int height;
+   int block_size;
+} A5TEX_HEADER;
+
+
+
+static uint32_t read32(const unsigned char *p)
+{
+   uint32_t v;
+   memcpy(&v, p, 4);
+   return v;
+}
+
+
+
+static unsigned char *write_length(unsigned char *op, int len)
+{
+   while (len >= 255) {
+      *op++ = 255;
+      len -= 255;
+   }
+   *op++ = len;
+   return op;
+}
+
+
+
+/* lz4_compress:
+ *  Compresses n bytes from src into dst in the LZ4 block format, using a
+ *  greedy search with a hash table of the last position of each 4-byte
+ *  sequence.  table must have room for 1 << LZ4_HASH_BITS entries.
+ *  Returns the compressed size, or 0 if it would exceed cap.
+ */
+static int lz4_compress(const unsigned char *src, int n,
+   unsigned char *dst, int cap, int *table)
+{
+   const unsigned char *ip = src;
+   const unsigned char *anchor = src;
+   const unsigned char *const end = src + n;
+   const unsigned char *const match_limit = end - LZ4_MATCH_LIMIT;
+   unsigned char *op = dst;
+   unsigned char *const op_end = dst + cap;
+   int lit;
+
+   memset(table, 0, sizeof(int) << LZ4_HASH_BITS);
+
+   if (n > LZ4_MATCH_LIMIT) {
+      while (ip < match_limit) {
+         const uint32_t seq = read32(ip);
+         const uint32_t h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+         const int pos = table[h];   /* position + 1, or 0 if none */
+         const unsigned char *ref = src + pos - 1;
+         int len;
+         unsigned char *token;
+
+         table[h] = (ip - src) + 1;
+         if (pos == 0 || ip - ref > LZ4_MAX_OFFSET || read32(ref) != seq) {
+            ip++;
+            continue;
+         }
+
+         len = LZ4_MIN_MATCH;
+         while (ip + len < end - LZ4_LAST_LITERALS && ref[len] == ip[len])
+            len++;
+
+         /* Worst case: token, literal run, offset and match length. */
+         lit = ip - anchor;
+         if (op + 1 + lit / 255 + 1 + lit + 2 + len / 255 + 1 > op_end)
+            return 0;
+
+         token = op++;
+         if (lit >= 15) {
+            *token = 15 << 4;
+            op = write_length(op, lit - 15);
+         }
+         else {
+            *token = lit << 4;
+         }
+         memcpy(op, anchor, lit);
+         op += lit;
+
+         *op++ = (ip - ref) & 0xff;
+         *op++ = (ip - ref) >> 8;
+
+         len -= LZ4_MIN_MATCH;
+         if (len >= 15) {
+            *token |= 15;
+            op = write_length(op, len - 15);
+         }
+         else {
+            *token |= len;
+         }
+
+         ip += len + LZ4_MIN_MATCH;
+         anchor = ip;
+      }
+   }
+
+   /* The last sequence holds only literals. */
+   lit = end - anchor;
+   if (op + 1 + lit / 255 + 1 + lit > op_end)
+      return 0;
+   if (lit >= 15) {
+      *op++ = 15 << 4;
+      op = write_length(op, lit - 15);
+   }
+   else {
+      *op++ = lit << 4;
+   }
+   memcpy(op, anchor, lit);
+   op += lit;
+
+   return op - dst;
+}
+
+
+
+/* lz4_decompress:
+ *  Decompresses an LZ4 block of n bytes which must expand to exactly
+ *  out_n bytes.  Returns false on malformed input.
+ */
+static bool lz4_decompress(const unsigned char *src, int n,
+   unsigned char *dst, int out_n)
+{
+   const unsigned char *ip = src;
+   const unsigned char *const end = src + n;
+   unsigned char *op = dst;
+   unsigned char *const op_end = dst + out_n;
+
+   while (ip < end) {
+      const int token = *ip++;
+      int lit = token >> 4;
+      int len = token & 15;
+      int offset;
+      int b;
+
+      if (lit == 15) {
+         do {
+            if (ip >= end)
+               return false;
+            b = *ip++;
+            lit += b;
+         } while (b == 255);
+      }
+      if (lit > end - ip || lit > op_end - op)
+         return false;
+      memcpy(op, ip, lit);
+      ip += lit;
+      op += lit;
+
+      if (ip == end)
+         break;
+
+      if (end - ip < 2)
+         return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > op - dst)
+         return false;
+
+      if (len == 15) {
+         do {
+            if (ip >= end)
+               return false;
+            b = *ip++;
+            len += b;
+         } while (b == 255);
+      }
+      len += LZ4_MIN_MATCH;
+      if (len > op_end - op)
+         return false;
+
+      if (offset >= len) {
+         memcpy(op, op - offset, len);
+         op += len;
+      }
+      else {
+         /* Overlapping copy repeats the last offset bytes. */
+         const unsigned char *ref = op - offset;
+         while (len--)
+            *op++ = *ref++;
+      }
+   }
+
+   return op == op_end;
+}
+
+
+
+#ifdef ALLEGRO_BIG_ENDIAN
+/* swap_pixels:
+ *  Converts between the little endian order of the file and the native
+ *  order of a row of n bytes.
+ */
+static void swap_pixels(unsigned char *row, int n, int format)
+{
+   int unit = al_get_pixel_size(format);
+   int i, j;
+
+   if (format == ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE ||
+         format == ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8)
+      return;
+   if (format == ALLEGRO_PIXEL_FORMAT_ABGR_F32)
+      unit = 4;
+
+   for (i = 0; i + unit <= n; i += unit) {
+      for (j = 0; j < unit / 2; j++) {
+         unsigned char t = row[i + j];
+         row[i + j] = row[i + unit - 1 - j];
+         row[i + unit - 1 - j] = t;
+      }
+   }
+}
+#endif
+
+
+
+static bool read_header(ALLEGRO_FILE *f, A5TEX_HEADER *header)
+{
+   unsigned char magic[4];
+
+   if (al_fread(f, magic, 4) != 4 || memcmp(magic, "A5TX", 4) != 0)
+      return false;
+   if (al_fgetc(f) != A5TEX_VERSION)
+      return false;
+   header->compression = al_fgetc(f);
+   header->flags = al_fread16le(f);
+   header->format = al_fread32le(f);
+   header->width = al_fread32le(f);
+   header->height = al_fread32le(f);
+   header->block_size = al_fread32le(f);
+
+   if (al_feof(f) || al_ferror(f))
+      return false;
+   if (header->format < ALLEGRO_PIXEL_FORMAT_ARGB_8888 ||
+         header->format >= ALLEGRO_NUM_PIXEL_FORMATS)
+      return false;
+   if (header->width <= 0 || header->height <= 0)
+      return false;
+   if (header->compression == A5TEX_LZ4) {
+      if (header->block_size <= 0)
+         return false;
+   }
+   else if (header->compression != A5TEX_NONE) {
+      return false;
+   }
+   return true;
+}
+
+
+
+/* Compressed pixel data and where each block goes.  Blocks are
+ * independent, so large images are decompressed by several threads.
+ */
+typedef struct A5TEX_BLOCKS
+{
+   unsigned char *data;
+   int64_t *offsets;       /* num_blocks + 1 offsets into data */
+   unsigned char *dest;
+   int64_t size;
+   int block_size;
+   int num_blocks;
+} A5TEX_BLOCKS;
+
+
+
+static bool decompress_block(void *arg, int i)
+{
+   A5TEX_BLOCKS *b = arg;
+   const unsigned char *src = b->data + b->offsets[i];
+   const int csize = b->offsets[i + 1] - b->offsets[i];
+   unsigned char *dest = b->dest + (int64_t)i * b->block_size;
+   int n = b->block_size;
+
+   if ((int64_t)i * b->block_size + n > b->size)
+      n = b->size - (int64_t)i * b->block_size;
+
+   if (csize == n) {
+      memcpy(dest, src, n);
+      return true;
+   }
+   return lz4_decompress(src, csize, dest, n);
+}
+
+
+
+/* read_lz4_pixels:
+ *  Reads the compressed pixel data of the given size into dest.
+ */
+static bool read_lz4_pixels(ALLEGRO_FILE *f, const A5TEX_HEADER *header,
+   unsigned char *dest, int64_t size)
+{
+   A5TEX_BLOCKS b;
+   int64_t total = 0;
+   bool ret = false;
+   int i;
+
+   memset(&b, 0, sizeof(b));
+   b.dest = dest;
+   b.size = size;
+   b.block_size = header->block_size;
+   b.num_blocks = (size + header->block_size - 1) / header->block_size;
+
+   b.offsets = al_malloc((b.num_blocks + 1) * sizeof(*b.offsets));
+   if (!b.offsets)
+      return false;
+
+   b.offsets[0] = 0;
+   for (i = 0; i < b.num_blocks; i++) {
+      uint32_t csize = al_fread32le(f);
+      if (csize > (uint32_t)header->block_size)
+         goto done;
+      total += csize;
+      b.offsets[i + 1] = total;
+   }
+   if (al_feof(f) || al_ferror(f))
+      goto done;
+
+   b.data = al_malloc(total);
+   if (!b.data)
+      goto done;
+   if ((int64_t)al_fread(f, b.data, total) != total)
+      goto done;
+
+   ret = _al_run_parallel(decompress_block, &b, b.num_blocks);
+
+done:
+   al_free(b.data);
+   al_free(b.offsets);
+   return ret;
+}
+
+
+
+static int get_channels(int format)
+{
+   switch (format) {
+      case ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8:
+         return 1;
+      case ALLEGRO_PIXEL_FORMAT_RGB_888:
+      case ALLEGRO_PIXEL_FORMAT_RGB_565:
+      case ALLEGRO_PIXEL_FORMAT_RGB_555:
+      case ALLEGRO_PIXEL_FORMAT_BGR_888:
+      case ALLEGRO_PIXEL_FORMAT_BGR_565:
+      case ALLEGRO_PIXEL_FORMAT_BGR_555:
+      case ALLEGRO_PIXEL_FORMAT_XBGR_8888:
+      case ALLEGRO_PIXEL_FORMAT_RGBX_8888:
+      case ALLEGRO_PIXEL_FORMAT_XRGB_8888:
+         return 3;
+      default:
+         return 4;
+   }
+}
+
+
+
+/* convert_alpha:
+ *  Multiplies the colors of the loaded pixels by alpha, or divides them by
+ *  it if premul is false.
+ */
+static bool convert_alpha(ALLEGRO_BITMAP *bmp, int format, bool premul)
+{
+   const int w = al_get_bitmap_width(bmp);
+   const int h = al_get_bitmap_height(bmp);
+   ALLEGRO_LOCKED_REGION *lr;
+   int x, y, i;
+
+   if (format == ALLEGRO_PIXEL_FORMAT_ABGR_F32) {
+      lr = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_F32,
+         ALLEGRO_LOCK_READWRITE);
+      if (!lr)
+         return false;
+      for (y = 0; y < h; y++) {
+         float *p = (float *)((char *)lr->data + y * lr->pitch);
+         for (x = 0; x < w; x++, p += 4) {
+            for (i = 0; i < 3; i++) {
+               if (premul)
+                  p[i] *= p[3];
+               else
+                  p[i] = (p[3] > 0.0f) ? p[i] / p[3] : 0.0f;
+            }
+         }
+      }
+   }
+   else {
+      lr = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+         ALLEGRO_LOCK_READWRITE);
+      if (!lr)
+         return false;
+      for (y = 0; y < h; y++) {
+         unsigned char *p = (unsigned char *)lr->data + y * lr->pitch;
+         for (x = 0; x < w; x++, p += 4) {
+            const int a = p[3];
+            for (i = 0; i < 3; i++) {
+               if (premul)
+                  p[i] = p[i] * a / 255;
+               else if (a == 0)
+                  p[i] = 0;
+               else if (p[i] < a)
+                  p[i] = (p[i] * 255 + a / 2) / a;
+               else
+                  p[i] = 255;
+            }
+         }
+      }
+   }
+
+   al_unlock_bitmap(bmp);
+   return true;
+}
+
+
+
+ALLEGRO_BITMAP *_al_load_a5tex_f(ALLEGRO_FILE *f, int flags)
+{
+   A5TEX_HEADER header;
+   ALLEGRO_BITMAP *bmp;
+   ALLEGRO_LOCKED_REGION *lr;
+   unsigned char *buf = NULL;
+   int pixel_size;
+   size_t row_size;
+   int64_t size;
+   bool contiguous;
+   bool premul;
+   bool ok;
+   int y;
+   ASSERT(f);
+
+   if (!read_header(f, &header)) {
+      ALLEGRO_ERROR("Invalid A5TEX header.\n");
+      return NULL;
+   }
+
+   /* The header allows sizes whose products overflow, and a row must fit
+    * the int pitch of a locked region.
+    */
+   pixel_size = al_get_pixel_size(header.format);
+   if (pixel_size <= 0 || header.width > INT_MAX / pixel_size) {
+      ALLEGRO_ERROR("Unsupported A5TEX row size.\n");
+      return NULL;
+   }
+   row_size = (size_t)header.width * pixel_size;
+   if ((size_t)header.height > SIZE_MAX / row_size ||
+         (uint64_t)header.height > INT64_MAX / row_size) {
+      ALLEGRO_ERROR("A5TEX pixel data too large.\n");
+      return NULL;
+   }
+   size = (int64_t)(row_size * header.height);
+
+   bmp = al_create_bitmap(header.width, header.height);
+   if (!bmp) {
+      ALLEGRO_ERROR("%dx%d bitmap creation failed.\n",
+         header.width, header.height);
+      return NULL;
+   }
+
+   /* Locking a memory bitmap in its own format gives access to the pixels
+    * themselves, so the file is read straight into the bitmap.
+    */
+   lr = al_lock_bitmap(bmp, header.format, ALLEGRO_LOCK_WRITEONLY);
+   if (!lr) {
+      al_destroy_bitmap(bmp);
+      return NULL;
+   }
+
+   contiguous = (lr->pitch > 0 && (size_t)lr->pitch == row_size);
+   if (!contiguous) {
+      buf = al_malloc(size);
+      if (!buf) {
+         al_unlock_bitmap(bmp);
+         al_destroy_bitmap(bmp);
+         return NULL;
+      }
+   }
+
+   if (header.compression == A5TEX_LZ4) {
+      ok = read_lz4_pixels(f, &header, contiguous ? lr->data : buf, size);
+   }
+   else {
+      ok = ((int64_t)al_fread(f, contiguous ? lr->data : buf, size) == size);
+   }
+
+   if (ok && !contiguous) {
+      for (y = 0; y < header.height; y++) {
+         memcpy((char *)lr->data + y * lr->pitch, buf + y * row_size,
+            row_size);
+      }
+   }
+
+#ifdef ALLEGRO_BIG_ENDIAN
+   if (ok) {
+      for (y = 0; y < header.height; y++)
+         swap_pixels((unsigned char *)lr->data + y * lr->pitch, row_size,
+            header.format);
+   }
+#endif
+
+   al_free(buf);
+   al_unlock_bitmap(bmp);
+
+   premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   if (ok && get_channels(header.format) == 4 &&
+         premul != !(header.flags & A5TEX_STRAIGHT_ALPHA)) {
+      ok = convert_alpha(bmp, header.format, premul);
+   }
+
+   if (!ok) {
+      ALLEGRO_ERROR("Error reading A5TEX pixel data.\n");
+      al_destroy_bitmap(bmp);
+      return NULL;
+   }
+
+   return bmp;
+}
+
+
+
+ALLEGRO_BITMAP *_al_load_a5tex(const char *filename, int flags)
+{
+   ALLEGRO_FILE *f;
+   ALLEGRO_BITMAP *bmp;
+   ASSERT(filename);
+
+   f = al_fopen(filename, "rb");
+   if (!f)
+      return NULL;
+
+   bmp = _al_load_a5tex_f(f, flags);
+
+   al_fclose(f);
+
+   return bmp;
+}
+
+
+
+bool _al_probe_a5tex_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info)
+{
+   A5TEX_HEADER header;
+   ASSERT(f);
+   ASSERT(info);
+
+   if (!read_header(f, &header))
+      return false;
+
+   info->width = header.width;
+   info->height = header.height;
+   info->bits_per_pixel = al_get_pixel_format_bits(header.format);
+   info->channels = get_channels(header.format);
+   info->has_alpha = (info->channels == 4);
+   return true;
+}
+
+
+
+/* get_compression:
+ *  Reads the compression to use from the system configuration.
+ */
+static int get_compression(void)
+{
+   ALLEGRO_CONFIG *cfg = al_get_system_config();
+   const char *str;
+
+   str = cfg ? al_get_config_value(cfg, "image", "a5tex_compression") : NULL;
+   if (!str || 0 == strcmp(str, "lz4"))
+      return A5TEX_LZ4;
+   if (0 == strcmp(str, "none"))
+      return A5TEX_NONE;
+
+   ALLEGRO_WARN("Ignoring invalid value %s for a5tex_compression.\n", str);
+   return A5TEX_LZ4;
+}
+
+
+
+/* write_lz4_pixels:
+ *  Compresses the rows in blocks.  Since the block sizes come first, all
+ *  blocks are compressed before anything is written.
+ */
+static bool write_lz4_pixels(ALLEGRO_FILE *f, const unsigned char *pixels,
+   int64_t size)
+{
+   const int num_blocks = (size + A5TEX_BLOCK_SIZE - 1) / A5TEX_BLOCK_SIZE;
+   unsigned char *out;
+   int *table;
+   int *sizes;
+   int64_t total = 0;
+   bool ret = false;
+   int i;
+
+   /* No block grows, as incompressible ones are stored as they are. */
+   out = al_malloc(size);
+   sizes = al_malloc(num_blocks * sizeof(*sizes));
+   table = al_malloc(sizeof(int) << LZ4_HASH_BITS);
+   if (!out || !sizes || !table)
+      goto done;
+
+   for (i = 0; i < num_blocks; i++) {
+      const unsigned char *src = pixels + (int64_t)i * A5TEX_BLOCK_SIZE;
+      int n = A5TEX_BLOCK_SIZE;
+      int csize;
+
+      if ((int64_t)i * A5TEX_BLOCK_SIZE + n > size)
+         n = size - (int64_t)i * A5TEX_BLOCK_SIZE;
+
+      csize = lz4_compress(src, n, out + total, n - 1, table);
+      if (csize == 0) {
+         /* Incompressible, store as is. */
+         memcpy(out + total, src, n);
+         csize = n;
+      }
+      sizes[i] = csize;
+      total += csize;
+   }
+
+   for (i = 0; i < num_blocks; i++)
+      al_fwrite32le(f, sizes[i]);
+   ret = ((int64_t)al_fwrite(f, out, total) == total);
+
+done:
+   al_free(out);
+   al_free(sizes);
+   al_free(table);
+   return ret;
+}
+
+
+
+bool _al_save_a5tex_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp)
+{
+   ALLEGRO_LOCKED_REGION *lr;
+   const int format = al_get_bitmap_format(bmp);
+   const int w = al_get_bitmap_width(bmp);
+   const int h = al_get_bitmap_height(bmp);
+   const int compression = get_compression();
+   const int row_size = w * al_get_pixel_size(format);
+   const int64_t size = (int64_t)row_size * h;
+   unsigned char *pixels;
+   bool ret;
+   int y;
+   ASSERT(f);
+   ASSERT(bmp);
+
+   lr = al_lock_bitmap(bmp, format, ALLEGRO_LOCK_READONLY);
+   if (!lr)
+      return false;
+
+   pixels = al_malloc(size);
+   if (!pixels) {
+      al_unlock_bitmap(bmp);
+      return false;
+   }
+   for (y = 0; y < h; y++) {
+      memcpy(pixels + y * row_size, (char *)lr->data + y * lr->pitch,
+         row_size);
+#ifdef ALLEGRO_BIG_ENDIAN
+      swap_pixels(pixels + y * row_size, row_size, format);
+#endif
+   }
+   al_unlock_bitmap(bmp);
+
+   al_fwrite(f, "A5TX", 4);
+   al_fputc(f, A5TEX_VERSION);
+   al_fputc(f, compression);
+   al_fwrite16le(f, 0);    /* premultiplied */
+   al_fwrite32le(f, format);
+   al_fwrite32le(f, w);
+   al_fwrite32le(f, h);
+   al_fwrite32le(f, compression == A5TEX_LZ4 ? A5TEX_BLOCK_SIZE : 0);
+
+   if (compression == A5TEX_LZ4)
+      ret = write_lz4_pixels(f, pixels, size);
+   else
+      ret = ((int64_t)al_fwrite(f, pixels, size) == size);
+
+   al_free(pixels);
+
+   return ret && !al_ferror(f);
+}
+
+
+
+bool _al_save_a5tex(const char *filename, ALLEGRO_BITMAP *bmp)
+{
+   ALLEGRO_FILE *f;
+   bool ret;
+   ASSERT(filename);
+   ASSERT(bmp);
+
+   f = al_fopen(filename, "wb");
+   if (!f) {
+      ALLEGRO_ERROR("Unable to open %s for writing.\n", filename);
+      return false;
+   }
+
+   ret = _al_save_a5tex_f(f, bmp);
+
+   al_fclose(f);
+
+   return ret;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -26,16 +26,27 @@ ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_pcx, (const char *filename, int flag
 ALLEGRO_IIO_FUNC(bool, _al_save_pcx, (const char *filename, ALLEGRO_BITMAP *bmp));
 ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_pcx_f, (ALLEGRO_FILE *f, int flags));
 ALLEGRO_IIO_FUNC(bool, _al_save_pcx_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp));
+ALLEGRO_IIO_FUNC(bool, _al_probe_pcx_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info));
 
 ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_bmp, (const char *filename, int flags));
 ALLEGRO_IIO_FUNC(bool, _al_save_bmp, (const char *filename, ALLEGRO_BITMAP *bmp));
 ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_bmp_f, (ALLEGRO_FILE *f, int flags));
 ALLEGRO_IIO_FUNC(bool, _al_save_bmp_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp));
+ALLEGRO_IIO_FUNC(bool, _al_probe_bmp_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info));
+ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP_STREAM *, _al_open_bmp_stream_f, (ALLEGRO_FILE *f, int flags));
 
 ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_tga, (const char *filename, int flags));
 ALLEGRO_IIO_FUNC(bool, _al_save_tga, (const char *filename, ALLEGRO_BITMAP *bmp));
 ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_tga_f, (ALLEGRO_FILE *f, int flags));
 ALLEGRO_IIO_FUNC(bool, _al_save_tga_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp));
+ALLEGRO_IIO_FUNC(bool, _al_probe_tga_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info));
+ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP_STREAM *, _al_open_tga_stream_f, (ALLEGRO_FILE *f, int flags));
+
+ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_a5tex, (const char *filename, int flags));
+ALLEGRO_IIO_FUNC(bool, _al_save_a5tex, (const char *filename, ALLEGRO_BITMAP *bmp));
+ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_a5tex_f, (ALLEGRO_FILE *f, int flags));
+ALLEGRO_IIO_FUNC(bool, _al_save_a5tex_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp));
+ALLEGRO_IIO_FUNC(bool, _al_probe_a5tex_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info));
 
 #ifdef ALLEGRO_CFG_IIO_HAVE_GDIPLUS
 ALLEGRO_IIO_FUNC(bool, _al_init_gdiplus, (void));
@@ -61,6 +72,8 @@ ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_png, (const char *filename, int flag
 ALLEGRO_IIO_FUNC(bool, _al_save_png, (const char *filename, ALLEGRO_BITMAP *bmp));
 ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_png_f, (ALLEGRO_FILE *f, int flags));
 ALLEGRO_IIO_FUNC(bool, _al_save_png_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp));
+ALLEGRO_IIO_FUNC(bool, _al_probe_png_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info));
+ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP_STREAM *, _al_open_png_stream_f, (ALLEGRO_FILE *f, int flags));
 #endif
 
 #ifdef ALLEGRO_CFG_IIO_HAVE_JPG
@@ -68,6 +81,8 @@ ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_jpg, (const char *filename, int flag
 ALLEGRO_IIO_FUNC(bool, _al_save_jpg, (const char *filename, ALLEGRO_BITMAP *bmp));
 ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP *, _al_load_jpg_f, (ALLEGRO_FILE *f, int flags));
 ALLEGRO_IIO_FUNC(bool, _al_save_jpg_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp));
+ALLEGRO_IIO_FUNC(bool, _al_probe_jpg_f, (ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info));
+ALLEGRO_IIO_FUNC(ALLEGRO_BITMAP_STREAM *, _al_open_jpg_stream_f, (ALLEGRO_FILE *f, int flags));
 #endif
 
 #ifdef __cplusplus
@@ -207,25 +207,41 @@ static void read_palette(int ncolors, PalEntry *pal, ALLEGRO_FILE *f,
 
 
 
+/* bmp_row_size:
+ *  Returns the number of bytes a row of pixels takes up in the file,
+ *  including the padding to a multiple of four bytes.
+ */
+static size_t bmp_row_size(int width, int bits_per_pixel)
+{
+   return (((size_t)width * bits_per_pixel + 31) / 32) * 4;
+}
+
+
+
+/* read_row:
+ *  Reads the data of one row of pixels into a scratch buffer, so the
+ *  pixels can be expanded without a call into the file for each one.
+ *  Data missing at the end of the file is read as zero.
+ */
+static void read_row(ALLEGRO_FILE *f, unsigned char *row, size_t size)
+{
+   size_t n = al_fread(f, row, size);
+   if (n < size)
+      memset(row + n, 0, size - n);
+}
+
+
+
 /* read_1bit_line:
  *  Support function for reading the 1 bit bitmap file format.
  */
-static void read_1bit_line(int length, ALLEGRO_FILE *f, unsigned char *buf)
+static void read_1bit_line(int length, const unsigned char *src,
+   unsigned char *buf)
 {
-   unsigned char b[32];
-   unsigned long n;
-   int i, j, k;
+   int i;
 
    for (i = 0; i < length; i++) {
-      j = i % 32;
-      if (j == 0) {
-         n = al_fread32be(f);
-         for (k = 0; k < 32; k++) {
-            b[31 - k] = (char)(n & 1);
-            n = n >> 1;
-         }
-      }
-      buf[i] = b[j];
+      buf[i] = (src[i >> 3] >> (7 - (i & 7))) & 1;
    }
 }
 
@@ -234,26 +250,13 @@ static void read_1bit_line(int length, ALLEGRO_FILE *f, unsigned char *buf)
 /* read_4bit_line:
  *  Support function for reading the 4 bit bitmap file format.
  */
-static void read_4bit_line(int length, ALLEGRO_FILE *f, unsigned char *buf)
+static void read_4bit_line(int length, const unsigned char *src,
+   unsigned char *buf)
 {
-   unsigned char b[8];
-   unsigned long n;
-   int i, j, k;
-   int temp;
+   int i;
 
    for (i = 0; i < length; i++) {
-      j = i % 8;
-      if (j == 0) {
-         n = al_fread32le(f);
-         for (k = 0; k < 4; k++) {
-            temp = n & 255;
-            b[k * 2 + 1] = temp & 15;
-            temp = temp >> 4;
-            b[k * 2] = temp & 15;
-            n = n >> 8;
-         }
-      }
-      buf[i] = b[j];
+      buf[i] = (i & 1) ? (src[i >> 1] & 15) : (src[i >> 1] >> 4);
    }
 }
 
@@ -262,23 +265,10 @@ static void read_4bit_line(int length, ALLEGRO_FILE *f, unsigned char *buf)
 /* read_8bit_line:
  *  Support function for reading the 8 bit bitmap file format.
  */
-static void read_8bit_line(int length, ALLEGRO_FILE *f, unsigned char *buf)
+static void read_8bit_line(int length, const unsigned char *src,
+   unsigned char *buf)
 {
-   unsigned char b[4];
-   unsigned long n;
-   int i, j, k;
-
-   for (i = 0; i < length; i++) {
-      j = i % 4;
-      if (j == 0) {
-         n = al_fread32le(f);
-         for (k = 0; k < 4; k++) {
-            b[k] = (char)(n & 255);
-            n = n >> 8;
-         }
-      }
-      buf[i] = b[j];
-   }
+   memcpy(buf, src, length);
 }
 
 
@@ -286,32 +276,22 @@ static void read_8bit_line(int length, ALLEGRO_FILE *f, unsigned char *buf)
 /* read_16bit_line:
  *  Support function for reading the 16 bit bitmap file format.
  */
-static void read_16bit_line(int length, ALLEGRO_FILE *f, unsigned char *data)
+static void read_16bit_line(int length, const unsigned char *src,
+   unsigned char *data)
 {
    int i, w;
-   unsigned char r, g, b;
 
    for (i = 0; i < length; i++) {
-      w = al_fread16le(f);
+      w = src[0] | (src[1] << 8);
 
       /* the format is like a 15-bpp bitmap, not 16bpp */
-      r = _al_rgb_scale_5[(w >> 10) & 0x1f];
-      g = _al_rgb_scale_5[(w >> 5) & 0x1f];
-      b = _al_rgb_scale_5[w & 0x1f];
-
-      data[0] = r;
-      data[1] = g;
-      data[2] = b;
+      data[0] = _al_rgb_scale_5[(w >> 10) & 0x1f];
+      data[1] = _al_rgb_scale_5[(w >> 5) & 0x1f];
+      data[2] = _al_rgb_scale_5[w & 0x1f];
       data[3] = 255;
+      src += 2;
       data += 4;
    }
-
-   /* padding */
-   i = (i * 2) % 4;
-   if (i != 0) {
-      while (i++ < 4)
-         al_fgetc(f);
-   }
 }
 
 
@@ -319,31 +299,19 @@ static void read_16bit_line(int length, ALLEGRO_FILE *f, unsigned char *data)
 /* read_24bit_line:
  *  Support function for reading the 24 bit bitmap file format.
  */
-static void read_24bit_line(int length, ALLEGRO_FILE *f, unsigned char *data)
+static void read_24bit_line(int length, const unsigned char *src,
+   unsigned char *data)
 {
    int i;
-   unsigned char c[3];
-   unsigned char r, g, b;
 
    for (i = 0; i < length; i++) {
-      al_fread(f, c, 3);
-      r = c[2];
-      g = c[1];
-      b = c[0];
-
-      data[0] = r;
-      data[1] = g;
-      data[2] = b;
+      data[0] = src[2];
+      data[1] = src[1];
+      data[2] = src[0];
       data[3] = 255;
+      src += 3;
       data += 4;
    }
-
-   /* padding */
-   i = (i * 3) % 4;
-   if (i != 0) {
-      while (i++ < 4)
-         al_fgetc(f);
-   }
 }
 
 
@@ -352,21 +320,19 @@ static void read_24bit_line(int length, ALLEGRO_FILE *f, unsigned char *data)
  *  Support function for reading the 32 bit bitmap file format,
  *  treating fourth byte as alpha.
  */
-static void read_32bit_line(int length, ALLEGRO_FILE *f, unsigned char *data,
-   int flags)
+static void read_32bit_line(int length, const unsigned char *src,
+   unsigned char *data, int flags)
 {
    int i;
-   unsigned char c[4];
    unsigned char r, g, b, a;
    bool premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
 
    for (i = 0; i < length; i++) {
-      al_fread(f, c, 4);
-      r = c[2];
-      g = c[1];
-      b = c[0];
-      a = c[3];
-      
+      r = src[2];
+      g = src[1];
+      b = src[0];
+      a = src[3];
+
       if (premul) {
          r = r * a / 255;
          g = g * a / 255;
@@ -377,6 +343,57 @@ static void read_32bit_line(int length, ALLEGRO_FILE *f, unsigned char *data,
       data[1] = g;
       data[2] = b;
       data[3] = a;
+      src += 4;
+      data += 4;
+   }
+}
+
+
+
+/* read_bitfields_line:
+ *  Support function for reading the bitfield compressed BMP image format.
+ */
+static void read_bitfields_line(int length, const unsigned char *src,
+   unsigned char *data, int bpp, const BMPINFOHEADER *infoheader)
+{
+   int k;
+   int bytes_per_pixel = (bpp + 1) / 8;
+   uint32_t buffer;
+   int pix;
+
+   for (k = 0; k < length; k++) {
+
+      buffer = src[0] | (src[1] << 8);
+      if (bytes_per_pixel > 2)
+         buffer |= src[2] << 16;
+      if (bytes_per_pixel > 3)
+         buffer |= (uint32_t)src[3] << 24;
+      src += bytes_per_pixel;
+
+      if (bpp == 15) {
+         if (infoheader->biAlphaMask == 0x8000) {
+            pix = ALLEGRO_CONVERT_ARGB_1555_TO_ARGB_8888(buffer);
+         }
+         else {
+            pix = ALLEGRO_CONVERT_RGB_555_TO_ARGB_8888(buffer);
+         }
+      }
+      else if (bpp == 16) {
+         pix = ALLEGRO_CONVERT_RGB_565_TO_ARGB_8888(buffer);
+      }
+      else {
+         if (infoheader->biAlphaMask == 0xFF000000) {
+            pix = buffer;
+         }
+         else {
+            pix = ALLEGRO_CONVERT_XRGB_8888_TO_ARGB_8888(buffer);
+         }
+      }
+
+      data[2] = pix & 255;
+      data[1] = (pix >> 8) & 255;
+      data[0] = (pix >> 16) & 255;
+      data[3] = (pix >> 24) & 255;
       data += 4;
    }
 }
@@ -389,10 +406,10 @@ static void read_32bit_line(int length, ALLEGRO_FILE *f, unsigned char *data,
 static void read_bitfields_image(ALLEGRO_FILE *f,
    const BMPINFOHEADER *infoheader, int bpp, ALLEGRO_LOCKED_REGION *lr)
 {
-   int k, i, line, height, dir;
+   int i, line, height, dir;
    int bytes_per_pixel;
-   unsigned long buffer;
-   int pix;
+   unsigned char *row;
+   size_t row_size;
 
    height = infoheader->biHeight;
    line = height < 0 ? 0 : height - 1;
@@ -400,46 +417,73 @@ static void read_bitfields_image(ALLEGRO_FILE *f,
    height = abs(height);
 
    bytes_per_pixel = (bpp + 1) / 8;
+   row_size = bmp_row_size(infoheader->biWidth, bytes_per_pixel * 8);
+
+   row = al_malloc(row_size);
+   if (!row)
+      return;
 
    for (i = 0; i < height; i++, line += dir) {
       unsigned char *data = (unsigned char *)lr->data + lr->pitch * line;
 
-      for (k = 0; k < (int)infoheader->biWidth; k++) {
+      read_row(f, row, row_size);
+      read_bitfields_line(infoheader->biWidth, row, data, bpp, infoheader);
+   }
 
-         al_fread(f, &buffer, bytes_per_pixel);
+   al_free(row);
+}
 
-         if (bpp == 15) {
-            if (infoheader->biAlphaMask == 0x8000) {
-               pix = ALLEGRO_CONVERT_ARGB_1555_TO_ARGB_8888(buffer);
-            }
-            else {
-               pix = ALLEGRO_CONVERT_RGB_555_TO_ARGB_8888(buffer);
-            }
-         }
-         else if (bpp == 16) {
-            pix = ALLEGRO_CONVERT_RGB_565_TO_ARGB_8888(buffer);
-         }
-         else {
-            if (infoheader->biAlphaMask == 0xFF000000) {
-               pix = buffer;
-            }
-            else {
-               pix = ALLEGRO_CONVERT_XRGB_8888_TO_ARGB_8888(buffer);
-            }
-         }
 
-         data[2] = pix & 255;
-         data[1] = (pix >> 8) & 255;
-         data[0] = (pix >> 16) & 255;
-         data[3] = (pix >> 24) & 255;
-         data += 4;
-      }
 
-      /* padding */
-      k = (k * bytes_per_pixel) % 4;
-      if (k > 0) {
-         while (k++ < 4)
-            al_fgetc(f);
+/* read_RGB_line:
+ *  Converts one row of the non-compressed BMP image format, going through
+ *  buf for the palette formats.
+ */
+static void read_RGB_line(int flags, const BMPINFOHEADER *infoheader,
+   const PalEntry *pal, const unsigned char *row, unsigned char *buf,
+   unsigned char *data)
+{
+   bool keep_index = INT_TO_BOOL(flags & ALLEGRO_KEEP_INDEX);
+   int j;
+
+   switch (infoheader->biBitCount) {
+
+      case 1:
+         read_1bit_line(infoheader->biWidth, row, buf);
+         break;
+
+      case 4:
+         read_4bit_line(infoheader->biWidth, row, buf);
+         break;
+
+      case 8:
+         read_8bit_line(infoheader->biWidth, row, buf);
+         break;
+
+      case 16:
+         read_16bit_line(infoheader->biWidth, row, data);
+         break;
+
+      case 24:
+         read_24bit_line(infoheader->biWidth, row, data);
+         break;
+
+      case 32:
+         read_32bit_line(infoheader->biWidth, row, data, flags);
+         break;
+   }
+   if (infoheader->biBitCount <= 8) {
+      if (keep_index) {
+         memcpy(data, buf, infoheader->biWidth);
+      }
+      else {
+         for (j = 0; j < (int)infoheader->biWidth; j++) {
+            data[0] = pal[buf[j]].r;
+            data[1] = pal[buf[j]].g;
+            data[2] = pal[buf[j]].b;
+            data[3] = 255;
+            data += 4;
+         }
       }
    }
 }
@@ -453,64 +497,34 @@ static void read_bitfields_image(ALLEGRO_FILE *f,
 static void read_RGB_image(ALLEGRO_FILE *f, int flags,
    const BMPINFOHEADER *infoheader, PalEntry *pal, ALLEGRO_LOCKED_REGION *lr)
 {
-   int i, j, line, height, dir;
+   int i, line, height, dir;
    unsigned char *buf;
+   unsigned char *row;
    unsigned char *data;
-   bool keep_index = INT_TO_BOOL(flags & ALLEGRO_KEEP_INDEX);
+   size_t row_size;
 
    height = infoheader->biHeight;
    line = height < 0 ? 0 : height - 1;
    dir = height < 0 ? 1 : -1;
    height = abs(height);
 
+   row_size = bmp_row_size(infoheader->biWidth, infoheader->biBitCount);
    buf = al_malloc(infoheader->biWidth);
+   row = al_malloc(row_size);
+   if (!buf || !row) {
+      al_free(buf);
+      al_free(row);
+      return;
+   }
 
    for (i = 0; i < height; i++, line += dir) {
       data = (unsigned char *)lr->data + lr->pitch * line;
 
-      switch (infoheader->biBitCount) {
-
-         case 1:
-            read_1bit_line(infoheader->biWidth, f, buf);
-            break;
-
-         case 4:
-            read_4bit_line(infoheader->biWidth, f, buf);
-            break;
-
-         case 8:
-            read_8bit_line(infoheader->biWidth, f, buf);
-            break;
-
-         case 16:
-            read_16bit_line(infoheader->biWidth, f, data);
-            break;
-
-         case 24:
-            read_24bit_line(infoheader->biWidth, f, data);
-            break;
-
-         case 32:
-            read_32bit_line(infoheader->biWidth, f, data, flags);
-            break;
-      }
-      if (infoheader->biBitCount <= 8) {
-         for (j = 0; j < (int)infoheader->biWidth; j++) {
-            if (keep_index) {
-               data[0] = buf[j];
-               data++;
-            }
-            else {
-               data[0] = pal[buf[j]].r;
-               data[1] = pal[buf[j]].g;
-               data[2] = pal[buf[j]].b;
-               data[3] = 255;
-               data += 4;
-            }
-         }
-      }
+      read_row(f, row, row_size);
+      read_RGB_line(flags, infoheader, pal, row, buf, data);
    }
 
+   al_free(row);
    al_free(buf);
 }
 
@@ -533,6 +547,8 @@ static void read_RGB_image_32bit_alpha_hack(ALLEGRO_FILE *f, int flags,
 {
    int i, j, line, height, dir;
    unsigned char *data;
+   unsigned char *row;
+   const unsigned char *src;
    unsigned char r, g, b, a;
    unsigned char have_alpha = 0;
    const bool premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
@@ -542,25 +558,35 @@ static void read_RGB_image_32bit_alpha_hack(ALLEGRO_FILE *f, int flags,
    dir = height < 0 ? 1 : -1;
    height = abs(height);
 
+   row = al_malloc(bmp_row_size(infoheader->biWidth, 32));
+   if (!row)
+      return;
+
    /* Read data. */
    for (i = 0; i < height; i++, line += dir) {
       data = (unsigned char *)lr->data + lr->pitch * line;
+      src = row;
+
+      read_row(f, row, bmp_row_size(infoheader->biWidth, 32));
 
       for (j = 0; j < (int)infoheader->biWidth; j++) {
-         b = al_fgetc(f);
-         g = al_fgetc(f);
-         r = al_fgetc(f);
-         a = al_fgetc(f);
+         b = src[0];
+         g = src[1];
+         r = src[2];
+         a = src[3];
          have_alpha |= a;
 
          data[0] = r;
          data[1] = g;
          data[2] = b;
          data[3] = a;
+         src += 4;
          data += 4;
       }
    }
 
+   al_free(row);
+
    /* Fixup pass. */
    if (!have_alpha) {
       for (i = 0; i < height; i++) {
@@ -609,7 +635,7 @@ static void read_RLE8_compressed_image(ALLEGRO_FILE *f, unsigned char *buf,
    int eolflag, eopicflag;
 
    eopicflag = 0;
-   height = abs(infoheader->biHeight);
+   height = labs(infoheader->biHeight);
    line = (infoheader->biHeight < 0) ? 0 : height - 1;
    dir = (infoheader->biHeight < 0) ? 1 : -1;
 
@@ -693,7 +719,7 @@ static void read_RLE4_compressed_image(ALLEGRO_FILE *f, unsigned char *buf,
    int eolflag, eopicflag;
 
    eopicflag = 0;               /* end of picture flag */
-   height = abs(infoheader->biHeight);
+   height = labs(infoheader->biHeight);
    line = (infoheader->biHeight < 0) ? 0 : height - 1;
    dir = (infoheader->biHeight < 0) ? 1 : -1;
 
@@ -797,32 +823,24 @@ static bool alpha_mask_supported(int biCompression, int biBitCount,
 
 
 
-/*  Like load_bmp, but starts loading from the current place in the ALLEGRO_FILE
- *  specified. If successful the offset into the file will be left just after
- *  the image data. If unsuccessful the offset into the file is unspecified,
- *  i.e. you must either reset the offset to some known place or close the
- *  packfile. The packfile is not closed by this function.
+/* read_bmp_headers:
+ *  Reads the file and info headers and the palette, leaving the file at
+ *  the start of the pixel data.  Stores the bit depth used by the bitfields
+ *  decoder in *bpp_out.
  */
-ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
+static bool read_bmp_headers(ALLEGRO_FILE *f, BMPINFOHEADER *infoheader,
+   PalEntry *pal, int *bpp_out)
 {
    BMPFILEHEADER fileheader;
-   BMPINFOHEADER infoheader;
-   ALLEGRO_BITMAP *bmp;
-   PalEntry pal[256];
    int64_t file_start;
    int64_t header_start;
    unsigned long biSize;
-   unsigned char *buf = NULL;
-   ALLEGRO_LOCKED_REGION *lr;
    int bpp;
-   bool keep_index = INT_TO_BOOL(flags & ALLEGRO_KEEP_INDEX);
-
-   ASSERT(f);
 
    file_start = al_ftell(f);
 
    if (read_bmfileheader(f, &fileheader) != 0) {
-      return NULL;
+      return false;
    }
 
    header_start = al_ftell(f);
@@ -830,7 +848,7 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
    biSize = al_fread32le(f);
    if (al_feof(f) || al_ferror(f)) {
       ALLEGRO_ERROR("EOF or file error\n");
-      return NULL;
+      return false;
    }
 
    switch (biSize) {
@@ -839,21 +857,21 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
       case WININFOHEADERSIZEV3:
       case WININFOHEADERSIZEV4:
       case WININFOHEADERSIZEV5:
-         if (read_win_bminfoheader(f, &infoheader) != 0) {
-            return NULL;
+         if (read_win_bminfoheader(f, infoheader) != 0) {
+            return false;
          }
          break;
 
       case OS2INFOHEADERSIZE:
-         if (read_os2_bminfoheader(f, &infoheader) != 0) {
-            return NULL;
+         if (read_os2_bminfoheader(f, infoheader) != 0) {
+            return false;
          }
-         ASSERT(infoheader.biCompression == BIT_RGB);
+         ASSERT(infoheader->biCompression == BIT_RGB);
          break;
 
       default:
          ALLEGRO_WARN("Unsupported header size: %ld\n", biSize);
-         return NULL;
+         return false;
    }
 
    /* End of header for OS/2 and BITMAPV2INFOHEADER (V1). */
@@ -861,16 +879,16 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
       ASSERT(al_ftell(f) == header_start + (int64_t) biSize);
    }
 
-   if ((int)infoheader.biWidth < 0) {
-      ALLEGRO_WARN("negative width: %ld\n", infoheader.biWidth);
-      return NULL;
+   if ((int)infoheader->biWidth < 0) {
+      ALLEGRO_WARN("negative width: %ld\n", infoheader->biWidth);
+      return false;
    }
 
-   if (infoheader.biBitCount == 24)
+   if (infoheader->biBitCount == 24)
       bpp = 24;
-   else if (infoheader.biBitCount == 16)
+   else if (infoheader->biBitCount == 16)
       bpp = 16;
-   else if (infoheader.biBitCount == 32)
+   else if (infoheader->biBitCount == 32)
       bpp = 32;
    else
       bpp = 8;
@@ -879,7 +897,7 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
     * In BITMAPV2INFOHEADER they form part of the header, but only valid when
     * for BITFIELDS images.
     */
-   if (infoheader.biCompression == BIT_BITFIELDS
+   if (infoheader->biCompression == BIT_BITFIELDS
       || biSize >= WININFOHEADERSIZEV2)
    {
       uint32_t redMask = al_fread32le(f);
@@ -888,7 +906,7 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
 
       (void)grnMask;
 
-      if (infoheader.biCompression == BIT_BITFIELDS) {
+      if (infoheader->biCompression == BIT_BITFIELDS) {
          if ((bluMask == 0x001f) && (redMask == 0x7C00))
             bpp = 15;
          else if ((bluMask == 0x001f) && (redMask == 0xF800))
@@ -899,28 +917,28 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
             /* Unrecognised bit masks/depth, refuse to load. */
             ALLEGRO_WARN("Unrecognised RGB masks: %x, %x, %x\n",
                redMask, grnMask, bluMask);
-            return NULL;
+            return false;
          }
       }
    }
 
    /* BITMAPV3INFOHEADER and above include an Alpha bit mask. */
    if (biSize < WININFOHEADERSIZEV3) {
-      infoheader.biHaveAlphaMask = false;
-      infoheader.biAlphaMask = 0x0;
+      infoheader->biHaveAlphaMask = false;
+      infoheader->biAlphaMask = 0x0;
    }
    else {
-      infoheader.biHaveAlphaMask = true;
-      infoheader.biAlphaMask = al_fread32le(f);
+      infoheader->biHaveAlphaMask = true;
+      infoheader->biAlphaMask = al_fread32le(f);
 
-      if (!alpha_mask_supported(infoheader.biCompression,
-            infoheader.biBitCount, infoheader.biAlphaMask))
+      if (!alpha_mask_supported(infoheader->biCompression,
+            infoheader->biBitCount, infoheader->biAlphaMask))
       {
          ALLEGRO_WARN(
             "Unsupported: compression=%ld, bit count=%d, alpha mask=%x\n",
-            infoheader.biCompression, infoheader.biBitCount,
-            infoheader.biAlphaMask);
-         return NULL;
+            infoheader->biCompression, infoheader->biBitCount,
+            infoheader->biAlphaMask);
+         return false;
       }
    }
 
@@ -929,33 +947,61 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
    /* Read the palette, if any.  Higher bit depth images _may_ have an optional
     * palette but we don't use it and don't read it.
     */
-   if (infoheader.biCompression != BIT_BITFIELDS
-      && infoheader.biBitCount <= 8)
+   if (infoheader->biCompression != BIT_BITFIELDS
+      && infoheader->biBitCount <= 8)
    {
       int win_flag = (biSize != OS2INFOHEADERSIZE);
-      int ncolors = infoheader.biClrUsed;
+      int ncolors = infoheader->biClrUsed;
       if (ncolors == 0) {
-         ncolors = (1 << infoheader.biBitCount);
+         ncolors = (1 << infoheader->biBitCount);
       }
       if (ncolors > 256) {
          ALLEGRO_ERROR("Too many colors: %d\n", ncolors);
-         return NULL;
+         return false;
       }
 
       read_palette(ncolors, pal, f, win_flag);
       if (al_feof(f) || al_ferror(f)) {
          ALLEGRO_ERROR("EOF or I/O error\n");
-         return NULL;
+         return false;
       }
    }
 
    /* Skip to the pixel storage. */
    if (!al_fseek(f, file_start + fileheader.bfOffBits, ALLEGRO_SEEK_SET)) {
       ALLEGRO_ERROR("Seek error\n");
+      return false;
+   }
+
+   *bpp_out = bpp;
+   return true;
+}
+
+
+
+/*  Like load_bmp, but starts loading from the current place in the ALLEGRO_FILE
+ *  specified. If successful the offset into the file will be left just after
+ *  the image data. If unsuccessful the offset into the file is unspecified,
+ *  i.e. you must either reset the offset to some known place or close the
+ *  packfile. The packfile is not closed by this function.
+ */
+ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
+{
+   BMPINFOHEADER infoheader;
+   ALLEGRO_BITMAP *bmp;
+   PalEntry pal[256];
+   unsigned char *buf = NULL;
+   ALLEGRO_LOCKED_REGION *lr;
+   int bpp;
+   bool keep_index = INT_TO_BOOL(flags & ALLEGRO_KEEP_INDEX);
+
+   ASSERT(f);
+
+   if (!read_bmp_headers(f, &infoheader, pal, &bpp)) {
       return NULL;
    }
 
-   bmp = al_create_bitmap(infoheader.biWidth, abs(infoheader.biHeight));
+   bmp = al_create_bitmap(infoheader.biWidth, labs(infoheader.biHeight));
    if (!bmp) {
       ALLEGRO_ERROR("Failed to create bitmap\n");
       return NULL;
@@ -985,7 +1031,7 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
       }
 
       /* RLE decoding may skip pixels so clear the buffer first. */
-      buf = al_calloc(infoheader.biWidth, abs(infoheader.biHeight));
+      buf = al_calloc(infoheader.biWidth, labs(infoheader.biHeight));
    }
 
    switch (infoheader.biCompression) {
@@ -1024,7 +1070,7 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
       int x, y;
       unsigned char *data;
 
-      for (y = 0; y < abs(infoheader.biHeight); y++) {
+      for (y = 0; y < labs(infoheader.biHeight); y++) {
          data = (unsigned char *)lr->data + lr->pitch * y;
          for (x = 0; x < (int)infoheader.biWidth; x++) {
             if (keep_index) {
@@ -1052,6 +1098,167 @@ ALLEGRO_BITMAP *_al_load_bmp_f(ALLEGRO_FILE *f, int flags)
 
 
 
+/* State of a BMP bitmap stream.  Most BMP files are stored bottom to top,
+ * so the stream seeks to each row.  RLE compressed images are not
+ * supported as their rows can't be found without decoding the whole image.
+ */
+typedef struct BMP_STREAM
+{
+   BMPINFOHEADER infoheader;
+   PalEntry pal[256];
+   ALLEGRO_FILE *f;
+   int bpp;
+   int flags;
+   bool alpha_hack;  /* 32-bit without an alpha mask */
+   bool opaque;      /* no alpha was found by the alpha hack */
+   int64_t data_start;
+   size_t row_size;
+   unsigned char *row;
+   unsigned char *buf;
+   int y;
+} BMP_STREAM;
+
+
+
+static int bmp_stream_read_rows(ALLEGRO_BITMAP_STREAM *stream,
+   unsigned char *buffer, int pitch, int num_rows)
+{
+   BMP_STREAM *bs = al_get_bitmap_stream_userdata(stream);
+   const BMPINFOHEADER *ih = &bs->infoheader;
+   const int height = labs(ih->biHeight);
+   int i, j;
+
+   for (i = 0; i < num_rows; i++, bs->y++) {
+      unsigned char *data = buffer + i * pitch;
+
+      if (ih->biHeight > 0) {
+         int64_t pos = bs->data_start +
+            (int64_t)(height - 1 - bs->y) * bs->row_size;
+         if (!al_fseek(bs->f, pos, ALLEGRO_SEEK_SET))
+            break;
+      }
+
+      read_row(bs->f, bs->row, bs->row_size);
+
+      if (ih->biCompression == BIT_BITFIELDS) {
+         read_bitfields_line(ih->biWidth, bs->row, data, bs->bpp, ih);
+      }
+      else if (bs->alpha_hack && bs->opaque) {
+         read_32bit_line(ih->biWidth, bs->row, data,
+            ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+         for (j = 0; j < (int)ih->biWidth; j++)
+            data[j * 4 + 3] = 255;
+      }
+      else {
+         read_RGB_line(bs->flags, ih, bs->pal, bs->row, bs->buf, data);
+      }
+   }
+
+   return i;
+}
+
+
+
+static void bmp_stream_close(ALLEGRO_BITMAP_STREAM *stream)
+{
+   BMP_STREAM *bs = al_get_bitmap_stream_userdata(stream);
+
+   al_free(bs->row);
+   al_free(bs->buf);
+   al_free(bs);
+}
+
+
+
+static const ALLEGRO_BITMAP_STREAM_INTERFACE bmp_stream_vt = {
+   bmp_stream_read_rows,
+   bmp_stream_close
+};
+
+
+
+/* find_alpha:
+ *  For the 32-bit alpha hack, returns true if any pixel has a non-zero
+ *  fourth byte.  Stops at the first one, so only images which really are
+ *  opaque are read to the end.
+ */
+static bool find_alpha(BMP_STREAM *bs)
+{
+   const int height = labs(bs->infoheader.biHeight);
+   int i, j;
+
+   for (i = 0; i < height; i++) {
+      read_row(bs->f, bs->row, bs->row_size);
+      for (j = 0; j < (int)bs->infoheader.biWidth; j++) {
+         if (bs->row[j * 4 + 3])
+            return true;
+      }
+   }
+
+   return false;
+}
+
+
+
+ALLEGRO_BITMAP_STREAM *_al_open_bmp_stream_f(ALLEGRO_FILE *f, int flags)
+{
+   BMP_STREAM *bs;
+   BMPINFOHEADER *ih;
+   ALLEGRO_BITMAP_STREAM *stream;
+
+   ASSERT(f);
+
+   bs = al_calloc(1, sizeof(*bs));
+   if (!bs)
+      return NULL;
+   ih = &bs->infoheader;
+
+   if (!read_bmp_headers(f, ih, bs->pal, &bs->bpp))
+      goto error;
+
+   if (ih->biCompression != BIT_RGB && ih->biCompression != BIT_BITFIELDS) {
+      ALLEGRO_WARN("Compressed BMP images can't be streamed.\n");
+      goto error;
+   }
+   if (ih->biWidth == 0 || ih->biHeight == 0)
+      goto error;
+
+   bs->f = f;
+   bs->flags = flags & ~ALLEGRO_KEEP_INDEX;
+   bs->data_start = al_ftell(f);
+   if (ih->biCompression == BIT_BITFIELDS)
+      bs->row_size = bmp_row_size(ih->biWidth, (bs->bpp + 1) / 8 * 8);
+   else
+      bs->row_size = bmp_row_size(ih->biWidth, ih->biBitCount);
+   bs->row = al_malloc(bs->row_size);
+   bs->buf = al_malloc(ih->biWidth);
+   if (!bs->row || !bs->buf)
+      goto error;
+
+   if (ih->biCompression == BIT_RGB && ih->biBitCount == 32 &&
+         !ih->biHaveAlphaMask) {
+      bs->alpha_hack = true;
+      bs->opaque = !find_alpha(bs);
+      if (!al_fseek(f, bs->data_start, ALLEGRO_SEEK_SET))
+         goto error;
+   }
+
+   stream = al_create_bitmap_stream(&bmp_stream_vt, bs, ih->biWidth,
+      labs(ih->biHeight));
+   if (!stream)
+      goto error;
+
+   return stream;
+
+error:
+   al_free(bs->row);
+   al_free(bs->buf);
+   al_free(bs);
+   return NULL;
+}
+
+
+
 /*  Like save_bmp but writes into the ALLEGRO_FILE given instead of a new file.
  *  The packfile is not closed after writing is completed. On success the
  *  offset into the file is left after the TGA file just written. On failure
@@ -1145,6 +1352,68 @@ bool _al_save_bmp_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp)
 
 
 
+/* Reads the headers of a BMP file, up to the palette. */
+bool _al_probe_bmp_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info)
+{
+   BMPFILEHEADER fileheader;
+   BMPINFOHEADER infoheader;
+   unsigned long biSize;
+   uint32_t alpha_mask = 0;
+   ASSERT(f);
+   ASSERT(info);
+
+   if (read_bmfileheader(f, &fileheader) != 0)
+      return false;
+
+   biSize = al_fread32le(f);
+   switch (biSize) {
+      case WININFOHEADERSIZE:
+      case WININFOHEADERSIZEV2:
+      case WININFOHEADERSIZEV3:
+      case WININFOHEADERSIZEV4:
+      case WININFOHEADERSIZEV5:
+         if (read_win_bminfoheader(f, &infoheader) != 0)
+            return false;
+         break;
+
+      case OS2INFOHEADERSIZE:
+         if (read_os2_bminfoheader(f, &infoheader) != 0)
+            return false;
+         break;
+
+      default:
+         return false;
+   }
+
+   if (biSize >= WININFOHEADERSIZEV3) {
+      al_fseek(f, 12, ALLEGRO_SEEK_CUR); /* RGB masks */
+      alpha_mask = al_fread32le(f);
+   }
+
+   if ((int)infoheader.biWidth < 0)
+      return false;
+
+   info->width = infoheader.biWidth;
+   info->height = labs(infoheader.biHeight);
+   info->bits_per_pixel = infoheader.biBitCount;
+
+   if (infoheader.biBitCount <= 8) {
+      info->channels = 1;
+      info->has_palette = true;
+   }
+   else {
+      /* Without an alpha mask, the fourth byte of 32-bit pixels may still
+       * hold alpha (see read_RGB_image_32bit_alpha_hack).
+       */
+      info->has_alpha = (alpha_mask != 0) || (infoheader.biBitCount == 32);
+      info->channels = info->has_alpha ? 4 : 3;
+   }
+
+   return !al_feof(f) && !al_ferror(f);
+}
+
+
+
 ALLEGRO_BITMAP *_al_load_bmp(const char *filename, int flags)
 {
    ALLEGRO_FILE *f;
@@ -4,11 +4,57 @@
 #include "allegro5/internal/aintern_image.h"
 #include "allegro5/internal/aintern_image_cfg.h"
 
+#include "iio.h"
+
 
 /* globals */
 static bool iio_inited = false;
 
 
+/* _al_get_rgba_byte_offsets:
+ *  For 32-bit pixel formats with 8 bits per component, stores the byte
+ *  offsets within a pixel of red, green, blue and alpha (or the unused byte)
+ *  so loaders can write pixels in the bitmap's own format.  Returns false
+ *  for other formats.
+ */
+bool _al_get_rgba_byte_offsets(int format, int offs[4])
+{
+   int shift[4];
+   int i;
+
+   switch (format) {
+      case ALLEGRO_PIXEL_FORMAT_ARGB_8888:
+      case ALLEGRO_PIXEL_FORMAT_XRGB_8888:
+         shift[0] = 16; shift[1] = 8; shift[2] = 0; shift[3] = 24;
+         break;
+      case ALLEGRO_PIXEL_FORMAT_RGBA_8888:
+      case ALLEGRO_PIXEL_FORMAT_RGBX_8888:
+         shift[0] = 24; shift[1] = 16; shift[2] = 8; shift[3] = 0;
+         break;
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888:
+      case ALLEGRO_PIXEL_FORMAT_XBGR_8888:
+         shift[0] = 0; shift[1] = 8; shift[2] = 16; shift[3] = 24;
+         break;
+      case ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE:
+         /* Byte order R, G, B, A regardless of endianness. */
+         for (i = 0; i < 4; i++)
+            offs[i] = i;
+         return true;
+      default:
+         return false;
+   }
+
+   for (i = 0; i < 4; i++) {
+#ifdef ALLEGRO_BIG_ENDIAN
+      offs[i] = 3 - shift[i] / 8;
+#else
+      offs[i] = shift[i] / 8;
+#endif
+   }
+   return true;
+}
+
+
 /* Function: al_init_image_addon
  */
 bool al_init_image_addon(void)
@@ -24,16 +70,27 @@ bool al_init_image_addon(void)
    success |= al_register_bitmap_saver(".pcx", _al_save_pcx);
    success |= al_register_bitmap_loader_f(".pcx", _al_load_pcx_f);
    success |= al_register_bitmap_saver_f(".pcx", _al_save_pcx_f);
+   success |= al_register_bitmap_prober(".pcx", _al_probe_pcx_f);
 
    success |= al_register_bitmap_loader(".bmp", _al_load_bmp);
    success |= al_register_bitmap_saver(".bmp", _al_save_bmp);
    success |= al_register_bitmap_loader_f(".bmp", _al_load_bmp_f);
    success |= al_register_bitmap_saver_f(".bmp", _al_save_bmp_f);
+   success |= al_register_bitmap_prober(".bmp", _al_probe_bmp_f);
+   success |= al_register_bitmap_stream_opener(".bmp", _al_open_bmp_stream_f);
 
    success |= al_register_bitmap_loader(".tga", _al_load_tga);
    success |= al_register_bitmap_saver(".tga", _al_save_tga);
    success |= al_register_bitmap_loader_f(".tga", _al_load_tga_f);
    success |= al_register_bitmap_saver_f(".tga", _al_save_tga_f);
+   success |= al_register_bitmap_prober(".tga", _al_probe_tga_f);
+   success |= al_register_bitmap_stream_opener(".tga", _al_open_tga_stream_f);
+
+   success |= al_register_bitmap_loader(".a5tex", _al_load_a5tex);
+   success |= al_register_bitmap_saver(".a5tex", _al_save_a5tex);
+   success |= al_register_bitmap_loader_f(".a5tex", _al_load_a5tex_f);
+   success |= al_register_bitmap_saver_f(".a5tex", _al_save_a5tex_f);
+   success |= al_register_bitmap_prober(".a5tex", _al_probe_a5tex_f);
 
 /* ALLEGRO_CFG_IIO_HAVE_* is sufficient to know that the library
    should be used. i.e., ALLEGRO_CFG_IIO_HAVE_GDIPLUS and
@@ -82,6 +139,8 @@ bool al_init_image_addon(void)
    success |= al_register_bitmap_saver(".png", _al_save_png);
    success |= al_register_bitmap_loader_f(".png", _al_load_png_f);
    success |= al_register_bitmap_saver_f(".png", _al_save_png_f);
+   success |= al_register_bitmap_prober(".png", _al_probe_png_f);
+   success |= al_register_bitmap_stream_opener(".png", _al_open_png_stream_f);
 #endif
 
 #ifdef ALLEGRO_CFG_IIO_HAVE_JPG
@@ -89,11 +148,15 @@ bool al_init_image_addon(void)
    success |= al_register_bitmap_saver(".jpg", _al_save_jpg);
    success |= al_register_bitmap_loader_f(".jpg", _al_load_jpg_f);
    success |= al_register_bitmap_saver_f(".jpg", _al_save_jpg_f);
+   success |= al_register_bitmap_prober(".jpg", _al_probe_jpg_f);
+   success |= al_register_bitmap_stream_opener(".jpg", _al_open_jpg_stream_f);
 
    success |= al_register_bitmap_loader(".jpeg", _al_load_jpg);
    success |= al_register_bitmap_saver(".jpeg", _al_save_jpg);
    success |= al_register_bitmap_loader_f(".jpeg", _al_load_jpg_f);
    success |= al_register_bitmap_saver_f(".jpeg", _al_save_jpg_f);
+   success |= al_register_bitmap_prober(".jpeg", _al_probe_jpg_f);
+   success |= al_register_bitmap_stream_opener(".jpeg", _al_open_jpg_stream_f);
 #endif
 
 #ifdef ALLEGRO_CFG_WANT_NATIVE_IMAGE_LOADER
@@ -34,6 +34,9 @@ extern double _al_png_screen_gamma;
 extern int _al_png_compression_level;
 
 
+bool _al_get_rgba_byte_offsets(int format, int offs[4]);
+
+
 
 #endif
 
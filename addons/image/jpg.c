@@ -13,6 +13,7 @@
 
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_image.h"
+#include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_image.h"
 
 #include "iio.h"
@@ -60,6 +61,15 @@ static boolean fill_input_buffer(j_decompress_ptr cinfo)
    struct my_src_mgr *src = (void *)cinfo->src;
    src->pub.next_input_byte = src->buffer;
    src->pub.bytes_in_buffer = al_fread(src->fp, src->buffer, BUFFER_SIZE);
+   if (src->pub.bytes_in_buffer == 0) {
+      /* Like libjpeg's own source manager, end a truncated file with an
+       * EOI marker instead of handing out stale data.
+       */
+      WARNMS(cinfo, JWRN_JPEG_EOF);
+      src->buffer[0] = 0xFF;
+      src->buffer[1] = JPEG_EOI;
+      src->pub.bytes_in_buffer = 2;
+   }
    return 1;
 }
 
@@ -147,6 +157,19 @@ static void my_error_exit(j_common_ptr cinfo)
    longjmp(jerr->jmpenv, 1);
 }
 
+#ifdef JCS_ALPHA_EXTENSIONS
+/* get_ext_color_space:
+ *  Returns the libjpeg-turbo colour space which produces the byte order
+ *  given by offs (see _al_get_rgba_byte_offsets), with opaque alpha.
+ */
+static J_COLOR_SPACE get_ext_color_space(const int offs[4])
+{
+   if (offs[3] == 0)
+      return (offs[0] < offs[2]) ? JCS_EXT_ARGB : JCS_EXT_ABGR;
+   return (offs[0] < offs[2]) ? JCS_EXT_RGBA : JCS_EXT_BGRA;
+}
+#endif
+
 /* We keep data for load_jpg_entry_helper in a structure allocated in the
  * caller's stack frame to avoid problems with automatic variables being
  * undefined after a longjmp.
@@ -165,6 +188,11 @@ static void load_jpg_entry_helper(ALLEGRO_FILE *fp,
    struct my_err_mgr jerr;
    ALLEGRO_LOCKED_REGION *lock;
    int w, h, s;
+   int dw, dh;
+   int format;
+   int offs[4];
+   bool direct;
+   bool ext_color_space;
 
    /* ALLEGRO_NO_PREMULTIPLIED_ALPHA does not apply.
     * ALLEGRO_KEEP_INDEX does not apply.
@@ -190,45 +218,91 @@ static void load_jpg_entry_helper(ALLEGRO_FILE *fp,
    jpeg_create_decompress(&cinfo);
    jpeg_packfile_src(&cinfo, fp, data->buffer);
    jpeg_read_header(&cinfo, true);
-   jpeg_start_decompress(&cinfo);
 
+   /* For al_load_bitmap_scaled, let the IDCT reduce the image by up to 1/8
+    * as long as it stays at least as large as requested.  Any remaining
+    * reduction is done by the caller.
+    */
+   if (_al_get_scaled_load_size(cinfo.image_width, cinfo.image_height,
+         &dw, &dh)) {
+      int denom = 8;
+      while (denom > 1 && ((int)cinfo.image_width < dw * denom ||
+            (int)cinfo.image_height < dh * denom)) {
+         denom /= 2;
+      }
+      cinfo.scale_num = 1;
+      cinfo.scale_denom = denom;
+   }
+
+   jpeg_calc_output_dimensions(&cinfo);
    w = cinfo.output_width;
    h = cinfo.output_height;
-   s = cinfo.output_components;
-
-   /* Only one and three components make sense in a JPG file. */
-   if (s != 1 && s != 3) {
-      data->error = true;
-      ALLEGRO_ERROR("%d components makes no sense\n", s);
-      goto error;
-   }
 
    data->bmp = al_create_bitmap(w, h);
    if (!data->bmp) {
       data->error = true;
       ALLEGRO_ERROR("%dx%d bitmap creation failed\n", w, h);
-      goto error;
+      goto longjmp_error;
    }
 
-   /* Allegro's pixel format is endian independent, so that in
-    * ALLEGRO_PIXEL_FORMAT_RGB_888 the lower 8 bits always hold the Blue
-    * component.  On a little endian system this is in byte 0.  On a big
-    * endian system this is in byte 2.
-    *
-    * libjpeg expects byte 0 to hold the Red component, byte 1 to hold the
-    * Green component, byte 2 to hold the Blue component.  Hence on little
-    * endian systems we need the opposite format, ALLEGRO_PIXEL_FORMAT_BGR_888.
+   /* Write pixels in the format of the bitmap when it has 8-bit components
+    * in 32 bits, so that unlocking needs no conversion.  libjpeg-turbo can
+    * even produce such pixels itself.
     */
+   format = al_get_bitmap_format(data->bmp);
+   direct = _al_get_rgba_byte_offsets(format, offs);
+   ext_color_space = false;
+#ifdef JCS_ALPHA_EXTENSIONS
+   if (direct && (cinfo.jpeg_color_space == JCS_YCbCr ||
+         cinfo.jpeg_color_space == JCS_RGB)) {
+      cinfo.out_color_space = get_ext_color_space(offs);
+      ext_color_space = true;
+   }
+#endif
+
+   jpeg_start_decompress(&cinfo);
+
+   s = cinfo.output_components;
+
+   /* Only one and three components make sense in a JPG file.  Four come
+    * from get_ext_color_space, but not from CMYK or YCCK files.
+    */
+   if (s != 1 && s != 3 && !(s == 4 && ext_color_space)) {
+      data->error = true;
+      ALLEGRO_ERROR("%d components makes no sense\n", s);
+      goto error;
+   }
+
+   if (direct) {
+      lock = al_lock_bitmap(data->bmp, format, ALLEGRO_LOCK_WRITEONLY);
+   }
+   else {
+      /* Allegro's pixel format is endian independent, so that in
+       * ALLEGRO_PIXEL_FORMAT_RGB_888 the lower 8 bits always hold the Blue
+       * component.  On a little endian system this is in byte 0.  On a big
+       * endian system this is in byte 2.
+       *
+       * libjpeg expects byte 0 to hold the Red component, byte 1 to hold
+       * the Green component, byte 2 to hold the Blue component.  Hence on
+       * little endian systems we need the opposite format,
+       * ALLEGRO_PIXEL_FORMAT_BGR_888.
+       */
 #ifdef ALLEGRO_BIG_ENDIAN
-   lock = al_lock_bitmap(data->bmp, ALLEGRO_PIXEL_FORMAT_RGB_888,
-       ALLEGRO_LOCK_WRITEONLY);
+      lock = al_lock_bitmap(data->bmp, ALLEGRO_PIXEL_FORMAT_RGB_888,
+          ALLEGRO_LOCK_WRITEONLY);
 #else
-   lock = al_lock_bitmap(data->bmp, ALLEGRO_PIXEL_FORMAT_BGR_888,
-       ALLEGRO_LOCK_WRITEONLY);
+      lock = al_lock_bitmap(data->bmp, ALLEGRO_PIXEL_FORMAT_BGR_888,
+          ALLEGRO_LOCK_WRITEONLY);
 #endif
+   }
+   if (!lock) {
+      data->error = true;
+      ALLEGRO_ERROR("Locking the bitmap failed\n");
+      goto error;
+   }
 
-   if (s == 3) {
-      /* Colour. */
+   if (s == 4 || (s == 3 && !direct)) {
+      /* Straight into the bitmap. */
       int y;
 
       for (y = cinfo.output_scanline; y < h; y = cinfo.output_scanline) {
@@ -237,7 +311,28 @@ static void load_jpg_entry_helper(ALLEGRO_FILE *fp,
          jpeg_read_scanlines(&cinfo, (void *)out, 1);
       }
    }
-   else if (s == 1) {
+   else if (direct) {
+      /* Colour or greyscale, expanded to the bitmap format. */
+      unsigned char *in;
+      unsigned char *out;
+      int x, y;
+
+      data->row = al_malloc(w * s);
+      for (y = cinfo.output_scanline; y < h; y = cinfo.output_scanline) {
+         jpeg_read_scanlines(&cinfo, (void *)&data->row, 1);
+         in = data->row;
+         out = ((unsigned char *)lock->data) + y * lock->pitch;
+         for (x = 0; x < w; x++) {
+            out[offs[0]] = in[0];
+            out[offs[1]] = in[s / 2];
+            out[offs[2]] = in[s - 1];
+            out[offs[3]] = 255;
+            in += s;
+            out += 4;
+         }
+      }
+   }
+   else {
       /* Greyscale. */
       unsigned char *in;
       unsigned char *out;
@@ -287,6 +382,192 @@ ALLEGRO_BITMAP *_al_load_jpg_f(ALLEGRO_FILE *fp, int flags)
    return data.bmp;
 }
 
+/* State of a JPEG bitmap stream.  It lives on the heap, so unlike the
+ * helpers above nothing on the stack is left undefined by a longjmp;
+ * every entry point sets jmpenv again before calling into libjpeg.
+ */
+typedef struct JPG_STREAM {
+   struct jpeg_decompress_struct cinfo;
+   struct my_err_mgr jerr;
+   JOCTET *buffer;
+   unsigned char *row;
+   int offs[4];
+} JPG_STREAM;
+
+static int jpg_stream_read_rows(ALLEGRO_BITMAP_STREAM *stream,
+   unsigned char *buffer, int pitch, int num_rows)
+{
+   JPG_STREAM *js = al_get_bitmap_stream_userdata(stream);
+   const int w = js->cinfo.output_width;
+   const int s = js->cinfo.output_components;
+   volatile int y = 0;
+
+   if (setjmp(js->jerr.jmpenv) != 0) {
+      /* Longjmp'd. */
+      return y;
+   }
+
+   for (; y < num_rows; y++) {
+      unsigned char *out = buffer + y * pitch;
+      unsigned char *in;
+      int x;
+
+      if (s == 4) {
+         jpeg_read_scanlines(&js->cinfo, (void *)&out, 1);
+         continue;
+      }
+
+      jpeg_read_scanlines(&js->cinfo, (void *)&js->row, 1);
+      in = js->row;
+      for (x = 0; x < w; x++) {
+         out[js->offs[0]] = in[0];
+         out[js->offs[1]] = in[s / 2];
+         out[js->offs[2]] = in[s - 1];
+         out[js->offs[3]] = 255;
+         in += s;
+         out += 4;
+      }
+   }
+
+   return y;
+}
+
+static void jpg_stream_close(ALLEGRO_BITMAP_STREAM *stream)
+{
+   JPG_STREAM *js = al_get_bitmap_stream_userdata(stream);
+
+   jpeg_destroy_decompress(&js->cinfo);
+   al_free(js->buffer);
+   al_free(js->row);
+   al_free(js);
+}
+
+static const ALLEGRO_BITMAP_STREAM_INTERFACE jpg_stream_vt = {
+   jpg_stream_read_rows,
+   jpg_stream_close
+};
+
+ALLEGRO_BITMAP_STREAM *_al_open_jpg_stream_f(ALLEGRO_FILE *fp, int flags)
+{
+   JPG_STREAM *js;
+   ALLEGRO_BITMAP_STREAM *stream;
+   int s;
+
+   /* ALLEGRO_NO_PREMULTIPLIED_ALPHA does not apply.
+    * ALLEGRO_KEEP_INDEX does not apply.
+    */
+   (void)flags;
+
+   js = al_calloc(1, sizeof(*js));
+   if (!js)
+      return NULL;
+   js->buffer = al_malloc(BUFFER_SIZE);
+   if (!js->buffer) {
+      al_free(js);
+      return NULL;
+   }
+   _al_get_rgba_byte_offsets(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, js->offs);
+
+   js->cinfo.err = jpeg_std_error(&js->jerr.pub);
+   js->jerr.pub.error_exit = my_error_exit;
+   if (setjmp(js->jerr.jmpenv) != 0) {
+      /* Longjmp'd. */
+      goto error;
+   }
+
+   jpeg_create_decompress(&js->cinfo);
+   jpeg_packfile_src(&js->cinfo, fp, js->buffer);
+   jpeg_read_header(&js->cinfo, true);
+
+#ifdef JCS_ALPHA_EXTENSIONS
+   if (js->cinfo.jpeg_color_space == JCS_YCbCr ||
+         js->cinfo.jpeg_color_space == JCS_RGB) {
+      js->cinfo.out_color_space = get_ext_color_space(js->offs);
+   }
+#endif
+
+   jpeg_start_decompress(&js->cinfo);
+
+   s = js->cinfo.output_components;
+   if (s != 1 && s != 3 && s != 4) {
+      ALLEGRO_ERROR("%d components makes no sense\n", s);
+      goto error;
+   }
+
+   if (s != 4) {
+      js->row = al_malloc(js->cinfo.output_width * s);
+      if (!js->row)
+         goto error;
+   }
+
+   stream = al_create_bitmap_stream(&jpg_stream_vt, js,
+      js->cinfo.output_width, js->cinfo.output_height);
+   if (!stream)
+      goto error;
+
+   return stream;
+
+error:
+   jpeg_destroy_decompress(&js->cinfo);
+   al_free(js->buffer);
+   al_free(js->row);
+   al_free(js);
+   return NULL;
+}
+
+/* See comment about load_jpg_entry_helper_data. */
+struct probe_jpg_entry_helper_data {
+   bool error;
+   JOCTET *buffer;
+};
+
+static void probe_jpg_entry_helper(ALLEGRO_FILE *fp,
+   struct probe_jpg_entry_helper_data *data, ALLEGRO_BITMAP_INFO *info)
+{
+   struct jpeg_decompress_struct cinfo;
+   struct my_err_mgr jerr;
+
+   data->error = false;
+
+   cinfo.err = jpeg_std_error(&jerr.pub);
+   jerr.pub.error_exit = my_error_exit;
+   if (setjmp(jerr.jmpenv) != 0) {
+      /* Longjmp'd. */
+      data->error = true;
+      goto longjmp_error;
+   }
+
+   data->buffer = al_malloc(BUFFER_SIZE);
+   if (!data->buffer) {
+      data->error = true;
+      return;
+   }
+
+   jpeg_create_decompress(&cinfo);
+   jpeg_packfile_src(&cinfo, fp, data->buffer);
+   jpeg_read_header(&cinfo, true);
+
+   info->width = cinfo.image_width;
+   info->height = cinfo.image_height;
+   info->channels = cinfo.num_components;
+   info->bits_per_pixel = cinfo.num_components * 8;
+
+ longjmp_error:
+   jpeg_destroy_decompress(&cinfo);
+
+   al_free(data->buffer);
+}
+
+bool _al_probe_jpg_f(ALLEGRO_FILE *fp, ALLEGRO_BITMAP_INFO *info)
+{
+   struct probe_jpg_entry_helper_data data;
+
+   memset(&data, 0, sizeof(data));
+   probe_jpg_entry_helper(fp, &data, info);
+
+   return !data.error;
+}
+
 /* See comment about load_jpg_entry_helper_data. */
 struct save_jpg_entry_helper_data {
    bool error;
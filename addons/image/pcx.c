@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_image.h"
 #include "allegro5/internal/aintern_image.h"
@@ -7,15 +9,68 @@
 /* Do NOT simplify this to just (x), it doesn't work in MSVC. */
 #define INT_TO_BOOL(x)   ((x) != 0)
 
+#define PCX_READ_BUFFER_SIZE  4096
+
+
+/* The RLE data does not say how long it is, so it is read through a small
+ * buffer instead of a byte at a time from the file.
+ */
+typedef struct PCX_READER
+{
+   ALLEGRO_FILE *f;
+   int pos;
+   int len;
+   unsigned char buf[PCX_READ_BUFFER_SIZE];
+} PCX_READER;
+
+
+static int pcx_refill(PCX_READER *r)
+{
+   int err = al_get_errno();
+
+   r->pos = 0;
+   r->len = al_fread(r->f, r->buf, PCX_READ_BUFFER_SIZE);
+
+   /* Reading ahead past the end of the file is not an error. */
+   if (r->len < PCX_READ_BUFFER_SIZE && !al_ferror(r->f))
+      al_set_errno(err);
+
+   if (r->len <= 0) {
+      r->len = 0;
+      return EOF;
+   }
+   return r->buf[r->pos++];
+}
+
+
+static INLINE int pcx_getc(PCX_READER *r)
+{
+   if (r->pos < r->len)
+      return r->buf[r->pos++];
+   return pcx_refill(r);
+}
+
+
+/* pcx_finish:
+ *  Gives the bytes which were read ahead but not used back to the file.
+ */
+static void pcx_finish(PCX_READER *r)
+{
+   if (r->pos < r->len)
+      al_fseek(r->f, r->pos - r->len, ALLEGRO_SEEK_CUR);
+   r->pos = r->len = 0;
+}
+
 ALLEGRO_BITMAP *_al_load_pcx_f(ALLEGRO_FILE *f, int flags)
 {
    ALLEGRO_BITMAP *b;
    int c;
    int width, height;
    int bpp, bytes_per_line;
-   int x, xx, y;
-   char ch;
+   int x, y;
+   int line_bytes, line_limit;
    ALLEGRO_LOCKED_REGION *lr;
+   PCX_READER reader;
    unsigned char *buf;
    PalEntry pal[256];
    bool keep_index;
@@ -88,76 +143,79 @@ ALLEGRO_BITMAP *_al_load_pcx_f(ALLEGRO_FILE *f, int flags)
       return NULL;
    }
 
-   xx = 0;                      /* index into buf, only for bpp = 8 */
+   reader.f = f;
+   reader.pos = reader.len = 0;
+   line_bytes = bytes_per_line * bpp / 8;
+   /* Padding bytes are decoded but not stored. */
+   line_limit = (bpp == 8) ? width : width * 3;
 
    for (y = 0; y < height; y++) {       /* read RLE encoded PCX data */
+      /* For bpp = 8 the whole image is kept in buf. */
+      unsigned char *line = (bpp == 8) ? buf + y * width : buf;
 
       x = 0;
 
-      while (x < bytes_per_line * bpp / 8) {
-         ch = al_fgetc(f);
+      while (x < line_bytes) {
+         int ch = pcx_getc(&reader);
          if ((ch & 0xC0) == 0xC0) { /* a run */
             c = (ch & 0x3F);
-            ch = al_fgetc(f);
+            ch = pcx_getc(&reader);
          }
          else {
             c = 1;                  /* single pixel */
          }
 
-         if (bpp == 8) {
-            while (c--) {
-               if (x < width)       /* ignore padding */
-                  buf[xx++] = ch;
-               x++;
-            }
-         }
-         else {
-            while (c--) {
-               if (x < width * 3)   /* ignore padding */
-                  buf[x] = ch;
-               x++;
-            }
-         }
+         if (x < line_limit)
+            memset(line + x, ch, (c < line_limit - x) ? c : line_limit - x);
+         x += c;
       }
       if (bpp == 24) {
-         char *dest = (char*)lr->data + y*lr->pitch;
+         unsigned char *dest = (unsigned char *)lr->data + y*lr->pitch;
+         const unsigned char *red = buf;
+         const unsigned char *green = buf + width;
+         const unsigned char *blue = buf + width * 2;
          for (x = 0; x < width; x++) {
-            dest[x*4    ] = buf[x];
-            dest[x*4 + 1] = buf[x + width];
-            dest[x*4 + 2] = buf[x + width * 2];
-            dest[x*4 + 3] = 255;
+            dest[0] = red[x];
+            dest[1] = green[x];
+            dest[2] = blue[x];
+            dest[3] = 255;
+            dest += 4;
          }
       }
    }
 
    if (bpp == 8) {               /* look for a 256 color palette */
-      while ((c = al_fgetc(f)) != EOF) {
+      while ((c = pcx_getc(&reader)) != EOF) {
          if (c == 12) {
             for (c = 0; c < 256; c++) {
-               pal[c].r = al_fgetc(f);
-               pal[c].g = al_fgetc(f);
-               pal[c].b = al_fgetc(f);
+               pal[c].r = pcx_getc(&reader);
+               pal[c].g = pcx_getc(&reader);
+               pal[c].b = pcx_getc(&reader);
             }
             break;
          }
       }
       for (y = 0; y < height; y++) {
-         char *dest = (char*)lr->data + y*lr->pitch;
-         for (x = 0; x < width; x++) {
-            int index = buf[y * width + x];
-            if (keep_index) {
-               dest[x] = index;
-            }
-            else {
-               dest[x*4    ] = pal[index].r;
-               dest[x*4 + 1] = pal[index].g;
-               dest[x*4 + 2] = pal[index].b;
-               dest[x*4 + 3] = 255;
+         unsigned char *dest = (unsigned char *)lr->data + y*lr->pitch;
+         const unsigned char *src = buf + y * width;
+         if (keep_index) {
+            memcpy(dest, src, width);
+         }
+         else {
+            for (x = 0; x < width; x++) {
+               int index = src[x];
+               dest[0] = pal[index].r;
+               dest[1] = pal[index].g;
+               dest[2] = pal[index].b;
+               dest[3] = 255;
+               dest += 4;
             }
          }
       }
    }
 
+   pcx_finish(&reader);
+
    al_unlock_bitmap(b);
 
    al_free(buf);
@@ -254,6 +312,41 @@ bool _al_save_pcx_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp)
       return true;
 }
 
+/* Reads the fixed 128-byte PCX header. */
+bool _al_probe_pcx_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info)
+{
+   unsigned char header[128];
+   int xmin, ymin, xmax, ymax;
+   int planes;
+   ASSERT(f);
+   ASSERT(info);
+
+   if (al_fread(f, header, sizeof(header)) != sizeof(header))
+      return false;
+
+   if (header[3] != 8)             /* 8 bit color planes only */
+      return false;
+
+   xmin = header[4] | (header[5] << 8);
+   ymin = header[6] | (header[7] << 8);
+   xmax = header[8] | (header[9] << 8);
+   ymax = header[10] | (header[11] << 8);
+   planes = header[65];
+
+   if (planes != 1 && planes != 3)
+      return false;
+
+   info->width = xmax - xmin + 1;
+   info->height = ymax - ymin + 1;
+   info->bits_per_pixel = planes * 8;
+   info->channels = planes;
+   info->has_palette = (planes == 1);
+
+   return true;
+}
+
+
+
 ALLEGRO_BITMAP *_al_load_pcx(const char *filename, int flags)
 {
    ALLEGRO_FILE *f;
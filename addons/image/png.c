@@ -9,11 +9,34 @@
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_image.h"
 #include "allegro5/internal/aintern_image.h"
+#include "allegro5/internal/aintern_system.h"
 
 #include "iio.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 ALLEGRO_DEBUG_CHANNEL("image")
 
+/* Files saved with the png_chunk_rows option compress bands of rows as
+ * independent deflate streams, one after the other in the usual zlib
+ * stream, and record where each band starts in a private chunk before the
+ * image data.  Other decoders see an ordinary PNG; we can inflate and
+ * unfilter the bands on several threads.  The chunk is not safe to copy
+ * (upper case fourth letter) as it describes the IDAT data, so editors drop
+ * it when they change the pixels.  Its contents are the number of rows per
+ * band followed by the offset of each band in the zlib stream, all as
+ * big-endian 32-bit numbers.
+ */
+#define PNG_ROW_CHUNKS_NAME   "alIX"
+
+
+typedef struct PNG_ROW_CHUNKS {
+   png_uint_32 rows_per_chunk;
+   png_uint_32 num_chunks;
+   png_uint_32 *offsets;         /* num_chunks + 1 entries */
+} PNG_ROW_CHUNKS;
+
 
 double _al_png_screen_gamma = -1.0;
 int _al_png_compression_level = Z_BEST_COMPRESSION;
@@ -48,6 +71,22 @@ static void user_error_fn(png_structp png_ptr, png_const_charp message)
 
 
 
+static int paeth_predictor(int a, int b, int c)
+{
+   const int p = a + b - c;
+   const int pa = abs(p - a);
+   const int pb = abs(p - b);
+   const int pc = abs(p - c);
+
+   if (pa <= pb && pa <= pc)
+      return a;
+   if (pb <= pc)
+      return b;
+   return c;
+}
+
+
+
 /*****************************************************************************
  * Loading routines
  ****************************************************************************/
@@ -86,37 +125,124 @@ static int check_if_png(ALLEGRO_FILE *fp)
 
 
 
-/* really_load_png:
- *  Worker routine, used by load_png and load_memory_png.
+/* set_output_order:
+ *  Makes libpng produce 8-bit RGBA pixels with the byte order given by
+ *  offs (see _al_get_rgba_byte_offsets), filling in opaque alpha for images
+ *  without it.  Only alpha first or last with RGB or BGR in between can be
+ *  produced, which covers all the formats we get offsets for.
  */
-static ALLEGRO_BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr,
-   int flags)
+static void set_output_order(png_structp png_ptr, const int offs[4],
+   bool has_alpha)
 {
-   ALLEGRO_BITMAP *bmp;
-   png_uint_32 width, height, rowbytes, real_rowbytes;
-   int bit_depth, color_type, interlace_type;
-   double image_gamma, screen_gamma;
-   int intent;
-   int bpp;
-   int number_passes, pass;
-   int num_trans = 0;
-   PalEntry pal[256];
-   png_bytep trans;
-   ALLEGRO_LOCKED_REGION *lock;
-   unsigned char *buf;
-   unsigned char *dest;
-   bool premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
-   bool index_only;
+   const bool alpha_first = (offs[3] == 0);
 
-   ALLEGRO_ASSERT(png_ptr && info_ptr);
+   if (offs[2] < offs[0])
+      png_set_bgr(png_ptr);
 
-   /* The call to png_read_info() gives us all of the information from the
-    * PNG file before the first IDAT (image data chunk).
-    */
-   png_read_info(png_ptr, info_ptr);
+   if (has_alpha) {
+      if (alpha_first)
+         png_set_swap_alpha(png_ptr);
+   }
+   else {
+      png_set_filler(png_ptr, 0xff,
+         alpha_first ? PNG_FILLER_BEFORE : PNG_FILLER_AFTER);
+   }
+}
+
+
+
+/* premultiply_row:
+ *  Premultiplies a row of pixels in place, after the last pass of libpng.
+ */
+static void premultiply_row(unsigned char *row, png_uint_32 width,
+   const int offs[4])
+{
+   png_uint_32 i;
+
+   for (i = 0; i < width; i++, row += 4) {
+      int a = row[offs[3]];
+      if (a == 255)
+         continue;
+      row[offs[0]] = row[offs[0]] * a / 255;
+      row[offs[1]] = row[offs[1]] * a / 255;
+      row[offs[2]] = row[offs[2]] * a / 255;
+   }
+}
+
+
+
+/* expand_palette_row:
+ *  Expands a row of palette indices, read into the start of the row, to
+ *  pixels in place.  Working from the end means no index is overwritten
+ *  before it has been looked up.  Pixels matching a tRNS entry become
+ *  transparent black.
+ */
+static void expand_palette_row(unsigned char *row, png_uint_32 width,
+   const PalEntry *pal, png_bytep trans, int num_trans, const int offs[4])
+{
+   png_uint_32 i = width;
+
+   while (i-- > 0) {
+      int pix = row[i];
+      unsigned char *dest = row + i * 4;
+      int ti;
+
+      dest[offs[0]] = pal[pix].r;
+      dest[offs[1]] = pal[pix].g;
+      dest[offs[2]] = pal[pix].b;
+      dest[offs[3]] = 255;
+      for (ti = 0; ti < num_trans; ti++) {
+         if (trans[ti] == pix) {
+            dest[0] = dest[1] = dest[2] = dest[3] = 0;
+            break;
+         }
+      }
+   }
+}
+
+
+
+/* read_palette:
+ *  Copies the PLTE chunk into pal, padding it with black.
+ */
+static void read_palette(png_structp png_ptr, png_infop info_ptr,
+   PalEntry *pal)
+{
+   int num_palette = 0, i;
+   png_colorp palette;
+
+   if (png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette)) {
+      /* We don't actually dither, we just copy the palette. */
+      for (i = 0; ((i < num_palette) && (i < 256)); i++) {
+         pal[i].r = palette[i].red;
+         pal[i].g = palette[i].green;
+         pal[i].b = palette[i].blue;
+      }
+   }
+   else {
+      i = 0;
+   }
+
+   for (; i < 256; i++)
+      pal[i].r = pal[i].g = pal[i].b = 0;
+}
+
+
+
+/* set_transforms:
+ *  Sets up libpng to produce 8-bit RGB(A) pixels, or 8-bit indices for
+ *  palette images, with gamma correction.  This must be called after
+ *  png_read_info.
+ */
+static void set_transforms(png_structp png_ptr, png_infop info_ptr)
+{
+   png_uint_32 width, height;
+   int bit_depth, color_type;
+   double image_gamma, screen_gamma;
+   int intent;
 
    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth,
-                &color_type, &interlace_type, NULL, NULL);
+                &color_type, NULL, NULL, NULL);
 
    /* Extract multiple pixels with bit depths of 1, 2, and 4 from a single
     * byte into separate bytes (useful for paletted and grayscale images).
@@ -133,7 +259,6 @@ static ALLEGRO_BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr,
    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
       if (!(color_type & PNG_COLOR_MASK_PALETTE))
          png_set_tRNS_to_alpha(png_ptr);
-      png_get_tRNS(png_ptr, info_ptr, &trans, &num_trans, NULL);
    }
 
    /* Convert 16-bits per colour component to 8-bits per colour component. */
@@ -158,49 +283,418 @@ static ALLEGRO_BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr,
             png_set_gamma(png_ptr, screen_gamma, 0.45455);
       }
    }
+}
 
-   /* Turn on interlace handling. */
-   number_passes = png_set_interlace_handling(png_ptr);
 
-   /* Call to gamma correct and add the background to the palette
-    * and update info structure.
+
+/* read_chunk_index:
+ *  libpng callback for unknown chunks, which picks up the row chunk index.
+ *  Only the first well-formed index is kept.
+ */
+static int read_chunk_index(png_structp png_ptr, png_unknown_chunkp chunk)
+{
+   PNG_ROW_CHUNKS *index = (PNG_ROW_CHUNKS *)png_get_user_chunk_ptr(png_ptr);
+   png_uint_32 i, n;
+
+   if (memcmp(chunk->name, PNG_ROW_CHUNKS_NAME, 4) != 0)
+      return 0;
+   if (index->offsets || chunk->size < 8 || chunk->size % 4 != 0)
+      return 1;
+
+   n = chunk->size / 4 - 1;
+   index->offsets = al_malloc((n + 1) * sizeof(*index->offsets));
+   if (!index->offsets)
+      return 1;
+
+   index->rows_per_chunk = png_get_uint_32(chunk->data);
+   index->num_chunks = n;
+   for (i = 0; i < n; i++)
+      index->offsets[i] = png_get_uint_32(chunk->data + 4 + 4 * i);
+   return 1;
+}
+
+
+
+/* start_row_chunks:
+ *  Checks whether the image data can be decoded with the row chunk index,
+ *  which needs 8-bit RGB or RGBA pixels that libpng would not transform,
+ *  and if so moves the file back to the header of the first IDAT chunk.
+ *  This must be called after png_read_info.
+ */
+static bool start_row_chunks(png_structp png_ptr, png_infop info_ptr,
+   const PNG_ROW_CHUNKS *index)
+{
+   ALLEGRO_FILE *fp = (ALLEGRO_FILE *)png_get_io_ptr(png_ptr);
+   png_uint_32 width, height, i;
+   int bit_depth, color_type, interlace_type;
+   double file_gamma = 0.45455;
+   int intent;
+
+   if (!index || !index->offsets || index->rows_per_chunk == 0)
+      return false;
+
+   png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth,
+                &color_type, &interlace_type, NULL, NULL);
+
+   if (bit_depth != 8 || interlace_type != PNG_INTERLACE_NONE)
+      return false;
+   if (color_type != PNG_COLOR_TYPE_RGB &&
+       color_type != PNG_COLOR_TYPE_RGB_ALPHA)
+      return false;
+   if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+      return false;
+   if (index->num_chunks !=
+       (height - 1) / index->rows_per_chunk + 1)
+      return false;
+
+   /* libpng leaves the pixels alone if the gamma correction would change
+    * them by less than 5%.
     */
-   png_read_update_info(png_ptr, info_ptr);
+   if (_al_png_screen_gamma != 0.0) {
+      double product;
+      if (!png_get_sRGB(png_ptr, info_ptr, &intent))
+         png_get_gAMA(png_ptr, info_ptr, &file_gamma);
+      product = get_gamma() * file_gamma;
+      if (product < 0.95 || product > 1.05)
+         return false;
+   }
+
+   /* The first band starts right after the two byte zlib header. */
+   if (index->offsets[0] != 2)
+      return false;
+   for (i = 1; i < index->num_chunks; i++) {
+      if (index->offsets[i] <= index->offsets[i - 1])
+         return false;
+   }
+
+   /* libpng has read the length and type of the first IDAT chunk. */
+   return al_fseek(fp, -8, ALLEGRO_SEEK_CUR);
+}
+
 
-   /* Palettes. */
-   if (color_type & PNG_COLOR_MASK_PALETTE) {
-      int num_palette, i;
-      png_colorp palette;
-
-      if (png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette)) {
-         /* We don't actually dither, we just copy the palette. */
-         for (i = 0; ((i < num_palette) && (i < 256)); i++) {
-            pal[i].r = palette[i].red;
-            pal[i].g = palette[i].green;
-            pal[i].b = palette[i].blue;
-         }
 
-         for (; i < 256; i++)
-            pal[i].r = pal[i].g = pal[i].b = 0;
+/* unfilter_row:
+ *  Undoes the PNG filter of a row of n bytes in place.  prev is the
+ *  unfiltered previous row, all zeros for the first row of the image.
+ */
+static bool unfilter_row(int filter, unsigned char *row,
+   const unsigned char *prev, size_t n, int bpp)
+{
+   size_t i;
+
+   switch (filter) {
+      case PNG_FILTER_VALUE_NONE:
+         break;
+
+      case PNG_FILTER_VALUE_SUB:
+         for (i = bpp; i < n; i++)
+            row[i] += row[i - bpp];
+         break;
+
+      case PNG_FILTER_VALUE_UP:
+         for (i = 0; i < n; i++)
+            row[i] += prev[i];
+         break;
+
+      case PNG_FILTER_VALUE_AVG:
+         for (i = 0; i < (size_t)bpp; i++)
+            row[i] += prev[i] / 2;
+         for (; i < n; i++)
+            row[i] += (row[i - bpp] + prev[i]) / 2;
+         break;
+
+      case PNG_FILTER_VALUE_PAETH:
+         for (i = 0; i < (size_t)bpp; i++)
+            row[i] += prev[i];
+         for (; i < n; i++)
+            row[i] += paeth_predictor(row[i - bpp], prev[i], prev[i - bpp]);
+         break;
+
+      default:
+         return false;
+   }
+
+   return true;
+}
+
+
+
+typedef struct PNG_CHUNK_DECODER {
+   const unsigned char *data;
+   const PNG_ROW_CHUNKS *index;
+   png_uint_32 width, height;
+   int channels;
+   unsigned char *dest;
+   int pitch;
+   const int *offs;
+   bool premul;
+   uLong *adlers;
+} PNG_CHUNK_DECODER;
+
+
+
+/* decode_chunk:
+ *  Inflates and unfilters one band of rows into the locked bitmap.  Only
+ *  the first band may refer to the row above, as the others start a new
+ *  deflate stream and must not depend on rows decoded elsewhere.
+ */
+static bool decode_chunk(void *arg, int c)
+{
+   PNG_CHUNK_DECODER *d = arg;
+   const png_uint_32 y0 = c * d->index->rows_per_chunk;
+   png_uint_32 y1 = y0 + d->index->rows_per_chunk;
+   const size_t rowbytes = (size_t)d->width * d->channels;
+   unsigned char *buf, *cur, *prev, *tmp;
+   uLong adler = adler32(0, NULL, 0);
+   bool ret = false;
+   z_stream z;
+   png_uint_32 x, y;
+
+   if (y1 > d->height)
+      y1 = d->height;
+
+   buf = al_malloc(2 * (rowbytes + 1));
+   if (!buf)
+      return false;
+   cur = buf;
+   prev = buf + rowbytes + 1;
+   memset(prev, 0, rowbytes + 1);
+
+   memset(&z, 0, sizeof(z));
+   if (inflateInit2(&z, -MAX_WBITS) != Z_OK) {
+      al_free(buf);
+      return false;
+   }
+   z.next_in = (Bytef *)d->data + d->index->offsets[c];
+   z.avail_in = d->index->offsets[c + 1] - d->index->offsets[c];
+
+   for (y = y0; y < y1; y++) {
+      const unsigned char *src = cur + 1;
+      unsigned char *dest = d->dest + (size_t)y * d->pitch;
+
+      z.next_out = cur;
+      z.avail_out = rowbytes + 1;
+      while (z.avail_out > 0) {
+         int zret = inflate(&z, Z_SYNC_FLUSH);
+         if (zret == Z_STREAM_END)
+            break;
+         if (zret != Z_OK)
+            goto done;
+      }
+      if (z.avail_out > 0)
+         goto done;
+      adler = adler32(adler, cur, rowbytes + 1);
+
+      if (y == y0 && y > 0 && cur[0] > PNG_FILTER_VALUE_SUB)
+         goto done;
+      if (!unfilter_row(cur[0], cur + 1, prev + 1, rowbytes, d->channels))
+         goto done;
+
+      for (x = 0; x < d->width; x++, src += d->channels, dest += 4) {
+         dest[d->offs[0]] = src[0];
+         dest[d->offs[1]] = src[1];
+         dest[d->offs[2]] = src[2];
+         dest[d->offs[3]] = (d->channels == 4) ? src[3] : 0xff;
       }
+      if (d->premul)
+         premultiply_row(dest - 4 * d->width, d->width, d->offs);
+
+      tmp = cur;
+      cur = prev;
+      prev = tmp;
    }
 
-   rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+   d->adlers[c] = adler;
+   ret = true;
 
-   /* Allocate the memory to hold the image using the fields of info_ptr. */
-   bpp = rowbytes * 8 / width;
+done:
+   inflateEnd(&z);
+   al_free(buf);
+   if (!ret)
+      ALLEGRO_ERROR("Bad image data in row chunk %d.\n", c);
+   return ret;
+}
 
-   /* Allegro cannot handle less than 8 bpp. */
-   if (bpp < 8)
-      bpp = 8;
 
 
-   if ((bpp == 24) || (bpp == 32)) {
-#ifdef ALLEGRO_BIG_ENDIAN
-      png_set_bgr(png_ptr);
-      png_set_swap_alpha(png_ptr);
-#endif
+/* read_idat:
+ *  Reads the contents of consecutive IDAT chunks, checking their CRCs.
+ *  Returns the zlib stream, or NULL on error.
+ */
+static unsigned char *read_idat(ALLEGRO_FILE *fp, size_t *size)
+{
+   unsigned char header[8];
+   unsigned char crc_bytes[4];
+   unsigned char *data = NULL;
+   size_t capacity = 0;
+   png_uint_32 length;
+
+   *size = 0;
+
+   while (al_fread(fp, header, 8) == 8) {
+      if (memcmp(header + 4, "IDAT", 4) != 0)
+         break;
+
+      length = png_get_uint_32(header);
+      if (length > PNG_UINT_31_MAX)
+         goto error;
+
+      if (*size + length > capacity) {
+         unsigned char *new_data;
+         size_t new_capacity = capacity ? capacity * 2 : 65536;
+         while (new_capacity < *size + length)
+            new_capacity *= 2;
+         new_data = al_realloc(data, new_capacity);
+         if (!new_data)
+            goto error;
+         data = new_data;
+         capacity = new_capacity;
+      }
+
+      if (al_fread(fp, data + *size, length) != length)
+         goto error;
+      if (al_fread(fp, crc_bytes, 4) != 4)
+         goto error;
+      if (crc32(crc32(0, header + 4, 4), data + *size, length) !=
+            png_get_uint_32(crc_bytes)) {
+         ALLEGRO_ERROR("IDAT CRC error.\n");
+         goto error;
+      }
+      *size += length;
+   }
+
+   if (*size > 0)
+      return data;
+
+error:
+   al_free(data);
+   return NULL;
+}
+
+
+
+/* read_row_chunks:
+ *  Decodes the image data with the row chunk index into a locked region,
+ *  in the byte order given by offs, the bands of rows in parallel.  The
+ *  file must be positioned at the first IDAT chunk (see start_row_chunks).
+ */
+static bool read_row_chunks(png_structp png_ptr, png_infop info_ptr,
+   PNG_ROW_CHUNKS *index, ALLEGRO_LOCKED_REGION *lock,
+   const int offs[4], bool premul)
+{
+   ALLEGRO_FILE *fp = (ALLEGRO_FILE *)png_get_io_ptr(png_ptr);
+   PNG_CHUNK_DECODER d;
+   unsigned char *data;
+   size_t size;
+   const png_uint_32 n = index->num_chunks;
+   png_uint_32 i;
+   uLong adler;
+   bool ret = false;
+
+   data = read_idat(fp, &size);
+   if (!data)
+      return false;
+
+   memset(&d, 0, sizeof(d));
+   d.data = data;
+   d.index = index;
+   d.width = png_get_image_width(png_ptr, info_ptr);
+   d.height = png_get_image_height(png_ptr, info_ptr);
+   d.channels = png_get_channels(png_ptr, info_ptr);
+   d.dest = lock->data;
+   d.pitch = lock->pitch;
+   d.offs = offs;
+   d.premul = premul && d.channels == 4;
+
+   /* Check the zlib header and that every band lies before the Adler-32
+    * checksum at the end.
+    */
+   if (size < 6 || (data[0] & 0x0f) != Z_DEFLATED || (data[0] >> 4) > 7 ||
+         (data[1] & 0x20) || ((data[0] << 8) | data[1]) % 31 != 0 ||
+         index->offsets[n - 1] >= size - 4) {
+      ALLEGRO_ERROR("Row chunk index does not match the image data.\n");
+      goto done;
+   }
+   index->offsets[n] = size - 4;
+
+   d.adlers = al_malloc(n * sizeof(*d.adlers));
+   if (!d.adlers)
+      goto done;
+
+   if (!_al_run_parallel(decode_chunk, &d, n))
+      goto done;
+
+   adler = d.adlers[0];
+   for (i = 1; i < n; i++) {
+      png_uint_32 rows = index->rows_per_chunk;
+      if (i == n - 1)
+         rows = d.height - i * index->rows_per_chunk;
+      adler = adler32_combine(adler, d.adlers[i],
+         (z_off_t)rows * (d.width * d.channels + 1));
+   }
+   if (adler != png_get_uint_32(data + size - 4)) {
+      ALLEGRO_ERROR("Image data checksum error.\n");
+      goto done;
+   }
+
+   ret = true;
+
+done:
+   al_free(d.adlers);
+   al_free(data);
+   return ret;
+}
+
+
+
+/* really_load_png:
+ *  Worker routine, used by load_png and load_memory_png.
+ */
+static ALLEGRO_BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr,
+   PNG_ROW_CHUNKS *index, int flags)
+{
+   ALLEGRO_BITMAP *bmp;
+   png_uint_32 width, height;
+   int color_type, interlace_type;
+   int number_passes, pass;
+   int num_trans = 0;
+   PalEntry pal[256];
+   png_bytep trans = NULL;
+   ALLEGRO_LOCKED_REGION *lock;
+   bool premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   bool is_palette;
+   bool has_alpha;
+   bool index_only = false;
+   bool use_chunks;
+   int64_t idat_pos = 0;
+   int offs[4];
+
+   ALLEGRO_ASSERT(png_ptr && info_ptr);
+
+   /* The call to png_read_info() gives us all of the information from the
+    * PNG file before the first IDAT (image data chunk).
+    */
+   png_read_info(png_ptr, info_ptr);
+
+   png_get_IHDR(png_ptr, info_ptr, &width, &height, NULL,
+                &color_type, &interlace_type, NULL, NULL);
+
+   is_palette = (color_type & PNG_COLOR_MASK_PALETTE);
+   has_alpha = (color_type & PNG_COLOR_MASK_ALPHA) ||
+      (!is_palette && png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS));
+
+   use_chunks = start_row_chunks(png_ptr, info_ptr, index);
+   if (use_chunks)
+      idat_pos = al_ftell((ALLEGRO_FILE *)png_get_io_ptr(png_ptr));
+   if (!use_chunks || idat_pos < 0) {
+      use_chunks = false;
+      set_transforms(png_ptr, info_ptr);
    }
+   if (is_palette && png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+      png_get_tRNS(png_ptr, info_ptr, &trans, &num_trans, NULL);
+
+   /* Turn on interlace handling. */
+   number_passes = png_set_interlace_handling(png_ptr);
 
    bmp = al_create_bitmap(width, height);
    if (!bmp) {
@@ -208,126 +702,85 @@ static ALLEGRO_BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr,
       return NULL;
    }
 
-   // TODO: can this be different from rowbytes?
-   real_rowbytes = ((bpp + 7) / 8) * width;
-   if (interlace_type == PNG_INTERLACE_ADAM7)
-      buf = al_malloc(real_rowbytes * height);
-   else
-      buf = al_malloc(real_rowbytes);
-
-   if (bpp == 8 && (color_type & PNG_COLOR_MASK_PALETTE) &&
-      (flags & ALLEGRO_KEEP_INDEX))
-   {
+   /* Rows are read straight into the bitmap, in its own format if libpng
+    * can produce it, so that unlocking needs no conversion.
+    */
+   if (is_palette && (flags & ALLEGRO_KEEP_INDEX)) {
       lock = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8,
          ALLEGRO_LOCK_WRITEONLY);
       index_only = true;
    }
+   else if (_al_get_rgba_byte_offsets(al_get_bitmap_format(bmp), offs)) {
+      lock = al_lock_bitmap(bmp, al_get_bitmap_format(bmp),
+         ALLEGRO_LOCK_WRITEONLY);
+   }
    else {
       lock = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
          ALLEGRO_LOCK_WRITEONLY);
-      index_only = false;
+      _al_get_rgba_byte_offsets(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, offs);
+   }
+   if (!lock) {
+      ALLEGRO_ERROR("al_lock_bitmap failed while loading PNG.\n");
+      al_destroy_bitmap(bmp);
+      return NULL;
    }
 
-   /* Read the image, one line at a time (easier to debug!) */
+   if (use_chunks) {
+      if (read_row_chunks(png_ptr, info_ptr, index, lock, offs, premul)) {
+         al_unlock_bitmap(bmp);
+         return bmp;
+      }
+
+      /* Decode the image data the usual way instead.  libpng has already
+       * read the length and type of the first IDAT chunk.
+       */
+      ALLEGRO_WARN("Ignoring the row chunk index.\n");
+      if (!al_fseek((ALLEGRO_FILE *)png_get_io_ptr(png_ptr), idat_pos + 8,
+            ALLEGRO_SEEK_SET)) {
+         al_unlock_bitmap(bmp);
+         al_destroy_bitmap(bmp);
+         return NULL;
+      }
+      set_transforms(png_ptr, info_ptr);
+   }
+
+   if (!is_palette) {
+      set_output_order(png_ptr, offs, has_alpha);
+   }
+
+   /* Call to gamma correct and add the background to the palette
+    * and update info structure.
+    */
+   png_read_update_info(png_ptr, info_ptr);
+
+   if (is_palette) {
+      read_palette(png_ptr, info_ptr, pal);
+   }
+
+   /* libpng combines the passes of interlaced pictures in place, so the
+    * rows of the bitmap hold everything that has been read so far.  Palette
+    * indices are kept at the start of their row until the last pass.
+    */
    for (pass = 0; pass < number_passes; pass++) {
+      const bool last_pass = (pass == number_passes - 1);
       png_uint_32 y;
-      unsigned int i;
-      unsigned char *ptr;
-      dest = lock->data;
 
       for (y = 0; y < height; y++) {
-         unsigned char *dest_row_start = dest;
-         /* For interlaced pictures, the row needs to be initialized with
-          * the contents of the previous pass.
-          */
-         if (interlace_type == PNG_INTERLACE_ADAM7)
-            ptr = buf + y * real_rowbytes;
-         else
-             ptr = buf;
-         png_read_row(png_ptr, NULL, ptr);
-   
-         switch (bpp) {
-            case 8:
-               if (index_only) {
-                  for (i = 0; i < width; i++) {
-                     *(dest++) = *(ptr++);
-                  }
-               }
-               else if (color_type & PNG_COLOR_MASK_PALETTE) {
-                  for (i = 0; i < width; i++) {
-                     int pix = ptr[0];
-                     int ti;
-                     ptr++;
-                     dest[0] = pal[pix].r;
-                     dest[1] = pal[pix].g;
-                     dest[2] = pal[pix].b;
-                     dest[3] = 255;
-                     for (ti = 0; ti < num_trans; ti++) {
-                        if (trans[ti] == pix) {
-                           dest[0] = dest[1] = dest[2] = dest[3] = 0;
-                           break;
-                        }
-                     }
-                     dest += 4;
-                  }
-               }
-               else {
-                  for (i = 0; i < width; i++) {
-                     int pix = ptr[0];
-                     ptr++;
-                     *(dest++) = pix;
-                     *(dest++) = pix;
-                     *(dest++) = pix;
-                     *(dest++) = 255;
-                  }
-               }
-               break;
-
-            case 24:
-               for (i = 0; i < width; i++) {
-                  uint32_t pix = READ3BYTES(ptr);
-                  ptr += 3;
-                  *(dest++) = pix & 0xff;
-                  *(dest++) = (pix >> 8) & 0xff;
-                  *(dest++) = (pix >> 16) & 0xff;
-                  *(dest++) = 255;
-               }
-               break;
-
-            case 32:
-               for (i = 0; i < width; i++) {
-                  uint32_t pix = bmp_read32(ptr);
-                  int r = pix & 0xff;
-                  int g = (pix >> 8) & 0xff;
-                  int b = (pix >> 16) & 0xff;
-                  int a = (pix >> 24) & 0xff;
-                  ptr += 4;
-
-                  if (premul) {
-                     r = r * a / 255;
-                     g = g * a / 255;
-                     b = b * a / 255;
-                  }
-
-                  *(dest++) = r;
-                  *(dest++) = g;
-                  *(dest++) = b;
-                  *(dest++) = a;
-               }
-               break;
-
-            default:
-               ALLEGRO_ASSERT(bpp == 8 || bpp == 24 || bpp == 32);
-               break;
-         }
-         dest = dest_row_start + lock->pitch;
+         unsigned char *dest = (unsigned char *)lock->data + y * lock->pitch;
+
+         png_read_row(png_ptr, dest, NULL);
+         if (!last_pass || index_only)
+            continue;
+
+         if (is_palette)
+            expand_palette_row(dest, width, pal, trans, num_trans, offs);
+         else if (premul && has_alpha)
+            premultiply_row(dest, width, offs);
       }
    }
 
    al_unlock_bitmap(bmp);
 
-   al_free(buf);
-
    /* Read rest of file, and get additional chunks in info_ptr. */
    png_read_end(png_ptr, info_ptr);
 
@@ -343,6 +796,7 @@ ALLEGRO_BITMAP *_al_load_png_f(ALLEGRO_FILE *fp, int flags)
    ALLEGRO_BITMAP *bmp;
    png_structp png_ptr;
    png_infop info_ptr;
+   PNG_ROW_CHUNKS index;
 
    ALLEGRO_ASSERT(fp);
 
@@ -372,10 +826,13 @@ ALLEGRO_BITMAP *_al_load_png_f(ALLEGRO_FILE *fp, int flags)
       return NULL;
    }
 
+   memset(&index, 0, sizeof(index));
+
    /* Set error handling. */
    if (setjmp(jmpbuf)) {
       /* Free all of the memory associated with the png_ptr and info_ptr */
       png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+      al_free(index.offsets);
       /* If we get here, we had a problem reading the file */
       ALLEGRO_ERROR("Error reading PNG file\n");
       return NULL;
@@ -385,14 +842,18 @@ ALLEGRO_BITMAP *_al_load_png_f(ALLEGRO_FILE *fp, int flags)
    /* Use Allegro packfile routines. */
    png_set_read_fn(png_ptr, fp, (png_rw_ptr) read_data);
 
+   /* Look out for the row chunk index. */
+   png_set_read_user_chunk_fn(png_ptr, &index, read_chunk_index);
+
    /* We have already read some of the signature. */
    png_set_sig_bytes(png_ptr, PNG_BYTES_TO_CHECK);
 
    /* Really load the image now. */
-   bmp = really_load_png(png_ptr, info_ptr, flags);
+   bmp = really_load_png(png_ptr, info_ptr, &index, flags);
 
    /* Clean up after the read, and free any memory allocated. */
    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+   al_free(index.offsets);
 
    return bmp;
 }
@@ -421,6 +882,219 @@ ALLEGRO_BITMAP *_al_load_png(const char *filename, int flags)
 
 
 
+/* Reads the chunks before the image data, which is enough to know the
+ * dimensions and whether the image has a palette or transparency.
+ */
+bool _al_probe_png_f(ALLEGRO_FILE *fp, ALLEGRO_BITMAP_INFO *info)
+{
+   jmp_buf jmpbuf;
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 width, height;
+   int bit_depth, color_type;
+
+   ALLEGRO_ASSERT(fp);
+   ALLEGRO_ASSERT(info);
+
+   if (!check_if_png(fp))
+      return false;
+
+   png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                    (void *)NULL, NULL, NULL);
+   if (!png_ptr)
+      return false;
+
+   info_ptr = png_create_info_struct(png_ptr);
+   if (!info_ptr) {
+      png_destroy_read_struct(&png_ptr, (png_infopp) NULL, (png_infopp) NULL);
+      return false;
+   }
+
+   if (setjmp(jmpbuf)) {
+      png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+      return false;
+   }
+   png_set_error_fn(png_ptr, jmpbuf, user_error_fn, NULL);
+   png_set_read_fn(png_ptr, fp, (png_rw_ptr) read_data);
+   png_set_sig_bytes(png_ptr, PNG_BYTES_TO_CHECK);
+
+   png_read_info(png_ptr, info_ptr);
+   png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
+      NULL, NULL, NULL);
+
+   info->width = width;
+   info->height = height;
+   info->channels = png_get_channels(png_ptr, info_ptr);
+   info->bits_per_pixel = info->channels * bit_depth;
+   info->has_palette = (color_type == PNG_COLOR_TYPE_PALETTE);
+   info->has_alpha = (color_type & PNG_COLOR_MASK_ALPHA) ||
+      png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS);
+
+   png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp) NULL);
+
+   return true;
+}
+
+
+
+
+/* State of a PNG bitmap stream.  libpng reports errors with longjmp, so
+ * every entry point sets jmpbuf again before calling into it.
+ */
+typedef struct PNG_STREAM
+{
+   jmp_buf jmpbuf;
+   png_structp png_ptr;
+   png_infop info_ptr;
+   png_uint_32 width;
+   bool is_palette;
+   bool premul;
+   PalEntry pal[256];
+   png_bytep trans;
+   int num_trans;
+   int offs[4];
+} PNG_STREAM;
+
+
+
+static int png_stream_read_rows(ALLEGRO_BITMAP_STREAM *stream,
+   unsigned char *buffer, int pitch, int num_rows)
+{
+   PNG_STREAM *ps = al_get_bitmap_stream_userdata(stream);
+   volatile int y = 0;
+
+   if (setjmp(ps->jmpbuf)) {
+      ALLEGRO_ERROR("Error reading PNG file\n");
+      return y;
+   }
+
+   for (; y < num_rows; y++) {
+      unsigned char *dest = buffer + y * pitch;
+
+      png_read_row(ps->png_ptr, dest, NULL);
+      if (ps->is_palette) {
+         expand_palette_row(dest, ps->width, ps->pal, ps->trans,
+            ps->num_trans, ps->offs);
+      }
+      else if (ps->premul) {
+         premultiply_row(dest, ps->width, ps->offs);
+      }
+   }
+
+   return y;
+}
+
+
+
+static void png_stream_close(ALLEGRO_BITMAP_STREAM *stream)
+{
+   PNG_STREAM *ps = al_get_bitmap_stream_userdata(stream);
+
+   png_destroy_read_struct(&ps->png_ptr, &ps->info_ptr, (png_infopp) NULL);
+   al_free(ps);
+}
+
+
+
+static const ALLEGRO_BITMAP_STREAM_INTERFACE png_stream_vt = {
+   png_stream_read_rows,
+   png_stream_close
+};
+
+
+
+/* Opens a stream over the rows of a PNG file.  Only non-interlaced images
+ * can be streamed, as the first pass of an interlaced image says nothing
+ * about most rows.
+ */
+ALLEGRO_BITMAP_STREAM *_al_open_png_stream_f(ALLEGRO_FILE *fp, int flags)
+{
+   PNG_STREAM *ps;
+   ALLEGRO_BITMAP_STREAM *stream;
+   png_uint_32 width, height;
+   int color_type, interlace_type;
+   bool has_alpha;
+
+   ALLEGRO_ASSERT(fp);
+
+   if (!check_if_png(fp)) {
+      ALLEGRO_ERROR("Not a png.\n");
+      return NULL;
+   }
+
+   ps = al_calloc(1, sizeof(*ps));
+   if (!ps)
+      return NULL;
+
+   ps->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+                                        (void *)NULL, NULL, NULL);
+   if (!ps->png_ptr) {
+      ALLEGRO_ERROR("png_ptr == NULL\n");
+      al_free(ps);
+      return NULL;
+   }
+
+   ps->info_ptr = png_create_info_struct(ps->png_ptr);
+   if (!ps->info_ptr) {
+      ALLEGRO_ERROR("png_create_info_struct failed\n");
+      goto error;
+   }
+
+   if (setjmp(ps->jmpbuf)) {
+      ALLEGRO_ERROR("Error reading PNG file\n");
+      goto error;
+   }
+   png_set_error_fn(ps->png_ptr, ps->jmpbuf, user_error_fn, NULL);
+   png_set_read_fn(ps->png_ptr, fp, (png_rw_ptr) read_data);
+   png_set_sig_bytes(ps->png_ptr, PNG_BYTES_TO_CHECK);
+
+   png_read_info(ps->png_ptr, ps->info_ptr);
+   png_get_IHDR(ps->png_ptr, ps->info_ptr, &width, &height, NULL,
+                &color_type, &interlace_type, NULL, NULL);
+
+   if (interlace_type != PNG_INTERLACE_NONE) {
+      ALLEGRO_ERROR("Interlaced PNG images can't be streamed.\n");
+      goto error;
+   }
+
+   ps->width = width;
+   ps->is_palette = (color_type & PNG_COLOR_MASK_PALETTE);
+   has_alpha = (color_type & PNG_COLOR_MASK_ALPHA) ||
+      (!ps->is_palette &&
+       png_get_valid(ps->png_ptr, ps->info_ptr, PNG_INFO_tRNS));
+   ps->premul = has_alpha && !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+
+   set_transforms(ps->png_ptr, ps->info_ptr);
+   if (ps->is_palette &&
+         png_get_valid(ps->png_ptr, ps->info_ptr, PNG_INFO_tRNS)) {
+      png_get_tRNS(ps->png_ptr, ps->info_ptr, &ps->trans, &ps->num_trans,
+         NULL);
+   }
+
+   _al_get_rgba_byte_offsets(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ps->offs);
+   if (!ps->is_palette) {
+      set_output_order(ps->png_ptr, ps->offs, has_alpha);
+   }
+
+   png_read_update_info(ps->png_ptr, ps->info_ptr);
+
+   if (ps->is_palette) {
+      read_palette(ps->png_ptr, ps->info_ptr, ps->pal);
+   }
+
+   stream = al_create_bitmap_stream(&png_stream_vt, ps, width, height);
+   if (!stream)
+      goto error;
+
+   return stream;
+
+error:
+   png_destroy_read_struct(&ps->png_ptr, &ps->info_ptr, (png_infopp) NULL);
+   al_free(ps);
+   return NULL;
+}
+
+
 
 /*****************************************************************************
  * Saving routines
@@ -448,6 +1122,146 @@ static void flush_data(png_structp png_ptr)
 }
 
 
+typedef struct PNG_CONFIG_NAME {
+   const char *name;
+   int value;
+} PNG_CONFIG_NAME;
+
+
+static const PNG_CONFIG_NAME compression_levels[] = {
+   { "default",   Z_DEFAULT_COMPRESSION },
+   { "best",      Z_BEST_COMPRESSION },
+   { "fastest",   Z_BEST_SPEED },
+   { "none",      Z_NO_COMPRESSION },
+   { NULL, 0 }
+};
+
+
+static const PNG_CONFIG_NAME compression_strategies[] = {
+   { "default",   Z_DEFAULT_STRATEGY },
+   { "filtered",  Z_FILTERED },
+   { "huffman",   Z_HUFFMAN_ONLY },
+   { "rle",       Z_RLE },
+   { "fixed",     Z_FIXED },
+   { NULL, 0 }
+};
+
+
+static const PNG_CONFIG_NAME filters[] = {
+   { "none",      PNG_FILTER_NONE },
+   { "sub",       PNG_FILTER_SUB },
+   { "up",        PNG_FILTER_UP },
+   { "avg",       PNG_FILTER_AVG },
+   { "paeth",     PNG_FILTER_PAETH },
+   { "all",       PNG_ALL_FILTERS },
+   { NULL, 0 }
+};
+
+
+/* get_config_setting:
+ *  Looks up a key of the [image] section of the system configuration,
+ *  which may be one of the given names or, if allow_number is set, a
+ *  number. Returns false if the key is missing or not understood.
+ */
+static bool get_config_setting(const char *key, const PNG_CONFIG_NAME *names,
+   bool allow_number, int *value)
+{
+   ALLEGRO_CONFIG *cfg = al_get_system_config();
+   const char *str;
+   char *end;
+   long n;
+
+   str = cfg ? al_get_config_value(cfg, "image", key) : NULL;
+   if (!str)
+      return false;
+
+   for (; names->name; names++) {
+      if (0 == strcmp(str, names->name)) {
+         *value = names->value;
+         return true;
+      }
+   }
+
+   if (allow_number) {
+      n = strtol(str, &end, 10);
+      if (end != str && *end == '\0') {
+         *value = n;
+         return true;
+      }
+   }
+
+   ALLEGRO_WARN("Ignoring invalid value %s for %s.\n", str, key);
+   return false;
+}
+
+
+static const PNG_CONFIG_NAME chunk_rows[] = {
+   { "off",       0 },
+   { NULL, 0 }
+};
+
+
+typedef struct PNG_SAVE_OPTIONS {
+   int level;
+   int strategy;                 /* -1 for the libpng default */
+   int filters;                  /* 0 for the libpng default */
+   int chunk_rows;
+} PNG_SAVE_OPTIONS;
+
+
+/* get_save_options:
+ *  Reads the compression settings from the system configuration. Without
+ *  a filter setting libpng tries every filter on every row and keeps the
+ *  best, which is wasted work for uncompressed output, so no filter is
+ *  used then.
+ */
+static void get_save_options(PNG_SAVE_OPTIONS *opt)
+{
+   int value;
+
+   opt->level = _al_png_compression_level;
+   opt->strategy = -1;
+   opt->filters = 0;
+   opt->chunk_rows = 0;
+
+   if (get_config_setting("png_compression_level", compression_levels, true,
+         &value)) {
+      if (value >= Z_DEFAULT_COMPRESSION && value <= Z_BEST_COMPRESSION)
+         opt->level = value;
+   }
+
+   if (get_config_setting("png_compression_strategy", compression_strategies,
+         false, &value)) {
+      opt->strategy = value;
+   }
+
+   if (get_config_setting("png_filter", filters, false, &value)) {
+      opt->filters = value;
+   }
+   else if (opt->level == Z_NO_COMPRESSION) {
+      opt->filters = PNG_FILTER_NONE;
+   }
+
+   if (get_config_setting("png_chunk_rows", chunk_rows, true, &value)) {
+      if (value >= 0)
+         opt->chunk_rows = value;
+   }
+}
+
+
+/* set_save_options:
+ *  Passes the compression settings on to libpng.
+ */
+static void set_save_options(png_structp png_ptr, const PNG_SAVE_OPTIONS *opt)
+{
+   png_set_compression_level(png_ptr, opt->level);
+   if (opt->strategy >= 0)
+      png_set_compression_strategy(png_ptr, opt->strategy);
+   if (opt->filters)
+      png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, opt->filters);
+}
+
+
 /* save_rgba:
  *  Core save routine for 32 bpp images.
  */
@@ -474,6 +1288,305 @@ static int save_rgba(png_structp png_ptr, ALLEGRO_BITMAP *bmp)
 
 
 
+/* filter_row:
+ *  Applies a PNG filter to a row of n bytes, writing the filter type
+ *  followed by the filtered bytes to out.  prev is the previous row, all
+ *  zeros for the first row of the image.
+ */
+static void filter_row(int filter, const unsigned char *row,
+   const unsigned char *prev, size_t n, int bpp, unsigned char *out)
+{
+   size_t i;
+
+   *out++ = filter;
+
+   switch (filter) {
+      case PNG_FILTER_VALUE_NONE:
+         memcpy(out, row, n);
+         break;
+
+      case PNG_FILTER_VALUE_SUB:
+         for (i = 0; i < (size_t)bpp; i++)
+            out[i] = row[i];
+         for (; i < n; i++)
+            out[i] = row[i] - row[i - bpp];
+         break;
+
+      case PNG_FILTER_VALUE_UP:
+         for (i = 0; i < n; i++)
+            out[i] = row[i] - prev[i];
+         break;
+
+      case PNG_FILTER_VALUE_AVG:
+         for (i = 0; i < (size_t)bpp; i++)
+            out[i] = row[i] - prev[i] / 2;
+         for (; i < n; i++)
+            out[i] = row[i] - (row[i - bpp] + prev[i]) / 2;
+         break;
+
+      case PNG_FILTER_VALUE_PAETH:
+         for (i = 0; i < (size_t)bpp; i++)
+            out[i] = row[i] - prev[i];
+         for (; i < n; i++)
+            out[i] = row[i] - paeth_predictor(row[i - bpp], prev[i],
+               prev[i - bpp]);
+         break;
+   }
+}
+
+
+
+/* choose_filter:
+ *  Filters a row with each filter allowed by mask, and returns the result
+ *  with the smallest sum of absolute (signed) byte values, like libpng.
+ *  best and trial must hold n + 1 bytes; the result is one of them.
+ */
+static unsigned char *choose_filter(int mask, const unsigned char *row,
+   const unsigned char *prev, size_t n, int bpp,
+   unsigned char *best, unsigned char *trial)
+{
+   static const int filter_masks[5] = {
+      PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG,
+      PNG_FILTER_PAETH
+   };
+   unsigned long best_sum = ~0UL;
+   int f;
+
+   for (f = 0; f < 5; f++) {
+      unsigned long sum = 0;
+      size_t i;
+
+      if (!(mask & filter_masks[f]))
+         continue;
+      if (mask == filter_masks[f]) {
+         filter_row(f, row, prev, n, bpp, best);
+         return best;
+      }
+
+      filter_row(f, row, prev, n, bpp, trial);
+      for (i = 1; i <= n; i++)
+         sum += abs((signed char)trial[i]);
+      if (sum < best_sum) {
+         unsigned char *tmp = best;
+         best = trial;
+         trial = tmp;
+         best_sum = sum;
+      }
+   }
+
+   return best;
+}
+
+
+
+typedef struct PNG_CHUNK_ENCODER {
+   const unsigned char *pixels;
+   int pitch;
+   png_uint_32 width, height;
+   png_uint_32 rows_per_chunk;
+   png_uint_32 num_chunks;
+   const PNG_SAVE_OPTIONS *opt;
+   unsigned char **data;
+   size_t *sizes;
+   uLong *adlers;
+} PNG_CHUNK_ENCODER;
+
+
+
+/* encode_chunk:
+ *  Filters and deflates one band of rows as a raw deflate stream.  Each
+ *  band but the last ends with a full flush, so the bands can be joined
+ *  into a single stream.  The first row of a band may only use the none
+ *  or sub filter as it must not refer to the band above.
+ */
+static bool encode_chunk(void *arg, int c)
+{
+   PNG_CHUNK_ENCODER *e = arg;
+   const PNG_SAVE_OPTIONS *opt = e->opt;
+   const png_uint_32 y0 = c * e->rows_per_chunk;
+   png_uint_32 y1 = y0 + e->rows_per_chunk;
+   const size_t rowbytes = (size_t)e->width * 4;
+   const bool last = ((png_uint_32)c == e->num_chunks - 1);
+   unsigned char *buf;
+   unsigned char *zeros;
+   uLong adler = adler32(0, NULL, 0);
+   int mask = opt->filters ? opt->filters : PNG_ALL_FILTERS;
+   int strategy = opt->strategy;
+   size_t capacity;
+   bool ret = false;
+   z_stream z;
+   png_uint_32 y;
+
+   if (y1 > e->height)
+      y1 = e->height;
+
+   /* libpng switches to Z_FILTERED when rows are filtered. */
+   if (strategy < 0)
+      strategy = (mask == PNG_FILTER_NONE) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+
+   buf = al_calloc(3, rowbytes + 1);
+   if (!buf)
+      return false;
+   zeros = buf + 2 * (rowbytes + 1);
+
+   memset(&z, 0, sizeof(z));
+   if (deflateInit2(&z, opt->level, Z_DEFLATED, -MAX_WBITS, 8,
+         strategy) != Z_OK) {
+      al_free(buf);
+      return false;
+   }
+
+   capacity = deflateBound(&z, (y1 - y0) * (rowbytes + 1)) + 16;
+   e->data[c] = al_malloc(capacity);
+   if (!e->data[c])
+      goto done;
+   z.next_out = e->data[c];
+   z.avail_out = capacity;
+
+   for (y = y0; y < y1; y++) {
+      const unsigned char *row = e->pixels + (size_t)y * e->pitch;
+      const unsigned char *prev = (y > 0) ? row - e->pitch : zeros;
+      int row_mask = mask;
+      unsigned char *out;
+      int flush = Z_NO_FLUSH;
+      int zret;
+
+      if (y == y0 && y > 0) {
+         row_mask &= PNG_FILTER_NONE | PNG_FILTER_SUB;
+         if (!row_mask)
+            row_mask = PNG_FILTER_NONE;
+      }
+      out = choose_filter(row_mask, row, prev, rowbytes, 4, buf,
+         buf + rowbytes + 1);
+      adler = adler32(adler, out, rowbytes + 1);
+
+      if (y == y1 - 1)
+         flush = last ? Z_FINISH : Z_FULL_FLUSH;
+      z.next_in = out;
+      z.avail_in = rowbytes + 1;
+      zret = deflate(&z, flush);
+      if (zret == Z_STREAM_ERROR || z.avail_in > 0)
+         goto done;
+      if (flush == Z_FINISH && zret != Z_STREAM_END)
+         goto done;
+   }
+
+   e->sizes[c] = capacity - z.avail_out;
+   e->adlers[c] = adler;
+   ret = true;
+
+done:
+   deflateEnd(&z);
+   al_free(buf);
+   return ret;
+}
+
+
+
+/* write_row_chunks:
+ *  Writes the image data as independently compressed bands of rows, with
+ *  the index that lets us decompress them in parallel, and the end of the
+ *  file.  This replaces save_rgba and png_write_end.
+ */
+static bool write_row_chunks(png_structp png_ptr, ALLEGRO_BITMAP *bmp,
+   const PNG_SAVE_OPTIONS *opt)
+{
+   ALLEGRO_LOCKED_REGION *lock;
+   PNG_CHUNK_ENCODER e;
+   unsigned char zlib_header[2];
+   unsigned char adler_bytes[4];
+   unsigned char *index = NULL;
+   png_uint_32 offset;
+   png_uint_32 i;
+   uLong adler;
+   int level;
+   bool ret = false;
+
+   memset(&e, 0, sizeof(e));
+   e.width = al_get_bitmap_width(bmp);
+   e.height = al_get_bitmap_height(bmp);
+   e.rows_per_chunk = opt->chunk_rows;
+   e.num_chunks = (e.height - 1) / e.rows_per_chunk + 1;
+   e.opt = opt;
+
+   e.data = al_calloc(e.num_chunks, sizeof(*e.data));
+   e.sizes = al_calloc(e.num_chunks, sizeof(*e.sizes));
+   e.adlers = al_calloc(e.num_chunks, sizeof(*e.adlers));
+   index = al_malloc(4 * (e.num_chunks + 1));
+   if (!e.data || !e.sizes || !e.adlers || !index)
+      goto done;
+
+   lock = al_lock_bitmap(bmp, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_READONLY);
+   if (!lock)
+      goto done;
+   e.pixels = lock->data;
+   e.pitch = lock->pitch;
+
+   ret = _al_run_parallel(encode_chunk, &e, e.num_chunks);
+   al_unlock_bitmap(bmp);
+   if (!ret)
+      goto done;
+
+   /* The zlib header, with the level hint zlib itself would write. */
+   level = (opt->level == Z_DEFAULT_COMPRESSION) ? 6 : opt->level;
+   zlib_header[0] = 0x78;
+   zlib_header[1] = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+   zlib_header[1] += 31 - ((zlib_header[0] << 8) | zlib_header[1]) % 31;
+
+   offset = 2;
+   png_save_uint_32(index, e.rows_per_chunk);
+   adler = e.adlers[0];
+   for (i = 0; i < e.num_chunks; i++) {
+      png_uint_32 rows = e.rows_per_chunk;
+      if (i == e.num_chunks - 1)
+         rows = e.height - i * e.rows_per_chunk;
+      png_save_uint_32(index + 4 + 4 * i, offset);
+      offset += e.sizes[i];
+      if (i > 0) {
+         adler = adler32_combine(adler, e.adlers[i],
+            (z_off_t)rows * (e.width * 4 + 1));
+      }
+   }
+   png_save_uint_32(adler_bytes, adler);
+
+   png_write_chunk(png_ptr, (png_const_bytep)PNG_ROW_CHUNKS_NAME, index,
+      4 * (e.num_chunks + 1));
+
+   /* One IDAT chunk per band, the first also holding the zlib header and
+    * the last the checksum.
+    */
+   for (i = 0; i < e.num_chunks; i++) {
+      const bool first = (i == 0);
+      const bool last = (i == e.num_chunks - 1);
+      png_write_chunk_start(png_ptr, (png_const_bytep)"IDAT",
+         e.sizes[i] + (first ? 2 : 0) + (last ? 4 : 0));
+      if (first)
+         png_write_chunk_data(png_ptr, zlib_header, 2);
+      png_write_chunk_data(png_ptr, e.data[i], e.sizes[i]);
+      if (last)
+         png_write_chunk_data(png_ptr, adler_bytes, 4);
+      png_write_chunk_end(png_ptr);
+   }
+
+   png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
+
+   ret = true;
+
+done:
+   if (e.data) {
+      for (i = 0; i < e.num_chunks; i++)
+         al_free(e.data[i]);
+   }
+   al_free(e.data);
+   al_free(e.sizes);
+   al_free(e.adlers);
+   al_free(index);
+   return ret;
+}
+
+
+
 /* Writes a non-interlaced, no-frills PNG, taking the usual save_xyz
  *  parameters.  Returns non-zero on error.
  */
@@ -482,6 +1595,7 @@ bool _al_save_png_f(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bmp)
    jmp_buf jmpbuf;
    png_structp png_ptr = NULL;
    png_infop info_ptr = NULL;
+   PNG_SAVE_OPTIONS opt;
    int colour_type;
 
    /* Create and initialize the png_struct with the
@@ -516,8 +1630,9 @@ bool _al_save_png_f(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bmp)
     */
    colour_type = PNG_COLOR_TYPE_RGB_ALPHA;
 
-   /* Set compression level. */
-   png_set_compression_level(png_ptr, _al_png_compression_level);
+   /* Set compression level, strategy and filters. */
+   get_save_options(&opt);
+   set_save_options(png_ptr, &opt);
 
    png_set_IHDR(png_ptr, info_ptr,
                 al_get_bitmap_width(bmp), al_get_bitmap_height(bmp),
@@ -535,10 +1650,17 @@ bool _al_save_png_f(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bmp)
     * PNG_TEXT_COMPRESSION_zTXt_WR, so it doesn't get written out again
     * at the end.
     */
-   if (!save_rgba(png_ptr, bmp))
-      goto Error;
+   if (opt.chunk_rows > 0 &&
+         (png_uint_32)opt.chunk_rows < (png_uint_32)al_get_bitmap_height(bmp)) {
+      if (!write_row_chunks(png_ptr, bmp, &opt))
+         goto Error;
+   }
+   else {
+      if (!save_rgba(png_ptr, bmp))
+         goto Error;
 
-   png_write_end(png_ptr, info_ptr);
+      png_write_end(png_ptr, info_ptr);
+   }
 
    png_destroy_write_struct(&png_ptr, &info_ptr);
 
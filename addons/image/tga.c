@@ -22,6 +22,8 @@
  */
 
 
+#include <string.h>
+
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_image.h"
 #include "allegro5/internal/aintern_image.h"
@@ -31,225 +33,99 @@
 
 
 
-/* raw_tga_read8:
- *  Helper for reading 256-color raw data from TGA files.
- */
-static INLINE unsigned char *raw_tga_read8(unsigned char *b, int w, ALLEGRO_FILE *f)
-{
-   return b + al_fread(f, b, w);
-}
-
-
-
-/* rle_tga_read8:
- *  Helper for reading 256-color RLE data from TGA files.
- */
-static void rle_tga_read8(unsigned char *b, int w, ALLEGRO_FILE *f)
-{
-   int value, count, c = 0;
-
-   do {
-      count = al_fgetc(f);
-      if (count & 0x80) {
-         /* run-length packet */
-         count = (count & 0x7F) + 1;
-         c += count;
-         value = al_fgetc(f);
-         while (count--)
-            *b++ = value;
-      }
-      else {
-         /* raw packet */
-         count++;
-         c += count;
-         b = raw_tga_read8(b, count, f);
-      }
-   } while (c < w);
-}
-
-
-
-/* single_tga_read32:
- *  Helper for reading a single 32-bit data from TGA files.
- */
-static INLINE int32_t single_tga_read32(ALLEGRO_FILE *f)
-{
-   return al_fread32le(f);
-}
-
-
-
-/* raw_tga_read32:
- *  Helper for reading 32-bit raw data from TGA files.
- */
-static unsigned int *raw_tga_read32(unsigned int *b, int w, ALLEGRO_FILE *f)
-{
-   while (w--)
-      *b++ = single_tga_read32(f);
-
-   return b;
-}
-
-
-
-/* rle_tga_read32:
- *  Helper for reading 32-bit RLE data from TGA files.
+/* raw_tga_read:
+ *  Helper for reading raw data from TGA files, w pixels of the given size
+ *  at once. Data missing at the end of the file is read as zero.
  */
-static void rle_tga_read32(unsigned int *b, int w, ALLEGRO_FILE *f)
+static unsigned char *raw_tga_read(unsigned char *b, int w,
+   int bytes_per_pixel, ALLEGRO_FILE *f)
 {
-   int color, count, c = 0;
+   size_t size = (size_t)w * bytes_per_pixel;
+   size_t n = al_fread(f, b, size);
 
-   do {
-      count = al_fgetc(f);
-      if (count & 0x80) {
-         /* run-length packet */
-         count = (count & 0x7F) + 1;
-         c += count;
-         color = single_tga_read32(f);
-         while (count--)
-            *b++ = color;
-      }
-      else {
-         /* raw packet */
-         count++;
-         c += count;
-         b = raw_tga_read32(b, count, f);
-      }
-   } while (c < w);
-}
+   if (n < size)
+      memset(b + n, 0, size - n);
 
-
-/* single_tga_read24:
- *  Helper for reading a single 24-bit data from TGA files.
- */
-static INLINE void single_tga_read24(ALLEGRO_FILE *f, unsigned char color[3])
-{
-   al_fread(f, color, 3);
-}
-
-
-
-/* raw_tga_read24:
- *  Helper for reading 24-bit raw data from TGA files.
- */
-static unsigned char *raw_tga_read24(unsigned char *b, int w, ALLEGRO_FILE *f)
-{
-   while (w--) {
-      single_tga_read24(f, b);
-      b += 3;
-   }
-
-   return b;
+   return b + size;
 }
 
 
 
-/* rle_tga_read24:
- *  Helper for reading 24-bit RLE data from TGA files.
+/* rle_tga_read:
+ *  Helper for reading RLE data from TGA files. Raw packets are read as a
+ *  whole, and runs are expanded from a single pixel. Packets reaching past
+ *  the end of the line are cut off.
  */
-static void rle_tga_read24(unsigned char *b, int w, ALLEGRO_FILE *f)
+static void rle_tga_read(unsigned char *b, int w, int bytes_per_pixel,
+   ALLEGRO_FILE *f)
 {
+   unsigned char color[4];
    int count, c = 0;
-   unsigned char color[3];
+   int i;
 
    do {
       count = al_fgetc(f);
+      if (count == EOF) {
+         memset(b, 0, (size_t)(w - c) * bytes_per_pixel);
+         return;
+      }
       if (count & 0x80) {
          /* run-length packet */
          count = (count & 0x7F) + 1;
+         if (count > w - c)
+            count = w - c;
          c += count;
-         single_tga_read24(f, color);
-         while (count--) {
-            b[0] = color[0];
-            b[1] = color[1];
-            b[2] = color[2];
-            b += 3;
+         raw_tga_read(color, 1, bytes_per_pixel, f);
+         if (bytes_per_pixel == 1) {
+            memset(b, color[0], count);
+            b += count;
+         }
+         else {
+            while (count--) {
+               for (i = 0; i < bytes_per_pixel; i++)
+                  *b++ = color[i];
+            }
          }
       }
       else {
          /* raw packet */
          count++;
+         if (count > w - c)
+            count = w - c;
          c += count;
-         b = raw_tga_read24(b, count, f);
+         b = raw_tga_read(b, count, bytes_per_pixel, f);
       }
    } while (c < w);
 }
 
 
 
-/* single_tga_read16:
- *  Helper for reading a single 16-bit data from TGA files.
- */
-static INLINE int single_tga_read16(ALLEGRO_FILE *f)
+/* The parts of a TGA header needed to decode the image. */
+typedef struct TGA_HEADER
 {
-   return al_fread16le(f);
-}
-
-
-
-/* raw_tga_read16:
- *  Helper for reading 16-bit raw data from TGA files.
- */
-static unsigned short *raw_tga_read16(unsigned short *b, int w, ALLEGRO_FILE *f)
-{
-   while (w--)
-      *b++ = single_tga_read16(f);
-
-   return b;
-}
+   unsigned char image_palette[256][3];
+   unsigned char image_type;
+   unsigned char bpp;
+   short unsigned int image_width;
+   short unsigned int image_height;
+   bool left_to_right;
+   bool top_to_bottom;
+   bool compressed;
+} TGA_HEADER;
 
 
 
-/* rle_tga_read16:
- *  Helper for reading 16-bit RLE data from TGA files.
+/* read_tga_header:
+ *  Reads the header, image id and palette, leaving the file at the start of
+ *  the image data. Returns false for unsupported images.
  */
-static void rle_tga_read16(unsigned short *b, int w, ALLEGRO_FILE *f)
+static bool read_tga_header(ALLEGRO_FILE *f, TGA_HEADER *h)
 {
-   int color, count, c = 0;
-
-   do {
-      count = al_fgetc(f);
-      if (count & 0x80) {
-         /* run-length packet */
-         count = (count & 0x7F) + 1;
-         c += count;
-         color = single_tga_read16(f);
-         while (count--)
-            *b++ = color;
-      }
-      else {
-         /* raw packet */
-         count++;
-         c += count;
-         b = raw_tga_read16(b, count, f);
-      }
-   } while (c < w);
-}
-
-
-/* Like load_tga, but starts loading from the current place in the ALLEGRO_FILE
- *  specified. If successful the offset into the file will be left just after
- *  the image data. If unsuccessful the offset into the file is unspecified,
- *  i.e. you must either reset the offset to some known place or close the
- *  packfile. The packfile is not closed by this function.
- */
-ALLEGRO_BITMAP *_al_load_tga_f(ALLEGRO_FILE *f, int flags)
-{
-   unsigned char image_id[256], image_palette[256][3];
+   unsigned char image_id[256];
    unsigned char id_length, palette_type, image_type, palette_entry_size;
-   unsigned char bpp, descriptor_bits;
+   unsigned char descriptor_bits;
    short unsigned int palette_colors;
-   short unsigned int image_width, image_height;
-   bool left_to_right;
-   bool top_to_bottom;
    unsigned int c, i;
-   int y;
-   int compressed;
-   ALLEGRO_BITMAP *bmp;
-   ALLEGRO_LOCKED_REGION *lr;
-   unsigned char *buf;
-   bool premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
-   ASSERT(f);
 
    id_length = al_fgetc(f);
    palette_type = al_fgetc(f);
@@ -259,13 +135,13 @@ ALLEGRO_BITMAP *_al_load_tga_f(ALLEGRO_FILE *f, int flags)
    palette_entry_size = al_fgetc(f);
    al_fread16le(f); /* left */
    al_fread16le(f); /* top */
-   image_width = al_fread16le(f);
-   image_height = al_fread16le(f);
-   bpp = al_fgetc(f);
+   h->image_width = al_fread16le(f);
+   h->image_height = al_fread16le(f);
+   h->bpp = al_fgetc(f);
    descriptor_bits = al_fgetc(f);
 
-   left_to_right = !(descriptor_bits & (1 << 4));
-   top_to_bottom = (descriptor_bits & (1 << 5));
+   h->left_to_right = !(descriptor_bits & (1 << 4));
+   h->top_to_bottom = (descriptor_bits & (1 << 5));
 
    al_fread(f, image_id, id_length);
 
@@ -277,16 +153,16 @@ ALLEGRO_BITMAP *_al_load_tga_f(ALLEGRO_FILE *f, int flags)
 
             case 16:
                c = al_fread16le(f);
-               image_palette[i][0] = (c & 0x1F) << 3;
-               image_palette[i][1] = ((c >> 5) & 0x1F) << 3;
-               image_palette[i][2] = ((c >> 10) & 0x1F) << 3;
+               h->image_palette[i][0] = (c & 0x1F) << 3;
+               h->image_palette[i][1] = ((c >> 5) & 0x1F) << 3;
+               h->image_palette[i][2] = ((c >> 10) & 0x1F) << 3;
                break;
 
             case 24:
             case 32:
-               image_palette[i][0] = al_fgetc(f);
-               image_palette[i][1] = al_fgetc(f);
-               image_palette[i][2] = al_fgetc(f);
+               h->image_palette[i][0] = al_fgetc(f);
+               h->image_palette[i][1] = al_fgetc(f);
+               h->image_palette[i][2] = al_fgetc(f);
                if (palette_entry_size == 32)
                   al_fgetc(f);
                break;
@@ -294,7 +170,7 @@ ALLEGRO_BITMAP *_al_load_tga_f(ALLEGRO_FILE *f, int flags)
       }
    }
    else if (palette_type != 0) {
-      return NULL;
+      return false;
    }
 
    /* Image type:
@@ -306,53 +182,166 @@ ALLEGRO_BITMAP *_al_load_tga_f(ALLEGRO_FILE *f, int flags)
     *   10 = RLE true color
     *   11 = RLE grayscale
     */
-   compressed = (image_type & 8);
+   h->compressed = (image_type & 8);
    image_type &= 7;
-
-   if ((image_type < 1) || (image_type > 3)) {
-      return NULL;
-   }
+   h->image_type = image_type;
 
    switch (image_type) {
 
       case 1:
          /* paletted image */
-         if ((palette_type != 1) || (bpp != 8)) {
-            return NULL;
+         if ((palette_type != 1) || (h->bpp != 8)) {
+            return false;
          }
 
          break;
 
       case 2:
          /* truecolor image */
-         if ((palette_type == 0) && ((bpp == 15) || (bpp == 16))) {
-            bpp = 15;
+         if ((palette_type == 0) && ((h->bpp == 15) || (h->bpp == 16))) {
+            h->bpp = 15;
          }
-         else if ((palette_type == 0) && ((bpp == 24) || (bpp == 32))) {
+         else if ((palette_type == 0) && ((h->bpp == 24) || (h->bpp == 32))) {
          }
          else {
-            return NULL;
+            return false;
          }
          break;
 
       case 3:
          /* grayscale image */
-         if ((palette_type != 0) || (bpp != 8)) {
-            return NULL;
+         if ((palette_type != 0) || (h->bpp != 8)) {
+            return false;
          }
 
          for (i=0; i<256; i++) {
-            image_palette[i][0] = i;
-            image_palette[i][1] = i;
-            image_palette[i][2] = i;
+            h->image_palette[i][0] = i;
+            h->image_palette[i][1] = i;
+            h->image_palette[i][2] = i;
          }
          break;
 
       default:
-         return NULL;
+         return false;
+   }
+
+   return true;
+}
+
+
+
+/* bytes_per_pixel:
+ *  bpp + 1 accounts for 15 bpp.
+ */
+static int bytes_per_pixel(const TGA_HEADER *h)
+{
+   return (h->bpp + 1) / 8;
+}
+
+
+
+/* convert_tga_row:
+ *  Converts a row of file pixels to ABGR_8888_LE.
+ */
+static void convert_tga_row(const TGA_HEADER *h, const unsigned char *src,
+   unsigned char *dest, bool premul)
+{
+   int step = 4;
+   unsigned int i;
+
+   /* Rows stored right to left are filled from the end. */
+   if (!h->left_to_right) {
+      dest += (h->image_width - 1) * 4;
+      step = -4;
    }
 
-   bmp = al_create_bitmap(image_width, image_height);
+   switch (h->image_type) {
+
+      case 1:
+      case 3:
+         for (i = 0; i < h->image_width; i++) {
+            int pix = src[i];
+
+            dest[0] = h->image_palette[pix][2];
+            dest[1] = h->image_palette[pix][1];
+            dest[2] = h->image_palette[pix][0];
+            dest[3] = 255;
+            dest += step;
+         }
+
+         break;
+
+      case 2:
+         if (h->bpp == 32) {
+            for (i = 0; i < h->image_width; i++) {
+               int b = src[0];
+               int g = src[1];
+               int r = src[2];
+               int a = src[3];
+
+               if (premul) {
+                  r = r * a / 255;
+                  g = g * a / 255;
+                  b = b * a / 255;
+               }
+
+               dest[0] = r;
+               dest[1] = g;
+               dest[2] = b;
+               dest[3] = a;
+               src += 4;
+               dest += step;
+            }
+         }
+         else if (h->bpp == 24) {
+            for (i = 0; i < h->image_width; i++) {
+               dest[0] = src[2];
+               dest[1] = src[1];
+               dest[2] = src[0];
+               dest[3] = 255;
+               src += 3;
+               dest += step;
+            }
+         }
+         else {
+            for (i = 0; i < h->image_width; i++) {
+               int pix = src[0] | (src[1] << 8);
+
+               dest[0] = _al_rgb_scale_5[(pix >> 10) & 0x1F];
+               dest[1] = _al_rgb_scale_5[(pix >> 5) & 0x1F];
+               dest[2] = _al_rgb_scale_5[(pix & 0x1F)];
+               dest[3] = 255;
+               src += 2;
+               dest += step;
+            }
+         }
+         break;
+   }
+}
+
+
+
+/* Like load_tga, but starts loading from the current place in the ALLEGRO_FILE
+ *  specified. If successful the offset into the file will be left just after
+ *  the image data. If unsuccessful the offset into the file is unspecified,
+ *  i.e. you must either reset the offset to some known place or close the
+ *  packfile. The packfile is not closed by this function.
+ */
+ALLEGRO_BITMAP *_al_load_tga_f(ALLEGRO_FILE *f, int flags)
+{
+   TGA_HEADER h;
+   int y;
+   ALLEGRO_BITMAP *bmp;
+   ALLEGRO_LOCKED_REGION *lr;
+   unsigned char *buf;
+   bool premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   ASSERT(f);
+
+   if (!read_tga_header(f, &h)) {
+      return NULL;
+   }
+
+   bmp = al_create_bitmap(h.image_width, h.image_height);
    if (!bmp) {
       return NULL;
    }
@@ -365,127 +354,200 @@ ALLEGRO_BITMAP *_al_load_tga_f(ALLEGRO_FILE *f, int flags)
       return NULL;
    }
 
-   /* bpp + 1 accounts for 15 bpp. */
-   buf = al_malloc(image_width * ((bpp + 1) / 8));
+   buf = al_malloc(h.image_width * bytes_per_pixel(&h));
    if (!buf) {
       al_unlock_bitmap(bmp);
       al_destroy_bitmap(bmp);
       return NULL;
    }
 
-   for (y = 0; y < image_height; y++) {
-      int true_y = (top_to_bottom) ? y : (image_height - 1 - y);
+   for (y = 0; y < h.image_height; y++) {
+      int true_y = (h.top_to_bottom) ? y : (h.image_height - 1 - y);
+      unsigned char *dest = (unsigned char *)lr->data + lr->pitch*true_y;
 
-      switch (image_type) {
+      if (h.compressed)
+         rle_tga_read(buf, h.image_width, bytes_per_pixel(&h), f);
+      else
+         raw_tga_read(buf, h.image_width, bytes_per_pixel(&h), f);
 
-         case 1:
-         case 3:
-            if (compressed)
-               rle_tga_read8(buf, image_width, f);
-            else
-               raw_tga_read8(buf, image_width, f);
+      convert_tga_row(&h, buf, dest, premul);
+   }
 
-            for (i = 0; i < image_width; i++) {
-               int true_x = (left_to_right) ? i : (image_width - 1 - i);
-               int pix = buf[i];
+   al_free(buf);
+   al_unlock_bitmap(bmp);
 
-               unsigned char *dest = (unsigned char *)lr->data +
-                  lr->pitch*true_y + true_x*4;
-               dest[0] = image_palette[pix][2];
-               dest[1] = image_palette[pix][1];
-               dest[2] = image_palette[pix][0];
-               dest[3] = 255;
-            }
+   if (al_get_errno()) {
+      al_destroy_bitmap(bmp);
+      return NULL;
+   }
 
-            break;
+   return bmp;
+}
 
-         case 2:
-            if (bpp == 32) {
-               if (compressed)
-                  rle_tga_read32((unsigned int *)buf, image_width, f);
-               else
-                  raw_tga_read32((unsigned int *)buf, image_width, f);
-
-               for (i = 0; i < image_width; i++) {
-                  int true_x = (left_to_right) ? i : (image_width - 1 - i);
-                  unsigned char *dest = (unsigned char *)lr->data +
-                     lr->pitch*true_y + true_x*4;
-
-#ifdef ALLEGRO_BIG_ENDIAN
-                  int a = buf[i * 4 + 0];
-                  int r = buf[i * 4 + 1];
-                  int g = buf[i * 4 + 2];
-                  int b = buf[i * 4 + 3];
-#else					 
-                  int b = buf[i * 4 + 0];
-                  int g = buf[i * 4 + 1];
-                  int r = buf[i * 4 + 2];
-                  int a = buf[i * 4 + 3];
-#endif                  
-                  if (premul) {
-                     r = r * a / 255;
-                     g = g * a / 255;
-                     b = b * a / 255;
-                  }
-
-                  dest[0] = r;
-                  dest[1] = g;
-                  dest[2] = b;
-                  dest[3] = a;
-               }
-            }
-            else if (bpp == 24) {
-               if (compressed)
-                  rle_tga_read24(buf, image_width, f);
-               else
-                  raw_tga_read24(buf, image_width, f);
-               for (i = 0; i < image_width; i++) {
-                  int true_x = (left_to_right) ? i : (image_width - 1 - i);
-                  int b = buf[i * 3 + 0];
-                  int g = buf[i * 3 + 1];
-                  int r = buf[i * 3 + 2];
-
-                  unsigned char *dest = (unsigned char *)lr->data +
-                     lr->pitch*true_y + true_x*4;
-                  dest[0] = r;
-                  dest[1] = g;
-                  dest[2] = b;
-                  dest[3] = 255;
-               }
-            }
-            else {
-               if (compressed)
-                  rle_tga_read16((unsigned short *)buf, image_width, f);
-               else
-                  raw_tga_read16((unsigned short *)buf, image_width, f);
-               for (i = 0; i < image_width; i++) {
-                  int true_x = (left_to_right) ? i : (image_width - 1 - i);
-                  int pix = *((unsigned short *)(buf + i * 2));
-                  int r = _al_rgb_scale_5[(pix >> 10)];
-                  int g = _al_rgb_scale_5[(pix >> 5) & 0x1F];
-                  int b = _al_rgb_scale_5[(pix & 0x1F)];
-
-                  unsigned char *dest = (unsigned char *)lr->data +
-                     lr->pitch*true_y + true_x*4;
-                  dest[0] = r;
-                  dest[1] = g;
-                  dest[2] = b;
-                  dest[3] = 255;
-               }
-            }
+
+
+/* skip_rle_tga_row:
+ *  Moves past one row of RLE data without decoding it, cutting off packets
+ *  at the end of the line exactly like rle_tga_read.
+ */
+static bool skip_rle_tga_row(int w, int bytes_per_pixel, ALLEGRO_FILE *f)
+{
+   int count, c = 0;
+
+   do {
+      count = al_fgetc(f);
+      if (count == EOF)
+         return false;
+      if (count & 0x80) {
+         count = (count & 0x7F) + 1;
+         if (count > w - c)
+            count = w - c;
+         c += count;
+         if (!al_fseek(f, bytes_per_pixel, ALLEGRO_SEEK_CUR))
+            return false;
+      }
+      else {
+         count++;
+         if (count > w - c)
+            count = w - c;
+         c += count;
+         if (!al_fseek(f, (int64_t)count * bytes_per_pixel, ALLEGRO_SEEK_CUR))
+            return false;
+      }
+   } while (c < w);
+
+   return true;
+}
+
+
+
+/* State of a TGA bitmap stream.  Most TGA files are stored bottom to top,
+ * so the stream seeks to each row.  For RLE data the row offsets are found
+ * by a pass over the packets when the stream is opened.
+ */
+typedef struct TGA_STREAM
+{
+   TGA_HEADER h;
+   ALLEGRO_FILE *f;
+   bool premul;
+   int64_t data_start;
+   int64_t *row_offsets;   /* RLE only, in file order */
+   unsigned char *buf;
+   int y;
+} TGA_STREAM;
+
+
+
+static int tga_stream_read_rows(ALLEGRO_BITMAP_STREAM *stream,
+   unsigned char *buffer, int pitch, int num_rows)
+{
+   TGA_STREAM *ts = al_get_bitmap_stream_userdata(stream);
+   const int bpp = bytes_per_pixel(&ts->h);
+   int i;
+
+   for (i = 0; i < num_rows; i++, ts->y++) {
+      int file_y = (ts->h.top_to_bottom) ? ts->y :
+         (ts->h.image_height - 1 - ts->y);
+
+      if (!ts->h.top_to_bottom) {
+         int64_t pos;
+         if (ts->h.compressed)
+            pos = ts->row_offsets[file_y];
+         else
+            pos = ts->data_start + (int64_t)file_y * ts->h.image_width * bpp;
+         if (pos >= 0 && !al_fseek(ts->f, pos, ALLEGRO_SEEK_SET))
             break;
+         if (pos < 0) {
+            /* Missing data is read as zero, like the loader does. */
+            memset(ts->buf, 0, (size_t)ts->h.image_width * bpp);
+            convert_tga_row(&ts->h, ts->buf, buffer + i * pitch, ts->premul);
+            continue;
+         }
       }
+
+      if (ts->h.compressed)
+         rle_tga_read(ts->buf, ts->h.image_width, bpp, ts->f);
+      else
+         raw_tga_read(ts->buf, ts->h.image_width, bpp, ts->f);
+
+      convert_tga_row(&ts->h, ts->buf, buffer + i * pitch, ts->premul);
    }
 
-   al_free(buf);
-   al_unlock_bitmap(bmp);
+   return i;
+}
 
-   if (al_get_errno()) {
-      al_destroy_bitmap(bmp);
+
+
+static void tga_stream_close(ALLEGRO_BITMAP_STREAM *stream)
+{
+   TGA_STREAM *ts = al_get_bitmap_stream_userdata(stream);
+
+   al_free(ts->row_offsets);
+   al_free(ts->buf);
+   al_free(ts);
+}
+
+
+
+static const ALLEGRO_BITMAP_STREAM_INTERFACE tga_stream_vt = {
+   tga_stream_read_rows,
+   tga_stream_close
+};
+
+
+
+ALLEGRO_BITMAP_STREAM *_al_open_tga_stream_f(ALLEGRO_FILE *f, int flags)
+{
+   TGA_STREAM *ts;
+   ALLEGRO_BITMAP_STREAM *stream;
+   int64_t pos;
+   int y;
+   ASSERT(f);
+
+   ts = al_calloc(1, sizeof(*ts));
+   if (!ts)
       return NULL;
+
+   if (!read_tga_header(f, &ts->h) ||
+         ts->h.image_width == 0 || ts->h.image_height == 0) {
+      goto error;
    }
 
-   return bmp;
+   ts->f = f;
+   ts->premul = !(flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   ts->data_start = al_ftell(f);
+   ts->buf = al_malloc(ts->h.image_width * bytes_per_pixel(&ts->h));
+   if (!ts->buf)
+      goto error;
+
+   if (ts->h.compressed && !ts->h.top_to_bottom) {
+      ts->row_offsets = al_malloc(ts->h.image_height * sizeof(int64_t));
+      if (!ts->row_offsets)
+         goto error;
+      pos = al_ftell(f);
+      for (y = 0; y < ts->h.image_height; y++) {
+         ts->row_offsets[y] = pos;
+         /* Rows after the end of the data are marked as missing. */
+         if (pos >= 0 && skip_rle_tga_row(ts->h.image_width,
+               bytes_per_pixel(&ts->h), f))
+            pos = al_ftell(f);
+         else
+            pos = -1;
+      }
+   }
+
+   stream = al_create_bitmap_stream(&tga_stream_vt, ts,
+      ts->h.image_width, ts->h.image_height);
+   if (!stream)
+      goto error;
+
+   return stream;
+
+error:
+   al_free(ts->row_offsets);
+   al_free(ts->buf);
+   al_free(ts);
+   return NULL;
 }
 
 
@@ -540,6 +602,70 @@ bool _al_save_tga_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP *bmp)
 }
 
 
+/* Reads the 18-byte TGA header. */
+bool _al_probe_tga_f(ALLEGRO_FILE *f, ALLEGRO_BITMAP_INFO *info)
+{
+   unsigned char palette_type, image_type, bpp;
+   short unsigned int image_width, image_height;
+   ASSERT(f);
+   ASSERT(info);
+
+   al_fgetc(f); /* id_length */
+   palette_type = al_fgetc(f);
+   image_type = al_fgetc(f) & 7;
+   al_fread16le(f); /* first_color */
+   al_fread16le(f); /* palette_colors */
+   al_fgetc(f); /* palette_entry_size */
+   al_fread16le(f); /* left */
+   al_fread16le(f); /* top */
+   image_width = al_fread16le(f);
+   image_height = al_fread16le(f);
+   bpp = al_fgetc(f);
+   al_fgetc(f); /* descriptor_bits */
+
+   if (al_feof(f) || al_ferror(f))
+      return false;
+
+   info->width = image_width;
+   info->height = image_height;
+   info->bits_per_pixel = bpp;
+
+   switch (image_type) {
+      case 1:
+         if (palette_type != 1 || bpp != 8)
+            return false;
+         info->channels = 1;
+         info->has_palette = true;
+         break;
+
+      case 2:
+         if (palette_type != 0)
+            return false;
+         if (bpp == 15 || bpp == 16 || bpp == 24)
+            info->channels = 3;
+         else if (bpp == 32) {
+            info->channels = 4;
+            info->has_alpha = true;
+         }
+         else
+            return false;
+         break;
+
+      case 3:
+         if (palette_type != 0 || bpp != 8)
+            return false;
+         info->channels = 1;
+         break;
+
+      default:
+         return false;
+   }
+
+   return true;
+}
+
+
+
 ALLEGRO_BITMAP *_al_load_tga(const char *filename, int flags)
 {
    ALLEGRO_FILE *f;
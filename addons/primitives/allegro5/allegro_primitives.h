@@ -153,10 +153,55 @@ struct ALLEGRO_VERTEX {
 };
 #endif
 
+/* Type: ALLEGRO_PRIM_LINE
+ */
+typedef struct ALLEGRO_PRIM_LINE ALLEGRO_PRIM_LINE;
+
+struct ALLEGRO_PRIM_LINE {
+   float x1, y1, x2, y2;
+   ALLEGRO_COLOR color;
+};
+
+/* Type: ALLEGRO_PRIM_RECTANGLE
+ */
+typedef struct ALLEGRO_PRIM_RECTANGLE ALLEGRO_PRIM_RECTANGLE;
+
+struct ALLEGRO_PRIM_RECTANGLE {
+   float x1, y1, x2, y2;
+   ALLEGRO_COLOR color;
+};
+
+/* Type: ALLEGRO_PRIM_ROUNDED_RECTANGLE
+ */
+typedef struct ALLEGRO_PRIM_ROUNDED_RECTANGLE ALLEGRO_PRIM_ROUNDED_RECTANGLE;
+
+struct ALLEGRO_PRIM_ROUNDED_RECTANGLE {
+   float x1, y1, x2, y2;
+   float rx, ry;
+   ALLEGRO_COLOR color;
+};
+
+/* Type: ALLEGRO_PRIM_CIRCLE
+ */
+typedef struct ALLEGRO_PRIM_CIRCLE ALLEGRO_PRIM_CIRCLE;
+
+struct ALLEGRO_PRIM_CIRCLE {
+   float cx, cy, r;
+   ALLEGRO_COLOR color;
+};
+
 /* Type: ALLEGRO_VERTEX_BUFFER
  */
 typedef struct ALLEGRO_VERTEX_BUFFER ALLEGRO_VERTEX_BUFFER;
 
+/* Type: ALLEGRO_INDEX_BUFFER
+ */
+typedef struct ALLEGRO_INDEX_BUFFER ALLEGRO_INDEX_BUFFER;
+
+/* Type: ALLEGRO_STROKE_MESH
+ */
+typedef struct ALLEGRO_STROKE_MESH ALLEGRO_STROKE_MESH;
+
 ALLEGRO_PRIM_FUNC(uint32_t, al_get_allegro_primitives_version, (void));
 
 /*
@@ -179,6 +224,15 @@ ALLEGRO_PRIM_FUNC(void*, al_lock_vertex_buffer, (ALLEGRO_VERTEX_BUFFER* buffer,
 ALLEGRO_PRIM_FUNC(void, al_unlock_vertex_buffer, (ALLEGRO_VERTEX_BUFFER* buffer));
 ALLEGRO_PRIM_FUNC(int, al_draw_vertex_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, int start, int end, int type));
 
+/*
+ * Index buffers
+ */
+ALLEGRO_PRIM_FUNC(ALLEGRO_INDEX_BUFFER*, al_create_index_buffer, (int index_size, const void* initial_data, size_t num_indices, int usage_hints));
+ALLEGRO_PRIM_FUNC(void, al_destroy_index_buffer, (ALLEGRO_INDEX_BUFFER* buffer));
+ALLEGRO_PRIM_FUNC(void*, al_lock_index_buffer, (ALLEGRO_INDEX_BUFFER* buffer, size_t offset, size_t length, int flags));
+ALLEGRO_PRIM_FUNC(void, al_unlock_index_buffer, (ALLEGRO_INDEX_BUFFER* buffer));
+ALLEGRO_PRIM_FUNC(int, al_draw_indexed_buffer, (ALLEGRO_VERTEX_BUFFER* vertex_buffer, ALLEGRO_BITMAP* texture, ALLEGRO_INDEX_BUFFER* index_buffer, int start, int end, int type));
+
 /*
 * Utilities for high level primitives.
 */
@@ -232,6 +286,25 @@ ALLEGRO_PRIM_FUNC(void, al_draw_polygon, (const float* vertices, int vertex_coun
 ALLEGRO_PRIM_FUNC(void, al_draw_filled_polygon, (const float* vertices, int vertex_count, ALLEGRO_COLOR color));
 ALLEGRO_PRIM_FUNC(void, al_draw_filled_polygon_with_holes, (const float* vertices, const int* vertex_counts, ALLEGRO_COLOR color));
 
+/*
+* Batched shapes
+*/
+ALLEGRO_PRIM_FUNC(void, al_draw_lines, (const ALLEGRO_PRIM_LINE* lines, int num_lines, float thickness));
+ALLEGRO_PRIM_FUNC(void, al_draw_rectangles, (const ALLEGRO_PRIM_RECTANGLE* rects, int num_rects, float thickness));
+ALLEGRO_PRIM_FUNC(void, al_draw_filled_rectangles, (const ALLEGRO_PRIM_RECTANGLE* rects, int num_rects));
+ALLEGRO_PRIM_FUNC(void, al_draw_circles, (const ALLEGRO_PRIM_CIRCLE* circles, int num_circles, float thickness));
+ALLEGRO_PRIM_FUNC(void, al_draw_filled_circles, (const ALLEGRO_PRIM_CIRCLE* circles, int num_circles));
+ALLEGRO_PRIM_FUNC(void, al_draw_filled_rounded_rectangles, (const ALLEGRO_PRIM_ROUNDED_RECTANGLE* rects, int num_rects));
+
+/*
+* Stroke meshes
+*/
+ALLEGRO_PRIM_FUNC(ALLEGRO_STROKE_MESH*, al_create_stroke_mesh, (void));
+ALLEGRO_PRIM_FUNC(void, al_destroy_stroke_mesh, (ALLEGRO_STROKE_MESH* mesh));
+ALLEGRO_PRIM_FUNC(bool, al_add_polyline_to_stroke_mesh, (ALLEGRO_STROKE_MESH* mesh, const float* vertices, int vertex_stride, int vertex_count, ALLEGRO_LINE_JOIN join_style, ALLEGRO_LINE_CAP cap_style, float thickness, float miter_limit));
+ALLEGRO_PRIM_FUNC(void, al_clear_stroke_mesh, (ALLEGRO_STROKE_MESH* mesh));
+ALLEGRO_PRIM_FUNC(void, al_draw_stroke_mesh, (ALLEGRO_STROKE_MESH* mesh, ALLEGRO_COLOR color));
+
 
 #ifdef __cplusplus
 }
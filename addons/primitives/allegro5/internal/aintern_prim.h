@@ -23,6 +23,12 @@ typedef struct ALLEGRO_PRIM_VERTEX_CACHE {
    ALLEGRO_COLOR   color;
    int             prim_type;
    void*           user_data;
+   /* When set, triangles are accumulated here and drawn anti-aliased by
+    * _al_prim_cache_term instead of being drawn as they are flushed.
+    */
+   struct ALLEGRO_PRIM_COVERAGE* coverage;
+   /* When set, flushed vertices are retained here instead of being drawn. */
+   ALLEGRO_STROKE_MESH* mesh;
 } ALLEGRO_PRIM_VERTEX_CACHE;
 
 struct ALLEGRO_VERTEX_BUFFER {
@@ -37,12 +43,51 @@ struct ALLEGRO_VERTEX_BUFFER {
    size_t lock_offset;
    size_t lock_length;
    int lock_flags;
+
+   /* Number of vertices in the buffer */
+   size_t size;
+
+   /* Software buffers keep the vertices in memory, in the layout given by
+    * decl, and cache them converted to ALLEGRO_VERTEX (decoded) and then
+    * transformed, so static geometry isn't converted again on every draw.
+    * decoded aliases soft_vertices when there is no decl.
+    */
+   bool is_soft;
+   char* soft_vertices;
+   ALLEGRO_VERTEX* decoded;
+   ALLEGRO_VERTEX* transformed;
+   ALLEGRO_TRANSFORM transform;
+   int texture_w, texture_h;
+   /* Range of vertices changed since the caches were last updated */
+   size_t dirty_start;
+   size_t dirty_end;
+};
+
+struct ALLEGRO_INDEX_BUFFER {
+   int index_size;
+   /* Number of indices in the buffer */
+   size_t size;
+
+   bool is_locked;
+   /* These two are in indices */
+   size_t lock_offset;
+   size_t lock_length;
+   int lock_flags;
+
+   /* Indices as given by the user, and widened to int for drawing.
+    * indices aliases data when index_size is 4.
+    */
+   void* data;
+   int* indices;
 };
 
 /* Internal cache for primitives. */
 void _al_prim_cache_init(ALLEGRO_PRIM_VERTEX_CACHE* cache, int prim_type, ALLEGRO_COLOR color);
 void _al_prim_cache_init_ex(ALLEGRO_PRIM_VERTEX_CACHE* cache, int prim_type, ALLEGRO_COLOR color, void* user_data);
 void _al_prim_cache_term(ALLEGRO_PRIM_VERTEX_CACHE* cache);
+void _al_prim_cache_use_coverage(ALLEGRO_PRIM_VERTEX_CACHE* cache);
+
+void _al_stroke_mesh_add_vertices(ALLEGRO_STROKE_MESH* mesh, int prim_type, const ALLEGRO_VERTEX* vtxs, int num);
 void _al_prim_cache_flush(ALLEGRO_PRIM_VERTEX_CACHE* cache);
 void _al_prim_cache_push_point(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* v);
 void _al_prim_cache_push_triangle(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* v0, const float* v1, const float* v2);
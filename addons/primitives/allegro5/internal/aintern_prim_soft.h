@@ -4,6 +4,8 @@
 struct ALLEGRO_BITMAP;
 struct ALLEGRO_VERTEX;
 
+typedef struct ALLEGRO_PRIM_COVERAGE ALLEGRO_PRIM_COVERAGE;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,9 +13,21 @@ extern "C" {
 int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type);
 int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, const int* indices, int num_vtx, int type);
 
+void _al_convert_vertices_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, ALLEGRO_VERTEX* dest, int start, int end);
+void _al_transform_vertices_soft(const ALLEGRO_TRANSFORM* trans, ALLEGRO_VERTEX* vtxs, int num);
+int _al_draw_transformed_prim_soft(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtxs, int start, int end, int type);
+int _al_draw_transformed_prim_indexed_soft(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtxs, const int* indices, int num_vtx, int type);
+
 void _al_line_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2);
 void _al_point_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v);
 
+bool _al_coverage_wanted(void);
+ALLEGRO_PRIM_COVERAGE* _al_create_coverage(void);
+void _al_destroy_coverage(ALLEGRO_PRIM_COVERAGE* cov);
+void _al_coverage_add_ring(ALLEGRO_PRIM_COVERAGE* cov, const float* vertices, int vertex_stride, int vertex_count, bool reverse);
+void _al_coverage_add_triangle(ALLEGRO_PRIM_COVERAGE* cov, const ALLEGRO_VERTEX* v0, const ALLEGRO_VERTEX* v1, const ALLEGRO_VERTEX* v2);
+void _al_coverage_fill(ALLEGRO_PRIM_COVERAGE* cov, ALLEGRO_COLOR color);
+
 #ifdef __cplusplus
 }
 #endif
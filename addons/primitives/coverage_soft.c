@@ -0,0 +1,429 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Anti-aliased software rasterizer for filled shapes.
+ *
+ *      Edges are accumulated as signed areas into a per-scanline buffer,
+ *      whose running sum is the fraction of each pixel covered by the
+ *      shape. This is exact for non-overlapping shapes and needs no
+ *      supersampling.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include "allegro5/allegro.h"
+#include "allegro5/allegro_primitives.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_blend.h"
+#include "allegro5/internal/aintern_pixels.h"
+#include "allegro5/internal/aintern_shader.h"
+#include "allegro5/internal/aintern_prim.h"
+#include "allegro5/internal/aintern_prim_soft.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+ALLEGRO_DEBUG_CHANNEL("primitives")
+
+/* Coverage below this is not drawn at all. */
+#define MIN_COVERAGE (1.0f / 512)
+
+typedef struct COVERAGE_EDGE {
+   float x0, y0, x1, y1;   /* y0 < y1, in target coordinates */
+   float dir;              /* +1 or -1, the original direction of the edge */
+} COVERAGE_EDGE;
+
+struct ALLEGRO_PRIM_COVERAGE {
+   ALLEGRO_TRANSFORM transform;
+   COVERAGE_EDGE* edges;
+   int num_edges;
+   int edges_capacity;
+};
+
+/* Returns true if filled shapes should be drawn with
+ * the coverage rasterizer.
+ */
+bool _al_coverage_wanted(void)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   ALLEGRO_CONFIG* cfg;
+   const char* value;
+
+   if (!target || !(al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP))
+      return false;
+   /* The coverage rasterizer does not run software shaders. */
+   if (_al_get_soft_shader(target))
+      return false;
+
+   cfg = al_get_system_config();
+   value = cfg ? al_get_config_value(cfg, "primitives", "antialias") : NULL;
+   return value && (!_al_stricmp(value, "true") || !strcmp(value, "1"));
+}
+
+ALLEGRO_PRIM_COVERAGE* _al_create_coverage(void)
+{
+   ALLEGRO_PRIM_COVERAGE* cov = al_calloc(1, sizeof(ALLEGRO_PRIM_COVERAGE));
+   if (!cov)
+      return NULL;
+   al_copy_transform(&cov->transform, al_get_current_transform());
+   return cov;
+}
+
+void _al_destroy_coverage(ALLEGRO_PRIM_COVERAGE* cov)
+{
+   if (!cov)
+      return;
+   al_free(cov->edges);
+   al_free(cov);
+}
+
+/* Adds an edge in target coordinates. */
+static void add_edge(ALLEGRO_PRIM_COVERAGE* cov, float x0, float y0, float x1, float y1)
+{
+   COVERAGE_EDGE* e;
+
+   /* Horizontal edges don't contribute anything. */
+   if (y0 == y1)
+      return;
+
+   if (cov->num_edges == cov->edges_capacity) {
+      int capacity = cov->edges_capacity ? 2 * cov->edges_capacity : 64;
+      COVERAGE_EDGE* edges = al_realloc(cov->edges, capacity * sizeof(COVERAGE_EDGE));
+      if (!edges)
+         return;
+      cov->edges = edges;
+      cov->edges_capacity = capacity;
+   }
+
+   e = &cov->edges[cov->num_edges++];
+   if (y0 < y1) {
+      e->x0 = x0; e->y0 = y0;
+      e->x1 = x1; e->y1 = y1;
+      e->dir = 1;
+   } else {
+      e->x0 = x1; e->y0 = y1;
+      e->x1 = x0; e->y1 = y0;
+      e->dir = -1;
+   }
+}
+
+/* Adds a closed ring of vertices. Rings wound in opposite directions
+ * cancel out, so holes must be passed with reverse set if they wind the
+ * same way as the outline.
+ */
+void _al_coverage_add_ring(ALLEGRO_PRIM_COVERAGE* cov, const float* vertices,
+   int vertex_stride, int vertex_count, bool reverse)
+{
+   float first_x, first_y, prev_x, prev_y;
+   int ii;
+
+   if (vertex_count < 3)
+      return;
+
+#define VERTEX(index) \
+   ((const float*)((const char*)vertices + vertex_stride * (reverse ? vertex_count - 1 - (index) : (index))))
+
+   first_x = VERTEX(0)[0];
+   first_y = VERTEX(0)[1];
+   al_transform_coordinates(&cov->transform, &first_x, &first_y);
+   prev_x = first_x;
+   prev_y = first_y;
+
+   for (ii = 1; ii < vertex_count; ii++) {
+      float x = VERTEX(ii)[0];
+      float y = VERTEX(ii)[1];
+      al_transform_coordinates(&cov->transform, &x, &y);
+      add_edge(cov, prev_x, prev_y, x, y);
+      prev_x = x;
+      prev_y = y;
+   }
+   add_edge(cov, prev_x, prev_y, first_x, first_y);
+
+#undef VERTEX
+}
+
+/* Adds a triangle. Triangles are always added with the same winding, so
+ * that edges shared by adjacent triangles cancel and overlapping triangles
+ * add up instead of cutting holes into each other.
+ */
+void _al_coverage_add_triangle(ALLEGRO_PRIM_COVERAGE* cov, const ALLEGRO_VERTEX* v0,
+   const ALLEGRO_VERTEX* v1, const ALLEGRO_VERTEX* v2)
+{
+   float x[3], y[3];
+   float area;
+
+   x[0] = v0->x; y[0] = v0->y;
+   x[1] = v1->x; y[1] = v1->y;
+   x[2] = v2->x; y[2] = v2->y;
+   al_transform_coordinates(&cov->transform, &x[0], &y[0]);
+   al_transform_coordinates(&cov->transform, &x[1], &y[1]);
+   al_transform_coordinates(&cov->transform, &x[2], &y[2]);
+
+   area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+   if (area == 0)
+      return;
+   if (area > 0) {
+      add_edge(cov, x[0], y[0], x[1], y[1]);
+      add_edge(cov, x[1], y[1], x[2], y[2]);
+      add_edge(cov, x[2], y[2], x[0], y[0]);
+   } else {
+      add_edge(cov, x[0], y[0], x[2], y[2]);
+      add_edge(cov, x[2], y[2], x[1], y[1]);
+      add_edge(cov, x[1], y[1], x[0], y[0]);
+   }
+}
+
+static int compare_edges(const void* a, const void* b)
+{
+   const COVERAGE_EDGE* ea = a;
+   const COVERAGE_EDGE* eb = b;
+   return (ea->y0 > eb->y0) - (ea->y0 < eb->y0);
+}
+
+/*
+ * Accumulates the signed area to the right of a segment lying within one
+ * scanline (0 <= y0 < y1 <= 1) into acc. The x coordinates are in
+ * [0, width], so acc needs width + 2 entries.
+ */
+static void accumulate(float* acc, float x0, float y0, float x1, float y1, float dir)
+{
+   float d = dir * (y1 - y0);
+   float xmin = _ALLEGRO_MIN(x0, x1);
+   float xmax = _ALLEGRO_MAX(x0, x1);
+   float xmin_floor = floorf(xmin);
+   int ximin = (int)xmin_floor;
+   int ximax = (int)ceilf(xmax);
+
+   if (ximax <= ximin + 1) {
+      /* The segment stays within one pixel column. */
+      float xmid = 0.5f * (x0 + x1) - xmin_floor;
+      acc[ximin] += d - d * xmid;
+      acc[ximin + 1] += d * xmid;
+   }
+   else {
+      float s = 1.0f / (xmax - xmin);
+      float xf0 = xmin - xmin_floor;
+      float xf1 = xmax - ceilf(xmax) + 1.0f;
+      float a0 = 0.5f * s * (1.0f - xf0) * (1.0f - xf0);
+      float am = 0.5f * s * xf1 * xf1;
+
+      acc[ximin] += d * a0;
+      if (ximax == ximin + 2) {
+         acc[ximin + 1] += d * (1.0f - a0 - am);
+      }
+      else {
+         float a1 = s * (1.5f - xf0);
+         float a2;
+         int xi;
+
+         acc[ximin + 1] += d * (a1 - a0);
+         for (xi = ximin + 2; xi < ximax - 1; xi++)
+            acc[xi] += d * s;
+         a2 = a1 + (ximax - ximin - 3) * s;
+         acc[ximax - 1] += d * (1.0f - a2 - am);
+      }
+      acc[ximax] += d * am;
+   }
+}
+
+/*
+ * Like accumulate, but for segments that may leave [0, width]. Parts to the
+ * left still cover the whole row, so they are moved onto the left edge;
+ * parts to the right can't affect any visible pixel and are dropped.
+ */
+static void accumulate_clipped(float* acc, int width, float x0, float y0, float x1, float y1, float dir)
+{
+   if ((x0 < 0) != (x1 < 0)) {
+      float ym = y0 + (0 - x0) * (y1 - y0) / (x1 - x0);
+      accumulate_clipped(acc, width, x0, y0, 0, ym, dir);
+      accumulate_clipped(acc, width, 0, ym, x1, y1, dir);
+      return;
+   }
+   if ((x0 > width) != (x1 > width)) {
+      float ym = y0 + (width - x0) * (y1 - y0) / (x1 - x0);
+      accumulate_clipped(acc, width, x0, y0, width, ym, dir);
+      accumulate_clipped(acc, width, width, ym, x1, y1, dir);
+      return;
+   }
+   if (x0 > width)
+      return;
+   if (x0 < 0) {
+      x0 = 0;
+      x1 = 0;
+   }
+   if (y1 > y0)
+      accumulate(acc, x0, y0, x1, y1, dir);
+}
+
+/* Fills the accumulated shape with a color, blended with the current
+ * blender according to how much of each pixel it covers.
+ */
+void _al_coverage_fill(ALLEGRO_PRIM_COVERAGE* cov, ALLEGRO_COLOR color)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
+   int clip_x, clip_y, clip_w, clip_h;
+   float min_x, max_x, min_y, max_y;
+   int x0, y0, x1, y1, width;
+   int first_active, num_active;
+   int next_edge;
+   bool scale_rgb;
+   ALLEGRO_LOCKED_REGION* lr = NULL;
+   float* acc;
+   int ii, y;
+
+   if (cov->num_edges == 0)
+      return;
+
+   min_x = max_x = cov->edges[0].x0;
+   min_y = cov->edges[0].y0;
+   max_y = cov->edges[0].y1;
+   for (ii = 0; ii < cov->num_edges; ii++) {
+      const COVERAGE_EDGE* e = &cov->edges[ii];
+      min_x = _ALLEGRO_MIN(min_x, _ALLEGRO_MIN(e->x0, e->x1));
+      max_x = _ALLEGRO_MAX(max_x, _ALLEGRO_MAX(e->x0, e->x1));
+      min_y = _ALLEGRO_MIN(min_y, e->y0);
+      max_y = _ALLEGRO_MAX(max_y, e->y1);
+   }
+
+   al_get_clipping_rectangle(&clip_x, &clip_y, &clip_w, &clip_h);
+   x0 = _ALLEGRO_MAX(clip_x, (int)floorf(_ALLEGRO_MAX(min_x, -1e9f)));
+   y0 = _ALLEGRO_MAX(clip_y, (int)floorf(_ALLEGRO_MAX(min_y, -1e9f)));
+   x1 = _ALLEGRO_MIN(clip_x + clip_w, (int)ceilf(_ALLEGRO_MIN(max_x, 1e9f)));
+   y1 = _ALLEGRO_MIN(clip_y + clip_h, (int)ceilf(_ALLEGRO_MIN(max_y, 1e9f)));
+   if (x0 >= x1 || y0 >= y1)
+      return;
+   width = x1 - x0;
+
+   acc = al_calloc(width + 2, sizeof(float));
+   if (!acc)
+      return;
+
+   if (al_is_bitmap_locked(target)) {
+      if (!_al_bitmap_region_is_locked(target, x0, y0, width, y1 - y0)) {
+         al_free(acc);
+         return;
+      }
+   }
+   else {
+      /* We hold the lock ourselves, so pixels can be blended directly into
+       * the locked region instead of going through al_put_blended_pixel.
+       */
+      lr = al_lock_bitmap_region(target, x0, y0, width, y1 - y0,
+         ALLEGRO_PIXEL_FORMAT_ANY, 0);
+      if (!lr) {
+         al_free(acc);
+         return;
+      }
+   }
+
+   /* Partial coverage is expressed through alpha. With premultiplied
+    * colors the color channels have to be scaled along with it, unless
+    * the blender multiplies them by alpha itself.
+    */
+   al_get_separate_blender(&op, &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
+   scale_rgb = src_mode != ALLEGRO_ALPHA;
+
+   qsort(cov->edges, cov->num_edges, sizeof(COVERAGE_EDGE), compare_edges);
+
+   /*
+    * The edges are sorted by their top, so the edges crossing a scanline
+    * are a window [first_active, next_edge) of the array, minus those that
+    * already ended. Ended edges are swapped to the front of the window.
+    */
+   first_active = 0;
+   next_edge = 0;
+
+   for (y = y0; y < y1; y++) {
+      float row_top = (float)y;
+      float row_bottom = row_top + 1;
+      float sum;
+      int min_touched = width + 1;
+      int max_touched = -1;
+
+      while (next_edge < cov->num_edges && cov->edges[next_edge].y0 < row_bottom)
+         next_edge++;
+
+      for (ii = first_active; ii < next_edge; ii++) {
+         COVERAGE_EDGE* e = &cov->edges[ii];
+         float ya, yb, xa, xb, slope;
+
+         if (e->y1 <= row_top) {
+            /* Finished; move it out of the window. */
+            COVERAGE_EDGE tmp = cov->edges[first_active];
+            cov->edges[first_active] = *e;
+            *e = tmp;
+            first_active++;
+            continue;
+         }
+
+         ya = _ALLEGRO_MAX(e->y0, row_top);
+         yb = _ALLEGRO_MIN(e->y1, row_bottom);
+         if (yb <= ya)
+            continue;
+
+         slope = (e->x1 - e->x0) / (e->y1 - e->y0);
+         xa = e->x0 + (ya - e->y0) * slope - x0;
+         xb = e->x0 + (yb - e->y0) * slope - x0;
+
+         accumulate_clipped(acc, width, xa, ya - row_top, xb, yb - row_top, e->dir);
+
+         min_touched = _ALLEGRO_MIN(min_touched, (int)floorf(_ALLEGRO_MAX(0, _ALLEGRO_MIN(xa, xb))));
+         max_touched = _ALLEGRO_MAX(max_touched, (int)ceilf(_ALLEGRO_MIN(width, _ALLEGRO_MAX(xa, xb))) + 1);
+      }
+
+      if (max_touched < 0)
+         continue;
+
+      /* Resolve the row. */
+      sum = 0;
+      num_active = _ALLEGRO_MIN(max_touched, width);
+      for (ii = min_touched; ii < num_active; ii++) {
+         float coverage;
+
+         sum += acc[ii];
+         acc[ii] = 0;
+         coverage = fabsf(sum);
+         if (coverage > 1)
+            coverage = 1;
+
+         if (coverage >= MIN_COVERAGE) {
+            ALLEGRO_COLOR c = color;
+            c.a *= coverage;
+            if (scale_rgb) {
+               c.r *= coverage;
+               c.g *= coverage;
+               c.b *= coverage;
+            }
+            if (lr) {
+               uint8_t* data = (uint8_t*)lr->data + (y - y0) * lr->pitch + ii * lr->pixel_size;
+               ALLEGRO_COLOR dst, result;
+               _AL_INLINE_GET_PIXEL(lr->format, data, dst, false);
+               _al_blend_inline(&c, &dst, op, src_mode, dst_mode,
+                  op_alpha, src_alpha, dst_alpha, &result);
+               _AL_INLINE_PUT_PIXEL(lr->format, data, result, false);
+            }
+            else {
+               al_put_blended_pixel(x0 + ii, y, c);
+            }
+         }
+      }
+      for (; ii <= max_touched && ii < width + 2; ii++)
+         acc[ii] = 0;
+   }
+
+   if (lr)
+      al_unlock_bitmap(target);
+
+   al_free(acc);
+}
+
+/* vim: set sts=3 sw=3 et: */
@@ -41,8 +41,10 @@
 #ifdef ALLEGRO_CFG_OPENGL
 #include "allegro5/allegro_opengl.h"
 #endif
+#include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include <math.h>
+#include <string.h>
 
 #ifdef ALLEGRO_MSVC
    #define hypotf(x, y) _hypotf((x), (y))
@@ -59,6 +61,58 @@ static float get_scale(void)
    return (hypotf(t->m[0][0], t->m[0][1]) + hypotf(t->m[1][0], t->m[1][1])) / 2;
 }
 
+/*
+ * Returns how many segments a curve needs to look smooth when drawn with
+ * the current transformation. A segment spanning an angle a of a circle of
+ * radius r deviates from it by about r * a^2 / 8, so keeping that error
+ * constant on screen takes a number of segments proportional to the square
+ * root of the radius on screen. ALLEGRO_PRIM_QUALITY sets the factor.
+ *
+ * No more than two segments per pixel of the perimeter of the clipping
+ * rectangle are used for a full turn, however big the curve, which bounds the
+ * vertices of a single shape by the size of the target. Only curves much
+ * larger than the target reach that limit; they come out with a larger
+ * error than ALLEGRO_PRIM_QUALITY asks for.
+ *
+ * turns is the fraction of a full circle that the curve spans, radius its
+ * (average) radius before transformation.
+ */
+static int get_num_segments(float turns, float radius)
+{
+   float num_segments = fabsf(turns) * ALLEGRO_PRIM_QUALITY * sqrtf(get_scale() * radius);
+   float max_segments = ALLEGRO_VERTEX_CACHE_SIZE;
+   int cx, cy, cw, ch;
+
+   if (al_get_target_bitmap()) {
+      al_get_clipping_rectangle(&cx, &cy, &cw, &ch);
+      max_segments = _ALLEGRO_MAX(max_segments, 4.0f * (cw + ch));
+   }
+   /* An arc going round more than once covers the same pixels again. */
+   max_segments *= _ALLEGRO_MIN(fabsf(turns), 1.0f);
+
+   /* Also catches NaN. */
+   if (!(num_segments < max_segments))
+      return (int)max_segments;
+   return (int)num_segments;
+}
+
+/*
+ * Returns room for num vertices: the local cache when they fit, otherwise a
+ * heap block. Release it with free_vertices.
+ */
+static ALLEGRO_VERTEX* alloc_vertices(ALLEGRO_VERTEX* cache, int num)
+{
+   if (num <= ALLEGRO_VERTEX_CACHE_SIZE)
+      return cache;
+   return al_malloc(num * sizeof(ALLEGRO_VERTEX));
+}
+
+static void free_vertices(ALLEGRO_VERTEX* cache, ALLEGRO_VERTEX* vtxs)
+{
+   if (vtxs != cache)
+      al_free(vtxs);
+}
+
 /* Function: al_draw_line
  */
 void al_draw_line(float x1, float y1, float x2, float y2,
@@ -492,7 +546,7 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
    float delta_theta, ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   ALLEGRO_VERTEX* vtx;
    int num_segments, ii;
    
    ASSERT(r >= 0);
@@ -504,24 +558,25 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
    }
    
    if (thickness <= 0) {
-      num_segments = fabsf(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * scale * sqrtf(r));
+      num_segments = get_num_segments(delta_theta / (2 * ALLEGRO_PI), r);
 
       if (num_segments < 2)
          num_segments = 2;
       
-      if (num_segments + 1 >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1 - 1;
-      }
+      vtx = alloc_vertices(vertex_cache, num_segments + 1);
+      if (!vtx)
+         return;
          
-      al_calculate_arc(&(vertex_cache[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r, r, start_theta, delta_theta, 0, num_segments);
-      vertex_cache[0].x = cx; vertex_cache[0].y = cy;
+      al_calculate_arc(&(vtx[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r, r, start_theta, delta_theta, 0, num_segments);
+      vtx[0].x = cx; vtx[0].y = cy;
       
       for (ii = 0; ii < num_segments + 1; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
       
-      al_draw_prim(vertex_cache, 0, 0, 0, num_segments + 1, ALLEGRO_PRIM_LINE_LOOP);
+      al_draw_prim(vtx, 0, 0, 0, num_segments + 1, ALLEGRO_PRIM_LINE_LOOP);
+      free_vertices(vertex_cache, vtx);
    } else {
       float ht = thickness / 2;
       float inner_side_angle = asinf(ht / (r - ht));
@@ -547,18 +602,19 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
          
          al_draw_arc(cx, cy, r, central_start_angle, central_angle, color, thickness);
          
-         vertex_cache[0].x = cx + (r - thickness / 2) * cosf(central_start_angle);
-         vertex_cache[0].y = cy + (r - thickness / 2) * sinf(central_start_angle);
-         
-         num_segments = (inner_side_angle + outer_side_angle) / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * scale * sqrtf(r + ht);
+         num_segments = get_num_segments((inner_side_angle + outer_side_angle) / (2 * ALLEGRO_PI), r + ht);
          
          if (num_segments < 2)
             num_segments = 2;
          
-         if (num_segments + extra_vtx >= ALLEGRO_VERTEX_CACHE_SIZE)
-            num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1 - extra_vtx;
+         vtx = alloc_vertices(vertex_cache, num_segments + extra_vtx);
+         if (!vtx)
+            return;
+         
+         vtx[0].x = cx + (r - thickness / 2) * cosf(central_start_angle);
+         vtx[0].y = cy + (r - thickness / 2) * sinf(central_start_angle);
            
-         al_calculate_arc(&(vertex_cache[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r + ht, r + ht, central_start_angle, -(outer_side_angle + inner_side_angle), 0, num_segments);
+         al_calculate_arc(&(vtx[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r + ht, r + ht, central_start_angle, -(outer_side_angle + inner_side_angle), 0, num_segments);
          
          /* Do the tip */
          vtx_id = num_segments + 1 + (inverted_winding ? (1 + (blunt_tip ? 1 : 0)) : 0);
@@ -568,76 +624,79 @@ void al_draw_pieslice(float cx, float cy, float r, float start_theta,
             float vy = ht * (-side_dir_x * (inverted_winding ? -1 : 1) - side_dir_y);
             float dot = vx * midpoint_dir_x + vy * midpoint_dir_y;
             
-            vertex_cache[vtx_id].x = cx + vx;
-            vertex_cache[vtx_id].y = cy + vy;
+            vtx[vtx_id].x = cx + vx;
+            vtx[vtx_id].y = cy + vy;
             vtx_id += vtx_delta;
             
-            vertex_cache[vtx_id].x = cx + dot * midpoint_dir_x;
-            vertex_cache[vtx_id].y = cy + dot * midpoint_dir_y;
+            vtx[vtx_id].x = cx + dot * midpoint_dir_x;
+            vtx[vtx_id].y = cy + dot * midpoint_dir_y;
          } else {
-            vertex_cache[vtx_id].x = cx - connect_len * midpoint_dir_x;
-            vertex_cache[vtx_id].y = cy - connect_len * midpoint_dir_y;
+            vtx[vtx_id].x = cx - connect_len * midpoint_dir_x;
+            vtx[vtx_id].y = cy - connect_len * midpoint_dir_y;
          }
          vtx_id += vtx_delta;
          
          if(connect_len > r - ht)
             connect_len = r - ht;
-         vertex_cache[vtx_id].x = cx + connect_len * midpoint_dir_x;
-         vertex_cache[vtx_id].y = cy + connect_len * midpoint_dir_y;
+         vtx[vtx_id].x = cx + connect_len * midpoint_dir_x;
+         vtx[vtx_id].y = cy + connect_len * midpoint_dir_y;
          
          for (ii = 0; ii < num_segments + extra_vtx; ii++) {
-            vertex_cache[ii].color = color;
-            vertex_cache[ii].z = 0;
+            vtx[ii].color = color;
+            vtx[ii].z = 0;
          }
          
-         al_draw_prim(vertex_cache, 0, 0, 0, num_segments + extra_vtx, ALLEGRO_PRIM_TRIANGLE_FAN);
+         al_draw_prim(vtx, 0, 0, 0, num_segments + extra_vtx, ALLEGRO_PRIM_TRIANGLE_FAN);
          
          /* Mirror the vertices and draw them again */
          for (ii = 0; ii < num_segments + extra_vtx; ii++) {
-            float dot = (vertex_cache[ii].x - cx) * midpoint_dir_x + (vertex_cache[ii].y - cy) * midpoint_dir_y;
-            vertex_cache[ii].x = 2 * cx + 2 * dot * midpoint_dir_x - vertex_cache[ii].x;
-            vertex_cache[ii].y = 2 * cy + 2 * dot * midpoint_dir_y - vertex_cache[ii].y;
+            float dot = (vtx[ii].x - cx) * midpoint_dir_x + (vtx[ii].y - cy) * midpoint_dir_y;
+            vtx[ii].x = 2 * cx + 2 * dot * midpoint_dir_x - vtx[ii].x;
+            vtx[ii].y = 2 * cy + 2 * dot * midpoint_dir_y - vtx[ii].y;
          }
          
-         al_draw_prim(vertex_cache, 0, 0, 0, num_segments + extra_vtx, ALLEGRO_PRIM_TRIANGLE_FAN);
+         al_draw_prim(vtx, 0, 0, 0, num_segments + extra_vtx, ALLEGRO_PRIM_TRIANGLE_FAN);
+         free_vertices(vertex_cache, vtx);
       } else {
          /* Apex: 2 vertices if the apex is blunt) */
          int extra_vtx = blunt_tip ? 2 : 1;
          
-         num_segments = (2 * outer_side_angle) / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * scale * sqrtf(r + ht);
+         num_segments = get_num_segments((2 * outer_side_angle) / (2 * ALLEGRO_PI), r + ht);
          
          if (num_segments < 2)
             num_segments = 2;
          
-         if (num_segments + extra_vtx >= ALLEGRO_VERTEX_CACHE_SIZE)
-            num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1 - extra_vtx;
+         vtx = alloc_vertices(vertex_cache, num_segments + extra_vtx);
+         if (!vtx)
+            return;
            
-         al_calculate_arc(&(vertex_cache[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r + ht, r + ht, start_theta - outer_side_angle, 2 * outer_side_angle + delta_theta, 0, num_segments);
+         al_calculate_arc(&(vtx[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r + ht, r + ht, start_theta - outer_side_angle, 2 * outer_side_angle + delta_theta, 0, num_segments);
          
          if (blunt_tip) {
             float vx = ht * (side_dir_y - side_dir_x);
             float vy = ht * (-side_dir_x - side_dir_y);
             float dot = vx * midpoint_dir_x + vy * midpoint_dir_y;
             
-            vertex_cache[0].x = cx + vx;
-            vertex_cache[0].y = cy + vy;
+            vtx[0].x = cx + vx;
+            vtx[0].y = cy + vy;
             
             vx = 2 * dot * midpoint_dir_x - vx;
             vy = 2 * dot * midpoint_dir_y - vy;
             
-            vertex_cache[num_segments + 1].x = cx + vx;
-            vertex_cache[num_segments + 1].y = cy + vy;
+            vtx[num_segments + 1].x = cx + vx;
+            vtx[num_segments + 1].y = cy + vy;
          } else {
-            vertex_cache[0].x = cx - connect_len * midpoint_dir_x;
-            vertex_cache[0].y = cy - connect_len * midpoint_dir_y;
+            vtx[0].x = cx - connect_len * midpoint_dir_x;
+            vtx[0].y = cy - connect_len * midpoint_dir_y;
          }
          
          for (ii = 0; ii < num_segments + extra_vtx; ii++) {
-            vertex_cache[ii].color = color;
-            vertex_cache[ii].z = 0;
+            vtx[ii].color = color;
+            vtx[ii].z = 0;
          }
          
-         al_draw_prim(vertex_cache, 0, 0, 0, num_segments + extra_vtx, ALLEGRO_PRIM_TRIANGLE_FAN);
+         al_draw_prim(vtx, 0, 0, 0, num_segments + extra_vtx, ALLEGRO_PRIM_TRIANGLE_FAN);
+         free_vertices(vertex_cache, vtx);
       }
    }
 }
@@ -648,29 +707,30 @@ void al_draw_filled_pieslice(float cx, float cy, float r, float start_theta,
    float delta_theta, ALLEGRO_COLOR color)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   ALLEGRO_VERTEX* vtx;
    int num_segments, ii;
    
    ASSERT(r >= 0);
    
-   num_segments = fabsf(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * scale * sqrtf(r));
+   num_segments = get_num_segments(delta_theta / (2 * ALLEGRO_PI), r);
 
    if (num_segments < 2)
       num_segments = 2;
    
-   if (num_segments + 1 >= ALLEGRO_VERTEX_CACHE_SIZE) {
-      num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1 - 1;
-   }
+   vtx = alloc_vertices(vertex_cache, num_segments + 1);
+   if (!vtx)
+      return;
       
-   al_calculate_arc(&(vertex_cache[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r, r, start_theta, delta_theta, 0, num_segments);
-   vertex_cache[0].x = cx; vertex_cache[0].y = cy;
+   al_calculate_arc(&(vtx[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, r, r, start_theta, delta_theta, 0, num_segments);
+   vtx[0].x = cx; vtx[0].y = cy;
    
    for (ii = 0; ii < num_segments + 1; ii++) {
-      vertex_cache[ii].color = color;
-      vertex_cache[ii].z = 0;
+      vtx[ii].color = color;
+      vtx[ii].z = 0;
    }
    
-   al_draw_prim(vertex_cache, 0, 0, 0, num_segments + 1, ALLEGRO_PRIM_TRIANGLE_FAN);
+   al_draw_prim(vtx, 0, 0, 0, num_segments + 1, ALLEGRO_PRIM_TRIANGLE_FAN);
+   free_vertices(vertex_cache, vtx);
 }
 
 /* Function: al_draw_ellipse
@@ -679,49 +739,51 @@ void al_draw_ellipse(float cx, float cy, float rx, float ry,
    ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   ALLEGRO_VERTEX* vtx;
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
 
    if (thickness > 0) {
-      int num_segments = ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f);
+      int num_segments = get_num_segments(1, (rx + ry) / 2.0f);
       int ii;
 
       /* In case rx and ry are both 0. */
       if (num_segments < 2)
          return;
 
-      if (2 * num_segments >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = (ALLEGRO_VERTEX_CACHE_SIZE - 1) / 2;
-      }
+      vtx = alloc_vertices(vertex_cache, 2 * num_segments);
+      if (!vtx)
+         return;
       
-      al_calculate_arc(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, 0, ALLEGRO_PI * 2, thickness, num_segments);
+      al_calculate_arc(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, 0, ALLEGRO_PI * 2, thickness, num_segments);
       for (ii = 0; ii < 2 * num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
          
-      al_draw_prim(vertex_cache, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      free_vertices(vertex_cache, vtx);
    } else {
-      int num_segments = ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f);
+      int num_segments = get_num_segments(1, (rx + ry) / 2.0f);
       int ii;
       
       /* In case rx and ry are both 0. */
       if (num_segments < 2)
          return;
 
-      if (num_segments >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1;
-      }
+      vtx = alloc_vertices(vertex_cache, num_segments);
+      if (!vtx)
+         return;
 
-      al_calculate_arc(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, 0, ALLEGRO_PI * 2, 0, num_segments);
+      al_calculate_arc(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, 0, ALLEGRO_PI * 2, 0, num_segments);
       for (ii = 0; ii < num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
          
-      al_draw_prim(vertex_cache, 0, 0, 0, num_segments - 1, ALLEGRO_PRIM_LINE_LOOP);
+      al_draw_prim(vtx, 0, 0, 0, num_segments - 1, ALLEGRO_PRIM_LINE_LOOP);
+      free_vertices(vertex_cache, vtx);
    }
 }
 
@@ -731,13 +793,13 @@ void al_draw_filled_ellipse(float cx, float cy, float rx, float ry,
    ALLEGRO_COLOR color)
 {
    LOCAL_VERTEX_CACHE;
+   ALLEGRO_VERTEX* vtx;
    int num_segments, ii;
-   float scale = get_scale();
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
    
-   num_segments = ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f);
+   num_segments = get_num_segments(1, (rx + ry) / 2.0f);
 
    /* In case rx and ry are both close to 0. If al_calculate_arc is passed
     * 0 or 1 it will assert.
@@ -745,19 +807,20 @@ void al_draw_filled_ellipse(float cx, float cy, float rx, float ry,
    if (num_segments < 2)
       return;
    
-   if (num_segments >= ALLEGRO_VERTEX_CACHE_SIZE) {
-      num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1;
-   }
+   vtx = alloc_vertices(vertex_cache, num_segments + 1);
+   if (!vtx)
+      return;
       
-   al_calculate_arc(&(vertex_cache[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, 0, ALLEGRO_PI * 2, 0, num_segments);
-   vertex_cache[0].x = cx; vertex_cache[0].y = cy;
+   al_calculate_arc(&(vtx[1].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, 0, ALLEGRO_PI * 2, 0, num_segments);
+   vtx[0].x = cx; vtx[0].y = cy;
    
    for (ii = 0; ii < num_segments + 1; ii++) {
-      vertex_cache[ii].color = color;
-      vertex_cache[ii].z = 0;
+      vtx[ii].color = color;
+      vtx[ii].z = 0;
    }
    
-   al_draw_prim(vertex_cache, 0, 0, 0, num_segments + 1, ALLEGRO_PRIM_TRIANGLE_FAN);
+   al_draw_prim(vtx, 0, 0, 0, num_segments + 1, ALLEGRO_PRIM_TRIANGLE_FAN);
+   free_vertices(vertex_cache, vtx);
 }
 
 /* Function: al_draw_circle
@@ -781,47 +844,49 @@ void al_draw_elliptical_arc(float cx, float cy, float rx, float ry, float start_
    float delta_theta, ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   ALLEGRO_VERTEX* vtx;
 
    ASSERT(rx >= 0 && ry >= 0);
    if (thickness > 0) {
-      int num_segments = fabsf(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f));
+      int num_segments = get_num_segments(delta_theta / (2 * ALLEGRO_PI), (rx + ry) / 2.0f);
       int ii;
 
       if (num_segments < 2)
          num_segments = 2;
 
-      if (2 * num_segments >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = (ALLEGRO_VERTEX_CACHE_SIZE - 1) / 2;
-      }
+      vtx = alloc_vertices(vertex_cache, 2 * num_segments);
+      if (!vtx)
+         return;
 
-      al_calculate_arc(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, start_theta, delta_theta, thickness, num_segments);
+      al_calculate_arc(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, start_theta, delta_theta, thickness, num_segments);
       
       for (ii = 0; ii < 2 * num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
       
-      al_draw_prim(vertex_cache, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      free_vertices(vertex_cache, vtx);
    } else {
-      int num_segments = fabsf(delta_theta / (2 * ALLEGRO_PI) * ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f));
+      int num_segments = get_num_segments(delta_theta / (2 * ALLEGRO_PI), (rx + ry) / 2.0f);
       int ii;
 
       if (num_segments < 2)
          num_segments = 2;
 
-      if (num_segments >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1;
-      }
+      vtx = alloc_vertices(vertex_cache, num_segments);
+      if (!vtx)
+         return;
       
-      al_calculate_arc(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, start_theta, delta_theta, 0, num_segments);
+      al_calculate_arc(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), cx, cy, rx, ry, start_theta, delta_theta, 0, num_segments);
       
       for (ii = 0; ii < num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
       
-      al_draw_prim(vertex_cache, 0, 0, 0, num_segments, ALLEGRO_PRIM_LINE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, num_segments, ALLEGRO_PRIM_LINE_STRIP);
+      free_vertices(vertex_cache, vtx);
    }
 }
 
@@ -839,13 +904,13 @@ void al_draw_rounded_rectangle(float x1, float y1, float x2, float y2,
    float rx, float ry, ALLEGRO_COLOR color, float thickness)
 {
    LOCAL_VERTEX_CACHE;
-   float scale = get_scale();
+   ALLEGRO_VERTEX* vtx;
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
 
    if (thickness > 0) {
-      int num_segments = ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f) / 4;
+      int num_segments = get_num_segments(0.25f, (rx + ry) / 2.0f);
       int ii;
 
       /* In case rx and ry are both 0. */
@@ -854,45 +919,46 @@ void al_draw_rounded_rectangle(float x1, float y1, float x2, float y2,
          return;
       }
 
-      if (8 * num_segments + 2 >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = (ALLEGRO_VERTEX_CACHE_SIZE - 3) / 8;
-      }
+      vtx = alloc_vertices(vertex_cache, 8 * num_segments + 2);
+      if (!vtx)
+         return;
       
-      al_calculate_arc(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), 0, 0, rx, ry, 0, ALLEGRO_PI / 2, thickness, num_segments);
+      al_calculate_arc(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), 0, 0, rx, ry, 0, ALLEGRO_PI / 2, thickness, num_segments);
       
       for (ii = 0; ii < 2 * num_segments; ii += 2) {
-         vertex_cache[ii + 2 * num_segments + 1].x = x1 + rx - vertex_cache[2 * num_segments - 1 - ii].x;
-         vertex_cache[ii + 2 * num_segments + 1].y = y1 + ry - vertex_cache[2 * num_segments - 1 - ii].y;
-         vertex_cache[ii + 2 * num_segments].x = x1 + rx - vertex_cache[2 * num_segments - 1 - ii - 1].x;
-         vertex_cache[ii + 2 * num_segments].y = y1 + ry - vertex_cache[2 * num_segments - 1 - ii - 1].y;
-
-         vertex_cache[ii + 4 * num_segments].x = x1 + rx - vertex_cache[ii].x;
-         vertex_cache[ii + 4 * num_segments].y = y2 - ry + vertex_cache[ii].y;
-         vertex_cache[ii + 4 * num_segments + 1].x = x1 + rx - vertex_cache[ii + 1].x;
-         vertex_cache[ii + 4 * num_segments + 1].y = y2 - ry + vertex_cache[ii + 1].y;
-
-         vertex_cache[ii + 6 * num_segments + 1].x = x2 - rx + vertex_cache[2 * num_segments - 1 - ii].x;
-         vertex_cache[ii + 6 * num_segments + 1].y = y2 - ry + vertex_cache[2 * num_segments - 1 - ii].y;
-         vertex_cache[ii + 6 * num_segments].x = x2 - rx + vertex_cache[2 * num_segments - 1 - ii - 1].x;
-         vertex_cache[ii + 6 * num_segments].y = y2 - ry + vertex_cache[2 * num_segments - 1 - ii - 1].y;
+         vtx[ii + 2 * num_segments + 1].x = x1 + rx - vtx[2 * num_segments - 1 - ii].x;
+         vtx[ii + 2 * num_segments + 1].y = y1 + ry - vtx[2 * num_segments - 1 - ii].y;
+         vtx[ii + 2 * num_segments].x = x1 + rx - vtx[2 * num_segments - 1 - ii - 1].x;
+         vtx[ii + 2 * num_segments].y = y1 + ry - vtx[2 * num_segments - 1 - ii - 1].y;
+
+         vtx[ii + 4 * num_segments].x = x1 + rx - vtx[ii].x;
+         vtx[ii + 4 * num_segments].y = y2 - ry + vtx[ii].y;
+         vtx[ii + 4 * num_segments + 1].x = x1 + rx - vtx[ii + 1].x;
+         vtx[ii + 4 * num_segments + 1].y = y2 - ry + vtx[ii + 1].y;
+
+         vtx[ii + 6 * num_segments + 1].x = x2 - rx + vtx[2 * num_segments - 1 - ii].x;
+         vtx[ii + 6 * num_segments + 1].y = y2 - ry + vtx[2 * num_segments - 1 - ii].y;
+         vtx[ii + 6 * num_segments].x = x2 - rx + vtx[2 * num_segments - 1 - ii - 1].x;
+         vtx[ii + 6 * num_segments].y = y2 - ry + vtx[2 * num_segments - 1 - ii - 1].y;
       }
       for (ii = 0; ii < 2 * num_segments; ii += 2) {
-         vertex_cache[ii].x = x2 - rx + vertex_cache[ii].x;
-         vertex_cache[ii].y = y1 + ry - vertex_cache[ii].y;
-         vertex_cache[ii + 1].x = x2 - rx + vertex_cache[ii + 1].x;
-         vertex_cache[ii + 1].y = y1 + ry - vertex_cache[ii + 1].y;
+         vtx[ii].x = x2 - rx + vtx[ii].x;
+         vtx[ii].y = y1 + ry - vtx[ii].y;
+         vtx[ii + 1].x = x2 - rx + vtx[ii + 1].x;
+         vtx[ii + 1].y = y1 + ry - vtx[ii + 1].y;
       }
-      vertex_cache[8 * num_segments] = vertex_cache[0];
-      vertex_cache[8 * num_segments + 1] = vertex_cache[1];
+      vtx[8 * num_segments] = vtx[0];
+      vtx[8 * num_segments + 1] = vtx[1];
 
       for (ii = 0; ii < 8 * num_segments + 2; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
          
-      al_draw_prim(vertex_cache, 0, 0, 0, 8 * num_segments + 2, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, 8 * num_segments + 2, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      free_vertices(vertex_cache, vtx);
    } else {
-      int num_segments = ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f) / 4;
+      int num_segments = get_num_segments(0.25f, (rx + ry) / 2.0f);
       int ii;
       
       /* In case rx and ry are both 0. */
@@ -901,33 +967,34 @@ void al_draw_rounded_rectangle(float x1, float y1, float x2, float y2,
          return;
       }
 
-      if (num_segments * 4 >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = (ALLEGRO_VERTEX_CACHE_SIZE - 1) / 4;
-      }
+      vtx = alloc_vertices(vertex_cache, 4 * num_segments);
+      if (!vtx)
+         return;
       
-      al_calculate_arc(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), 0, 0, rx, ry, 0, ALLEGRO_PI / 2, 0, num_segments + 1);
+      al_calculate_arc(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), 0, 0, rx, ry, 0, ALLEGRO_PI / 2, 0, num_segments + 1);
 
       for (ii = 0; ii < num_segments; ii++) {
-         vertex_cache[ii + 1 * num_segments].x = x1 + rx - vertex_cache[num_segments - 1 - ii].x;
-         vertex_cache[ii + 1 * num_segments].y = y1 + ry - vertex_cache[num_segments - 1 - ii].y;
+         vtx[ii + 1 * num_segments].x = x1 + rx - vtx[num_segments - 1 - ii].x;
+         vtx[ii + 1 * num_segments].y = y1 + ry - vtx[num_segments - 1 - ii].y;
 
-         vertex_cache[ii + 2 * num_segments].x = x1 + rx - vertex_cache[ii].x;
-         vertex_cache[ii + 2 * num_segments].y = y2 - ry + vertex_cache[ii].y;
+         vtx[ii + 2 * num_segments].x = x1 + rx - vtx[ii].x;
+         vtx[ii + 2 * num_segments].y = y2 - ry + vtx[ii].y;
 
-         vertex_cache[ii + 3 * num_segments].x = x2 - rx + vertex_cache[num_segments - 1 - ii].x;
-         vertex_cache[ii + 3 * num_segments].y = y2 - ry + vertex_cache[num_segments - 1 - ii].y;
+         vtx[ii + 3 * num_segments].x = x2 - rx + vtx[num_segments - 1 - ii].x;
+         vtx[ii + 3 * num_segments].y = y2 - ry + vtx[num_segments - 1 - ii].y;
       }
       for (ii = 0; ii < num_segments; ii++) {
-         vertex_cache[ii].x = x2 - rx + vertex_cache[ii].x;
-         vertex_cache[ii].y = y1 + ry - vertex_cache[ii].y;
+         vtx[ii].x = x2 - rx + vtx[ii].x;
+         vtx[ii].y = y1 + ry - vtx[ii].y;
       }
 
       for (ii = 0; ii < 4 * num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
          
-      al_draw_prim(vertex_cache, 0, 0, 0, 4 * num_segments, ALLEGRO_PRIM_LINE_LOOP);
+      al_draw_prim(vtx, 0, 0, 0, 4 * num_segments, ALLEGRO_PRIM_LINE_LOOP);
+      free_vertices(vertex_cache, vtx);
    }
 }
 
@@ -937,9 +1004,9 @@ void al_draw_filled_rounded_rectangle(float x1, float y1, float x2, float y2,
    float rx, float ry, ALLEGRO_COLOR color)
 {
    LOCAL_VERTEX_CACHE;
+   ALLEGRO_VERTEX* vtx;
    int ii;
-   float scale = get_scale();
-   int num_segments = ALLEGRO_PRIM_QUALITY * scale * sqrtf((rx + ry) / 2.0f) / 4;
+   int num_segments = get_num_segments(0.25f, (rx + ry) / 2.0f);
 
    ASSERT(rx >= 0);
    ASSERT(ry >= 0);
@@ -950,36 +1017,37 @@ void al_draw_filled_rounded_rectangle(float x1, float y1, float x2, float y2,
       return;
    }
 
-   if (num_segments * 4 >= ALLEGRO_VERTEX_CACHE_SIZE) {
-      num_segments = (ALLEGRO_VERTEX_CACHE_SIZE - 1) / 4;
-   }
+   vtx = alloc_vertices(vertex_cache, 4 * num_segments);
+   if (!vtx)
+      return;
    
-   al_calculate_arc(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), 0, 0, rx, ry, 0, ALLEGRO_PI / 2, 0, num_segments + 1);
+   al_calculate_arc(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), 0, 0, rx, ry, 0, ALLEGRO_PI / 2, 0, num_segments + 1);
 
    for (ii = 0; ii < num_segments; ii++) {
-      vertex_cache[ii + 1 * num_segments].x = x1 + rx - vertex_cache[num_segments - 1 - ii].x;
-      vertex_cache[ii + 1 * num_segments].y = y1 + ry - vertex_cache[num_segments - 1 - ii].y;
+      vtx[ii + 1 * num_segments].x = x1 + rx - vtx[num_segments - 1 - ii].x;
+      vtx[ii + 1 * num_segments].y = y1 + ry - vtx[num_segments - 1 - ii].y;
 
-      vertex_cache[ii + 2 * num_segments].x = x1 + rx - vertex_cache[ii].x;
-      vertex_cache[ii + 2 * num_segments].y = y2 - ry + vertex_cache[ii].y;
+      vtx[ii + 2 * num_segments].x = x1 + rx - vtx[ii].x;
+      vtx[ii + 2 * num_segments].y = y2 - ry + vtx[ii].y;
 
-      vertex_cache[ii + 3 * num_segments].x = x2 - rx + vertex_cache[num_segments - 1 - ii].x;
-      vertex_cache[ii + 3 * num_segments].y = y2 - ry + vertex_cache[num_segments - 1 - ii].y;
+      vtx[ii + 3 * num_segments].x = x2 - rx + vtx[num_segments - 1 - ii].x;
+      vtx[ii + 3 * num_segments].y = y2 - ry + vtx[num_segments - 1 - ii].y;
    }
    for (ii = 0; ii < num_segments; ii++) {
-      vertex_cache[ii].x = x2 - rx + vertex_cache[ii].x;
-      vertex_cache[ii].y = y1 + ry - vertex_cache[ii].y;
+      vtx[ii].x = x2 - rx + vtx[ii].x;
+      vtx[ii].y = y1 + ry - vtx[ii].y;
    }
 
    for (ii = 0; ii < 4 * num_segments; ii++) {
-      vertex_cache[ii].color = color;
-      vertex_cache[ii].z = 0;
+      vtx[ii].color = color;
+      vtx[ii].z = 0;
    }
 
    /*
    TODO: Doing this as a triangle fan just doesn't sound all that great, perhaps shuffle the vertices somehow to at least make it a strip
    */
-   al_draw_prim(vertex_cache, 0, 0, 0, 4 * num_segments, ALLEGRO_PRIM_TRIANGLE_FAN);
+   al_draw_prim(vtx, 0, 0, 0, 4 * num_segments, ALLEGRO_PRIM_TRIANGLE_FAN);
+   free_vertices(vertex_cache, vtx);
 }
 
 /* Function: al_calculate_spline
@@ -1066,42 +1134,44 @@ void al_calculate_spline(float* dest, int stride, float points[8],
 void al_draw_spline(float points[8], ALLEGRO_COLOR color, float thickness)
 {
    int ii;
-   float scale = get_scale();
-   int num_segments = (int)(sqrtf(hypotf(points[2] - points[0], points[3] - points[1]) +
-                                  hypotf(points[4] - points[2], points[5] - points[3]) +
-                                  hypotf(points[6] - points[4], points[7] - points[5])) *
-                            1.2 * ALLEGRO_PRIM_QUALITY * scale / 10);
+   float length = hypotf(points[2] - points[0], points[3] - points[1]) +
+                  hypotf(points[4] - points[2], points[5] - points[3]) +
+                  hypotf(points[6] - points[4], points[7] - points[5]);
+   int num_segments = get_num_segments(0.12f, length);
    LOCAL_VERTEX_CACHE;
+   ALLEGRO_VERTEX* vtx;
    
    if(num_segments < 2)
       num_segments = 2;
 
    if (thickness > 0) {
-      if (2 * num_segments >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = (ALLEGRO_VERTEX_CACHE_SIZE - 1) / 2;
-      }
+      vtx = alloc_vertices(vertex_cache, 2 * num_segments);
+      if (!vtx)
+         return;
          
-      al_calculate_spline(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), points, thickness, num_segments);
+      al_calculate_spline(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), points, thickness, num_segments);
       
       for (ii = 0; ii < 2 * num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
       
-      al_draw_prim(vertex_cache, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      free_vertices(vertex_cache, vtx);
    } else {
-      if (num_segments >= ALLEGRO_VERTEX_CACHE_SIZE) {
-         num_segments = ALLEGRO_VERTEX_CACHE_SIZE - 1;
-      }
+      vtx = alloc_vertices(vertex_cache, num_segments);
+      if (!vtx)
+         return;
          
-      al_calculate_spline(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), points, thickness, num_segments);
+      al_calculate_spline(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), points, thickness, num_segments);
       
       for (ii = 0; ii < num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
       
-      al_draw_prim(vertex_cache, 0, 0, 0, num_segments, ALLEGRO_PRIM_LINE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, num_segments, ALLEGRO_PRIM_LINE_STRIP);
+      free_vertices(vertex_cache, vtx);
    }
 }
 
@@ -1233,25 +1303,641 @@ void al_draw_ribbon(const float *points, int points_stride, ALLEGRO_COLOR color,
    float thickness, int num_segments)
 {
    LOCAL_VERTEX_CACHE;
+   ALLEGRO_VERTEX* vtx;
    int ii;
 
-   al_calculate_ribbon(&(vertex_cache[0].x), sizeof(ALLEGRO_VERTEX), points, points_stride, thickness, num_segments);
+   vtx = alloc_vertices(vertex_cache, thickness > 0 ? 2 * num_segments : num_segments);
+   if (!vtx)
+      return;
+
+   al_calculate_ribbon(&(vtx[0].x), sizeof(ALLEGRO_VERTEX), points, points_stride, thickness, num_segments);
    
    if (thickness > 0) {
       for (ii = 0; ii < 2 * num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
       
-      al_draw_prim(vertex_cache, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, 2 * num_segments, ALLEGRO_PRIM_TRIANGLE_STRIP);
    } else {
       for (ii = 0; ii < num_segments; ii++) {
-         vertex_cache[ii].color = color;
-         vertex_cache[ii].z = 0;
+         vtx[ii].color = color;
+         vtx[ii].z = 0;
       }
       
-      al_draw_prim(vertex_cache, 0, 0, 0, num_segments, ALLEGRO_PRIM_LINE_STRIP);
+      al_draw_prim(vtx, 0, 0, 0, num_segments, ALLEGRO_PRIM_LINE_STRIP);
+   }
+
+   free_vertices(vertex_cache, vtx);
+}
+
+/*
+ * Batched shapes.
+ *
+ * The routines below emit the same vertices and triangles as their single
+ * shape counterparts, but accumulate them into one indexed primitive that
+ * is submitted whenever the batch fills up. Unit arcs are computed once per
+ * segment count and shared by every shape in the batch. Shapes too big for
+ * a batch are drawn on their own.
+ */
+#define BATCH_VERTEX_COUNT 16384
+#define BATCH_INDEX_COUNT  (3 * BATCH_VERTEX_COUNT)
+
+/* Batches start out in these arrays, and grow on the heap only when the
+ * shapes need more room.
+ */
+#define BATCH_INLINE_VERTEX_COUNT 256
+#define BATCH_INLINE_INDEX_COUNT  (3 * BATCH_INLINE_VERTEX_COUNT)
+
+typedef struct PRIM_BATCH {
+   ALLEGRO_VERTEX* vtxs;
+   int* indices;
+   int num_vtxs;
+   int num_indices;
+   int vtx_capacity;
+   int index_capacity;
+   int type;
+
+   /* Unit arcs spanning arc_delta, keyed by their point count. An offset of
+    * -1 means the arc hasn't been computed yet.
+    */
+   float arc_delta;
+   float* arcs;
+   int arcs_size;
+   int arcs_capacity;
+   int arc_offset[ALLEGRO_VERTEX_CACHE_SIZE + 1];
+
+   /* The last arc with more points than arc_offset can hold. */
+   float* big_arc;
+   int big_arc_points;
+   int big_arc_capacity;
+
+   ALLEGRO_VERTEX inline_vtxs[BATCH_INLINE_VERTEX_COUNT];
+   int inline_indices[BATCH_INLINE_INDEX_COUNT];
+} PRIM_BATCH;
+
+static void batch_init(PRIM_BATCH* batch, int type, float arc_delta)
+{
+   int ii;
+
+   batch->vtxs = batch->inline_vtxs;
+   batch->indices = batch->inline_indices;
+   batch->num_vtxs = 0;
+   batch->num_indices = 0;
+   batch->vtx_capacity = BATCH_INLINE_VERTEX_COUNT;
+   batch->index_capacity = BATCH_INLINE_INDEX_COUNT;
+   batch->type = type;
+   batch->arc_delta = arc_delta;
+   batch->arcs = NULL;
+   batch->arcs_size = 0;
+   batch->arcs_capacity = 0;
+   for (ii = 0; ii <= ALLEGRO_VERTEX_CACHE_SIZE; ii++)
+      batch->arc_offset[ii] = -1;
+   batch->big_arc = NULL;
+   batch->big_arc_points = 0;
+   batch->big_arc_capacity = 0;
+}
+
+static void batch_flush(PRIM_BATCH* batch)
+{
+   if (batch->num_indices > 0) {
+      al_draw_indexed_prim(batch->vtxs, 0, 0, batch->indices,
+         batch->num_indices, batch->type);
+   }
+   batch->num_vtxs = 0;
+   batch->num_indices = 0;
+}
+
+static void batch_destroy(PRIM_BATCH* batch)
+{
+   batch_flush(batch);
+   if (batch->vtxs != batch->inline_vtxs)
+      al_free(batch->vtxs);
+   if (batch->indices != batch->inline_indices)
+      al_free(batch->indices);
+   al_free(batch->arcs);
+   al_free(batch->big_arc);
+}
+
+/*
+ * Makes room for at least num_vtxs vertices and num_indices indices in
+ * all, doubling the buffers up to the batch size.
+ */
+static bool batch_grow(PRIM_BATCH* batch, int num_vtxs, int num_indices)
+{
+   ASSERT(num_vtxs <= BATCH_VERTEX_COUNT);
+   ASSERT(num_indices <= BATCH_INDEX_COUNT);
+
+   if (num_vtxs > batch->vtx_capacity) {
+      int capacity = batch->vtx_capacity;
+      ALLEGRO_VERTEX* vtxs;
+
+      while (capacity < num_vtxs)
+         capacity *= 2;
+      capacity = _ALLEGRO_MIN(capacity, BATCH_VERTEX_COUNT);
+      vtxs = al_malloc(capacity * sizeof(ALLEGRO_VERTEX));
+      if (!vtxs)
+         return false;
+      memcpy(vtxs, batch->vtxs, batch->num_vtxs * sizeof(ALLEGRO_VERTEX));
+      if (batch->vtxs != batch->inline_vtxs)
+         al_free(batch->vtxs);
+      batch->vtxs = vtxs;
+      batch->vtx_capacity = capacity;
+   }
+
+   if (num_indices > batch->index_capacity) {
+      int capacity = batch->index_capacity;
+      int* indices;
+
+      while (capacity < num_indices)
+         capacity *= 2;
+      capacity = _ALLEGRO_MIN(capacity, BATCH_INDEX_COUNT);
+      indices = al_malloc(capacity * sizeof(int));
+      if (!indices)
+         return false;
+      memcpy(indices, batch->indices, batch->num_indices * sizeof(int));
+      if (batch->indices != batch->inline_indices)
+         al_free(batch->indices);
+      batch->indices = indices;
+      batch->index_capacity = capacity;
+   }
+
+   return true;
+}
+
+/*
+ * Returns true if a shape fits into an empty batch. Shapes that don't are
+ * drawn with the single shape routines, after flushing the batch to keep
+ * the drawing order.
+ */
+static bool batch_fits(PRIM_BATCH* batch, int num_vtxs, int num_indices)
+{
+   if (num_vtxs <= BATCH_VERTEX_COUNT && num_indices <= BATCH_INDEX_COUNT &&
+       batch_grow(batch, num_vtxs, num_indices))
+      return true;
+   batch_flush(batch);
+   return false;
+}
+
+/*
+ * Reserves space for a shape, growing the batch or flushing it first if
+ * the shape doesn't fit. Shapes bigger than the inline arrays must have
+ * been checked with batch_fits. The new vertices get the color passed; the caller fills in the positions
+ * and the indices, which are relative to the returned vertices.
+ */
+static ALLEGRO_VERTEX* batch_reserve(PRIM_BATCH* batch, int num_vtxs,
+   int num_indices, ALLEGRO_COLOR color, int** indices, int* base)
+{
+   ALLEGRO_VERTEX* vtxs;
+   int ii;
+
+   if (batch->num_vtxs + num_vtxs > batch->vtx_capacity ||
+       batch->num_indices + num_indices > batch->index_capacity) {
+      if (batch->num_vtxs + num_vtxs > BATCH_VERTEX_COUNT ||
+          batch->num_indices + num_indices > BATCH_INDEX_COUNT ||
+          !batch_grow(batch, batch->num_vtxs + num_vtxs,
+             batch->num_indices + num_indices)) {
+         batch_flush(batch);
+      }
+   }
+
+   ASSERT(num_vtxs <= batch->vtx_capacity);
+   ASSERT(num_indices <= batch->index_capacity);
+
+   vtxs = batch->vtxs + batch->num_vtxs;
+   for (ii = 0; ii < num_vtxs; ii++) {
+      vtxs[ii].z = 0;
+      vtxs[ii].u = 0;
+      vtxs[ii].v = 0;
+      vtxs[ii].color = color;
+   }
+
+   *indices = batch->indices + batch->num_indices;
+   *base = batch->num_vtxs;
+
+   batch->num_vtxs += num_vtxs;
+   batch->num_indices += num_indices;
+
+   return vtxs;
+}
+
+/*
+ * Returns num_points points of a unit arc starting at angle 0, as computed
+ * by al_calculate_arc. Scaling and offsetting these yields bit-identical
+ * results to calling al_calculate_arc with the actual radii.
+ */
+static const float* batch_unit_arc(PRIM_BATCH* batch, int num_points)
+{
+   ASSERT(num_points > 1);
+
+   if (num_points > ALLEGRO_VERTEX_CACHE_SIZE) {
+      if (num_points != batch->big_arc_points) {
+         if (2 * num_points > batch->big_arc_capacity) {
+            float* arc = al_realloc(batch->big_arc, 2 * num_points * sizeof(float));
+            if (!arc)
+               return NULL;
+            batch->big_arc = arc;
+            batch->big_arc_capacity = 2 * num_points;
+         }
+         al_calculate_arc(batch->big_arc, 2 * sizeof(float),
+            0, 0, 1, 1, 0, batch->arc_delta, 0, num_points);
+         batch->big_arc_points = num_points;
+      }
+      return batch->big_arc;
    }
+
+   if (batch->arc_offset[num_points] < 0) {
+      int size = batch->arcs_size + 2 * num_points;
+
+      if (size > batch->arcs_capacity) {
+         int capacity = _ALLEGRO_MAX(2 * batch->arcs_capacity, size);
+         float* arcs = al_realloc(batch->arcs, capacity * sizeof(float));
+         if (!arcs)
+            return NULL;
+         batch->arcs = arcs;
+         batch->arcs_capacity = capacity;
+      }
+
+      al_calculate_arc(batch->arcs + batch->arcs_size, 2 * sizeof(float),
+         0, 0, 1, 1, 0, batch->arc_delta, 0, num_points);
+      batch->arc_offset[num_points] = batch->arcs_size;
+      batch->arcs_size = size;
+   }
+
+   return batch->arcs + batch->arc_offset[num_points];
+}
+
+/* Triangles (0, ii, ii - 1) of a fan, as the software renderer splits it. */
+static void batch_fan(int* indices, int base, int num_vtxs)
+{
+   int ii;
+
+   for (ii = 2; ii < num_vtxs; ii++) {
+      *indices++ = base;
+      *indices++ = base + ii;
+      *indices++ = base + ii - 1;
+   }
+}
+
+static void batch_strip(int* indices, int base, int num_vtxs)
+{
+   int ii;
+
+   for (ii = 2; ii < num_vtxs; ii++) {
+      *indices++ = base + ii - 2;
+      *indices++ = base + ii - 1;
+      *indices++ = base + ii;
+   }
+}
+
+static void batch_loop(int* indices, int base, int num_vtxs)
+{
+   int ii;
+
+   for (ii = 1; ii < num_vtxs; ii++) {
+      *indices++ = base + ii - 1;
+      *indices++ = base + ii;
+   }
+   *indices++ = base + num_vtxs - 1;
+   *indices++ = base;
+}
+
+static void batch_filled_rectangle(PRIM_BATCH* batch, float x1, float y1,
+   float x2, float y2, ALLEGRO_COLOR color)
+{
+   int* indices;
+   int base;
+   ALLEGRO_VERTEX* vtx = batch_reserve(batch, 4, 6, color, &indices, &base);
+
+   vtx[0].x = x1; vtx[0].y = y1;
+   vtx[1].x = x1; vtx[1].y = y2;
+   vtx[2].x = x2; vtx[2].y = y2;
+   vtx[3].x = x2; vtx[3].y = y1;
+
+   batch_fan(indices, base, 4);
+}
+
+/* Function: al_draw_lines
+ */
+void al_draw_lines(const ALLEGRO_PRIM_LINE* lines, int num_lines,
+   float thickness)
+{
+   PRIM_BATCH batch;
+   int ii;
+
+   ASSERT(lines || num_lines == 0);
+
+   if (num_lines <= 0)
+      return;
+
+   batch_init(&batch, thickness > 0 ? ALLEGRO_PRIM_TRIANGLE_LIST :
+         ALLEGRO_PRIM_LINE_LIST, 0);
+
+   for (ii = 0; ii < num_lines; ii++) {
+      const ALLEGRO_PRIM_LINE* l = &lines[ii];
+      ALLEGRO_VERTEX* vtx;
+      int* indices;
+      int base;
+
+      if (thickness > 0) {
+         float tx, ty;
+         float len = hypotf(l->x2 - l->x1, l->y2 - l->y1);
+
+         if (len == 0)
+            continue;
+
+         tx = 0.5f * thickness * (l->y2 - l->y1) / len;
+         ty = 0.5f * thickness * -(l->x2 - l->x1) / len;
+
+         vtx = batch_reserve(&batch, 4, 6, l->color, &indices, &base);
+         vtx[0].x = l->x1 + tx; vtx[0].y = l->y1 + ty;
+         vtx[1].x = l->x1 - tx; vtx[1].y = l->y1 - ty;
+         vtx[2].x = l->x2 - tx; vtx[2].y = l->y2 - ty;
+         vtx[3].x = l->x2 + tx; vtx[3].y = l->y2 + ty;
+         batch_fan(indices, base, 4);
+      } else {
+         vtx = batch_reserve(&batch, 2, 2, l->color, &indices, &base);
+         vtx[0].x = l->x1; vtx[0].y = l->y1;
+         vtx[1].x = l->x2; vtx[1].y = l->y2;
+         indices[0] = base;
+         indices[1] = base + 1;
+      }
+   }
+
+   batch_destroy(&batch);
+}
+
+/* Function: al_draw_rectangles
+ */
+void al_draw_rectangles(const ALLEGRO_PRIM_RECTANGLE* rects, int num_rects,
+   float thickness)
+{
+   PRIM_BATCH batch;
+   int ii;
+
+   ASSERT(rects || num_rects == 0);
+
+   if (num_rects <= 0)
+      return;
+
+   batch_init(&batch, thickness > 0 ? ALLEGRO_PRIM_TRIANGLE_LIST :
+         ALLEGRO_PRIM_LINE_LIST, 0);
+
+   for (ii = 0; ii < num_rects; ii++) {
+      const ALLEGRO_PRIM_RECTANGLE* r = &rects[ii];
+      ALLEGRO_VERTEX* vtx;
+      int* indices;
+      int base;
+
+      if (thickness > 0) {
+         float t = thickness / 2;
+
+         vtx = batch_reserve(&batch, 10, 24, r->color, &indices, &base);
+         vtx[0].x = r->x1 - t; vtx[0].y = r->y1 - t;
+         vtx[1].x = r->x1 + t; vtx[1].y = r->y1 + t;
+         vtx[2].x = r->x2 + t; vtx[2].y = r->y1 - t;
+         vtx[3].x = r->x2 - t; vtx[3].y = r->y1 + t;
+         vtx[4].x = r->x2 + t; vtx[4].y = r->y2 + t;
+         vtx[5].x = r->x2 - t; vtx[5].y = r->y2 - t;
+         vtx[6].x = r->x1 - t; vtx[6].y = r->y2 + t;
+         vtx[7].x = r->x1 + t; vtx[7].y = r->y2 - t;
+         vtx[8].x = r->x1 - t; vtx[8].y = r->y1 - t;
+         vtx[9].x = r->x1 + t; vtx[9].y = r->y1 + t;
+         batch_strip(indices, base, 10);
+      } else {
+         vtx = batch_reserve(&batch, 4, 8, r->color, &indices, &base);
+         vtx[0].x = r->x1; vtx[0].y = r->y1;
+         vtx[1].x = r->x2; vtx[1].y = r->y1;
+         vtx[2].x = r->x2; vtx[2].y = r->y2;
+         vtx[3].x = r->x1; vtx[3].y = r->y2;
+         batch_loop(indices, base, 4);
+      }
+   }
+
+   batch_destroy(&batch);
+}
+
+/* Function: al_draw_filled_rectangles
+ */
+void al_draw_filled_rectangles(const ALLEGRO_PRIM_RECTANGLE* rects,
+   int num_rects)
+{
+   PRIM_BATCH batch;
+   int ii;
+
+   ASSERT(rects || num_rects == 0);
+
+   if (num_rects <= 0)
+      return;
+
+   batch_init(&batch, ALLEGRO_PRIM_TRIANGLE_LIST, 0);
+
+   for (ii = 0; ii < num_rects; ii++) {
+      const ALLEGRO_PRIM_RECTANGLE* r = &rects[ii];
+      batch_filled_rectangle(&batch, r->x1, r->y1, r->x2, r->y2, r->color);
+   }
+
+   batch_destroy(&batch);
+}
+
+/* Function: al_draw_circles
+ */
+void al_draw_circles(const ALLEGRO_PRIM_CIRCLE* circles, int num_circles,
+   float thickness)
+{
+   PRIM_BATCH batch;
+   int ii;
+
+   ASSERT(circles || num_circles == 0);
+
+   if (num_circles <= 0)
+      return;
+
+   batch_init(&batch, thickness > 0 ? ALLEGRO_PRIM_TRIANGLE_LIST :
+         ALLEGRO_PRIM_LINE_LIST, ALLEGRO_PI * 2);
+
+   for (ii = 0; ii < num_circles; ii++) {
+      const ALLEGRO_PRIM_CIRCLE* c = &circles[ii];
+      int num_segments = get_num_segments(1, (c->r + c->r) / 2.0f);
+      const float* arc;
+      ALLEGRO_VERTEX* vtx;
+      int* indices;
+      int base;
+      int jj;
+
+      ASSERT(c->r >= 0);
+
+      /* In case r is 0. */
+      if (num_segments < 2)
+         continue;
+
+      if (thickness > 0) {
+         float r1 = c->r - thickness / 2.0f;
+         float r2 = c->r + thickness / 2.0f;
+
+         if (!batch_fits(&batch, 2 * num_segments, 3 * (2 * num_segments - 2))) {
+            al_draw_circle(c->cx, c->cy, c->r, c->color, thickness);
+            continue;
+         }
+
+         arc = batch_unit_arc(&batch, num_segments);
+         if (!arc)
+            continue;
+
+         vtx = batch_reserve(&batch, 2 * num_segments,
+            3 * (2 * num_segments - 2), c->color, &indices, &base);
+         for (jj = 0; jj < num_segments; jj++) {
+            vtx[2 * jj].x = r2 * arc[2 * jj] + c->cx;
+            vtx[2 * jj].y = r2 * arc[2 * jj + 1] + c->cy;
+            vtx[2 * jj + 1].x = r1 * arc[2 * jj] + c->cx;
+            vtx[2 * jj + 1].y = r1 * arc[2 * jj + 1] + c->cy;
+         }
+         batch_strip(indices, base, 2 * num_segments);
+      } else {
+         if (!batch_fits(&batch, num_segments - 1, 2 * (num_segments - 1))) {
+            al_draw_circle(c->cx, c->cy, c->r, c->color, thickness);
+            continue;
+         }
+
+         arc = batch_unit_arc(&batch, num_segments);
+         if (!arc)
+            continue;
+
+         /* The last point of the arc coincides with the first. */
+         vtx = batch_reserve(&batch, num_segments - 1,
+            2 * (num_segments - 1), c->color, &indices, &base);
+         for (jj = 0; jj < num_segments - 1; jj++) {
+            vtx[jj].x = c->r * arc[2 * jj] + c->cx;
+            vtx[jj].y = c->r * arc[2 * jj + 1] + c->cy;
+         }
+         batch_loop(indices, base, num_segments - 1);
+      }
+   }
+
+   batch_destroy(&batch);
+}
+
+/* Function: al_draw_filled_circles
+ */
+void al_draw_filled_circles(const ALLEGRO_PRIM_CIRCLE* circles,
+   int num_circles)
+{
+   PRIM_BATCH batch;
+   int ii;
+
+   ASSERT(circles || num_circles == 0);
+
+   if (num_circles <= 0)
+      return;
+
+   batch_init(&batch, ALLEGRO_PRIM_TRIANGLE_LIST, ALLEGRO_PI * 2);
+
+   for (ii = 0; ii < num_circles; ii++) {
+      const ALLEGRO_PRIM_CIRCLE* c = &circles[ii];
+      int num_segments = get_num_segments(1, (c->r + c->r) / 2.0f);
+      const float* arc;
+      ALLEGRO_VERTEX* vtx;
+      int* indices;
+      int base;
+      int jj;
+
+      ASSERT(c->r >= 0);
+
+      /* In case r is close to 0. */
+      if (num_segments < 2)
+         continue;
+
+      if (!batch_fits(&batch, num_segments + 1, 3 * (num_segments - 1))) {
+         al_draw_filled_circle(c->cx, c->cy, c->r, c->color);
+         continue;
+      }
+
+      arc = batch_unit_arc(&batch, num_segments);
+      if (!arc)
+         continue;
+
+      vtx = batch_reserve(&batch, num_segments + 1, 3 * (num_segments - 1),
+         c->color, &indices, &base);
+      vtx[0].x = c->cx; vtx[0].y = c->cy;
+      for (jj = 0; jj < num_segments; jj++) {
+         vtx[jj + 1].x = c->r * arc[2 * jj] + c->cx;
+         vtx[jj + 1].y = c->r * arc[2 * jj + 1] + c->cy;
+      }
+      batch_fan(indices, base, num_segments + 1);
+   }
+
+   batch_destroy(&batch);
+}
+
+/* Function: al_draw_filled_rounded_rectangles
+ */
+void al_draw_filled_rounded_rectangles(
+   const ALLEGRO_PRIM_ROUNDED_RECTANGLE* rects, int num_rects)
+{
+   PRIM_BATCH batch;
+   int ii;
+
+   ASSERT(rects || num_rects == 0);
+
+   if (num_rects <= 0)
+      return;
+
+   batch_init(&batch, ALLEGRO_PRIM_TRIANGLE_LIST, ALLEGRO_PI / 2);
+
+   for (ii = 0; ii < num_rects; ii++) {
+      const ALLEGRO_PRIM_ROUNDED_RECTANGLE* r = &rects[ii];
+      int num_segments = get_num_segments(0.25f, (r->rx + r->ry) / 2.0f);
+      const float* arc;
+      ALLEGRO_VERTEX* vtx;
+      int* indices;
+      int base;
+      int n, jj;
+
+      ASSERT(r->rx >= 0);
+      ASSERT(r->ry >= 0);
+
+      /* In case rx and ry are both 0. */
+      if (num_segments < 2) {
+         batch_filled_rectangle(&batch, r->x1, r->y1, r->x2, r->y2, r->color);
+         continue;
+      }
+
+      n = num_segments;
+
+      if (!batch_fits(&batch, 4 * n, 3 * (4 * n - 2))) {
+         al_draw_filled_rounded_rectangle(r->x1, r->y1, r->x2, r->y2,
+            r->rx, r->ry, r->color);
+         continue;
+      }
+
+      arc = batch_unit_arc(&batch, n + 1);
+      if (!arc)
+         continue;
+
+      vtx = batch_reserve(&batch, 4 * n, 3 * (4 * n - 2), r->color,
+         &indices, &base);
+      for (jj = 0; jj < n; jj++) {
+         float ax = r->rx * arc[2 * jj];
+         float ay = r->ry * arc[2 * jj + 1];
+         float bx = r->rx * arc[2 * (n - 1 - jj)];
+         float by = r->ry * arc[2 * (n - 1 - jj) + 1];
+
+         vtx[jj].x = r->x2 - r->rx + ax;
+         vtx[jj].y = r->y1 + r->ry - ay;
+
+         vtx[jj + 1 * n].x = r->x1 + r->rx - bx;
+         vtx[jj + 1 * n].y = r->y1 + r->ry - by;
+
+         vtx[jj + 2 * n].x = r->x1 + r->rx - ax;
+         vtx[jj + 2 * n].y = r->y2 - r->ry + ay;
+
+         vtx[jj + 3 * n].x = r->x2 - r->rx + bx;
+         vtx[jj + 3 * n].y = r->y2 - r->ry + by;
+      }
+      batch_fan(indices, base, 4 * n);
+   }
+
+   batch_destroy(&batch);
 }
 
 /* vim: set sts=3 sw=3 et: */
@@ -19,6 +19,7 @@
 #include "allegro5/allegro.h"
 #include "allegro5/allegro_primitives.h"
 #include "allegro5/internal/aintern_prim.h"
+#include "allegro5/internal/aintern_prim_soft.h"
 #include <math.h>
 
 #ifdef ALLEGRO_MSVC
@@ -39,6 +40,52 @@ static void polygon_push_triangle_callback(int i0, int i1, int i2, void* user_da
 }
 
 
+static float ring_signed_area(const float* vertices, int vertex_count)
+{
+   float area = 0.0f;
+   int ii, jj;
+
+   for (ii = 0, jj = vertex_count - 1; ii < vertex_count; jj = ii++)
+      area += vertices[jj * 2] * vertices[ii * 2 + 1] - vertices[ii * 2] * vertices[jj * 2 + 1];
+
+   return area;
+}
+
+
+/* Draws a polygon with anti-aliased edges. The rings are rasterized
+ * directly, with holes made to wind against the outline so they cancel it.
+ * Returns false if the coverage rasterizer could not be used.
+ */
+static bool draw_filled_polygon_coverage(const float *vertices,
+   const int *vertex_counts, ALLEGRO_COLOR color)
+{
+   ALLEGRO_PRIM_COVERAGE* cov = _al_create_coverage();
+   float outline_area = 0.0f;
+   int ii;
+
+   if (!cov)
+      return false;
+
+   for (ii = 0; vertex_counts[ii] > 0; ii++) {
+      int count = vertex_counts[ii];
+      float area = ring_signed_area(vertices, count);
+      bool reverse = false;
+
+      if (ii == 0)
+         outline_area = area;
+      else
+         reverse = (area > 0) == (outline_area > 0);
+
+      _al_coverage_add_ring(cov, vertices, 2 * sizeof(float), count, reverse);
+      vertices += 2 * count;
+   }
+
+   _al_coverage_fill(cov, color);
+   _al_destroy_coverage(cov);
+   return true;
+}
+
+
 /* Function: al_draw_polygon
  */
 void al_draw_polygon(const float *vertices, int vertex_count,
@@ -57,10 +104,14 @@ void al_draw_filled_polygon(const float *vertices, int vertex_count,
    ALLEGRO_PRIM_VERTEX_CACHE cache;
    int vertex_counts[2];
 
-   _al_prim_cache_init_ex(&cache, ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE, color, (void*)vertices);
-
    vertex_counts[0] = vertex_count;
    vertex_counts[1] = 0; /* terminator */
+
+   if (_al_coverage_wanted() && draw_filled_polygon_coverage(vertices, vertex_counts, color))
+      return;
+
+   _al_prim_cache_init_ex(&cache, ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE, color, (void*)vertices);
+
    al_triangulate_polygon(vertices, sizeof(float) * 2, vertex_counts,
       polygon_push_triangle_callback, &cache);
 
@@ -74,6 +125,9 @@ void al_draw_filled_polygon_with_holes(const float *vertices,
 {
    ALLEGRO_PRIM_VERTEX_CACHE cache;
 
+   if (_al_coverage_wanted() && draw_filled_polygon_coverage(vertices, vertex_counts, color))
+      return;
+
    _al_prim_cache_init_ex(&cache, ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE, color, (void*)vertices);
 
    al_triangulate_polygon(vertices, sizeof(float) * 2, vertex_counts,
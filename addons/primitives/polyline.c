@@ -20,6 +20,7 @@
 #include "allegro5/allegro_primitives.h"
 #include "allegro5/internal/aintern_list.h"
 #include "allegro5/internal/aintern_prim.h"
+#include "allegro5/internal/aintern_prim_soft.h"
 #include <float.h>
 #include <math.h>
 
@@ -459,11 +460,15 @@ static void emit_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* vertice
 # undef VERTEX
 }
 
-static void do_draw_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* vertices, int vertex_stride, int vertex_count, int join_style, int cap_style, ALLEGRO_COLOR color, float thickness, float miter_limit)
+/* Draws a polyline, or adds its geometry to mesh if that is not NULL. */
+static void do_draw_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, ALLEGRO_STROKE_MESH* mesh, const float* vertices, int vertex_stride, int vertex_count, int join_style, int cap_style, ALLEGRO_COLOR color, float thickness, float miter_limit)
 {
    if (thickness > 0.0f)
    {
       _al_prim_cache_init(cache, ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE, color);
+      cache->mesh = mesh;
+      if (!mesh && _al_coverage_wanted())
+         _al_prim_cache_use_coverage(cache);
       emit_polyline(cache, vertices, vertex_stride, vertex_count, join_style, cap_style, thickness, miter_limit);
       _al_prim_cache_term(cache);
    }
@@ -474,6 +479,7 @@ static void do_draw_polyline(ALLEGRO_PRIM_VERTEX_CACHE* cache, const float* vert
       int i;
 
       _al_prim_cache_init(cache, ALLEGRO_PRIM_VERTEX_CACHE_LINE_STRIP, color);
+      cache->mesh = mesh;
 
       for (i = 0; i < vertex_count; ++i) {
 
@@ -496,7 +502,217 @@ void al_draw_polyline(const float* vertices, int vertex_stride,
    ALLEGRO_COLOR color, float thickness, float miter_limit)
 {
    ALLEGRO_PRIM_VERTEX_CACHE cache;
-   do_draw_polyline(&cache, vertices, vertex_stride, vertex_count, join_style, cap_style, color, thickness, miter_limit);
+   do_draw_polyline(&cache, NULL, vertices, vertex_stride, vertex_count, join_style, cap_style, color, thickness, miter_limit);
+}
+
+
+struct ALLEGRO_STROKE_MESH {
+   /* Untransformed triangle list and line list, all vertices have color. */
+   ALLEGRO_VERTEX* triangles;
+   int num_triangle_vertices;
+   int triangles_capacity;
+   ALLEGRO_VERTEX* lines;
+   int num_line_vertices;
+   int lines_capacity;
+   ALLEGRO_COLOR color;
+
+   /* Set when adding vertices failed, cleared by the next addition. */
+   bool out_of_memory;
+
+   /* Copy of the triangles for drawing to video bitmaps, created on demand
+    * and dropped whenever the triangles or their color change.
+    */
+   ALLEGRO_VERTEX_BUFFER* vertex_buffer;
+};
+
+static bool reserve_vertices(ALLEGRO_VERTEX** vtxs, int* capacity, int needed)
+{
+   ALLEGRO_VERTEX* new_vtxs;
+   int new_capacity;
+
+   if (needed <= *capacity)
+      return true;
+
+   new_capacity = *capacity ? *capacity : 256;
+   while (new_capacity < needed)
+      new_capacity *= 2;
+
+   new_vtxs = al_realloc(*vtxs, new_capacity * sizeof(ALLEGRO_VERTEX));
+   if (!new_vtxs)
+      return false;
+
+   *vtxs = new_vtxs;
+   *capacity = new_capacity;
+   return true;
+}
+
+/* Receives the vertices flushed from a vertex cache that has its mesh set.
+ * Line strips are stored as line lists, so separate polylines stay apart.
+ */
+void _al_stroke_mesh_add_vertices(ALLEGRO_STROKE_MESH* mesh, int prim_type, const ALLEGRO_VERTEX* vtxs, int num)
+{
+   int ii;
+
+   if (mesh->out_of_memory)
+      return;
+
+   if (prim_type == ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE) {
+      if (!reserve_vertices(&mesh->triangles, &mesh->triangles_capacity, mesh->num_triangle_vertices + num)) {
+         mesh->out_of_memory = true;
+         return;
+      }
+      for (ii = 0; ii < num; ii++) {
+         ALLEGRO_VERTEX* v = &mesh->triangles[mesh->num_triangle_vertices++];
+         *v = vtxs[ii];
+         v->color = mesh->color;
+      }
+   }
+   else if (prim_type == ALLEGRO_PRIM_VERTEX_CACHE_LINE_STRIP && num >= 2) {
+      if (!reserve_vertices(&mesh->lines, &mesh->lines_capacity, mesh->num_line_vertices + 2 * (num - 1))) {
+         mesh->out_of_memory = true;
+         return;
+      }
+      for (ii = 0; ii < num - 1; ii++) {
+         ALLEGRO_VERTEX* v = &mesh->lines[mesh->num_line_vertices];
+         v[0] = vtxs[ii];
+         v[1] = vtxs[ii + 1];
+         v[0].color = v[1].color = mesh->color;
+         mesh->num_line_vertices += 2;
+      }
+   }
+}
+
+/* Function: al_create_stroke_mesh
+ */
+ALLEGRO_STROKE_MESH* al_create_stroke_mesh(void)
+{
+   ALLEGRO_STROKE_MESH* mesh = al_calloc(1, sizeof(ALLEGRO_STROKE_MESH));
+   if (!mesh)
+      return NULL;
+   mesh->color = al_map_rgb_f(1, 1, 1);
+   return mesh;
+}
+
+/* Function: al_destroy_stroke_mesh
+ */
+void al_destroy_stroke_mesh(ALLEGRO_STROKE_MESH* mesh)
+{
+   if (!mesh)
+      return;
+   if (mesh->vertex_buffer)
+      al_destroy_vertex_buffer(mesh->vertex_buffer);
+   al_free(mesh->triangles);
+   al_free(mesh->lines);
+   al_free(mesh);
+}
+
+/* Function: al_add_polyline_to_stroke_mesh
+ */
+bool al_add_polyline_to_stroke_mesh(ALLEGRO_STROKE_MESH* mesh,
+   const float* vertices, int vertex_stride, int vertex_count,
+   ALLEGRO_LINE_JOIN join_style, ALLEGRO_LINE_CAP cap_style,
+   float thickness, float miter_limit)
+{
+   ALLEGRO_PRIM_VERTEX_CACHE cache;
+   int old_triangle_vertices;
+   int old_line_vertices;
+   ASSERT(mesh);
+
+   old_triangle_vertices = mesh->num_triangle_vertices;
+   old_line_vertices = mesh->num_line_vertices;
+   mesh->out_of_memory = false;
+
+   do_draw_polyline(&cache, mesh, vertices, vertex_stride, vertex_count, join_style, cap_style, mesh->color, thickness, miter_limit);
+
+   if (mesh->out_of_memory) {
+      /* Leave out the partially added polyline. */
+      mesh->num_triangle_vertices = old_triangle_vertices;
+      mesh->num_line_vertices = old_line_vertices;
+      return false;
+   }
+
+   if (mesh->num_triangle_vertices != old_triangle_vertices && mesh->vertex_buffer) {
+      al_destroy_vertex_buffer(mesh->vertex_buffer);
+      mesh->vertex_buffer = NULL;
+   }
+   return true;
+}
+
+/* Function: al_clear_stroke_mesh
+ */
+void al_clear_stroke_mesh(ALLEGRO_STROKE_MESH* mesh)
+{
+   ASSERT(mesh);
+
+   mesh->num_triangle_vertices = 0;
+   mesh->num_line_vertices = 0;
+   if (mesh->vertex_buffer) {
+      al_destroy_vertex_buffer(mesh->vertex_buffer);
+      mesh->vertex_buffer = NULL;
+   }
+}
+
+static void set_mesh_color(ALLEGRO_STROKE_MESH* mesh, ALLEGRO_COLOR color)
+{
+   int ii;
+
+   if (!memcmp(&mesh->color, &color, sizeof(ALLEGRO_COLOR)))
+      return;
+
+   mesh->color = color;
+   for (ii = 0; ii < mesh->num_triangle_vertices; ii++)
+      mesh->triangles[ii].color = color;
+   for (ii = 0; ii < mesh->num_line_vertices; ii++)
+      mesh->lines[ii].color = color;
+
+   if (mesh->vertex_buffer) {
+      al_destroy_vertex_buffer(mesh->vertex_buffer);
+      mesh->vertex_buffer = NULL;
+   }
+}
+
+/* Function: al_draw_stroke_mesh
+ */
+void al_draw_stroke_mesh(ALLEGRO_STROKE_MESH* mesh, ALLEGRO_COLOR color)
+{
+   ALLEGRO_BITMAP* target = al_get_target_bitmap();
+   ASSERT(mesh);
+
+   set_mesh_color(mesh, color);
+
+   if (mesh->num_triangle_vertices > 0) {
+      if (_al_coverage_wanted()) {
+         ALLEGRO_PRIM_COVERAGE* cov = _al_create_coverage();
+         int ii;
+
+         if (cov) {
+            for (ii = 0; ii < mesh->num_triangle_vertices; ii += 3)
+               _al_coverage_add_triangle(cov, &mesh->triangles[ii],
+                  &mesh->triangles[ii + 1], &mesh->triangles[ii + 2]);
+            _al_coverage_fill(cov, color);
+            _al_destroy_coverage(cov);
+         }
+         else {
+            al_draw_prim(mesh->triangles, NULL, NULL, 0, mesh->num_triangle_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+         }
+      }
+      else if (al_get_bitmap_flags(target) & ALLEGRO_MEMORY_BITMAP) {
+         al_draw_prim(mesh->triangles, NULL, NULL, 0, mesh->num_triangle_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+      }
+      else {
+         if (!mesh->vertex_buffer) {
+            mesh->vertex_buffer = al_create_vertex_buffer(NULL, mesh->triangles,
+               mesh->num_triangle_vertices, true, ALLEGRO_BUFFER_STATIC);
+         }
+         if (mesh->vertex_buffer)
+            al_draw_vertex_buffer(mesh->vertex_buffer, NULL, 0, mesh->num_triangle_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+         else
+            al_draw_prim(mesh->triangles, NULL, NULL, 0, mesh->num_triangle_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+      }
+   }
+
+   if (mesh->num_line_vertices > 0)
+      al_draw_prim(mesh->lines, NULL, NULL, 0, mesh->num_line_vertices, ALLEGRO_PRIM_LINE_LIST);
 }
 
 /* vim: set sts=3 sw=3 et: */
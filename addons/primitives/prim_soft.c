@@ -25,121 +25,353 @@
 #include "allegro5/internal/aintern_prim_soft.h"
 #include "allegro5/internal/aintern_prim.h"
 #include "allegro5/internal/aintern_tri_soft.h"
+#include <string.h>
 
 /*
 The vertex cache allows for bulk transformation of vertices, for faster run speeds
 */
 #define LOCAL_VERTEX_CACHE  ALLEGRO_VERTEX vertex_cache[ALLEGRO_VERTEX_CACHE_SIZE]
 
-static void convert_vtx(ALLEGRO_BITMAP* texture, const char* src, ALLEGRO_VERTEX* dest, const ALLEGRO_VERTEX_DECL* decl)
-{
-   ALLEGRO_VERTEX_ELEMENT* e;
-   if(!decl) {
-      *dest = *((ALLEGRO_VERTEX*)src);
-      return;
+/*
+Copies the x and y members of a pair attribute of the given storage into the
+destination vertices. Storage formats the software renderer doesn't support
+read as 0.
+*/
+#define CONVERT_PAIR(type, a, b)                                      \
+   for (ii = 0; ii < num; ii++) {                                     \
+      const type* ptr = (const type*)(src + ii * stride + e->offset); \
+      dest[ii].a = (float)ptr[0];                                     \
+      dest[ii].b = (float)ptr[1];                                     \
    }
-   e = &decl->elements[ALLEGRO_PRIM_POSITION];
-   if(e->attribute) {
-      switch(e->storage) {
-         case ALLEGRO_PRIM_FLOAT_2:
-         case ALLEGRO_PRIM_FLOAT_3:
-         {
-            float *ptr = (float*)(src + e->offset);
-            dest->x = *(ptr);
-            dest->y = *(ptr + 1);
-            break;
+
+static void convert_pairs(const char* src, int stride, const ALLEGRO_VERTEX_ELEMENT* e,
+   ALLEGRO_VERTEX* dest, int num, bool texcoord)
+{
+   int ii;
+
+   switch (e->attribute ? e->storage : -1) {
+      case ALLEGRO_PRIM_FLOAT_2:
+      case ALLEGRO_PRIM_FLOAT_3:
+         if (texcoord) {
+            CONVERT_PAIR(float, u, v);
+         } else {
+            CONVERT_PAIR(float, x, y);
          }
-         case ALLEGRO_PRIM_SHORT_2:
-         {
-            short *ptr = (short*)(src + e->offset);
-            dest->x = (float)*(ptr);
-            dest->y = (float)*(ptr + 1);
-            break;
+         break;
+      case ALLEGRO_PRIM_SHORT_2:
+         if (texcoord) {
+            CONVERT_PAIR(short, u, v);
+         } else {
+            CONVERT_PAIR(short, x, y);
          }
-      }
-   } else {
-      dest->x = 0;
-      dest->y = 0;
+         break;
+      default:
+         for (ii = 0; ii < num; ii++) {
+            if (texcoord) {
+               dest[ii].u = 0;
+               dest[ii].v = 0;
+            } else {
+               dest[ii].x = 0;
+               dest[ii].y = 0;
+            }
+         }
+         break;
    }
+}
+
+#undef CONVERT_PAIR
+
+/*
+Converts num vertices in the format described by decl into ALLEGRO_VERTEX.
+The declaration is examined once per call, and each attribute is then copied
+by a loop specialized for its storage, rather than switching on every
+attribute of every vertex.
+*/
+static void convert_vertices(ALLEGRO_BITMAP* texture, const char* src, const ALLEGRO_VERTEX_DECL* decl,
+   ALLEGRO_VERTEX* dest, int num)
+{
+   const ALLEGRO_VERTEX_ELEMENT* e;
+   int stride;
+   int ii;
+
+   if (!decl) {
+      memcpy(dest, src, num * sizeof(ALLEGRO_VERTEX));
+      return;
+   }
+   stride = decl->stride;
+
+   convert_pairs(src, stride, &decl->elements[ALLEGRO_PRIM_POSITION], dest, num, false);
+   for (ii = 0; ii < num; ii++)
+      dest[ii].z = 0;
 
    e = &decl->elements[ALLEGRO_PRIM_TEX_COORD];
-   if(!e->attribute)
+   if (!e->attribute)
       e = &decl->elements[ALLEGRO_PRIM_TEX_COORD_PIXEL];
-   if(e->attribute) {
-      switch(e->storage) {
-         case ALLEGRO_PRIM_FLOAT_2:
-         case ALLEGRO_PRIM_FLOAT_3:
-         {
-            float *ptr = (float*)(src + e->offset);
-            dest->u = *(ptr);
-            dest->v = *(ptr + 1);
-            break;
-         }
-         case ALLEGRO_PRIM_SHORT_2:
-         {
-            short *ptr = (short*)(src + e->offset);
-            dest->u = (float)*(ptr);
-            dest->v = (float)*(ptr + 1);
-            break;
-         }
-      }
-      if(texture && e->attribute == ALLEGRO_PRIM_TEX_COORD) {
-         dest->u *= (float)al_get_bitmap_width(texture);
-         dest->v *= (float)al_get_bitmap_height(texture);
+   convert_pairs(src, stride, e, dest, num, true);
+   if (texture && e->attribute == ALLEGRO_PRIM_TEX_COORD) {
+      float w = (float)al_get_bitmap_width(texture);
+      float h = (float)al_get_bitmap_height(texture);
+      for (ii = 0; ii < num; ii++) {
+         dest[ii].u *= w;
+         dest[ii].v *= h;
       }
-   } else {
-      dest->u = 0;
-      dest->v = 0;
    }
 
    e = &decl->elements[ALLEGRO_PRIM_COLOR_ATTR];
-   if(e->attribute) {
-      dest->color = *(ALLEGRO_COLOR*)(src + e->offset);
+   if (e->attribute) {
+      for (ii = 0; ii < num; ii++)
+         dest[ii].color = *(const ALLEGRO_COLOR*)(src + ii * stride + e->offset);
    } else {
-      dest->color = al_map_rgba_f(1,1,1,1);
+      ALLEGRO_COLOR white = al_map_rgba_f(1, 1, 1, 1);
+      for (ii = 0; ii < num; ii++)
+         dest[ii].color = white;
+   }
+}
+
+void _al_convert_vertices_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
+   ALLEGRO_VERTEX* dest, int start, int end)
+{
+   int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+
+   convert_vertices(texture, (const char*)vtxs + start * stride, decl, dest + start, end - start);
+}
+
+/*
+Batch version of al_transform_coordinates. The coefficients are loaded once,
+and the common cases of an identity or pure translation are handled by
+cheaper loops.
+*/
+void _al_transform_vertices_soft(const ALLEGRO_TRANSFORM* trans, ALLEGRO_VERTEX* vtxs, int num)
+{
+   const float m00 = trans->m[0][0];
+   const float m01 = trans->m[0][1];
+   const float m10 = trans->m[1][0];
+   const float m11 = trans->m[1][1];
+   const float m30 = trans->m[3][0];
+   const float m31 = trans->m[3][1];
+   int ii;
+
+   if (m00 == 1 && m01 == 0 && m10 == 0 && m11 == 1) {
+      if (m30 == 0 && m31 == 0)
+         return;
+      for (ii = 0; ii < num; ii++) {
+         vtxs[ii].x += m30;
+         vtxs[ii].y += m31;
+      }
+      return;
+   }
+
+   for (ii = 0; ii < num; ii++) {
+      const float x = vtxs[ii].x;
+      const float y = vtxs[ii].y;
+      vtxs[ii].x = x * m00 + y * m10 + m30;
+      vtxs[ii].y = x * m01 + y * m11 + m31;
+   }
+}
+
+/*
+Draws vertices that have already been converted and transformed
+*/
+static int draw_vertices(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtx, int num_vtx, int type)
+{
+   int ii;
+
+   switch (type) {
+      case ALLEGRO_PRIM_LINE_LIST: {
+         for (ii = 0; ii < num_vtx - 1; ii += 2) {
+            _al_line_2d(texture, &vtx[ii], &vtx[ii + 1]);
+         }
+         return num_vtx / 2;
+      };
+      case ALLEGRO_PRIM_LINE_STRIP: {
+         for (ii = 1; ii < num_vtx; ii++) {
+            _al_line_2d(texture, &vtx[ii - 1], &vtx[ii]);
+         }
+         return num_vtx - 1;
+      };
+      case ALLEGRO_PRIM_LINE_LOOP: {
+         for (ii = 1; ii < num_vtx; ii++) {
+            _al_line_2d(texture, &vtx[ii - 1], &vtx[ii]);
+         }
+         _al_line_2d(texture, &vtx[num_vtx - 1], &vtx[0]);
+         return num_vtx;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_LIST: {
+         for (ii = 0; ii < num_vtx - 2; ii += 3) {
+            _al_triangle_2d(texture, &vtx[ii], &vtx[ii + 1], &vtx[ii + 2]);
+         }
+         return num_vtx / 3;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_STRIP: {
+         for (ii = 2; ii < num_vtx; ii++) {
+            _al_triangle_2d(texture, &vtx[ii - 2], &vtx[ii - 1], &vtx[ii]);
+         }
+         return num_vtx - 2;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_FAN: {
+         for (ii = 1; ii < num_vtx; ii++) {
+            _al_triangle_2d(texture, &vtx[0], &vtx[ii], &vtx[ii - 1]);
+         }
+         return num_vtx - 2;
+      };
+      case ALLEGRO_PRIM_POINT_LIST: {
+         for (ii = 0; ii < num_vtx; ii++) {
+            _al_point_2d(texture, &vtx[ii]);
+         }
+         return num_vtx;
+      };
+   }
+   return 0;
+}
+
+/*
+Same as above, but vtx[indices[i] - base] is the i'th vertex
+*/
+static int draw_indexed_vertices(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtx, int base,
+   const int* indices, int num_vtx, int type)
+{
+   int ii;
+
+   switch (type) {
+      case ALLEGRO_PRIM_LINE_LIST: {
+         for (ii = 0; ii < num_vtx - 1; ii += 2) {
+            int idx1 = indices[ii] - base;
+            int idx2 = indices[ii + 1] - base;
+            
+            _al_line_2d(texture, &vtx[idx1], &vtx[idx2]);
+         }
+         return num_vtx / 2;
+      };
+      case ALLEGRO_PRIM_LINE_STRIP: {
+         for (ii = 1; ii < num_vtx; ii++) {
+            int idx1 = indices[ii - 1] - base;
+            int idx2 = indices[ii] - base;
+            
+            _al_line_2d(texture, &vtx[idx1], &vtx[idx2]);
+         }
+         return num_vtx - 1;
+      };
+      case ALLEGRO_PRIM_LINE_LOOP: {
+         int idx1, idx2;
+         
+         for (ii = 1; ii < num_vtx; ii++) {
+            idx1 = indices[ii - 1] - base;
+            idx2 = indices[ii] - base;
+            
+            _al_line_2d(texture, &vtx[idx1], &vtx[idx2]);
+         }
+         idx1 = indices[0] - base;
+         idx2 = indices[num_vtx - 1] - base;
+         
+         _al_line_2d(texture, &vtx[idx2], &vtx[idx1]);
+         return num_vtx;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_LIST: {
+         for (ii = 0; ii < num_vtx - 2; ii += 3) {
+            int idx1 = indices[ii] - base;
+            int idx2 = indices[ii + 1] - base;
+            int idx3 = indices[ii + 2] - base;
+            _al_triangle_2d(texture, &vtx[idx1], &vtx[idx2], &vtx[idx3]);
+         }
+         return num_vtx / 3;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_STRIP: {
+         for (ii = 2; ii < num_vtx; ii++) {
+            int idx1 = indices[ii - 2] - base;
+            int idx2 = indices[ii - 1] - base;
+            int idx3 = indices[ii] - base;
+            _al_triangle_2d(texture, &vtx[idx1], &vtx[idx2], &vtx[idx3]);
+         }
+         return num_vtx - 2;
+      };
+      case ALLEGRO_PRIM_TRIANGLE_FAN: {
+         int idx0 = indices[0] - base;
+         for (ii = 1; ii < num_vtx; ii++) {
+            int idx1 = indices[ii] - base;
+            int idx2 = indices[ii - 1] - base;
+            _al_triangle_2d(texture, &vtx[idx0], &vtx[idx1], &vtx[idx2]);
+         }
+         return num_vtx - 2;
+      };
+      case ALLEGRO_PRIM_POINT_LIST: {
+         for (ii = 0; ii < num_vtx; ii++) {
+            int idx = indices[ii] - base;
+            _al_point_2d(texture, &vtx[idx]);
+         }
+         return num_vtx;
+      };
    }
+   return 0;
+}
+
+int _al_draw_transformed_prim_soft(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtxs, int start, int end, int type)
+{
+   int num_primitives;
+
+   if (texture)
+      al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+
+   num_primitives = draw_vertices(texture, vtxs + start, end - start, type);
+
+   if (texture)
+      al_unlock_bitmap(texture);
+
+   return num_primitives;
+}
+
+int _al_draw_transformed_prim_indexed_soft(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* vtxs,
+   const int* indices, int num_vtx, int type)
+{
+   int num_primitives;
+
+   if (texture)
+      al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+
+   num_primitives = draw_indexed_vertices(texture, vtxs, 0, indices, num_vtx, type);
+
+   if (texture)
+      al_unlock_bitmap(texture);
+
+   return num_primitives;
 }
 
 int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_VERTEX_DECL* decl, int start, int end, int type)
 {
    LOCAL_VERTEX_CACHE;
+   ALLEGRO_VERTEX* cache;
    int num_primitives;
    int num_vtx;
-   int use_cache;
    int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
    const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
    
    num_primitives = 0;
    num_vtx = end - start;
-   use_cache = num_vtx < ALLEGRO_VERTEX_CACHE_SIZE;
+
+   /*
+   Vertices are converted and transformed in bulk into the local cache, or
+   into a heap cache sized to the batch when they don't fit
+   */
+   if (num_vtx <= ALLEGRO_VERTEX_CACHE_SIZE)
+      cache = vertex_cache;
+   else
+      cache = al_malloc(num_vtx * sizeof(ALLEGRO_VERTEX));
 
    if (texture)
       al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
       
-   if (use_cache) {
-      int ii;
-      int n = 0;
-      const char* vtxptr = (const char*)vtxs + start * stride;
-      for (ii = 0; ii < num_vtx; ii++) {
-         convert_vtx(texture, vtxptr, &vertex_cache[ii], decl);
-         al_transform_coordinates(global_trans, &vertex_cache[ii].x, &vertex_cache[ii].y);
-         n++;
-         vtxptr += stride;
-      }
-   }
-   
-#define SET_VERTEX(v, idx)                                             \
-   convert_vtx(texture, (const char*)vtxs + stride * (idx), &v, decl); \
-   al_transform_coordinates(global_trans, &v.x, &v.y);            \
+#define SET_VERTEX(v, idx)                                                   \
+   convert_vertices(texture, (const char*)vtxs + stride * (idx), decl, &v, 1); \
+   _al_transform_vertices_soft(global_trans, &v, 1);                         \
     
-   switch (type) {
-      case ALLEGRO_PRIM_LINE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 1; ii += 2) {
-               _al_line_2d(texture, &vertex_cache[ii], &vertex_cache[ii + 1]);
-            }
-         } else {
+   if (cache) {
+      convert_vertices(texture, (const char*)vtxs + start * stride, decl, cache, num_vtx);
+      _al_transform_vertices_soft(global_trans, cache, num_vtx);
+      num_primitives = draw_vertices(texture, cache, num_vtx, type);
+      if (cache != vertex_cache)
+         al_free(cache);
+   } else {
+      switch (type) {
+         case ALLEGRO_PRIM_LINE_LIST: {
             int ii;
             for (ii = start; ii < end - 1; ii += 2) {
                ALLEGRO_VERTEX v1, v2;
@@ -148,17 +380,10 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
                
                _al_line_2d(texture, &v1, &v2);
             }
-         }
-         num_primitives = num_vtx / 2;
-         break;
-      };
-      case ALLEGRO_PRIM_LINE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               _al_line_2d(texture, &vertex_cache[ii - 1], &vertex_cache[ii]);
-            }
-         } else {
+            num_primitives = num_vtx / 2;
+            break;
+         };
+         case ALLEGRO_PRIM_LINE_STRIP: {
             int ii;
             int idx = 1;
             ALLEGRO_VERTEX vtx[2];
@@ -168,18 +393,10 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
                _al_line_2d(texture, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
-         }
-         num_primitives = num_vtx - 1;
-         break;
-      };
-      case ALLEGRO_PRIM_LINE_LOOP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               _al_line_2d(texture, &vertex_cache[ii - 1], &vertex_cache[ii]);
-            }
-            _al_line_2d(texture, &vertex_cache[num_vtx - 1], &vertex_cache[0]);
-         } else {
+            num_primitives = num_vtx - 1;
+            break;
+         };
+         case ALLEGRO_PRIM_LINE_LOOP: {
             int ii;
             int idx = 1;
             ALLEGRO_VERTEX vtx[2];
@@ -191,17 +408,10 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
             }
             SET_VERTEX(vtx[idx], start)
             _al_line_2d(texture, &vtx[idx], &vtx[1 - idx]);
-         }
-         num_primitives = num_vtx;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 2; ii += 3) {
-               _al_triangle_2d(texture, &vertex_cache[ii], &vertex_cache[ii + 1], &vertex_cache[ii + 2]);
-            }
-         } else {
+            num_primitives = num_vtx;
+            break;
+         };
+         case ALLEGRO_PRIM_TRIANGLE_LIST: {
             int ii;
             for (ii = start; ii < end - 2; ii += 3) {
                ALLEGRO_VERTEX v1, v2, v3;
@@ -211,17 +421,10 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
                
                _al_triangle_2d(texture, &v1, &v2, &v3);
             }
-         }
-         num_primitives = num_vtx / 3;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 2; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[ii - 2], &vertex_cache[ii - 1], &vertex_cache[ii]);
-            }
-         } else {
+            num_primitives = num_vtx / 3;
+            break;
+         };
+         case ALLEGRO_PRIM_TRIANGLE_STRIP: {
             int ii;
             int idx = 2;
             ALLEGRO_VERTEX vtx[3];
@@ -233,17 +436,10 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
                _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
                idx = (idx + 1) % 3;
             }
-         }
-         num_primitives = num_vtx - 2;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_FAN: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               _al_triangle_2d(texture, &vertex_cache[0], &vertex_cache[ii], &vertex_cache[ii - 1]);
-            }
-         } else {
+            num_primitives = num_vtx - 2;
+            break;
+         };
+         case ALLEGRO_PRIM_TRIANGLE_FAN: {
             int ii;
             int idx = 1;
             ALLEGRO_VERTEX v0;
@@ -255,17 +451,10 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
                _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
-         }
-         num_primitives = num_vtx - 2;
-         break;
-      };
-      case ALLEGRO_PRIM_POINT_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx; ii++) {
-               _al_point_2d(texture, &vertex_cache[ii]);
-            }
-         } else {
+            num_primitives = num_vtx - 2;
+            break;
+         };
+         case ALLEGRO_PRIM_POINT_LIST: {
             int ii;
             for (ii = start; ii < end; ii++) {
                ALLEGRO_VERTEX v;
@@ -273,10 +462,10 @@ int _al_draw_prim_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const ALLEGRO_
 
                _al_point_2d(texture, &v);
             }
-         }
-         num_primitives = num_vtx;
-         break;
-      };
+            num_primitives = num_vtx;
+            break;
+         };
+      }
    }
    
    if(texture)
@@ -290,15 +479,17 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
    const int* indices, int num_vtx, int type)
 {
    LOCAL_VERTEX_CACHE;
+   unsigned char local_converted[ALLEGRO_VERTEX_CACHE_SIZE];
+   ALLEGRO_VERTEX* cache;
+   unsigned char* converted;
    int num_primitives;
-   int use_cache;
-   int min_idx, max_idx;
+   int min_idx, max_idx, range;
+   bool sparse;
    int ii;
    int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
    const ALLEGRO_TRANSFORM* global_trans = al_get_current_transform();
 
    num_primitives = 0;   
-   use_cache = 1;
    min_idx = indices[0];
    max_idx = indices[0];
 
@@ -309,40 +500,65 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
       int idx = indices[ii];
       if (max_idx < idx)
          max_idx = idx;
-      else if (min_idx > indices[ii])
+      else if (min_idx > idx)
          min_idx = idx;
    }
-   if (max_idx - min_idx >= ALLEGRO_VERTEX_CACHE_SIZE) {
-      use_cache = 0;
+   range = max_idx - min_idx + 1;
+
+   /*
+   Every vertex in the range is converted and transformed once, whether it is
+   referenced once or many times. When the indices only touch a small part of
+   the range, only the referenced vertices are converted instead, and when the
+   range is hopelessly sparse the cache isn't used at all
+   */
+   sparse = range > 2 * num_vtx;
+   cache = NULL;
+   converted = NULL;
+   if (range <= ALLEGRO_VERTEX_CACHE_SIZE) {
+      cache = vertex_cache;
+      converted = local_converted;
+   }
+   else if (range / 64 <= num_vtx) {
+      cache = al_malloc(range * sizeof(ALLEGRO_VERTEX));
+      if (cache && sparse) {
+         converted = al_malloc(range);
+         if (!converted) {
+            al_free(cache);
+            cache = NULL;
+         }
+      }
    }
 
    if (texture)
       al_lock_bitmap(texture, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
       
-   if (use_cache) {
-      int ii;
-      for (ii = 0; ii < num_vtx; ii++) {
-         int idx = indices[ii];
-         convert_vtx(texture, (const char*)vtxs + idx * stride, &vertex_cache[idx - min_idx], decl);
-         al_transform_coordinates(global_trans, &vertex_cache[idx - min_idx].x, &vertex_cache[idx - min_idx].y);
-      }
-   }
-   
-#define SET_VERTEX(v, idx)                                             \
-   convert_vtx(texture, (const char*)vtxs + stride * (idx), &v, decl); \
-   al_transform_coordinates(global_trans, &v.x, &v.y);            \
+#define SET_VERTEX(v, idx)                                                   \
+   convert_vertices(texture, (const char*)vtxs + stride * (idx), decl, &v, 1); \
+   _al_transform_vertices_soft(global_trans, &v, 1);                         \
     
-   switch (type) {
-      case ALLEGRO_PRIM_LINE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 1; ii += 2) {
-               int idx1 = indices[ii] - min_idx;
-               int idx2 = indices[ii + 1] - min_idx;
-               
-               _al_line_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2]);
+   if (cache) {
+      if (sparse) {
+         memset(converted, 0, range);
+         for (ii = 0; ii < num_vtx; ii++) {
+            int idx = indices[ii] - min_idx;
+            if (!converted[idx]) {
+               SET_VERTEX(cache[idx], indices[ii]);
+               converted[idx] = 1;
             }
-         } else {
+         }
+      }
+      else {
+         convert_vertices(texture, (const char*)vtxs + min_idx * stride, decl, cache, range);
+         _al_transform_vertices_soft(global_trans, cache, range);
+      }
+      num_primitives = draw_indexed_vertices(texture, cache, min_idx, indices, num_vtx, type);
+      if (cache != vertex_cache) {
+         al_free(cache);
+         al_free(converted);
+      }
+   } else {
+      switch (type) {
+         case ALLEGRO_PRIM_LINE_LIST: {
             int ii;
             for (ii = 0; ii < num_vtx - 1; ii += 2) {
                int idx1 = indices[ii];
@@ -354,20 +570,10 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                
                _al_line_2d(texture, &v1, &v2);
             }
-         }
-         num_primitives = num_vtx / 2;
-         break;
-      };
-      case ALLEGRO_PRIM_LINE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 1; ii < num_vtx; ii++) {
-               int idx1 = indices[ii - 1] - min_idx;
-               int idx2 = indices[ii] - min_idx;
-               
-               _al_line_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2]);
-            }
-         } else {
+            num_primitives = num_vtx / 2;
+            break;
+         };
+         case ALLEGRO_PRIM_LINE_STRIP: {
             int ii;
             int idx = 1;
             ALLEGRO_VERTEX vtx[2];
@@ -377,26 +583,10 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                _al_line_2d(texture, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
-         }
-         num_primitives = num_vtx - 1;
-         break;
-      };
-      case ALLEGRO_PRIM_LINE_LOOP: {
-         if (use_cache) {
-            int ii;
-            int idx1, idx2;
-            
-            for (ii = 1; ii < num_vtx; ii++) {
-               int idx1 = indices[ii - 1] - min_idx;
-               int idx2 = indices[ii] - min_idx;
-               
-               _al_line_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2]);
-            }
-            idx1 = indices[0] - min_idx;
-            idx2 = indices[num_vtx - 1] - min_idx;
-            
-            _al_line_2d(texture, &vertex_cache[idx2], &vertex_cache[idx1]);
-         } else {
+            num_primitives = num_vtx - 1;
+            break;
+         };
+         case ALLEGRO_PRIM_LINE_LOOP: {
             int ii;
             int idx = 1;
             ALLEGRO_VERTEX vtx[2];
@@ -408,20 +598,10 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
             }
             SET_VERTEX(vtx[idx], indices[0])
             _al_line_2d(texture, &vtx[0], &vtx[1]);
-         }
-         num_primitives = num_vtx;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx - 2; ii += 3) {
-               int idx1 = indices[ii] - min_idx;
-               int idx2 = indices[ii + 1] - min_idx;
-               int idx3 = indices[ii + 2] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
-            }
-         } else {
+            num_primitives = num_vtx;
+            break;
+         };
+         case ALLEGRO_PRIM_TRIANGLE_LIST: {
             int ii;
             for (ii = 0; ii < num_vtx - 2; ii += 3) {
                int idx1 = indices[ii];
@@ -435,20 +615,10 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                
                _al_triangle_2d(texture, &v1, &v2, &v3);
             }
-         }
-         num_primitives = num_vtx / 3;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_STRIP: {
-         if (use_cache) {
-            int ii;
-            for (ii = 2; ii < num_vtx; ii++) {
-               int idx1 = indices[ii - 2] - min_idx;
-               int idx2 = indices[ii - 1] - min_idx;
-               int idx3 = indices[ii] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx1], &vertex_cache[idx2], &vertex_cache[idx3]);
-            }
-         } else {
+            num_primitives = num_vtx / 3;
+            break;
+         };
+         case ALLEGRO_PRIM_TRIANGLE_STRIP: {
             int ii;
             int idx = 2;
             ALLEGRO_VERTEX vtx[3];
@@ -460,20 +630,10 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                _al_triangle_2d(texture, &vtx[0], &vtx[1], &vtx[2]);
                idx = (idx + 1) % 3;
             }
-         }
-         num_primitives = num_vtx - 2;
-         break;
-      };
-      case ALLEGRO_PRIM_TRIANGLE_FAN: {
-         if (use_cache) {
-            int ii;
-            int idx0 = indices[0] - min_idx;
-            for (ii = 1; ii < num_vtx; ii++) {
-               int idx1 = indices[ii] - min_idx;
-               int idx2 = indices[ii - 1] - min_idx;
-               _al_triangle_2d(texture, &vertex_cache[idx0], &vertex_cache[idx1], &vertex_cache[idx2]);
-            }
-         } else {
+            num_primitives = num_vtx - 2;
+            break;
+         };
+         case ALLEGRO_PRIM_TRIANGLE_FAN: {
             int ii;
             int idx = 1;
             ALLEGRO_VERTEX v0;
@@ -485,18 +645,10 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
                _al_triangle_2d(texture, &v0, &vtx[0], &vtx[1]);
                idx = 1 - idx;
             }
-         }
-         num_primitives = num_vtx - 2;
-         break;
-      };
-      case ALLEGRO_PRIM_POINT_LIST: {
-         if (use_cache) {
-            int ii;
-            for (ii = 0; ii < num_vtx; ii++) {
-               int idx = indices[ii] - min_idx;
-               _al_point_2d(texture, &vertex_cache[idx]);
-            }
-         } else {
+            num_primitives = num_vtx - 2;
+            break;
+         };
+         case ALLEGRO_PRIM_POINT_LIST: {
             int ii;
             for (ii = 0; ii < num_vtx; ii++) {
                ALLEGRO_VERTEX v;
@@ -504,10 +656,10 @@ int _al_draw_prim_indexed_soft(ALLEGRO_BITMAP* texture, const void* vtxs, const
 
                _al_point_2d(texture, &v);
             }
-         }
-         num_primitives = num_vtx;
-         break;
-      };
+            num_primitives = num_vtx;
+            break;
+         };
+      }
    }
 
    if(texture)
@@ -20,6 +20,7 @@
 #include "allegro5/allegro_primitives.h"
 #include "allegro5/internal/aintern_list.h"
 #include "allegro5/internal/aintern_prim.h"
+#include "allegro5/internal/aintern_prim_soft.h"
 #include <float.h>
 #include <math.h>
 
@@ -175,11 +176,29 @@ void _al_prim_cache_init_ex(ALLEGRO_PRIM_VERTEX_CACHE* cache, int prim_type, ALL
    cache->color     = color;
    cache->prim_type = prim_type;
    cache->user_data = user_data;
+   cache->coverage  = NULL;
+   cache->mesh      = NULL;
+}
+
+/* Makes a triangle cache collect its triangles for the coverage rasterizer.
+ * Nothing is drawn until _al_prim_cache_term. Leaves the cache as it is if
+ * the coverage can't be created.
+ */
+void _al_prim_cache_use_coverage(ALLEGRO_PRIM_VERTEX_CACHE* cache)
+{
+   ASSERT(cache->prim_type == ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE);
+   cache->coverage = _al_create_coverage();
 }
 
 void _al_prim_cache_term(ALLEGRO_PRIM_VERTEX_CACHE* cache)
 {
    _al_prim_cache_flush(cache);
+
+   if (cache->coverage) {
+      _al_coverage_fill(cache->coverage, cache->color);
+      _al_destroy_coverage(cache->coverage);
+      cache->coverage = NULL;
+   }
 }
 
 void _al_prim_cache_flush(ALLEGRO_PRIM_VERTEX_CACHE* cache)
@@ -187,7 +206,16 @@ void _al_prim_cache_flush(ALLEGRO_PRIM_VERTEX_CACHE* cache)
    if (cache->size == 0)
       return;
 
-   if (cache->prim_type == ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE)
+   if (cache->mesh) {
+      _al_stroke_mesh_add_vertices(cache->mesh, cache->prim_type, cache->buffer, cache->size);
+   }
+   else if (cache->coverage) {
+      size_t ii;
+      for (ii = 0; ii < cache->size; ii += 3)
+         _al_coverage_add_triangle(cache->coverage, &cache->buffer[ii],
+            &cache->buffer[ii + 1], &cache->buffer[ii + 2]);
+   }
+   else if (cache->prim_type == ALLEGRO_PRIM_VERTEX_CACHE_TRIANGLE)
       al_draw_prim(cache->buffer, NULL, NULL, 0, cache->size, ALLEGRO_PRIM_TRIANGLE_LIST);
    else if (cache->prim_type == ALLEGRO_PRIM_VERTEX_CACHE_LINE_STRIP)
       al_draw_prim(cache->buffer, NULL, NULL, 0, cache->size, ALLEGRO_PRIM_LINE_STRIP);
@@ -27,6 +27,7 @@
 #include "allegro5/internal/aintern_prim_opengl.h"
 #include "allegro5/internal/aintern_prim_soft.h"
 #include <math.h>
+#include <string.h>
 
 #ifdef ALLEGRO_CFG_OPENGL
 #include "allegro5/allegro_opengl.h"
@@ -62,6 +63,63 @@ void al_shutdown_primitives_addon(void)
    addon_initialized = false;
 }
 
+/* Records the bounding box of the vertices drawn to a display bitmap which
+ * tracks its dirty rectangles. Memory targets record what they lock.
+ */
+static void mark_prim_dirty(ALLEGRO_BITMAP *target, const void *vtxs,
+   const ALLEGRO_VERTEX_DECL *decl, const int *indices, int start, int end)
+{
+   const ALLEGRO_VERTEX_ELEMENT *e = NULL;
+   const char *base = vtxs;
+   int stride = decl ? decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+   int offset = 0;
+   int storage = ALLEGRO_PRIM_FLOAT_2;
+   float x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+   int ii;
+
+   if (!al_get_bitmap_dirty_tracking(target) || start >= end)
+      return;
+
+   if (decl) {
+      e = &decl->elements[ALLEGRO_PRIM_POSITION];
+      offset = e->offset;
+      storage = e->storage;
+   }
+
+   if (storage != ALLEGRO_PRIM_FLOAT_2 && storage != ALLEGRO_PRIM_FLOAT_3 &&
+         storage != ALLEGRO_PRIM_SHORT_2) {
+      _al_mark_bitmap_dirty(target, target->cl, target->ct,
+         target->cr_excl - target->cl, target->cb_excl - target->ct);
+      return;
+   }
+
+   for (ii = start; ii < end; ii++) {
+      const char *v = base + (indices ? indices[ii] : ii) * stride + offset;
+      float x, y;
+      if (storage == ALLEGRO_PRIM_SHORT_2) {
+         x = ((const short *)v)[0];
+         y = ((const short *)v)[1];
+      }
+      else {
+         x = ((const float *)v)[0];
+         y = ((const float *)v)[1];
+      }
+      if (ii == start) {
+         x1 = x2 = x;
+         y1 = y2 = y;
+      }
+      else {
+         x1 = _ALLEGRO_MIN(x1, x);
+         y1 = _ALLEGRO_MIN(y1, y);
+         x2 = _ALLEGRO_MAX(x2, x);
+         y2 = _ALLEGRO_MAX(y2, y);
+      }
+   }
+
+   /* Points and lines may cover the pixels around their vertices. */
+   _al_mark_target_dirty(x1 - 1, y1 - 1, x2 + 1, y2 + 1);
+}
+
 /* Function: al_draw_prim
  */
 int al_draw_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
@@ -90,6 +148,7 @@ int al_draw_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
       } else if (flags & ALLEGRO_DIRECT3D) {
          ret =  _al_draw_prim_directx(target, texture, vtxs, decl, start, end, type);
       }
+      mark_prim_dirty(target, vtxs, decl, NULL, start, end);
    }
    
    return ret;
@@ -124,6 +183,7 @@ int al_draw_indexed_prim(const void* vtxs, const ALLEGRO_VERTEX_DECL* decl,
       } else if (flags & ALLEGRO_DIRECT3D) {
          ret =  _al_draw_prim_indexed_directx(target, texture, vtxs, decl, indices, num_vtx, type);
       }
+      mark_prim_dirty(target, vtxs, decl, indices, 0, num_vtx);
    }
    
    return ret;
@@ -147,6 +207,12 @@ uint32_t al_get_allegro_primitives_version(void)
    return ALLEGRO_VERSION_INT;
 }
 
+static int current_display_flags(void)
+{
+   ALLEGRO_DISPLAY* display = al_get_current_display();
+   return display ? al_get_display_flags(display) : 0;
+}
+
 /* Function: al_create_vertex_decl
  */
 ALLEGRO_VERTEX_DECL* al_create_vertex_decl(const ALLEGRO_VERTEX_ELEMENT* elements, int stride)
@@ -194,7 +260,7 @@ ALLEGRO_VERTEX_DECL* al_create_vertex_decl(const ALLEGRO_VERTEX_ELEMENT* element
    }
 
    display = al_get_current_display();
-   flags = al_get_display_flags(display);
+   flags = current_display_flags();
    if (flags & ALLEGRO_DIRECT3D) {
       _al_set_d3d_decl(display, ret);
    }
@@ -218,29 +284,129 @@ void al_destroy_vertex_decl(ALLEGRO_VERTEX_DECL* decl)
    al_free(decl);
 }
 
+static bool create_vertex_buffer_soft(ALLEGRO_VERTEX_BUFFER* buf,
+   const void* initial_data, size_t num_vertices)
+{
+   int stride = buf->decl ? buf->decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+   size_t size = num_vertices * stride;
+
+   buf->soft_vertices = al_malloc(size > 0 ? size : 1);
+   if (!buf->soft_vertices)
+      return false;
+   if (initial_data)
+      memcpy(buf->soft_vertices, initial_data, size);
+
+   buf->is_soft = true;
+   buf->dirty_start = 0;
+   buf->dirty_end = num_vertices;
+   return true;
+}
+
+static void destroy_vertex_buffer_soft(ALLEGRO_VERTEX_BUFFER* buf)
+{
+   if (buf->decoded != (ALLEGRO_VERTEX*)buf->soft_vertices)
+      al_free(buf->decoded);
+   al_free(buf->transformed);
+   al_free(buf->soft_vertices);
+}
+
+/* Brings the decoded and transformed caches of a software buffer up to
+ * date for drawing with the given texture and the current transformation.
+ * Returns NULL if the caches can't be allocated.
+ */
+static ALLEGRO_VERTEX* get_transformed_vertices(ALLEGRO_VERTEX_BUFFER* buf,
+   ALLEGRO_BITMAP* texture)
+{
+   const ALLEGRO_TRANSFORM* trans = al_get_current_transform();
+   int texture_w = texture ? al_get_bitmap_width(texture) : 0;
+   int texture_h = texture ? al_get_bitmap_height(texture) : 0;
+   size_t start = buf->dirty_start;
+   size_t end = buf->dirty_end;
+
+   if (!buf->transformed) {
+      size_t size = (buf->size > 0 ? buf->size : 1) * sizeof(ALLEGRO_VERTEX);
+
+      buf->transformed = al_malloc(size);
+      if (!buf->transformed)
+         return NULL;
+      if (buf->decl) {
+         buf->decoded = al_malloc(size);
+         if (!buf->decoded) {
+            al_free(buf->transformed);
+            buf->transformed = NULL;
+            return NULL;
+         }
+      }
+      else {
+         buf->decoded = (ALLEGRO_VERTEX*)buf->soft_vertices;
+      }
+      buf->texture_w = texture_w;
+      buf->texture_h = texture_h;
+      start = 0;
+      end = buf->size;
+   }
+
+   /* Normalized texture coordinates are decoded into pixels. */
+   if (buf->decl && buf->decl->elements[ALLEGRO_PRIM_TEX_COORD].attribute &&
+         (buf->texture_w != texture_w || buf->texture_h != texture_h)) {
+      buf->texture_w = texture_w;
+      buf->texture_h = texture_h;
+      start = 0;
+      end = buf->size;
+   }
+
+   if (buf->decl && start < end) {
+      _al_convert_vertices_soft(texture, buf->soft_vertices, buf->decl,
+         buf->decoded, start, end);
+   }
+
+   if (memcmp(trans, &buf->transform, sizeof(ALLEGRO_TRANSFORM)) != 0) {
+      al_copy_transform(&buf->transform, trans);
+      start = 0;
+      end = buf->size;
+   }
+
+   if (start < end) {
+      memcpy(buf->transformed + start, buf->decoded + start,
+         (end - start) * sizeof(ALLEGRO_VERTEX));
+      _al_transform_vertices_soft(trans, buf->transformed + start, end - start);
+   }
+
+   buf->dirty_start = 0;
+   buf->dirty_end = 0;
+   return buf->transformed;
+}
+
 /* Function: al_create_vertex_buffer
  */
 ALLEGRO_VERTEX_BUFFER* al_create_vertex_buffer(ALLEGRO_VERTEX_DECL* decl,
    const void* initial_data, size_t num_vertices, bool write_only, int hints)
 {
    ALLEGRO_VERTEX_BUFFER* ret;
-   int flags = al_get_display_flags(al_get_current_display());
+   int flags = current_display_flags();
    ASSERT(addon_initialized);
    ret = al_calloc(1, sizeof(ALLEGRO_VERTEX_BUFFER));
    ret->write_only = write_only;
    ret->decl = decl;
+   ret->size = num_vertices;
 
+   if (flags & (ALLEGRO_OPENGL | ALLEGRO_DIRECT3D)) {
 #if defined ALLEGRO_IPHONE || defined ALLEGRO_ANDROID
-   if (!write_only)
-      goto fail;
+      if (!write_only)
+         goto fail;
 #endif
 
-   if (flags & ALLEGRO_OPENGL) {
-      if (_al_create_vertex_buffer_opengl(ret, initial_data, num_vertices, hints))
-         return ret;
+      if (flags & ALLEGRO_OPENGL) {
+         if (_al_create_vertex_buffer_opengl(ret, initial_data, num_vertices, hints))
+            return ret;
+      }
+      else if (flags & ALLEGRO_DIRECT3D) {
+         if (_al_create_vertex_buffer_directx(ret, initial_data, num_vertices, hints))
+            return ret;
+      }
    }
-   else if (flags & ALLEGRO_DIRECT3D) {
-      if (_al_create_vertex_buffer_directx(ret, initial_data, num_vertices, hints))
+   else {
+      if (create_vertex_buffer_soft(ret, initial_data, num_vertices))
          return ret;
    }
 
@@ -255,7 +421,7 @@ fail:
  */
 void al_destroy_vertex_buffer(ALLEGRO_VERTEX_BUFFER* buffer)
 {
-   int flags = al_get_display_flags(al_get_current_display());
+   int flags = current_display_flags();
    ASSERT(addon_initialized);
 
    if (buffer == 0)
@@ -263,7 +429,10 @@ void al_destroy_vertex_buffer(ALLEGRO_VERTEX_BUFFER* buffer)
 
    al_unlock_vertex_buffer(buffer);
 
-   if (flags & ALLEGRO_OPENGL) {
+   if (buffer->is_soft) {
+      destroy_vertex_buffer_soft(buffer);
+   }
+   else if (flags & ALLEGRO_OPENGL) {
       _al_destroy_vertex_buffer_opengl(buffer);
    }
    else if (flags & ALLEGRO_DIRECT3D) {
@@ -280,7 +449,7 @@ void* al_lock_vertex_buffer(ALLEGRO_VERTEX_BUFFER* buffer, size_t offset,
 {
    void* ret;
    int stride;
-   int disp_flags = al_get_display_flags(al_get_current_display());
+   int disp_flags = current_display_flags();
    ASSERT(buffer);
    ASSERT(addon_initialized);
    if (buffer->is_locked || (buffer->write_only && flags != ALLEGRO_LOCK_WRITEONLY))
@@ -291,7 +460,10 @@ void* al_lock_vertex_buffer(ALLEGRO_VERTEX_BUFFER* buffer, size_t offset,
    buffer->lock_length = length * stride;
    buffer->lock_flags = flags;
 
-   if (disp_flags & ALLEGRO_OPENGL) {
+   if (buffer->is_soft) {
+      ret = buffer->soft_vertices + buffer->lock_offset;
+   }
+   else if (disp_flags & ALLEGRO_OPENGL) {
       ret = _al_lock_vertex_buffer_opengl(buffer);
    }
    else if (disp_flags & ALLEGRO_DIRECT3D) {
@@ -310,14 +482,30 @@ void* al_lock_vertex_buffer(ALLEGRO_VERTEX_BUFFER* buffer, size_t offset,
  */
 void al_unlock_vertex_buffer(ALLEGRO_VERTEX_BUFFER* buffer)
 {
-   int flags = al_get_display_flags(al_get_current_display());
+   int flags = current_display_flags();
    ASSERT(buffer);
    ASSERT(addon_initialized);
 
    if (!buffer->is_locked)
       return;
 
-   if (flags & ALLEGRO_OPENGL) {
+   if (buffer->is_soft) {
+      if (buffer->lock_flags != ALLEGRO_LOCK_READONLY && buffer->lock_length > 0) {
+         int stride = buffer->decl ? buffer->decl->stride : (int)sizeof(ALLEGRO_VERTEX);
+         size_t start = buffer->lock_offset / stride;
+         size_t end = (buffer->lock_offset + buffer->lock_length) / stride;
+
+         if (buffer->dirty_start == buffer->dirty_end) {
+            buffer->dirty_start = start;
+            buffer->dirty_end = end;
+         }
+         else {
+            buffer->dirty_start = _ALLEGRO_MIN(buffer->dirty_start, start);
+            buffer->dirty_end = _ALLEGRO_MAX(buffer->dirty_end, end);
+         }
+      }
+   }
+   else if (flags & ALLEGRO_OPENGL) {
       _al_unlock_vertex_buffer_opengl(buffer);
    }
    else if (flags & ALLEGRO_DIRECT3D) {
@@ -327,6 +515,12 @@ void al_unlock_vertex_buffer(ALLEGRO_VERTEX_BUFFER* buffer)
    buffer->is_locked = false;
 }
 
+static bool is_soft_target(ALLEGRO_BITMAP* target, ALLEGRO_BITMAP* texture)
+{
+   return (target->flags & ALLEGRO_MEMORY_BITMAP) ||
+      (texture && texture->flags & ALLEGRO_MEMORY_BITMAP);
+}
+
 /* Function: al_draw_vertex_buffer
  */
 int al_draw_vertex_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
@@ -343,7 +537,19 @@ int al_draw_vertex_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
 
    target = al_get_target_bitmap();
 
-   if (target->flags & ALLEGRO_MEMORY_BITMAP || (texture && texture->flags & ALLEGRO_MEMORY_BITMAP)) {
+   if (vertex_buffer->is_soft) {
+      if (start == end)
+         return 0;
+      if (is_soft_target(target, texture)) {
+         ALLEGRO_VERTEX* vtx = get_transformed_vertices(vertex_buffer, texture);
+         if (vtx)
+            return _al_draw_transformed_prim_soft(texture, vtx, start, end, type);
+      }
+      return al_draw_prim(vertex_buffer->soft_vertices, vertex_buffer->decl,
+         texture, start, end, type);
+   }
+
+   if (is_soft_target(target, texture)) {
       void* vtx;
       ASSERT(!vertex_buffer->write_only);
       vtx = al_lock_vertex_buffer(vertex_buffer, start, end - start, ALLEGRO_LOCK_READONLY);
@@ -351,14 +557,172 @@ int al_draw_vertex_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
       ret = _al_draw_prim_soft(texture, vtx, vertex_buffer->decl, 0, end - start, type);
       al_unlock_vertex_buffer(vertex_buffer);
    } else {
-      int flags = al_get_display_flags(al_get_current_display());
+      int flags = current_display_flags();
       if (flags & ALLEGRO_OPENGL) {
          ret = _al_draw_vertex_buffer_opengl(target, texture, vertex_buffer, start, end, type);
       }
       else if (flags & ALLEGRO_DIRECT3D) {
          ret = _al_draw_vertex_buffer_directx(target, texture, vertex_buffer, start, end, type);
       }
+      /* The vertices are not at hand, so assume everything changed. */
+      if (al_get_bitmap_dirty_tracking(target)) {
+         _al_mark_bitmap_dirty(target, target->cl, target->ct,
+            target->cr_excl - target->cl, target->cb_excl - target->ct);
+      }
+   }
+
+   return ret;
+}
+
+/* Function: al_create_index_buffer
+ */
+ALLEGRO_INDEX_BUFFER* al_create_index_buffer(int index_size,
+    const void* initial_data, size_t num_indices, int hints)
+{
+   ALLEGRO_INDEX_BUFFER* ret;
+   size_t size = (num_indices > 0 ? num_indices : 1) * index_size;
+   ASSERT(addon_initialized);
+   ASSERT(index_size == 2 || index_size == 4);
+   (void)hints;
+
+   ret = al_calloc(1, sizeof(ALLEGRO_INDEX_BUFFER));
+   if (!ret)
+      return NULL;
+   ret->index_size = index_size;
+   ret->size = num_indices;
+
+   ret->data = al_calloc(1, size);
+   if (!ret->data)
+      goto fail;
+   if (index_size == 4) {
+      ret->indices = ret->data;
+   }
+   else {
+      ret->indices = al_calloc(num_indices > 0 ? num_indices : 1, sizeof(int));
+      if (!ret->indices)
+         goto fail;
+   }
+
+   if (initial_data) {
+      ret->lock_offset = 0;
+      ret->lock_length = num_indices;
+      ret->lock_flags = ALLEGRO_LOCK_WRITEONLY;
+      ret->is_locked = true;
+      memcpy(ret->data, initial_data, num_indices * index_size);
+      al_unlock_index_buffer(ret);
+   }
+
+   return ret;
+
+fail:
+   al_free(ret->data);
+   al_free(ret);
+   return NULL;
+}
+
+/* Function: al_destroy_index_buffer
+ */
+void al_destroy_index_buffer(ALLEGRO_INDEX_BUFFER* buffer)
+{
+   ASSERT(addon_initialized);
+
+   if (buffer == 0)
+      return;
+
+   if (buffer->indices != buffer->data)
+      al_free(buffer->indices);
+   al_free(buffer->data);
+   al_free(buffer);
+}
+
+/* Function: al_lock_index_buffer
+ */
+void* al_lock_index_buffer(ALLEGRO_INDEX_BUFFER* buffer, size_t offset,
+   size_t length, int flags)
+{
+   ASSERT(buffer);
+   ASSERT(addon_initialized);
+   ASSERT(offset + length <= buffer->size);
+   if (buffer->is_locked)
+      return 0;
+
+   buffer->lock_offset = offset;
+   buffer->lock_length = length;
+   buffer->lock_flags = flags;
+   buffer->is_locked = true;
+
+   return (char*)buffer->data + offset * buffer->index_size;
+}
+
+/* Function: al_unlock_index_buffer
+ */
+void al_unlock_index_buffer(ALLEGRO_INDEX_BUFFER* buffer)
+{
+   ASSERT(buffer);
+   ASSERT(addon_initialized);
+
+   if (!buffer->is_locked)
+      return;
+
+   if (buffer->index_size == 2 && buffer->lock_flags != ALLEGRO_LOCK_READONLY) {
+      const uint16_t* src = (uint16_t*)buffer->data + buffer->lock_offset;
+      int* dest = buffer->indices + buffer->lock_offset;
+      size_t ii;
+
+      for (ii = 0; ii < buffer->lock_length; ii++)
+         dest[ii] = src[ii];
+   }
+
+   buffer->is_locked = false;
+}
+
+/* Function: al_draw_indexed_buffer
+ */
+int al_draw_indexed_buffer(ALLEGRO_VERTEX_BUFFER* vertex_buffer,
+   ALLEGRO_BITMAP* texture, ALLEGRO_INDEX_BUFFER* index_buffer,
+   int start, int end, int type)
+{
+   ALLEGRO_BITMAP *target;
+   const int* indices;
+   void* vtx;
+   int ret;
+
+   ASSERT(addon_initialized);
+   ASSERT(end >= start);
+   ASSERT(type >= 0 && type < ALLEGRO_PRIM_NUM_TYPES);
+   ASSERT(vertex_buffer);
+   ASSERT(!vertex_buffer->is_locked);
+   ASSERT(index_buffer);
+   ASSERT(!index_buffer->is_locked);
+   ASSERT((size_t)end <= index_buffer->size);
+
+   if (start == end)
+      return 0;
+
+   target = al_get_target_bitmap();
+   indices = index_buffer->indices + start;
+
+   if (vertex_buffer->is_soft) {
+      if (is_soft_target(target, texture)) {
+         ALLEGRO_VERTEX* transformed = get_transformed_vertices(vertex_buffer, texture);
+         if (transformed)
+            return _al_draw_transformed_prim_indexed_soft(texture, transformed,
+               indices, end - start, type);
+      }
+      return al_draw_indexed_prim(vertex_buffer->soft_vertices,
+         vertex_buffer->decl, texture, indices, end - start, type);
    }
 
+   /* Hardware vertex buffers are read back and drawn like a vertex array. */
+   if (vertex_buffer->write_only) {
+      ALLEGRO_WARN("Cannot draw a write-only vertex buffer with an index buffer.\n");
+      return 0;
+   }
+   vtx = al_lock_vertex_buffer(vertex_buffer, 0, vertex_buffer->size, ALLEGRO_LOCK_READONLY);
+   if (!vtx)
+      return 0;
+   ret = al_draw_indexed_prim(vtx, vertex_buffer->decl, texture, indices, end - start, type);
+   al_unlock_vertex_buffer(vertex_buffer);
+
    return ret;
 }
@@ -10,6 +10,11 @@
  *
  *      Polygon triangulation with holes.
  *
+ *      The polygon (outline and holes together) is split into y-monotone
+ *      pieces with a plane sweep, and each piece is then triangulated in
+ *      linear time. See chapter 3 of "Computational Geometry: Algorithms
+ *      and Applications" by de Berg et al.
+ *
  *
  *      By Michał Cichoń.
  *
@@ -20,791 +25,850 @@
 # include "allegro5/allegro.h"
 # include "allegro5/allegro_primitives.h"
 # include "allegro5/internal/aintern_prim.h"
-# include "allegro5/internal/aintern_list.h"
-# include <float.h>
 # include <math.h>
+# include <stdlib.h>
+# include <string.h>
 
 
-# define POLY_DEBUG 0
+/* Vertex types for the sweep. */
+enum {
+   POLY_VERTEX_START,
+   POLY_VERTEX_END,
+   POLY_VERTEX_SPLIT,
+   POLY_VERTEX_MERGE,
+   POLY_VERTEX_REGULAR_LEFT,     /* interior lies to the right */
+   POLY_VERTEX_REGULAR_RIGHT     /* interior lies to the left */
+};
 
 
-/* */
-# define POLY_VERTEX_ATTR_REFLEX      0x0001
-# define POLY_VERTEX_ATTR_EAR_CLIP    0x0002
-# define POLY_VERTEX_ATTR_ALL         (POLY_VERTEX_ATTR_REFLEX | POLY_VERTEX_ATTR_EAR_CLIP)
+typedef void (*POLY_EMIT_TRIANGLE)(int, int, int, void*);
 
 
-typedef void (*POLY_EMIT_TRIANGLE)(int, int, int, void*);
+/*
+ *  All working memory of the triangulator comes from a scratch arena,
+ *  which is released in one go when we are done.
+ */
+typedef struct POLY_ARENA_BLOCK {
+   struct POLY_ARENA_BLOCK* prev;
+   size_t                   size;
+   size_t                   used;
+} POLY_ARENA_BLOCK;
+
+# define POLY_ARENA_ALIGN        16
+# define POLY_ARENA_HEADER       ((sizeof(POLY_ARENA_BLOCK) + POLY_ARENA_ALIGN - 1) & ~(size_t)(POLY_ARENA_ALIGN - 1))
+# define POLY_ARENA_BLOCK_SIZE   (64 * 1024)
+
 
 typedef struct POLY {
    const float*            vertex_buffer;
    size_t                  vertex_stride;
-   size_t                  vertex_count;
-   const int*              split_indices;
-   size_t                  split_stride;
-   size_t                  split_count;
+   int                     vertex_count;
    POLY_EMIT_TRIANGLE      emit;
    void*                   userdata;
-   _AL_LIST*               vertex_list;
-   _AL_LIST*               reflex_list;
-   _AL_LIST*               ear_list;
+   POLY_ARENA_BLOCK*       arena;
+
+   /* Per vertex. Vertices dropped as duplicates have next == -1. */
+   int*                    next;
+   int*                    prev;
+   unsigned char*          type;
+   int*                    helper;        /* of the edge (v, next[v]) */
+
+   /* Vertices in sweep order, top to bottom. */
+   int*                    order;
+   int                     order_count;
+
+   /*
+    *  Sweep line status: the edges crossing the sweep line, sorted from
+    *  left to right, as a treap. Each edge (v, next[v]) is node v. The
+    *  priorities are a hash of the vertex index, which keeps the depth
+    *  logarithmic in the expected case. Nodes not in the status have
+    *  status_parent == POLY_NOT_IN_STATUS.
+    */
+   int*                    status_left;
+   int*                    status_right;
+   int*                    status_parent;
+   int                     status_root;
+
+   /* Diagonals splitting the polygon into monotone pieces. */
+   int*                    diagonals;
+   int                     diagonal_count;
 } POLY;
 
-typedef struct POLY_SPLIT {
-   int      begin;
-   size_t   size;
-   float*   point;
-   int      max_index;
-} POLY_SPLIT;
 
+# define POLY_NOT_IN_STATUS      -2
 
-# if POLY_DEBUG
-typedef void (*poly_debug_draw_text_t)(float x, float y, int line, const char* format, ...);
 
-#if defined _MSC_VER
-#define EXPORT __declspec(dllexport)
-#else
-#define EXPORT
-#define __noop ((void)0)
-#endif
+# define POLY_VERTEX(index)      ((const float*)(((const uint8_t*)polygon->vertex_buffer) + (index) * polygon->vertex_stride))
 
-EXPORT int                     g_poly_debug_split_step      = -1;
-EXPORT int                     g_poly_debug_step            = -1;
-EXPORT int                     g_poly_debug_step_current    = 0;
-EXPORT poly_debug_draw_text_t  g_poly_debug_draw_text       = NULL;
-EXPORT float                   g_poly_debug_scale           = 1.0f;
 
-#undef EXPORT
-
-# define POLY_DEBUG_TEXT(x,y,...)            (g_poly_debug_draw_text ? g_poly_debug_draw_text(x,y,INT_MAX,__VA_ARGS__) : __noop)
-# define POLY_DEBUG_TEXT_LINE(x,y,line,...)  (g_poly_debug_draw_text ? g_poly_debug_draw_text(x,y,line,__VA_ARGS__)    : __noop)
+static void* poly_alloc(POLY* polygon, size_t size)
+{
+   POLY_ARENA_BLOCK* block = polygon->arena;
+   void* ptr;
 
-# endif
+   size = (size + POLY_ARENA_ALIGN - 1) & ~(size_t)(POLY_ARENA_ALIGN - 1);
 
+   if (!block || block->used + size > block->size) {
 
-/* Internal functions. */
-static bool      poly_initialize(POLY* poly);
-static void      poly_classify_vertices(_AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear);
-static void      poly_classify_vertices_in_range(_AL_LIST_ITEM* begin, _AL_LIST_ITEM* end, _AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear);
-static void      poly_do_triangulate(POLY* poly);
+      size_t block_size = POLY_ARENA_BLOCK_SIZE;
 
-static _AL_LIST* poly_create_split_list(POLY* polygon);
-static void      poly_split_list_dtor(void* user_data);
+      if (block_size < size)
+         block_size = size;
 
+      block = (POLY_ARENA_BLOCK*)al_malloc(POLY_ARENA_HEADER + block_size);
+      if (NULL == block)
+         return NULL;
 
-/*
- *  Seek for closest intersection point of polygon with a ray directed
- *  to the right.
- *
- *  Returns true if intersection was found. 'point', 'edge0' and 'edge1'
- *  are set to proper values (if not NULL).
- *  Returns false if intersection was not fount and none of above
- *  are modified.
- */
-static bool poly_find_closest_intersection(_AL_LIST* vertices, const float* vertex, float* point, _AL_LIST_ITEM** edge0, _AL_LIST_ITEM** edge1)
-{
-   size_t i;
-   const float* v0 = NULL;
-   float v1[2];
-   float intersection[2];
-   float t0, t1;
-   float best_point[2] = {0, 0};
-   float best_t;
-   _AL_LIST_ITEM* item = NULL;
-   _AL_LIST_ITEM* next = NULL;
-   _AL_LIST_ITEM* best_e0 = NULL;
-   _AL_LIST_ITEM* best_e1 = NULL;
-
-   /* Assemble line pointing to the right. */
-   v0    = vertex;
-   v1[0] = v0[0] + 1.0f;
-   v1[1] = v0[1];
-
-   /* Seek for the closest intersection. */
-   best_t = FLT_MAX;
-   item = _al_list_front(vertices);
-   next = _al_list_next_circular(vertices, item);
-   for (i = 0; i < _al_list_size(vertices); ++i, item = next, next = _al_list_next_circular(vertices, next)) {
-
-      float* p0 = (float*)_al_list_item_data(item);
-      float* p1 = (float*)_al_list_item_data(next);
-
-      /* Perform quick rejection.
-       *
-       * We are interested only with outer edges. That mean only those
-       * whose go from the bottom to the up. Note we cannot intersect
-       * parallel line.
-       *
-       * Second condition reject edges lying completely on the left
-       * side of ray origin.
-       */
-      if ((p0[1] < p1[1]) || (p0[0] <= vertex[0] && p1[0] <= vertex[0]))
-         continue;
-
-      if (_al_prim_intersect_segment(v0, v1, p0, p1, intersection, &t0, &t1) && (t1 >= 0.0f) && (t1 <= 1.0f) && (t0 >= 0.0f) && (t0 < best_t)) {
-
-         best_t        = t0;
-         best_point[0] = intersection[0];
-         best_point[1] = intersection[1];
-         best_e0       = item;
-         best_e1       = next;
-      }
+      block->prev = polygon->arena;
+      block->size = block_size;
+      block->used = 0;
+      polygon->arena = block;
    }
 
-   if (NULL != best_e0) {
-
-      if (NULL != point) {
+   ptr = (uint8_t*)block + POLY_ARENA_HEADER + block->used;
+   block->used += size;
 
-         point[0] = best_point[0];
-         point[1] = best_point[1];
-      }
-
-      if (NULL != edge0)
-         *edge0 = best_e0;
+   return ptr;
+}
 
-      if (NULL != edge1)
-         *edge1 = best_e1;
 
-# if POLY_DEBUG
-      //al_draw_line(v0[0], v0[1], point[0], point[1], al_map_rgb(255, 0, 0), 0.0f);
-# endif
+static void poly_free_arena(POLY* polygon)
+{
+   while (polygon->arena) {
 
-      return true;
+      POLY_ARENA_BLOCK* prev = polygon->arena->prev;
+      al_free(polygon->arena);
+      polygon->arena = prev;
    }
-   else
-      return false;
 }
 
 
 /*
- *  Seek for the best vertex in polygon for doing split.
- *
- *  Returns vertex after which split (hole) vertices
- *  can be inserted.
+ *  Sweep order. The sweep goes from the top (largest y) to the bottom,
+ *  points at the same height are taken from left to right.
  */
-static _AL_LIST_ITEM* poly_find_outter_split_vertex(POLY* polygon, POLY_SPLIT* split)
+static bool poly_is_above(POLY* polygon, int a, int b)
 {
-   float intersection[2];
-   _AL_LIST_ITEM* edge_vertex_0;
-   _AL_LIST_ITEM* edge_vertex_1;
-   _AL_LIST_ITEM* vertex;
-   _AL_LIST_ITEM* reflex_item;
-   _AL_LIST_ITEM* best_vertex;
-   float  best_distance;
-   float* p0;
-   float* p1;
-   float* p;
-
-   if (!poly_find_closest_intersection(polygon->vertex_list, split->point, intersection, &edge_vertex_0, &edge_vertex_1))
-      return NULL;
-
-   p0 = (float*)_al_list_item_data(edge_vertex_0);
-   p1 = (float*)_al_list_item_data(edge_vertex_1);
-
-   /* Maybe we hit an edge vertex? */
-   if (_al_prim_are_points_equal(split->point, p0))
-      return edge_vertex_0;
-
-   if (_al_prim_are_points_equal(split->point, p1))
-      return edge_vertex_1;
-
-   /* No luck. Pick point which most far away from us. */
-   if (p0[0] > p1[0]) {
-
-      vertex = edge_vertex_0;
-      p      = p0;
-   }
-   else {
+   const float* pa = POLY_VERTEX(a);
+   const float* pb = POLY_VERTEX(b);
 
-      vertex = edge_vertex_1;
-      p      = p1;
-   }
+   if (pa[1] != pb[1])
+      return pa[1] > pb[1];
 
-   /* Seek in reflex vertices. */
-   best_vertex = NULL;
-   best_distance = FLT_MAX;
+   if (pa[0] != pb[0])
+      return pa[0] < pb[0];
 
-   for (reflex_item = _al_list_front(polygon->reflex_list); reflex_item; reflex_item = _al_list_next(polygon->reflex_list, reflex_item)) {
+   return a < b;
+}
 
-      _AL_LIST_ITEM* reflex_vertex = (_AL_LIST_ITEM*)_al_list_item_data(reflex_item);
 
-      float* reflex_point = (float*)_al_list_item_data(reflex_vertex);
+static float poly_cross(POLY* polygon, int a, int b, int c)
+{
+   const float* pa = POLY_VERTEX(a);
+   const float* pb = POLY_VERTEX(b);
+   const float* pc = POLY_VERTEX(c);
 
-      if (_al_prim_is_point_in_triangle(reflex_point, split->point, p, intersection)) {
+   return (pb[0] - pa[0]) * (pc[1] - pb[1]) - (pb[1] - pa[1]) * (pc[0] - pb[0]);
+}
 
-         float diff_x = reflex_point[0] - split->point[0];
-         float diff_y = reflex_point[1] - split->point[1];
 
-         float dist = diff_x * diff_x + diff_y * diff_y;
+typedef struct POLY_SORT_KEY {
+   float x, y;
+   int   index;
+} POLY_SORT_KEY;
 
-         if (dist < best_distance) {
 
-            best_distance = dist;
-            best_vertex   = reflex_vertex;
-         }
-      }
-   }
+static int poly_sort_key_compare(const void* a, const void* b)
+{
+   const POLY_SORT_KEY* ka = (const POLY_SORT_KEY*)a;
+   const POLY_SORT_KEY* kb = (const POLY_SORT_KEY*)b;
 
-   if (NULL != best_vertex)
-      vertex = best_vertex;
+   if (ka->y != kb->y)
+      return ka->y > kb->y ? -1 : 1;
 
-//# if POLY_DEBUG
-//   p0 = (float*)_al_list_item_data(vertex);
-//   al_draw_line(p0[0], p0[1], intersection[0], intersection[1], al_map_rgb(255, 0, 0), 0.0f);
-//# endif
+   if (ka->x != kb->x)
+      return ka->x < kb->x ? -1 : 1;
 
-   return vertex;
+   return ka->index - kb->index;
 }
 
 
-# define POLY_VERTEX(index)      ((float*)(((uint8_t*)polygon->vertex_buffer) + (index) * polygon->vertex_stride))
-# define POLY_SPLIT(index)       (*((int*)(((uint8_t*)polygon->split_indices) + (index) * polygon->split_stride)))
-# define POLY_SPLIT_INDEX(split) (((uint8_t*)split - (uint8_t*)polygon->split_indices) / polygon->split_stride)
-
-
 /*
- *  Create list of the splits.
+ *  Link vertices of every ring into a cycle, dropping repeated points.
+ *  Rings are oriented so that the interior lies to the left of every edge
+ *  (with y pointing up), which means the outline goes counter-clockwise
+ *  and the holes clockwise.
  */
-static _AL_LIST* poly_create_split_list(POLY* polygon)
+static bool poly_link_rings(POLY* polygon, const int* vertex_counts)
 {
-   int i;
-   int last_split;
+   int ring;
+   int begin = 0;
 
-   _AL_LIST*       list   = _al_list_create_static(polygon->split_count);
-   POLY_SPLIT* splits = (POLY_SPLIT*)al_malloc(polygon->split_count * sizeof(POLY_SPLIT));
+   for (ring = 0; vertex_counts[ring] > 0; ++ring) {
 
-   if ((NULL == list) || (NULL == splits)) {
+      int end = begin + vertex_counts[ring];
+      int first = -1;
+      int last = -1;
+      int count = 0;
+      double area = 0.0;
+      int i;
 
-      _al_list_destroy(list);
-      al_free(splits);
+      for (i = begin; i < end; ++i) {
 
-      return NULL;
-   }
+         polygon->next[i] = -1;
 
-   /* Set list destructor, so we will don't worry about
-    * manually releasing allocated memory.
-    */
-   _al_list_set_dtor(list, poly_split_list_dtor);
-   _al_list_set_user_data(list, splits);
+         if (last >= 0 && _al_prim_are_points_equal(POLY_VERTEX(last), POLY_VERTEX(i)))
+            continue;
+
+         if (last >= 0)
+            polygon->next[last] = i;
+         else
+            first = i;
 
-   last_split = POLY_SPLIT(0);
-   for (i = 1; i < (int)polygon->split_count; ++i) {
+         polygon->prev[i] = last;
+         last = i;
+         ++count;
+      }
 
-      int j;
-      float max;
-      POLY_SPLIT* split = splits + i;
-      _AL_LIST_ITEM* where;
+      while (count > 1 && _al_prim_are_points_equal(POLY_VERTEX(last), POLY_VERTEX(first))) {
 
-      split->begin = last_split;
-      split->size  = POLY_SPLIT(i) - last_split;
-      last_split   = last_split + split->size;
+         int before = polygon->prev[last];
+         polygon->next[last] = -1;
+         polygon->next[before] = -1;
+         last = before;
+         --count;
+      }
 
-      max = -FLT_MAX;
-      split->max_index = -1;
-      for (j = split->begin; j < split->begin + (int)split->size; ++j) {
+      if (count < 3) {
 
-         float* point = POLY_VERTEX(j);
+         /* A degenerate outline leaves nothing to fill. */
+         if (ring == 0)
+            return false;
 
-         if (point[0] >= max) {
+         for (i = begin; i < end; ++i)
+            polygon->next[i] = -1;
 
-            max               = point[0];
-            split->point      = point;
-            split->max_index  = j;
-         }
+         begin = end;
+         continue;
       }
 
-      split->max_index -= split->begin;
+      polygon->next[last] = first;
+      polygon->prev[first] = last;
+
+      i = first;
+      do {
+         const float* p0 = POLY_VERTEX(i);
+         const float* p1 = POLY_VERTEX(polygon->next[i]);
+         area += (double)p0[0] * p1[1] - (double)p1[0] * p0[1];
+         i = polygon->next[i];
+      } while (i != first);
+
+      if ((ring == 0 && area < 0.0) || (ring > 0 && area > 0.0)) {
+
+         i = first;
+         do {
+            int next = polygon->next[i];
+            polygon->next[i] = polygon->prev[i];
+            polygon->prev[i] = next;
+            i = next;
+         } while (i != first);
+      }
 
-      ASSERT(split->max_index >= 0);
+      begin = end;
+   }
 
-      where = NULL;
-      if (!_al_list_is_empty(list)) {
+   return true;
+}
 
-         for (where = _al_list_front(list); where; where = _al_list_next(list, where)) {
 
-            POLY_SPLIT* local_split = (POLY_SPLIT*)_al_list_item_data(where);
+/*
+ *  Classify vertices and sort them in sweep order.
+ */
+static bool poly_prepare_sweep(POLY* polygon)
+{
+   POLY_SORT_KEY* keys;
+   int count = 0;
+   int i;
 
-            if (local_split->point[0] < max)
-               break;
-         }
-      }
+   keys = (POLY_SORT_KEY*)poly_alloc(polygon, polygon->vertex_count * sizeof(POLY_SORT_KEY));
+   if (NULL == keys)
+      return false;
+
+   for (i = 0; i < polygon->vertex_count; ++i) {
 
-      if (NULL == where)
-         _al_list_push_back(list, split);
+      int prev = polygon->prev[i];
+      int next = polygon->next[i];
+      bool prev_below;
+      bool next_below;
+
+      if (next < 0)
+         continue;
+
+      prev_below = poly_is_above(polygon, i, prev);
+      next_below = poly_is_above(polygon, i, next);
+
+      if (prev_below && next_below)
+         polygon->type[i] = poly_cross(polygon, prev, i, next) > 0.0f ? POLY_VERTEX_START : POLY_VERTEX_SPLIT;
+      else if (!prev_below && !next_below)
+         polygon->type[i] = poly_cross(polygon, prev, i, next) > 0.0f ? POLY_VERTEX_END : POLY_VERTEX_MERGE;
+      else if (next_below)
+         polygon->type[i] = POLY_VERTEX_REGULAR_LEFT;
       else
-         _al_list_insert_before(list, where, split);
+         polygon->type[i] = POLY_VERTEX_REGULAR_RIGHT;
+
+      polygon->helper[i] = -1;
+      polygon->status_left[i] = -1;
+      polygon->status_right[i] = -1;
+      polygon->status_parent[i] = POLY_NOT_IN_STATUS;
+
+      keys[count].x = POLY_VERTEX(i)[0];
+      keys[count].y = POLY_VERTEX(i)[1];
+      keys[count].index = i;
+      ++count;
    }
 
-   return list;
+   qsort(keys, count, sizeof(POLY_SORT_KEY), poly_sort_key_compare);
+
+   for (i = 0; i < count; ++i)
+      polygon->order[i] = keys[i].index;
+   polygon->order_count = count;
+   polygon->status_root = -1;
+
+   return true;
 }
 
 
 /*
- *  Release memory allocated by split list. This method
- *  serve as callback to the list.
+ *  Where the edge (v, next[v]) crosses the horizontal line at y.
+ *  Edges in the status always go downwards.
  */
-static void poly_split_list_dtor(void* user_data)
+static float poly_edge_x(POLY* polygon, int edge, float y)
 {
-   /* This is array of POLY_SPLIT. */
-   al_free(user_data);
+   const float* p0 = POLY_VERTEX(edge);
+   const float* p1 = POLY_VERTEX(polygon->next[edge]);
+
+   if (y >= p0[1])
+      return p0[0];
+
+   if (y <= p1[1])
+      return p1[0];
+
+   return p0[0] + (p1[0] - p0[0]) * ((y - p0[1]) / (p1[1] - p0[1]));
 }
 
 
 /*
- *  Perform initialization step to polygon triangulation.
- *
- *  Three linked list are initialized: vertex_list, reflex_list
- *  and ear_list.
- *
- *  All provided splits (holes) are resolved in this step.
- *  Therefore at the end we have simple polygon.
+ *  Treap priority of an edge, a bijective mix of its index.
  */
-static bool poly_initialize(POLY* polygon)
+static unsigned int poly_status_priority(int edge)
 {
-   _AL_LIST* vertex_list;
-   _AL_LIST* reflex_list;
-   _AL_LIST* ear_list;
-   _AL_LIST* split_list;
-   _AL_LIST_ITEM* split_item;
-   size_t vertex_count;
-   bool use_split_list;
-   size_t j;
-   int i;
+   unsigned int h = (unsigned int)edge;
 
-# if POLY_DEBUG
-   if (g_poly_debug_split_step >= 0)
-      polygon->split_count = min(g_poly_debug_split_step, polygon->split_count);
-# endif
+   h ^= h >> 16;
+   h *= 0x85ebca6bu;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35u;
+   h ^= h >> 16;
 
-   /* Every hole add two extra vertices to the list. */
-   vertex_count = polygon->vertex_count + (polygon->split_count - 1) * 2;
+   return h;
+}
 
-   /* Create lists for polygon. */
-   vertex_list = _al_list_create_static(vertex_count);
-   reflex_list = _al_list_create_static(vertex_count);
-   ear_list    = _al_list_create_static(vertex_count);
 
-   if (polygon->split_count > 1) {
+/*
+ *  Returns the rightmost edge in the status lying to the left of vertex v,
+ *  or -1 if there is none.
+ */
+static int poly_status_find_left(POLY* polygon, int v)
+{
+   const float* p = POLY_VERTEX(v);
+   int node = polygon->status_root;
+   int left = -1;
+
+   while (node >= 0) {
 
-      split_list     = poly_create_split_list(polygon);
-      use_split_list = true;
-   }
-   else {
-      split_list = NULL;
-      use_split_list = false;
+      if (poly_edge_x(polygon, node, p[1]) < p[0]) {
+         left = node;
+         node = polygon->status_right[node];
+      }
+      else
+         node = polygon->status_left[node];
    }
 
-   if ((NULL == vertex_list) || (NULL == reflex_list) || (NULL == ear_list) || (use_split_list && (NULL == split_list))) {
+   return left;
+}
 
-      _al_list_destroy(vertex_list);
-      _al_list_destroy(reflex_list);
-      _al_list_destroy(ear_list);
-      _al_list_destroy(split_list);
 
-      return false;
+/*
+ *  Rotates node up over its parent.
+ */
+static void poly_status_rotate_up(POLY* polygon, int node)
+{
+   int parent = polygon->status_parent[node];
+   int grandparent = polygon->status_parent[parent];
+   int child;
+
+   if (polygon->status_left[parent] == node) {
+      child = polygon->status_right[node];
+      polygon->status_left[parent] = child;
+      polygon->status_right[node] = parent;
+   }
+   else {
+      child = polygon->status_left[node];
+      polygon->status_right[parent] = child;
+      polygon->status_left[node] = parent;
    }
 
-   /* Store lists in polygon. */
-   polygon->vertex_list = vertex_list;
-   polygon->reflex_list = reflex_list;
-   polygon->ear_list    = ear_list;
+   if (child >= 0)
+      polygon->status_parent[child] = parent;
+   polygon->status_parent[parent] = node;
+   polygon->status_parent[node] = grandparent;
 
-   /* Push main polygon outline. */
-   for (i = 0; i < POLY_SPLIT(0); ++i)
-      _al_list_push_back(vertex_list, POLY_VERTEX(i));
+   if (grandparent < 0)
+      polygon->status_root = node;
+   else if (polygon->status_left[grandparent] == parent)
+      polygon->status_left[grandparent] = node;
+   else
+      polygon->status_right[grandparent] = node;
+}
 
-   if (use_split_list) {
 
-# if POLY_DEBUG
-       int current_split = 0;
-# endif
+static void poly_status_insert(POLY* polygon, int edge, int v)
+{
+   const float* p = POLY_VERTEX(v);
+   unsigned int priority = poly_status_priority(edge);
+   int parent = -1;
+   int node = polygon->status_root;
+   bool right = false;
+
+   /* Before the first edge not to the left of v. */
+   while (node >= 0) {
+
+      parent = node;
+      right = poly_edge_x(polygon, node, p[1]) < p[0];
+      node = right ? polygon->status_right[node] : polygon->status_left[node];
+   }
 
-       poly_classify_vertices(vertex_list, reflex_list, NULL);
+   polygon->status_left[edge] = -1;
+   polygon->status_right[edge] = -1;
+   polygon->status_parent[edge] = parent;
 
-      /* Resolve all holes. */
-      for (split_item = _al_list_front(split_list); split_item; split_item = _al_list_next(split_list, split_item)) {
+   if (parent < 0)
+      polygon->status_root = edge;
+   else if (right)
+      polygon->status_right[parent] = edge;
+   else
+      polygon->status_left[parent] = edge;
 
-         _AL_LIST_ITEM* first_vertex;
-         _AL_LIST_ITEM* last_vertex;
-         POLY_SPLIT* split;
+   while (polygon->status_parent[edge] >= 0 &&
+         poly_status_priority(polygon->status_parent[edge]) < priority)
+      poly_status_rotate_up(polygon, edge);
 
-# if POLY_DEBUG
-         if (g_poly_debug_split_step >= 0 && current_split >= g_poly_debug_split_step)
-             break;
+   polygon->helper[edge] = v;
+}
 
-         ++current_split;
-# endif
 
-         split = (POLY_SPLIT*)_al_list_item_data(split_item);
+static void poly_status_remove(POLY* polygon, int edge)
+{
+   int parent;
+   int child;
 
-         first_vertex = poly_find_outter_split_vertex(polygon, split);
+   if (polygon->status_parent[edge] == POLY_NOT_IN_STATUS)
+      return;
 
-         if (NULL == first_vertex)
-            break;
+   /* Rotate the edge down until it has at most one child. */
+   while (polygon->status_left[edge] >= 0 && polygon->status_right[edge] >= 0) {
 
-         /* Insert hole vertices. */
-         last_vertex = first_vertex;
-         for (j = 0; j <= split->size; ++j)
-            last_vertex = _al_list_insert_after(vertex_list, last_vertex,
-               POLY_VERTEX(split->begin + ((j + split->max_index) % split->size)));
-         last_vertex = _al_list_insert_after(vertex_list, last_vertex, _al_list_item_data(first_vertex));
+      int left = polygon->status_left[edge];
+      int right = polygon->status_right[edge];
 
-         _al_list_remove(reflex_list, first_vertex);
+      if (poly_status_priority(left) > poly_status_priority(right))
+         poly_status_rotate_up(polygon, left);
+      else
+         poly_status_rotate_up(polygon, right);
+   }
 
-         poly_classify_vertices_in_range(first_vertex, _al_list_next(vertex_list, last_vertex), vertex_list, reflex_list, NULL);
-      }
+   parent = polygon->status_parent[edge];
+   child = polygon->status_left[edge] >= 0 ? polygon->status_left[edge] : polygon->status_right[edge];
 
-      _al_list_destroy(split_list);
+   if (child >= 0)
+      polygon->status_parent[child] = parent;
 
-      poly_classify_vertices(vertex_list, NULL, ear_list);
-   }
+   if (parent < 0)
+      polygon->status_root = child;
+   else if (polygon->status_left[parent] == edge)
+      polygon->status_left[parent] = child;
    else
-      /* Initialize reflex and ear vertex lists. */
-      poly_classify_vertices(vertex_list, reflex_list, ear_list);
+      polygon->status_right[parent] = child;
 
-   return true;
+   polygon->status_parent[edge] = POLY_NOT_IN_STATUS;
 }
 
-# undef POLY_VERTEX
-# undef POLY_SPLIT
-# undef POLY_SPLIT_INDEX
+
+static void poly_add_diagonal(POLY* polygon, int v0, int v1)
+{
+   polygon->diagonals[polygon->diagonal_count * 2 + 0] = v0;
+   polygon->diagonals[polygon->diagonal_count * 2 + 1] = v1;
+   ++polygon->diagonal_count;
+}
 
 
 /*
- *  Compute polygon vertex attributes. Currently supported attributes are:
- *    - ear clip
- *    - reflex
- *
- *  Vertex is an ear clip when triangle made by their edges does not contain
- *  any other vertices.
- *
- *  Vertex is a reflex when angle between edges is greater or equal
- *  to 180 degrees.
- *
- *  Optionally function may take reflex list (if not NULL). In this case test
- *  for ear clip is performed only on reflex vertices not on entire polygon.
- *  This is used for triangulation speed optimization, because convex
- *  (non reflect) vertices will never became reflex.
- *
- *  Flags are used to determine for which attribute we want to check.
- *  Use POLY_VERTEX_ATTR_ALL to test for all attributes.
+ *  If the helper of the edge is a merge vertex, connect v to it.
  */
-static int poly_compute_vertex_attributes(_AL_LIST* vertices, _AL_LIST_ITEM* item, int flags, _AL_LIST* reflex)
+static void poly_fix_up(POLY* polygon, int edge, int v)
 {
-   size_t i;
-   _AL_LIST_ITEM* prev = _al_list_previous_circular(vertices, item);
-   _AL_LIST_ITEM* next = _al_list_next_circular(vertices, item);
-   _AL_LIST_ITEM* point = NULL;
-   int result = 0;
-   float* v0;
-   float* v1;
-   float* v2;
-   float cross;
+   int helper = polygon->helper[edge];
 
-   // Oops, degenerate triangle in store.
-   if (_al_list_size(vertices) < 3)
-      return result;
+   if (helper >= 0 && polygon->type[helper] == POLY_VERTEX_MERGE)
+      poly_add_diagonal(polygon, v, helper);
+}
 
-   // Get points.
-   v0 = (float*)_al_list_item_data(prev);
-   v1 = (float*)_al_list_item_data(item);
-   v2 = (float*)_al_list_item_data(next);
 
-   // Compute the cross product between the two edges
-   cross = (v0[0] - v1[0]) * (v2[1] - v1[1]) - (v0[1] - v1[1]) * (v2[0] - v1[0]);
+/*
+ *  Connect v to the helper of the edge directly to the left of it, and
+ *  make v the new helper of that edge.
+ */
+static void poly_connect_left(POLY* polygon, int v, bool always)
+{
+   int edge = poly_status_find_left(polygon, v);
 
-# if POLY_DEBUG
-   if (g_poly_debug_step == g_poly_debug_step_current) {
+   if (edge < 0)
+      return;
 
-      float step = 0.25f * 0.0f;
+   if (always) {
+      if (polygon->helper[edge] >= 0)
+         poly_add_diagonal(polygon, v, polygon->helper[edge]);
+   }
+   else
+      poly_fix_up(polygon, edge, v);
 
-      float dir0[2] = { v0[0] - v1[0], v0[1] - v1[1] };
-      float dir2[2] = { v2[0] - v1[0], v2[1] - v1[1] };
+   polygon->helper[edge] = v;
+}
 
-      POLY_DEBUG_TEXT(v1[0], v1[1], "%d", cross > 0);
 
-      al_draw_line(v1[0], v1[1], v1[0] + dir0[0] * step, v1[1] + dir0[1] * step, al_map_rgb(255, 0, 0), 4.0f * g_poly_debug_scale);
-      al_draw_line(v1[0], v1[1], v1[0] + dir2[0] * step, v1[1] + dir2[1] * step, al_map_rgb(255, 0, 0), 4.0f * g_poly_debug_scale);
-   }
-# endif
+/*
+ *  Sweep the polygon from top to bottom, adding diagonals which split it
+ *  into y-monotone pieces.
+ */
+static void poly_make_monotone(POLY* polygon)
+{
+   int i;
 
-   // If internal angle is less than 180 degrees then we may
-   // have an ear clip vertex, otherwise we have reflex.
-   if (cross >= 0)
-   {
-      if (flags & POLY_VERTEX_ATTR_EAR_CLIP)
-      {
-         _AL_LIST_ITEM* start;
-         _AL_LIST* search_list;
-         size_t size;
+   for (i = 0; i < polygon->order_count; ++i) {
 
-         if (reflex) {
+      int v = polygon->order[i];
+      int prev_edge = polygon->prev[v];
 
-            search_list = reflex;
-            size        = _al_list_size(search_list);
-            start       = _al_list_front(reflex);
-         }
-         else {
-            search_list = vertices;
-            size        = _al_list_size(search_list) - 3;
-            start       = _al_list_next_circular(search_list, next);
-         }
+      switch (polygon->type[v]) {
 
-         // Check for ear vertex.
-         point = start;
-         for (i = 0; i < size; ++i, point = _al_list_next_circular(search_list, point)) {
+         case POLY_VERTEX_START:
+            poly_status_insert(polygon, v, v);
+            break;
 
-            float* v;
+         case POLY_VERTEX_END:
+            poly_fix_up(polygon, prev_edge, v);
+            poly_status_remove(polygon, prev_edge);
+            break;
 
-            // TODO: optimize this by removing if
-            if (search_list == reflex)
-               v = (float*)_al_list_item_data((_AL_LIST_ITEM*)_al_list_item_data(point));
-            else
-               v = (float*)_al_list_item_data(point);
+         case POLY_VERTEX_SPLIT:
+            poly_connect_left(polygon, v, true);
+            poly_status_insert(polygon, v, v);
+            break;
 
-            // Ignore vertices which belong to the triangle.
-            if ((v == v0) || (v == v1) || (v == v2))
-               continue;
+         case POLY_VERTEX_MERGE:
+            poly_fix_up(polygon, prev_edge, v);
+            poly_status_remove(polygon, prev_edge);
+            poly_connect_left(polygon, v, false);
+            break;
 
-            // Set point to NULL if we find any point inside the triangle.
-            if (_al_prim_is_point_in_triangle(v, v0, v1, v2)) {
-               point = NULL;
-               break;
-            }
-         }
+         case POLY_VERTEX_REGULAR_LEFT:
+            poly_fix_up(polygon, prev_edge, v);
+            poly_status_remove(polygon, prev_edge);
+            poly_status_insert(polygon, v, v);
+            break;
 
-         // If point is not NULL, we have ear vertex.
-         if ((NULL != point) || _al_list_is_empty(search_list))
-            result |= POLY_VERTEX_ATTR_EAR_CLIP;
+         case POLY_VERTEX_REGULAR_RIGHT:
+            poly_connect_left(polygon, v, false);
+            break;
       }
    }
-   else if (flags & POLY_VERTEX_ATTR_REFLEX)
-      result |= POLY_VERTEX_ATTR_REFLEX;
-
-   return result;
 }
 
 
 /*
- *  Classify all vertices into reflex or ear group.
- *
- *  One of target group may be NULL so it will be simply ignored.
+ *  Triangulate a y-monotone piece, given as a counter-clockwise list of
+ *  vertices.
  */
-static void poly_classify_vertices(_AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear)
+static void poly_triangulate_monotone(POLY* polygon, const int* face, int count, int* sorted, bool* left, int* stack)
 {
-   poly_classify_vertices_in_range(_al_list_front(vertices), NULL, vertices, reflex, ear);
-}
-
+   int top = 0;
+   int bottom = 0;
+   int l, r, j;
+   int stack_size;
 
-/*
- *  Classify selected range of vertices [begin, end) into
- *  reflex or ear group.
- *
- *  One of target group may be NULL so it will be simply ignored.
- */
-static void poly_classify_vertices_in_range(_AL_LIST_ITEM* begin, _AL_LIST_ITEM* end, _AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear)
-{
-   _AL_LIST_ITEM* item = NULL;
-   int attribute_mask = 0;
+   if (count < 3)
+      return;
 
-   if (NULL != ear)
-      attribute_mask |= POLY_VERTEX_ATTR_EAR_CLIP;
+   if (count == 3) {
+      polygon->emit(face[0], face[1], face[2], polygon->userdata);
+      return;
+   }
 
-   if (NULL != reflex)
-      attribute_mask |= POLY_VERTEX_ATTR_REFLEX;
+   for (j = 1; j < count; ++j) {
 
-   for (item = begin; item != end; item = _al_list_next(vertices, item))
-   {
-      int attr = poly_compute_vertex_attributes(vertices, item, attribute_mask, NULL);
+      if (poly_is_above(polygon, face[j], face[top]))
+         top = j;
+      if (poly_is_above(polygon, face[bottom], face[j]))
+         bottom = j;
+   }
 
-      if (0 == attr)
-         continue;
+   /* Going counter-clockwise from the top we walk down the left chain,
+    * the right chain is walked backwards. Merge both.
+    */
+   sorted[0] = face[top];
+   left[0] = true;
+   l = (top + 1) % count;
+   r = (top + count - 1) % count;
+   for (j = 1; j < count; ++j) {
+
+      if (l == bottom && r == bottom) {
+         sorted[j] = face[bottom];
+         left[j] = true;
+      }
+      else if (r == bottom || (l != bottom && poly_is_above(polygon, face[l], face[r]))) {
+         sorted[j] = face[l];
+         left[j] = true;
+         l = (l + 1) % count;
+      }
+      else {
+         sorted[j] = face[r];
+         left[j] = false;
+         r = (r + count - 1) % count;
+      }
+   }
 
-      if (attr & POLY_VERTEX_ATTR_EAR_CLIP)
-         _al_list_push_back(ear, item);
+   stack[0] = 0;
+   stack[1] = 1;
+   stack_size = 2;
 
-      if (attr & POLY_VERTEX_ATTR_REFLEX)
-         _al_list_push_back(reflex, item);
-   }
-}
+   for (j = 2; j < count - 1; ++j) {
 
+      int last;
 
-/*
- *  Reclassify vertex. After triangle was emitted one vertex
- *  is removed from the list. Two neighbor vertices may
- *  change their attributes. In this place we have general
- *  function which update lists to match new attributes
- *  of provided vertex.
- */
-static void poly_update_vertex_attributes(_AL_LIST* vertices, _AL_LIST* reflex, _AL_LIST* ear, _AL_LIST_ITEM* vertex)
-{
-   _AL_LIST_ITEM* item;
+      if (left[j] != left[stack[stack_size - 1]]) {
 
-   int attr = poly_compute_vertex_attributes(vertices, vertex, POLY_VERTEX_ATTR_ALL, reflex);
+         while (stack_size > 1) {
+            int a = stack[stack_size - 1];
+            int b = stack[stack_size - 2];
 
-   // Update reflex list only if an attribute change.
-   item = _al_list_find_first(reflex, vertex);
-   if (attr & POLY_VERTEX_ATTR_REFLEX) {
+            if (left[j])
+               polygon->emit(sorted[b], sorted[j], sorted[a], polygon->userdata);
+            else
+               polygon->emit(sorted[a], sorted[j], sorted[b], polygon->userdata);
+            --stack_size;
+         }
 
-      if (NULL == item)
-         _al_list_push_back(reflex, vertex);
+         stack[0] = j - 1;
+         stack[1] = j;
+         stack_size = 2;
+         continue;
+      }
 
-      _al_list_remove(ear, vertex);
-   }
-   else {
+      last = stack[--stack_size];
+      while (stack_size > 0) {
 
-      if (NULL != item)
-         _al_list_erase(reflex, item);
+         int a = stack[stack_size - 1];
 
-      item = _al_list_find_first(ear, vertex);
-      if (attr & POLY_VERTEX_ATTR_EAR_CLIP) {
+         if (left[j]) {
+            if (poly_cross(polygon, sorted[a], sorted[last], sorted[j]) <= 0.0f)
+               break;
+            polygon->emit(sorted[a], sorted[last], sorted[j], polygon->userdata);
+         }
+         else {
+            if (poly_cross(polygon, sorted[j], sorted[last], sorted[a]) <= 0.0f)
+               break;
+            polygon->emit(sorted[j], sorted[last], sorted[a], polygon->userdata);
+         }
 
-         if (NULL == item)
-            _al_list_push_front(ear, vertex);
+         last = stack[--stack_size];
       }
-      else {
 
-         if (NULL != item)
-            _al_list_erase(ear, item);
-      }
+      stack[stack_size++] = last;
+      stack[stack_size++] = j;
+   }
+
+   /* The bottom vertex sees all vertices left on the stack. */
+   while (stack_size > 1) {
+
+      int a = stack[stack_size - 1];
+      int b = stack[stack_size - 2];
+
+      if (left[a])
+         polygon->emit(sorted[b], sorted[a], sorted[count - 1], polygon->userdata);
+      else
+         polygon->emit(sorted[a], sorted[b], sorted[count - 1], polygon->userdata);
+      --stack_size;
    }
 }
 
 
-/*
- *  Triangulator iterate trough list of ear vertices
- *  and clip isolated triangles. This process repeats
- *  until there are ear vertices.
- */
-static void poly_do_triangulate(POLY* polygon)
-{
-# define VERTEX_INDEX(vertex) ((((uint8_t*)vertex) - ((uint8_t*)polygon->vertex_buffer)) / polygon->vertex_stride)
+typedef struct POLY_OUT_EDGE {
+   float angle;
+   int   half_edge;
+} POLY_OUT_EDGE;
 
-# if POLY_DEBUG
-   g_poly_debug_step_current = 0;
 
-   {
-      _AL_LIST_ITEM* item;
-      _AL_LIST_ITEM* next;
-      int* histogram = al_calloc(_al_list_size(polygon->vertex_list), sizeof(int));
+static int poly_out_edge_compare(const void* a, const void* b)
+{
+   const POLY_OUT_EDGE* ea = (const POLY_OUT_EDGE*)a;
+   const POLY_OUT_EDGE* eb = (const POLY_OUT_EDGE*)b;
 
-      /*std::map<float*, int> histogram;*/
+   if (ea->angle != eb->angle)
+      return ea->angle < eb->angle ? -1 : 1;
 
-      int index = 0;
-      for (item = _al_list_front(polygon->vertex_list); item; item = _al_list_next(polygon->vertex_list, item)) {
+   return ea->half_edge - eb->half_edge;
+}
 
-         float* point0;
-         float* point1;
-         float n[2];
-         float l, r;
-         char status[3] = { 0 };
-         int status_index = 0;
 
-         next = _al_list_next_circular(polygon->vertex_list, item);
+/*
+ *  Walk the pieces the diagonals cut the polygon into and triangulate
+ *  each of them.
+ *
+ *  Half-edge h < vertex_count is the polygon edge (h, next[h]). Diagonal
+ *  d gives half-edges vertex_count + 2 * d (in the order it was added)
+ *  and vertex_count + 2 * d + 1 (reversed).
+ */
+static bool poly_triangulate_pieces(POLY* polygon)
+{
+   int n = polygon->vertex_count;
+   int half_edge_count = n + 2 * polygon->diagonal_count;
+   int* from;
+   int* to;
+   int* next_half_edge;
+   int* out_start;
+   POLY_OUT_EDGE* out;
+   bool* visited;
+   int* face;
+   int* sorted;
+   bool* left;
+   int* stack;
+   int h, v, i;
+
+   from           = (int*)poly_alloc(polygon, half_edge_count * sizeof(int));
+   to             = (int*)poly_alloc(polygon, half_edge_count * sizeof(int));
+   next_half_edge = (int*)poly_alloc(polygon, half_edge_count * sizeof(int));
+   out_start      = (int*)poly_alloc(polygon, (n + 1) * sizeof(int));
+   out            = (POLY_OUT_EDGE*)poly_alloc(polygon, half_edge_count * sizeof(POLY_OUT_EDGE));
+   visited        = (bool*)poly_alloc(polygon, half_edge_count * sizeof(bool));
+   face           = (int*)poly_alloc(polygon, half_edge_count * sizeof(int));
+   sorted         = (int*)poly_alloc(polygon, half_edge_count * sizeof(int));
+   left           = (bool*)poly_alloc(polygon, half_edge_count * sizeof(bool));
+   stack          = (int*)poly_alloc(polygon, half_edge_count * sizeof(int));
+
+   if (!from || !to || !next_half_edge || !out_start || !out || !visited || !face || !sorted || !left || !stack)
+      return false;
 
-         point0 = (float*)_al_list_item_data(item);
-         point1 = (float*)_al_list_item_data(next);
+   for (h = 0; h < n; ++h) {
+      from[h] = h;
+      to[h] = polygon->next[h];
+   }
+   for (i = 0; i < polygon->diagonal_count; ++i) {
+      from[n + 2 * i]     = to[n + 2 * i + 1] = polygon->diagonals[2 * i + 0];
+      from[n + 2 * i + 1] = to[n + 2 * i]     = polygon->diagonals[2 * i + 1];
+   }
 
-         n[0] = -(point1[1] - point0[1]);
-         n[1] =   point1[0] - point0[0];
+   /* Gather the outgoing interior half-edges of every vertex. */
+   memset(out_start, 0, (n + 1) * sizeof(int));
+   for (h = 0; h < half_edge_count; ++h)
+      if (to[h] >= 0)
+         ++out_start[from[h] + 1];
+   for (v = 0; v < n; ++v)
+      out_start[v + 1] += out_start[v];
+   {
+      int* fill = next_half_edge;   /* used as scratch until below */
+      memcpy(fill, out_start, n * sizeof(int));
+      for (h = 0; h < half_edge_count; ++h)
+         if (to[h] >= 0)
+            out[fill[from[h]]++].half_edge = h;
+   }
 
-         l = 2.0f * sqrtf(n[0] * n[0] + n[1] * n[1]);
+   /* Sort them counter-clockwise, starting with the polygon edge. */
+   for (v = 0; v < n; ++v) {
 
-         n[0] /= l;
-         n[1] /= l;
+      const float* p;
+      float ref_x, ref_y;
 
-         r = 1.0f * 0.0f;
+      if (out_start[v + 1] - out_start[v] < 2)
+         continue;
 
-         al_draw_line(point0[0] + n[0] * r, point0[1] + n[1] * r, point1[0] + n[0] * r, point1[1] + n[1] * r, al_map_rgba(255, 0, 255, 128), r * g_poly_debug_scale);
+      p = POLY_VERTEX(v);
+      ref_x = POLY_VERTEX(polygon->next[v])[0] - p[0];
+      ref_y = POLY_VERTEX(polygon->next[v])[1] - p[1];
 
-         if (_al_list_contains(polygon->reflex_list, item))
-            status[status_index++] = 'R';
-         if (_al_list_contains(polygon->ear_list, item))
-            status[status_index++] = 'E';
+      for (i = out_start[v]; i < out_start[v + 1]; ++i) {
 
-         POLY_DEBUG_TEXT_LINE(point0[0], point0[1], -histogram[VERTEX_INDEX(point0)], "%s %d", status, index++);
+         h = out[i].half_edge;
+         if (h < n) {
+            out[i].angle = 0.0f;
+         }
+         else {
+            float dx = POLY_VERTEX(to[h])[0] - p[0];
+            float dy = POLY_VERTEX(to[h])[1] - p[1];
+            float angle = atan2f(ref_x * dy - ref_y * dx, ref_x * dx + ref_y * dy);
 
-         ++histogram[VERTEX_INDEX(point0)];
+            if (angle <= 0.0f)
+               angle += 2.0f * ALLEGRO_PI;
+            out[i].angle = angle;
+         }
       }
 
-      al_free(histogram);
+      qsort(out + out_start[v], out_start[v + 1] - out_start[v], sizeof(POLY_OUT_EDGE), poly_out_edge_compare);
    }
-# endif
-
-   // Repeat until there are ear clips.
-   while (!_al_list_is_empty(polygon->ear_list)) {
-
-      _AL_LIST_ITEM* ear_item;
-      _AL_LIST_ITEM* vertex_item;
-      _AL_LIST_ITEM* next;
-      _AL_LIST_ITEM* prev;
-      float* v0;
-      float* v1;
-      float* v2;
-
-      // Get point and corresponding item on polygon->vertex_list list.
-      ear_item    = _al_list_front(polygon->ear_list);
-      vertex_item = (_AL_LIST_ITEM*)_al_list_item_data(ear_item);
-      prev        = _al_list_previous_circular(polygon->vertex_list, vertex_item);
-      next        = _al_list_next_circular(polygon->vertex_list,     vertex_item);
-      v0 = (float*)_al_list_item_data(prev);
-      v1 = (float*)_al_list_item_data(vertex_item);
-      v2 = (float*)_al_list_item_data(next);
-
-# if POLY_DEBUG
-      if (g_poly_debug_step == g_poly_debug_step_current) {
-         _AL_LIST_ITEM* item;
-         ALLEGRO_COLOR color;
-         int second = 0;
-
-         al_draw_filled_triangle(v0[0], v0[1], v1[0], v1[1], v2[0], v2[1], al_map_rgba(0, 0, 255, 64));
-
-         for (item = _al_list_front(polygon->vertex_list); item; item = _al_list_next(polygon->vertex_list, item)) {
-
-            float* point = (float*)_al_list_item_data(item);
-            al_draw_filled_circle(point[0], point[1], 6.0f * g_poly_debug_scale, al_map_rgb(255, 255, 255));
-         }
 
-         for (item = _al_list_front(polygon->reflex_list); item; item = _al_list_next(polygon->reflex_list, item)) {
+   /* Next half-edge around a piece: turn as far right as possible. Arriving
+    * along a polygon edge that means the last outgoing half-edge, arriving
+    * along a diagonal the one just before the diagonal going back.
+    */
+   for (v = 0; v < n; ++v) {
 
-            float* point = (float*)_al_list_item_data((_AL_LIST_ITEM*)_al_list_item_data(item));
+      for (i = out_start[v]; i < out_start[v + 1]; ++i) {
 
-            al_draw_filled_circle(point[0], point[1], 6.0f * g_poly_debug_scale, al_map_rgb(255, 255, 0));
+         h = out[i].half_edge;
+         if (h >= n) {
+            int twin = n + ((h - n) ^ 1);
+            next_half_edge[twin] = out[i > out_start[v] ? i - 1 : out_start[v + 1] - 1].half_edge;
          }
+      }
 
-         color = al_map_rgb(255, 0, 0);
-         second = _al_list_size(polygon->ear_list) - 1;
-         for (item = _al_list_back(polygon->ear_list); item; item = _al_list_previous(polygon->ear_list, item), --second) {
+      if (polygon->next[v] >= 0)
+         next_half_edge[polygon->prev[v]] = out[out_start[v + 1] - 1].half_edge;
+   }
 
-            float* point = (float*)_al_list_item_data((_AL_LIST_ITEM*)_al_list_item_data(item));
+   for (h = 0; h < half_edge_count; ++h)
+      visited[h] = false;
 
-            if (second == 0)
-               color = al_map_rgb(0, 255, 0);
-            else if (second == 1)
-               color = al_map_rgb(0, 0, 255);
+   for (h = 0; h < half_edge_count; ++h) {
 
-            al_draw_circle(point[0], point[1], 9.0f * g_poly_debug_scale, color, 2.0f * g_poly_debug_scale);
-         }
-      }
-      if (g_poly_debug_step >= 0 && g_poly_debug_step_current >= g_poly_debug_step)
-         break;
-      g_poly_debug_step_current++;
-# endif
-
-      // Emit triangle.
-      polygon->emit(VERTEX_INDEX(v0), VERTEX_INDEX(v1), VERTEX_INDEX(v2), polygon->userdata);
-
-      // Remove polygon->ear_list clip from all lists.
-      _al_list_erase(polygon->ear_list,      ear_item);
-      _al_list_erase(polygon->vertex_list, vertex_item);
-      _al_list_erase(polygon->reflex_list, _al_list_find_first(polygon->reflex_list, vertex_item));
-
-      // Update attributes of corner vertices.
-      poly_update_vertex_attributes(polygon->vertex_list, polygon->reflex_list, polygon->ear_list, prev);
-      poly_update_vertex_attributes(polygon->vertex_list, polygon->reflex_list, polygon->ear_list, next);
+      int count = 0;
+      int e = h;
+
+      if (visited[h] || to[h] < 0)
+         continue;
+
+      do {
+         if (visited[e] || count >= half_edge_count)
+            break;
+         visited[e] = true;
+         face[count++] = from[e];
+         e = next_half_edge[e];
+      } while (e != h);
+
+      /* Pieces that don't close up come from bad input. */
+      if (e == h)
+         poly_triangulate_monotone(polygon, face, count, sorted, left, stack);
    }
 
-# undef VERTEX_INDEX
+   return true;
 }
 
 
@@ -817,54 +881,56 @@ bool al_triangulate_polygon(
 {
    POLY polygon;
    int vertex_count;
-   int split_count;
-   int *splits;
+   int n;
    int i;
    bool ret;
 
-   for (i = 0; vertex_counts[i] > 0; i++) {
-      /* do nothing */
-   }
-   ASSERT(i > 0);
-   split_count = i;
-
-   splits = malloc(split_count * sizeof(int));
-   if (!splits) {
-      return false;
-   }
    vertex_count = 0;
-   for (i = 0; i < split_count; i++) {
+   for (i = 0; vertex_counts[i] > 0; i++) {
       vertex_count += vertex_counts[i];
-      splits[i] = vertex_count;
    }
+   ASSERT(i > 0);
+   n = vertex_count;
 
    memset(&polygon, 0, sizeof(polygon));
    polygon.vertex_buffer = vertices;
    polygon.vertex_stride = vertex_stride;
    polygon.vertex_count  = vertex_count;
-   polygon.split_indices = splits;
-   polygon.split_stride  = sizeof(int);   /* XXX can simplify code now */
-   polygon.split_count   = split_count;
    polygon.emit          = emit_triangle;
    polygon.userdata      = userdata;
 
-   if (poly_initialize(&polygon)) {
-
-      poly_do_triangulate(&polygon);
-
-      _al_list_destroy(polygon.vertex_list);
-      _al_list_destroy(polygon.reflex_list);
-      _al_list_destroy(polygon.ear_list);
-
+   polygon.next       = (int*)poly_alloc(&polygon, n * sizeof(int));
+   polygon.prev       = (int*)poly_alloc(&polygon, n * sizeof(int));
+   polygon.type       = (unsigned char*)poly_alloc(&polygon, n);
+   polygon.helper     = (int*)poly_alloc(&polygon, n * sizeof(int));
+   polygon.order      = (int*)poly_alloc(&polygon, n * sizeof(int));
+   polygon.status_left   = (int*)poly_alloc(&polygon, n * sizeof(int));
+   polygon.status_right  = (int*)poly_alloc(&polygon, n * sizeof(int));
+   polygon.status_parent = (int*)poly_alloc(&polygon, n * sizeof(int));
+   /* Each vertex adds at most two diagonals. */
+   polygon.diagonals  = (int*)poly_alloc(&polygon, 4 * n * sizeof(int));
+
+   if (!polygon.next || !polygon.prev || !polygon.type || !polygon.helper ||
+         !polygon.order || !polygon.status_left || !polygon.status_right ||
+         !polygon.status_parent || !polygon.diagonals) {
+      ret = false;
+   }
+   else if (!poly_link_rings(&polygon, vertex_counts)) {
       ret = true;
    }
-   else {
+   else if (!poly_prepare_sweep(&polygon)) {
       ret = false;
    }
+   else {
+      poly_make_monotone(&polygon);
+      ret = poly_triangulate_pieces(&polygon);
+   }
 
-   free(splits);
+   poly_free_arena(&polygon);
 
    return ret;
 }
 
+# undef POLY_VERTEX
+
 /* vim: set sts=3 sw=3 et: */
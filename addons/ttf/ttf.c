@@ -3,6 +3,7 @@
 #include "allegro5/allegro_opengl.h"
 #endif
 #include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_vector.h"
 
 #include "allegro5/allegro_ttf.h"
@@ -33,6 +34,9 @@ ALLEGRO_DEBUG_CHANNEL("font")
 
 #define RANGE_SIZE   128
 
+/* Number of glyphs collected before they are drawn as one batch. */
+#define GLYPH_RUN_SIZE  64
+
 
 typedef struct REGION
 {
@@ -80,6 +84,13 @@ typedef struct ALLEGRO_TTF_FONT_DATA
 
    int bitmap_format;
    int bitmap_flags;
+
+   /* The last characters looked up by ttf_get_glyph_advance. */
+   struct {
+      int32_t ch;
+      int ft_index;
+   } char_index_cache[2];
+   int char_index_next;
 } ALLEGRO_TTF_FONT_DATA;
 
 
@@ -438,57 +449,6 @@ static int get_kerning(ALLEGRO_TTF_FONT_DATA const *data, FT_Face face,
 }
 
 
-static int render_glyph(ALLEGRO_FONT const *f,
-   ALLEGRO_COLOR color, int prev_ft_index, int ft_index,
-   float xpos, float ypos)
-{
-   ALLEGRO_TTF_FONT_DATA *data = f->data;
-   FT_Face face = data->face;
-   ALLEGRO_TTF_GLYPH_DATA *glyph = get_glyph(data, ft_index);
-   int advance = 0;
-   ALLEGRO_DISPLAY *display;
-   ALLEGRO_TRANSFORM old_projection_transform;
-
-   /* Workabout for bug 3484535 */
-   display = al_get_current_display();
-   if (display) {
-      al_copy_transform(&old_projection_transform,
-         al_get_projection_transform(display));
-   }
-
-   /* We don't try to cache all glyphs in a pre-pass before drawing them.
-    * While that would indeed save us making separate texture uploads, it
-    * implies two passes over a string even in the common case when all glyphs
-    * are already cached.  This turns out to have an measureable impact on
-    * performance.
-    */
-   cache_glyph(data, face, ft_index, glyph, false);
-
-   /* Workabout for bug 3484535 */
-   if (display) {
-      al_set_projection_transform(display, &old_projection_transform);
-   }
-
-   advance += get_kerning(data, face, prev_ft_index, ft_index);
-
-   if (glyph->page_bitmap) {
-      /* Each glyph has a 1-pixel border all around. */
-      al_draw_tinted_bitmap_region(glyph->page_bitmap, color,
-         glyph->region.x + 1, glyph->region.y + 1,
-         glyph->region.w - 2, glyph->region.h - 2,
-         xpos + glyph->offset_x + advance,
-         ypos + glyph->offset_y, 0);
-   }
-   else if (glyph->region.x > 0) {
-      ALLEGRO_ERROR("Glyph %d not on any page.\n", ft_index);
-   }
-
-   advance += glyph->advance;
-
-   return advance;
-}
-
-
 static int ttf_font_height(ALLEGRO_FONT const *f)
 {
    ASSERT(f);
@@ -548,11 +508,43 @@ static int ttf_char_length(ALLEGRO_FONT const *f, int ch)
 }
 
 
+/* Caches a glyph while text may be drawn, keeping the projection and
+ * whether bitmap drawing is held.
+ */
+static void cache_glyph_keep_state(ALLEGRO_TTF_FONT_DATA *data,
+   FT_Face face, int ft_index, ALLEGRO_TTF_GLYPH_DATA *glyph)
+{
+   ALLEGRO_DISPLAY *display;
+   ALLEGRO_TRANSFORM old_projection_transform;
+   bool hold = al_is_bitmap_drawing_held();
+
+   /* Workabout for bug 3484535 */
+   display = al_get_current_display();
+   if (display) {
+      al_copy_transform(&old_projection_transform,
+         al_get_projection_transform(display));
+   }
+
+   cache_glyph(data, face, ft_index, glyph, false);
+
+   /* Workabout for bug 3484535 */
+   if (display) {
+      al_set_projection_transform(display, &old_projection_transform);
+   }
+
+   /* Caching may have released the hold. */
+   al_hold_bitmap_drawing(hold);
+}
+
+
 static int ttf_render(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
    const ALLEGRO_USTR *text, float x, float y)
 {
    ALLEGRO_TTF_FONT_DATA *data = f->data;
    FT_Face face = data->face;
+   _AL_BITMAP_QUAD quads[GLYPH_RUN_SIZE];
+   ALLEGRO_BITMAP *page = NULL;
+   int num_quads = 0;
    int pos = 0;
    int advance = 0;
    int prev_ft_index = -1;
@@ -564,11 +556,56 @@ static int ttf_render(ALLEGRO_FONT const *f, ALLEGRO_COLOR color,
 
    while ((ch = al_ustr_get_next(text, &pos)) >= 0) {
       int ft_index = FT_Get_Char_Index(face, ch);
-      advance += render_glyph(f, color, prev_ft_index, ft_index,
-         x + advance, y);
+      ALLEGRO_TTF_GLYPH_DATA *glyph = get_glyph(data, ft_index);
+      float xpos = x + advance;
+      int kerning;
+
+      /* We don't try to cache all glyphs in a pre-pass before drawing them.
+       * While that would indeed save us making separate texture uploads, it
+       * implies two passes over a string even in the common case when all
+       * glyphs are already cached.  This turns out to have an measureable
+       * impact on performance. Pending quads are drawn first so that the
+       * glyphs still come out in order.
+       */
+      if (!glyph->page_bitmap && glyph->region.x >= 0) {
+         if (page)
+            _al_draw_tinted_bitmap_quads(page, color, quads, num_quads);
+         num_quads = 0;
+         cache_glyph_keep_state(data, face, ft_index, glyph);
+      }
+
+      kerning = get_kerning(data, face, prev_ft_index, ft_index);
+
+      if (glyph->page_bitmap) {
+         _AL_BITMAP_QUAD *q;
+
+         if (glyph->page_bitmap != page || num_quads == GLYPH_RUN_SIZE) {
+            if (page)
+               _al_draw_tinted_bitmap_quads(page, color, quads, num_quads);
+            page = glyph->page_bitmap;
+            num_quads = 0;
+         }
+
+         /* Each glyph has a 1-pixel border all around. */
+         q = &quads[num_quads++];
+         q->sx = glyph->region.x + 1;
+         q->sy = glyph->region.y + 1;
+         q->sw = glyph->region.w - 2;
+         q->sh = glyph->region.h - 2;
+         q->dx = xpos + glyph->offset_x + kerning;
+         q->dy = y + glyph->offset_y;
+      }
+      else if (glyph->region.x > 0) {
+         ALLEGRO_ERROR("Glyph %d not on any page.\n", ft_index);
+      }
+
+      advance += kerning + glyph->advance;
       prev_ft_index = ft_index;
    }
 
+   if (page)
+      _al_draw_tinted_bitmap_quads(page, color, quads, num_quads);
+
    al_hold_bitmap_drawing(hold);
 
    return advance;
@@ -602,6 +639,52 @@ static int ttf_text_length(ALLEGRO_FONT const *f, const ALLEGRO_USTR *text)
 }
 
 
+/* Text layout asks for the advance of each character twice, the second
+ * time together with the next character, so the last two lookups are kept.
+ */
+static int get_char_index(ALLEGRO_TTF_FONT_DATA *data, int32_t ch)
+{
+   int i;
+
+   for (i = 0; i < 2; i++) {
+      if (data->char_index_cache[i].ch == ch)
+         return data->char_index_cache[i].ft_index;
+   }
+
+   i = data->char_index_next;
+   data->char_index_next = !i;
+   data->char_index_cache[i].ch = ch;
+   data->char_index_cache[i].ft_index = FT_Get_Char_Index(data->face, ch);
+   return data->char_index_cache[i].ft_index;
+}
+
+
+static int ttf_get_glyph_advance(ALLEGRO_FONT const *f, int codepoint1,
+   int codepoint2)
+{
+   ALLEGRO_TTF_FONT_DATA *data = f->data;
+   FT_Face face = data->face;
+   ALLEGRO_TTF_GLYPH_DATA *glyph;
+   int ft_index;
+   int kerning = 0;
+
+   if (codepoint1 == ALLEGRO_NO_KERNING)
+      return 0;
+
+   ft_index = get_char_index(data, codepoint1);
+   glyph = get_glyph(data, ft_index);
+   if (!glyph->page_bitmap && glyph->region.x >= 0)
+      cache_glyph_keep_state(data, face, ft_index, glyph);
+
+   if (codepoint2 != ALLEGRO_NO_KERNING) {
+      int ft_index2 = get_char_index(data, codepoint2);
+      kerning = get_kerning(data, face, ft_index, ft_index2);
+   }
+
+   return glyph->advance + kerning;
+}
+
+
 static void ttf_get_text_dimensions(ALLEGRO_FONT const *f,
    ALLEGRO_USTR const *text,
    int *bbx, int *bby, int *bbw, int *bbh)
@@ -812,6 +895,8 @@ ALLEGRO_FONT *al_load_ttf_font_stretch_f(ALLEGRO_FILE *file,
 
     data->face = face;
     data->flags = flags;
+    data->char_index_cache[0].ch = -1;
+    data->char_index_cache[1].ch = -1;
 
     _al_vector_init(&data->glyph_ranges, sizeof(ALLEGRO_TTF_GLYPH_RANGE));
     _al_vector_init(&data->page_bitmaps, sizeof(ALLEGRO_BITMAP*));
@@ -910,6 +995,7 @@ bool al_init_ttf_addon(void)
    vt.destroy = ttf_destroy;
    vt.get_text_dimensions = ttf_get_text_dimensions;
    vt.get_font_ranges = ttf_get_font_ranges;
+   vt.get_glyph_advance = ttf_get_glyph_advance;
 
    al_register_font_loader(".ttf", al_load_ttf_font);
 
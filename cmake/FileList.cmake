@@ -1,10 +1,12 @@
 set(ALLEGRO_SRC_FILES
     src/allegro.c
     src/bitmap.c
+    src/bitmap_dirty.c
     src/bitmap_draw.c
     src/bitmap_io.c
     src/bitmap_lock.c
     src/bitmap_pixel.c
+    src/bitmap_resample.c
     src/bitmap_type.c
     src/blenders.c
     src/config.c
@@ -34,9 +36,11 @@ set(ALLEGRO_SRC_FILES
     src/monitor.c
     src/mousenu.c
     src/mouse_cursor.c
+    src/parallel.c
     src/path.c
     src/pixels.c
     src/shader.c
+    src/shader_soft.c
     src/system.c
     src/threads.c
     src/timernu.c
@@ -31,6 +31,19 @@ enum {
 };
 
 
+/*
+ * Resampling flags
+ */
+enum {
+   ALLEGRO_RESAMPLE_BOX             = 0,
+   ALLEGRO_RESAMPLE_MITCHELL        = 1,
+   ALLEGRO_RESAMPLE_LANCZOS         = 2,
+   ALLEGRO_RESAMPLE_FILTER_MASK     = 0x000f,
+   ALLEGRO_RESAMPLE_LINEAR_LIGHT    = 0x0010
+   /* ALLEGRO_NO_PREMULTIPLIED_ALPHA = 0x0200 is also accepted */
+};
+
+
 AL_FUNC(void, al_set_new_bitmap_format, (int format));
 AL_FUNC(void, al_set_new_bitmap_flags, (int flags));
 AL_FUNC(int, al_get_new_bitmap_format, (void));
@@ -43,6 +56,7 @@ AL_FUNC(int, al_get_bitmap_format, (ALLEGRO_BITMAP *bitmap));
 AL_FUNC(int, al_get_bitmap_flags, (ALLEGRO_BITMAP *bitmap));
 
 AL_FUNC(ALLEGRO_BITMAP*, al_create_bitmap, (int w, int h));
+AL_FUNC(ALLEGRO_BITMAP*, al_create_bitmap_from_pixels, (int w, int h, int format, void *pixels, int pitch, void (*free_fn)(void *pixels)));
 AL_FUNC(void, al_destroy_bitmap, (ALLEGRO_BITMAP *bitmap));
 
 AL_FUNC(void, al_put_pixel, (int x, int y, ALLEGRO_COLOR color));
@@ -67,6 +81,18 @@ AL_FUNC(ALLEGRO_BITMAP *, al_clone_bitmap, (ALLEGRO_BITMAP *bitmap));
 AL_FUNC(void, al_convert_bitmap, (ALLEGRO_BITMAP *bitmap));
 AL_FUNC(void, al_convert_bitmaps, (void));
 
+/* Resampling */
+AL_FUNC(bool, al_resample_bitmap, (ALLEGRO_BITMAP *dest, ALLEGRO_BITMAP *src, int flags));
+AL_FUNC(int, al_create_mipmaps, (ALLEGRO_BITMAP *bitmap, ALLEGRO_BITMAP **mipmaps, int max_mipmaps, int flags));
+
+/* Dirty rectangles */
+AL_FUNC(bool, al_set_bitmap_dirty_tracking, (ALLEGRO_BITMAP *bitmap, bool track));
+AL_FUNC(bool, al_get_bitmap_dirty_tracking, (ALLEGRO_BITMAP *bitmap));
+AL_FUNC(void, al_add_bitmap_dirty_rect, (ALLEGRO_BITMAP *bitmap, int x, int y, int width, int height));
+AL_FUNC(int, al_get_bitmap_num_dirty_rects, (ALLEGRO_BITMAP *bitmap));
+AL_FUNC(bool, al_get_bitmap_dirty_rect, (ALLEGRO_BITMAP *bitmap, int index, int *x, int *y, int *width, int *height));
+AL_FUNC(void, al_clear_bitmap_dirty_rects, (ALLEGRO_BITMAP *bitmap));
+
 #ifdef __cplusplus
    }
 #endif
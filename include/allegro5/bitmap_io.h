@@ -2,6 +2,7 @@
 #define __al_included_allegro5_bitmap_io_h
 
 #include "allegro5/bitmap.h"
+#include "allegro5/events.h"
 #include "allegro5/file.h"
 
 #ifdef __cplusplus
@@ -17,21 +18,79 @@ enum {
    ALLEGRO_KEEP_INDEX               = 0x0800
 };
 
+/* Type: ALLEGRO_BITMAP_INFO
+ */
+typedef struct ALLEGRO_BITMAP_INFO ALLEGRO_BITMAP_INFO;
+
+struct ALLEGRO_BITMAP_INFO
+{
+   int width;
+   int height;
+   int channels;
+   int bits_per_pixel;
+   bool has_palette;
+   bool has_alpha;
+};
+
+/* Type: ALLEGRO_BITMAP_BATCH
+ */
+typedef struct ALLEGRO_BITMAP_BATCH ALLEGRO_BITMAP_BATCH;
+
+enum {
+   ALLEGRO_EVENT_BITMAP_LOADED      = 560
+};
+
+/* Type: ALLEGRO_BITMAP_STREAM
+ */
+typedef struct ALLEGRO_BITMAP_STREAM ALLEGRO_BITMAP_STREAM;
+
+/* Type: ALLEGRO_BITMAP_STREAM_INTERFACE
+ */
+typedef struct ALLEGRO_BITMAP_STREAM_INTERFACE
+{
+   AL_METHOD(int,  bsi_read_rows, (ALLEGRO_BITMAP_STREAM *stream, unsigned char *buffer, int pitch, int num_rows));
+   AL_METHOD(void, bsi_close, (ALLEGRO_BITMAP_STREAM *stream));
+} ALLEGRO_BITMAP_STREAM_INTERFACE;
+
 typedef ALLEGRO_BITMAP *(*ALLEGRO_IIO_LOADER_FUNCTION)(const char *filename, int flags);
 typedef ALLEGRO_BITMAP *(*ALLEGRO_IIO_FS_LOADER_FUNCTION)(ALLEGRO_FILE *fp, int flags);
 typedef bool (*ALLEGRO_IIO_SAVER_FUNCTION)(const char *filename, ALLEGRO_BITMAP *bitmap);
 typedef bool (*ALLEGRO_IIO_FS_SAVER_FUNCTION)(ALLEGRO_FILE *fp, ALLEGRO_BITMAP *bitmap);
+typedef bool (*ALLEGRO_IIO_PROBER_FUNCTION)(ALLEGRO_FILE *fp, ALLEGRO_BITMAP_INFO *info);
+typedef ALLEGRO_BITMAP_STREAM *(*ALLEGRO_IIO_STREAM_OPENER_FUNCTION)(ALLEGRO_FILE *fp, int flags);
 
 AL_FUNC(bool, al_register_bitmap_loader, (const char *ext, ALLEGRO_IIO_LOADER_FUNCTION loader));
 AL_FUNC(bool, al_register_bitmap_saver, (const char *ext, ALLEGRO_IIO_SAVER_FUNCTION saver));
 AL_FUNC(bool, al_register_bitmap_loader_f, (const char *ext, ALLEGRO_IIO_FS_LOADER_FUNCTION fs_loader));
 AL_FUNC(bool, al_register_bitmap_saver_f, (const char *ext, ALLEGRO_IIO_FS_SAVER_FUNCTION fs_saver));
+AL_FUNC(bool, al_register_bitmap_prober, (const char *ext, ALLEGRO_IIO_PROBER_FUNCTION prober));
+AL_FUNC(bool, al_register_bitmap_stream_opener, (const char *ext, ALLEGRO_IIO_STREAM_OPENER_FUNCTION opener));
 AL_FUNC(ALLEGRO_BITMAP *, al_load_bitmap, (const char *filename));
 AL_FUNC(ALLEGRO_BITMAP *, al_load_bitmap_flags, (const char *filename, int flags));
 AL_FUNC(ALLEGRO_BITMAP *, al_load_bitmap_f, (ALLEGRO_FILE *fp, const char *ident));
 AL_FUNC(ALLEGRO_BITMAP *, al_load_bitmap_flags_f, (ALLEGRO_FILE *fp, const char *ident, int flags));
+AL_FUNC(ALLEGRO_BITMAP *, al_load_bitmap_scaled, (const char *filename, int max_w, int max_h, int flags));
+AL_FUNC(ALLEGRO_BITMAP *, al_load_bitmap_scaled_f, (ALLEGRO_FILE *fp, const char *ident, int max_w, int max_h, int flags));
 AL_FUNC(bool, al_save_bitmap, (const char *filename, ALLEGRO_BITMAP *bitmap));
 AL_FUNC(bool, al_save_bitmap_f, (ALLEGRO_FILE *fp, const char *ident, ALLEGRO_BITMAP *bitmap));
+AL_FUNC(bool, al_probe_bitmap, (const char *filename, ALLEGRO_BITMAP_INFO *info));
+AL_FUNC(bool, al_probe_bitmap_f, (ALLEGRO_FILE *fp, const char *ident, ALLEGRO_BITMAP_INFO *info));
+
+AL_FUNC(ALLEGRO_BITMAP_STREAM *, al_open_bitmap_stream, (const char *filename, int flags));
+AL_FUNC(ALLEGRO_BITMAP_STREAM *, al_open_bitmap_stream_f, (ALLEGRO_FILE *fp, const char *ident, int flags));
+AL_FUNC(ALLEGRO_BITMAP_STREAM *, al_create_bitmap_stream, (const ALLEGRO_BITMAP_STREAM_INTERFACE *vt, void *userdata, int width, int height));
+AL_FUNC(void *, al_get_bitmap_stream_userdata, (ALLEGRO_BITMAP_STREAM *stream));
+AL_FUNC(int, al_get_bitmap_stream_width, (ALLEGRO_BITMAP_STREAM *stream));
+AL_FUNC(int, al_get_bitmap_stream_height, (ALLEGRO_BITMAP_STREAM *stream));
+AL_FUNC(int, al_get_bitmap_stream_position, (ALLEGRO_BITMAP_STREAM *stream));
+AL_FUNC(int, al_read_bitmap_stream, (ALLEGRO_BITMAP_STREAM *stream, void *buffer, int pitch, int num_rows));
+AL_FUNC(int, al_read_bitmap_stream_to_bitmap, (ALLEGRO_BITMAP_STREAM *stream, ALLEGRO_BITMAP *bitmap));
+AL_FUNC(void, al_close_bitmap_stream, (ALLEGRO_BITMAP_STREAM *stream));
+
+AL_FUNC(ALLEGRO_BITMAP_BATCH *, al_load_bitmaps_async, (const char * const *filenames, int count, int flags, ALLEGRO_EVENT_QUEUE *queue, void (*callback)(int index, ALLEGRO_BITMAP *bitmap, void *arg), void *arg));
+AL_FUNC(ALLEGRO_EVENT_SOURCE *, al_get_bitmap_batch_event_source, (ALLEGRO_BITMAP_BATCH *batch));
+AL_FUNC(void, al_wait_for_bitmap_batch, (ALLEGRO_BITMAP_BATCH *batch));
+AL_FUNC(void, al_destroy_bitmap_batch, (ALLEGRO_BITMAP_BATCH *batch));
 
 #ifdef __cplusplus
    }
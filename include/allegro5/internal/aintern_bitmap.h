@@ -13,6 +13,20 @@ extern "C" {
 
 typedef struct ALLEGRO_BITMAP_INTERFACE ALLEGRO_BITMAP_INTERFACE;
 
+/* Pixels of memory bitmaps which are shared between clones until one of
+ * them is written to, or which belong to the user.
+ */
+typedef struct _AL_DIRTY_RECTS _AL_DIRTY_RECTS;
+
+typedef struct _AL_SHARED_PIXELS
+{
+   ALLEGRO_MUTEX *mutex;
+   int refcount;
+   unsigned char *memory;
+   /* Called with memory once no bitmap uses it, unless NULL. */
+   void (*free_fn)(void *memory);
+} _AL_SHARED_PIXELS;
+
 struct ALLEGRO_BITMAP
 {
    ALLEGRO_BITMAP_INTERFACE *vt;
@@ -54,6 +68,18 @@ struct ALLEGRO_BITMAP
    int lock_h;
    int lock_flags;
    ALLEGRO_LOCKED_REGION locked_region;
+   /*
+    * Memory bitmaps can have several regions locked at the same time, as
+    * long as they don't overlap.  Each lock is held by a different
+    * sub-bitmap or the bitmap itself, which has the locking info above set.
+    *
+    * first_lock - list of the bitmaps holding a lock on this bitmap
+    * next_lock - next bitmap in the list of the parent
+    * lock_mutex - protects the list
+    */
+   ALLEGRO_BITMAP *first_lock;
+   ALLEGRO_BITMAP *next_lock;
+   ALLEGRO_MUTEX *lock_mutex;
 
    /* Transformation for this bitmap */
    ALLEGRO_TRANSFORM transform;
@@ -73,11 +99,26 @@ struct ALLEGRO_BITMAP
    /* A memory copy of the bitmap data. May be NULL for an empty bitmap. */
    unsigned char *memory;
 
+   /* If not NULL, memory belongs to this and must not be written to or
+    * freed directly.  Only used for memory bitmaps.
+    */
+   _AL_SHARED_PIXELS *shared;
+
+   /* Pixels shared before this bitmap got its own copy while other regions
+    * were locked, kept until those are unlocked.
+    */
+   _AL_SHARED_PIXELS *old_shared;
+
    /* Extra data for display bitmaps, like texture id and so on. */
    void *extra;
 
    /* set_target_bitmap and lock_bitmap mark bitmaps as dirty for preservation */
    bool dirty;
+
+   /* Changed regions, if al_set_bitmap_dirty_tracking was called. Only used
+    * for parent bitmaps.
+    */
+   _AL_DIRTY_RECTS *dirty_rects;
 };
 
 struct ALLEGRO_BITMAP_INTERFACE
@@ -119,6 +160,9 @@ void _al_convert_bitmap_data(
 	int sx, int sy, int dx, int dy,
 	int width, int height);
 
+bool _al_unshare_bitmap_memory(ALLEGRO_BITMAP *bitmap);
+void _al_release_shared_pixels(_AL_SHARED_PIXELS *shared);
+
 /* Bitmap type conversion */ 
 void _al_init_convert_bitmap_list(void);
 void _al_register_convert_bitmap(ALLEGRO_BITMAP *bitmap);
@@ -129,8 +173,25 @@ void _al_convert_to_memory_bitmap(ALLEGRO_BITMAP *bitmap);
 /* Simple bitmap drawing */
 void _al_put_pixel(ALLEGRO_BITMAP *bitmap, int x, int y, ALLEGRO_COLOR color);
 
+/* One region of a bitmap drawn by _al_draw_tinted_bitmap_quads. */
+typedef struct _AL_BITMAP_QUAD
+{
+   float sx, sy, sw, sh;   /* source region, relative to the bitmap */
+   float dx, dy;           /* destination, before transformation */
+} _AL_BITMAP_QUAD;
+
+AL_FUNC(void, _al_draw_tinted_bitmap_quads, (ALLEGRO_BITMAP *bitmap,
+   ALLEGRO_COLOR tint, const _AL_BITMAP_QUAD *quads, int num_quads));
+
+/* Dirty rectangles */
+AL_FUNC(void, _al_mark_bitmap_dirty, (ALLEGRO_BITMAP *bitmap,
+   int x, int y, int w, int h));
+AL_FUNC(void, _al_mark_target_dirty, (float x1, float y1, float x2, float y2));
+void _al_destroy_dirty_rects(ALLEGRO_BITMAP *bitmap);
+
 /* Bitmap I/O */
 void _al_init_iio_table(void);
+AL_FUNC(bool, _al_get_scaled_load_size, (int w, int h, int *dw, int *dh));
 
 
 #ifdef __cplusplus
@@ -9,6 +9,9 @@
 void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *bitmap,
    ALLEGRO_COLOR tint,
    int sx, int sy, int sw, int sh, int dx, int dy, int flags);
+void _al_draw_bitmap_quads_memory(ALLEGRO_BITMAP *bitmap,
+   ALLEGRO_COLOR tint, float xofs, float yofs,
+   const _AL_BITMAP_QUAD *quads, int num_quads);
 
 
 #ifdef __cplusplus
@@ -9,6 +9,10 @@
 void _al_clear_memory(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR *color);
 void _al_draw_pixel_memory(ALLEGRO_BITMAP *bmp, float x, float y, ALLEGRO_COLOR *color);
 
+void _al_init_fill_bands(void);
+void _al_fill_bands(int y1, int y2, int width,
+   void (*proc)(void *arg, int y1, int y2), void *arg);
+
 
 #ifdef __cplusplus
    }
@@ -266,7 +266,7 @@
       uint32_t _pp_pixel;                                                     \
       switch (format) {                                                       \
          case ALLEGRO_PIXEL_FORMAT_ARGB_8888:                                 \
-            _pp_pixel  = _al_fast_float_to_int(color.a * 255) << 24;          \
+            _pp_pixel  = (uint32_t)_al_fast_float_to_int(color.a * 255) << 24; \
             _pp_pixel |= _al_fast_float_to_int(color.r * 255) << 16;          \
             _pp_pixel |= _al_fast_float_to_int(color.g * 255) <<  8;          \
             _pp_pixel |= _al_fast_float_to_int(color.b * 255);                \
@@ -276,7 +276,7 @@
             break;                                                            \
                                                                               \
          case ALLEGRO_PIXEL_FORMAT_RGBA_8888:                                 \
-            _pp_pixel  = _al_fast_float_to_int(color.r * 255) << 24;          \
+            _pp_pixel  = (uint32_t)_al_fast_float_to_int(color.r * 255) << 24; \
             _pp_pixel |= _al_fast_float_to_int(color.g * 255) << 16;          \
             _pp_pixel |= _al_fast_float_to_int(color.b * 255) <<  8;          \
             _pp_pixel |= _al_fast_float_to_int(color.a * 255);                \
@@ -343,7 +343,7 @@
             break;                                                            \
                                                                               \
          case ALLEGRO_PIXEL_FORMAT_ABGR_8888:                                 \
-            _pp_pixel  = _al_fast_float_to_int(color.a * 0xff) << 24;         \
+            _pp_pixel  = (uint32_t)_al_fast_float_to_int(color.a * 0xff) << 24; \
             _pp_pixel |= _al_fast_float_to_int(color.b * 0xff) << 16;         \
             _pp_pixel |= _al_fast_float_to_int(color.g * 0xff) << 8;          \
             _pp_pixel |= _al_fast_float_to_int(color.r * 0xff);               \
@@ -391,7 +391,7 @@
                                                                               \
          case ALLEGRO_PIXEL_FORMAT_RGBX_8888:                                 \
             _pp_pixel  = 0xff;                                                \
-            _pp_pixel |= _al_fast_float_to_int(color.r * 0xff) << 24;         \
+            _pp_pixel |= (uint32_t)_al_fast_float_to_int(color.r * 0xff) << 24; \
             _pp_pixel |= _al_fast_float_to_int(color.g * 0xff) << 16;         \
             _pp_pixel |= _al_fast_float_to_int(color.b * 0xff) << 8;          \
             *(uint32_t *)(data) = _pp_pixel;                                  \
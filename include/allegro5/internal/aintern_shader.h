@@ -51,6 +51,11 @@ void _al_unregister_shader_bitmap(ALLEGRO_SHADER *shader, ALLEGRO_BITMAP *bmp);
 
 ALLEGRO_SHADER *_al_create_default_shader(int display_flags);
 
+ALLEGRO_SHADER *_al_create_shader_soft(ALLEGRO_SHADER_PLATFORM platform);
+AL_FUNC(ALLEGRO_SHADER *, _al_get_soft_shader, (ALLEGRO_BITMAP *target));
+int _al_get_soft_shader_span_length(ALLEGRO_SHADER *shader);
+void _al_run_soft_shader(ALLEGRO_SHADER *shader, ALLEGRO_SHADER_SPAN *span);
+
 #ifdef ALLEGRO_CFG_SHADER_GLSL
 ALLEGRO_SHADER *_al_create_shader_glsl(ALLEGRO_SHADER_PLATFORM platform);
 void _al_set_shader_glsl(ALLEGRO_DISPLAY *display, ALLEGRO_SHADER *shader);
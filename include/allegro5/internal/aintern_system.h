@@ -62,6 +62,12 @@ AL_VAR(_AL_DTOR_LIST *, _al_dtor_list);
 AL_FUNC(void *, _al_open_library, (const char *filename));
 AL_FUNC(void *, _al_import_symbol, (void *library, const char *symbol));
 AL_FUNC(void, _al_close_library, (void *library));
+AL_FUNC(int, _al_get_num_cpus, (void));
+
+void _al_init_parallel(void);
+AL_FUNC(int, _al_get_parallel_threads, (void));
+AL_FUNC(bool, _al_run_parallel, (bool (*proc)(void *arg, int job), void *arg,
+   int num_jobs));
 
 #ifdef __cplusplus
 }
@@ -10,6 +10,9 @@ void _al_tls_init_once(void);
 
 int *_al_tls_get_dtor_owner_count(void);
 
+void _al_set_bitmap_load_size_hint(int max_w, int max_h);
+void _al_get_bitmap_load_size_hint(int *max_w, int *max_h);
+
 
 #ifdef __cplusplus
    }
@@ -25,13 +25,27 @@ typedef enum ALLEGRO_SHADER_TYPE ALLEGRO_SHADER_TYPE;
 enum ALLEGRO_SHADER_PLATFORM {
    ALLEGRO_SHADER_AUTO = 0,
    ALLEGRO_SHADER_GLSL = 1,
-   ALLEGRO_SHADER_HLSL = 2
+   ALLEGRO_SHADER_HLSL = 2,
+   ALLEGRO_SHADER_SOFTWARE = 3
 };
 
 /* Enum: ALLEGRO_SHADER_PLATFORM
  */
 typedef enum ALLEGRO_SHADER_PLATFORM ALLEGRO_SHADER_PLATFORM;
 
+/* Type: ALLEGRO_SHADER_SPAN
+ */
+typedef struct ALLEGRO_SHADER_SPAN ALLEGRO_SHADER_SPAN;
+
+struct ALLEGRO_SHADER_SPAN
+{
+   int x, y;
+   int length;
+   float *r, *g, *b, *a;
+   const float *u, *v;
+   ALLEGRO_BITMAP *texture;
+};
+
 /* Shader variable names */
 #define ALLEGRO_SHADER_VAR_COLOR             "al_color"
 #define ALLEGRO_SHADER_VAR_POS               "al_pos"
@@ -66,6 +80,10 @@ AL_FUNC(bool, al_set_shader_float_vector, (const char *name, int num_components,
    float *f, int num_elems));
 AL_FUNC(bool, al_set_shader_bool, (const char *name, bool b));
 
+AL_FUNC(bool, al_set_shader_span_callback, (ALLEGRO_SHADER *shader,
+   void (*callback)(ALLEGRO_SHADER_SPAN *span, void *user_data),
+   void *user_data, int max_length));
+
 AL_FUNC(char const *, al_get_default_shader_source, (ALLEGRO_SHADER_PLATFORM platform,
    ALLEGRO_SHADER_TYPE type));
 
@@ -15,13 +15,14 @@ def interp(string):
    return string
 
 def make_drawer(name):
-   global texture, grad, solid, shade, opaque, white
+   global texture, grad, solid, shade, opaque, white, program
    texture = "_texture_" in name
    grad = "_grad_" in name
    solid = "_solid_" in name
    shade = "_shade" in name
    opaque = "_opaque" in name
    white = "_white" in name
+   program = "_program" in name
 
    if grad and solid:
       raise Exception("grad and solid")
@@ -29,6 +30,8 @@ def make_drawer(name):
       raise Exception("grad and white")
    if shade and opaque:
       raise Exception("shade and opaque")
+   if program and (shade or opaque or white):
+      raise Exception("program and shade, opaque or white")
 
    print interp("static void #{name} (uintptr_t state, int x1, int y, int x2) {")
 
@@ -64,7 +67,7 @@ def make_drawer(name):
    print """\
       ALLEGRO_BITMAP *target = s->target;
 
-      if (target->parent) {
+      if (target->parent && !target->locked) {
          x1 += target->xofs;
          x2 += target->xofs;
          y += target->yofs;
@@ -117,9 +120,9 @@ def make_drawer(name):
    print "{"
    if texture:
       print """\
-      const int offset_x = s->texture->parent ? s->texture->xofs : 0;
-      const int offset_y = s->texture->parent ? s->texture->yofs : 0;
-      ALLEGRO_BITMAP* texture = s->texture->parent ? s->texture->parent : s->texture;
+      const int offset_x = (s->texture->parent && !s->texture->locked) ? s->texture->xofs : 0;
+      const int offset_y = (s->texture->parent && !s->texture->locked) ? s->texture->yofs : 0;
+      ALLEGRO_BITMAP* texture = (s->texture->parent && !s->texture->locked) ? s->texture->parent : s->texture;
       const int src_format = texture->locked_region.format;
       const int src_size = texture->locked_region.pixel_size;
 
@@ -140,6 +143,15 @@ def make_drawer(name):
          + x1 * target->locked_region.pixel_size;
       """
 
+   if program:
+      # The source colors are gathered into spans for the software shader,
+      # which are then blended in one go.
+      print interp("""\
+         program_span p;
+         program_span_init(&p, s->target, target, #{"s->texture" if texture else "NULL"},
+            dst_format, dst_data, x1, y);
+         """)
+
    if shade:
       make_if_blender_loop(
             op='ALLEGRO_ADD',
@@ -182,7 +194,7 @@ def make_drawer(name):
       print "else"
       make_loop(copy_format=True, src_size='2')
       print "else"
-   else:
+   elif not program:
       make_loop(
             if_format='ALLEGRO_PIXEL_FORMAT_ARGB_8888'
             )
@@ -190,6 +202,11 @@ def make_drawer(name):
 
    make_loop()
 
+   if program:
+      print """\
+         program_span_flush(&p);
+         """
+
    print """\
    }
    }
@@ -408,6 +425,15 @@ def make_innermost_loop(
                break;
          }
          """)
+   elif program:
+      if texture:
+         print """\
+         program_span_put(&p, src_color, al_fixtof(uu), al_fixtof(vv));
+         """
+      else:
+         print """\
+         program_span_put(&p, src_color, 0, 0);
+         """
    elif shade:
       blend = "_al_blend_inline"
       if alpha_only:
@@ -473,16 +499,21 @@ if __name__ == "__main__":
 
    make_drawer("shader_solid_any_draw_shade")
    make_drawer("shader_solid_any_draw_opaque")
+   make_drawer("shader_solid_any_draw_program")
 
    make_drawer("shader_grad_any_draw_shade")
    make_drawer("shader_grad_any_draw_opaque")
+   make_drawer("shader_grad_any_draw_program")
 
    make_drawer("shader_texture_solid_any_draw_shade")
    make_drawer("shader_texture_solid_any_draw_shade_white")
    make_drawer("shader_texture_solid_any_draw_opaque")
    make_drawer("shader_texture_solid_any_draw_opaque_white")
 
+   make_drawer("shader_texture_solid_any_draw_program")
+
    make_drawer("shader_texture_grad_any_draw_shade")
    make_drawer("shader_texture_grad_any_draw_opaque")
+   make_drawer("shader_texture_grad_any_draw_program")
 
 # vim: set sts=3 sw=3 et:
@@ -31,19 +31,132 @@
 ALLEGRO_DEBUG_CHANNEL("bitmap")
 
 
-/* Creates a memory bitmap.
+/* Frees internally allocated pixels of a memory bitmap. */
+static void free_memory(void *memory)
+{
+   al_free(memory);
+}
+
+
+
+static _AL_SHARED_PIXELS *create_shared_pixels(unsigned char *memory,
+   void (*free_fn)(void *memory))
+{
+   _AL_SHARED_PIXELS *shared = al_malloc(sizeof *shared);
+   if (!shared)
+      return NULL;
+   shared->mutex = al_create_mutex();
+   shared->refcount = 1;
+   shared->memory = memory;
+   shared->free_fn = free_fn;
+   return shared;
+}
+
+
+
+static void destroy_shared_pixels(_AL_SHARED_PIXELS *shared)
+{
+   if (shared->mutex)
+      al_destroy_mutex(shared->mutex);
+   al_free(shared);
+}
+
+
+
+static int get_shared_refcount(_AL_SHARED_PIXELS *shared)
+{
+   int refcount;
+
+   if (shared->mutex)
+      al_lock_mutex(shared->mutex);
+   refcount = shared->refcount;
+   if (shared->mutex)
+      al_unlock_mutex(shared->mutex);
+   return refcount;
+}
+
+
+
+void _al_release_shared_pixels(_AL_SHARED_PIXELS *shared)
+{
+   int refcount;
+
+   if (shared->mutex)
+      al_lock_mutex(shared->mutex);
+   refcount = --shared->refcount;
+   if (shared->mutex)
+      al_unlock_mutex(shared->mutex);
+
+   if (refcount == 0) {
+      if (shared->free_fn)
+         shared->free_fn(shared->memory);
+      destroy_shared_pixels(shared);
+   }
+}
+
+
+
+/* Gives a memory bitmap pixels it may write to, copying them if they are
+ * still shared with a clone.  Returns false if memory ran out.
  */
-static ALLEGRO_BITMAP *create_memory_bitmap(int w, int h)
+bool _al_unshare_bitmap_memory(ALLEGRO_BITMAP *bitmap)
 {
-   ALLEGRO_BITMAP *bitmap;
+   _AL_SHARED_PIXELS *shared = bitmap->shared;
+   unsigned char *memory;
    int pitch;
-   int format = al_get_new_bitmap_format();
 
-   format = _al_get_real_pixel_format(al_get_current_display(), format);
+   if (!shared)
+      return true;
 
-   bitmap = al_calloc(1, sizeof *bitmap);
+   if (get_shared_refcount(shared) == 1) {
+      /* Nobody else can see the pixels.  User pixels stay shared with the
+       * user, but our own can be written to like any others from now on.
+       */
+      if (shared->free_fn == free_memory) {
+         destroy_shared_pixels(shared);
+         bitmap->shared = NULL;
+      }
+      return true;
+   }
+
+   pitch = bitmap->w * al_get_pixel_size(bitmap->format);
+   memory = al_malloc(pitch * bitmap->h);
+   if (!memory) {
+      ALLEGRO_ERROR("Out of memory unsharing %dx%d bitmap\n",
+         bitmap->w, bitmap->h);
+      return false;
+   }
+
+   _al_convert_bitmap_data(
+      bitmap->memory, bitmap->format, bitmap->pitch,
+      memory, bitmap->format, pitch,
+      0, 0, 0, 0, bitmap->w, bitmap->h);
+
+   bitmap->memory = memory;
+   bitmap->pitch = pitch;
+   bitmap->shared = NULL;
+
+   /* Regions locked meanwhile still point into the old pixels. */
+   if (bitmap->first_lock) {
+      ASSERT(!bitmap->old_shared);
+      bitmap->old_shared = shared;
+   }
+   else {
+      _al_release_shared_pixels(shared);
+   }
+   return true;
+}
 
-   pitch = w * al_get_pixel_size(format);
+
+
+/* Creates a memory bitmap using the given pixels.
+ */
+static ALLEGRO_BITMAP *new_memory_bitmap(int w, int h, int format, int flags,
+   unsigned char *memory, int pitch)
+{
+   ALLEGRO_BITMAP *bitmap;
+
+   bitmap = al_calloc(1, sizeof *bitmap);
 
    bitmap->vt = NULL;
    bitmap->format = format;
@@ -51,7 +164,7 @@ static ALLEGRO_BITMAP *create_memory_bitmap(int w, int h)
    /* If this is really a video bitmap, we add it to the list of to
     * be converted bitmaps.
     */
-   bitmap->flags = al_get_new_bitmap_flags() | ALLEGRO_MEMORY_BITMAP;
+   bitmap->flags = flags | ALLEGRO_MEMORY_BITMAP;
    bitmap->flags &= ~ALLEGRO_VIDEO_BITMAP;
    bitmap->w = w;
    bitmap->h = h;
@@ -66,7 +179,9 @@ static ALLEGRO_BITMAP *create_memory_bitmap(int w, int h)
    bitmap->inverse_transform_dirty = false;
    bitmap->parent = NULL;
    bitmap->xofs = bitmap->yofs = 0;
-   bitmap->memory = al_malloc(pitch * h);
+   bitmap->memory = memory;
+   bitmap->shared = NULL;
+   bitmap->lock_mutex = al_create_mutex();
    
    _al_register_convert_bitmap(bitmap);
    return bitmap;
@@ -74,24 +189,61 @@ static ALLEGRO_BITMAP *create_memory_bitmap(int w, int h)
 
 
 
+/* Creates a memory bitmap.
+ */
+static ALLEGRO_BITMAP *create_memory_bitmap(int w, int h)
+{
+   int pitch;
+   int format = al_get_new_bitmap_format();
+
+   format = _al_get_real_pixel_format(al_get_current_display(), format);
+
+   pitch = w * al_get_pixel_size(format);
+
+   return new_memory_bitmap(w, h, format, al_get_new_bitmap_flags(),
+      al_malloc(pitch * h), pitch);
+}
+
+
+
 static void destroy_memory_bitmap(ALLEGRO_BITMAP *bmp)
 {
    _al_unregister_convert_bitmap(bmp);
 
-   if (bmp->memory)
+   if (bmp->old_shared)
+      _al_release_shared_pixels(bmp->old_shared);
+   if (bmp->shared)
+      _al_release_shared_pixels(bmp->shared);
+   else if (bmp->memory)
       al_free(bmp->memory);
+   if (bmp->lock_mutex)
+      al_destroy_mutex(bmp->lock_mutex);
    al_free(bmp);
 }
 
 
 
+/* Returns true if a new bitmap would be a memory bitmap.
+ */
+static bool new_bitmap_is_memory(void)
+{
+   ALLEGRO_SYSTEM *system = al_get_system_driver();
+   ALLEGRO_DISPLAY *current_display = al_get_current_display();
+
+   return (al_get_new_bitmap_flags() & ALLEGRO_MEMORY_BITMAP) ||
+      (!current_display || !current_display->vt ||
+      current_display->vt->create_bitmap == NULL) ||
+      (system->displays._size < 1);
+}
+
+
+
 static ALLEGRO_BITMAP *do_create_bitmap(int w, int h,
    bool (*custom_upload)(ALLEGRO_BITMAP *bitmap, void *data),
    void *custom_data)
 {
    ALLEGRO_BITMAP *bitmap;
    ALLEGRO_BITMAP **back;
-   ALLEGRO_SYSTEM *system = al_get_system_driver();
    ALLEGRO_DISPLAY *current_display = al_get_current_display();
    int64_t mul;
    bool result;
@@ -105,10 +257,7 @@ static ALLEGRO_BITMAP *do_create_bitmap(int w, int h,
       return NULL;
    }
 
-   if ((al_get_new_bitmap_flags() & ALLEGRO_MEMORY_BITMAP) ||
-         (!current_display || !current_display->vt ||
-         current_display->vt->create_bitmap == NULL) ||
-         (system->displays._size < 1)) {
+   if (new_bitmap_is_memory()) {
 
       if (al_get_new_bitmap_flags() & ALLEGRO_VIDEO_BITMAP)
          return NULL;
@@ -186,6 +335,47 @@ ALLEGRO_BITMAP *al_create_bitmap(int w, int h)
 }
 
 
+/* Function: al_create_bitmap_from_pixels
+ */
+ALLEGRO_BITMAP *al_create_bitmap_from_pixels(int w, int h, int format,
+   void *pixels, int pitch, void (*free_fn)(void *pixels))
+{
+   ALLEGRO_BITMAP *bitmap;
+   _AL_SHARED_PIXELS *shared;
+   int flags;
+
+   ASSERT(w >= 0);
+   ASSERT(h >= 0);
+   ASSERT(pixels);
+
+   if (!_al_pixel_format_is_real(format)) {
+      ALLEGRO_ERROR("Pixel format %d is not a real format\n", format);
+      return NULL;
+   }
+
+   if (4 * (int64_t) w * (int64_t) h > (int64_t) INT_MAX) {
+      ALLEGRO_WARN("Rejecting %dx%d bitmap\n", w, h);
+      return NULL;
+   }
+
+   shared = create_shared_pixels(pixels, free_fn);
+   if (!shared)
+      return NULL;
+
+   /* The pixels belong to the caller, so never move them into a texture
+    * behind their back.
+    */
+   flags = al_get_new_bitmap_flags() & ~ALLEGRO_CONVERT_BITMAP;
+   bitmap = new_memory_bitmap(w, h, format, flags, pixels, pitch);
+   bitmap->shared = shared;
+
+   _al_register_destructor(_al_dtor_list, bitmap,
+      (void (*)(void *))al_destroy_bitmap);
+
+   return bitmap;
+}
+
+
 /* Function: al_destroy_bitmap
  */
 void al_destroy_bitmap(ALLEGRO_BITMAP *bitmap)
@@ -209,6 +399,8 @@ void al_destroy_bitmap(ALLEGRO_BITMAP *bitmap)
 
    _al_unregister_destructor(_al_dtor_list, bitmap);
 
+   _al_destroy_dirty_rects(bitmap);
+
    if (bitmap->flags & ALLEGRO_MEMORY_BITMAP) {
       destroy_memory_bitmap(bitmap);
       return;
@@ -484,6 +676,52 @@ void _al_convert_bitmap_data(
 }
 
 
+/* Creates a memory bitmap sharing the pixels of another one until either of
+ * them is written to, if the clone would have the same format anyway.
+ */
+static ALLEGRO_BITMAP *share_memory_bitmap(ALLEGRO_BITMAP *bitmap)
+{
+   ALLEGRO_BITMAP *clone;
+   _AL_SHARED_PIXELS *shared = bitmap->shared;
+   int format;
+
+   if (!(bitmap->flags & ALLEGRO_MEMORY_BITMAP) || bitmap->parent ||
+         bitmap->first_lock || !new_bitmap_is_memory())
+      return NULL;
+
+   format = _al_get_real_pixel_format(al_get_current_display(),
+      al_get_new_bitmap_format());
+   if (format != bitmap->format)
+      return NULL;
+
+   if (shared && !shared->mutex)
+      return NULL;
+   if (!shared) {
+      shared = create_shared_pixels(bitmap->memory, free_memory);
+      if (!shared)
+         return NULL;
+      if (!shared->mutex) {
+         destroy_shared_pixels(shared);
+         return NULL;
+      }
+      bitmap->shared = shared;
+   }
+
+   al_lock_mutex(shared->mutex);
+   shared->refcount++;
+   al_unlock_mutex(shared->mutex);
+
+   clone = new_memory_bitmap(bitmap->w, bitmap->h, format,
+      al_get_new_bitmap_flags(), bitmap->memory, bitmap->pitch);
+   clone->shared = shared;
+
+   _al_register_destructor(_al_dtor_list, clone,
+      (void (*)(void *))al_destroy_bitmap);
+
+   return clone;
+}
+
+
 /* Function: al_clone_bitmap
  */
 ALLEGRO_BITMAP *al_clone_bitmap(ALLEGRO_BITMAP *bitmap)
@@ -491,6 +729,10 @@ ALLEGRO_BITMAP *al_clone_bitmap(ALLEGRO_BITMAP *bitmap)
    ALLEGRO_BITMAP *clone;
    ASSERT(bitmap);
 
+   clone = share_memory_bitmap(bitmap);
+   if (clone)
+      return clone;
+
    clone = al_create_bitmap(bitmap->w, bitmap->h);
    if (!clone)
       return NULL;
@@ -0,0 +1,366 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Tracking of the changed regions of bitmaps.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include <math.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
+
+/* More changes than this are merged into the rectangles they grow the
+ * least, so the rectangles can cover more than what actually changed.
+ */
+#define MAX_DIRTY_RECTS    32
+
+
+/* The rectangles are kept for the parent bitmap only. They may be added
+ * from several threads, when those lock or draw to different sub-bitmaps.
+ */
+struct _AL_DIRTY_RECTS
+{
+   ALLEGRO_MUTEX *mutex;
+   int count;
+   struct {
+      int x1, y1, x2, y2;  /* x2 and y2 are exclusive */
+   } rects[MAX_DIRTY_RECTS];
+};
+
+
+
+static double area(int x1, int y1, int x2, int y2)
+{
+   return (double)(x2 - x1) * (y2 - y1);
+}
+
+
+
+static void add_rect(_AL_DIRTY_RECTS *dirty, int x1, int y1, int x2, int y2)
+{
+   double least = 0.0;
+   int best = -1;
+   int i;
+
+   for (i = 0; i < dirty->count; i++) {
+      if (dirty->rects[i].x1 <= x1 && dirty->rects[i].y1 <= y1 &&
+            dirty->rects[i].x2 >= x2 && dirty->rects[i].y2 >= y2)
+         return;
+   }
+
+   /* Absorb the rectangles which overlap the new one so much that both
+    * together cover no less than their bounding box, e.g. the triangles of
+    * a filled shape. The grown rectangle may absorb more of them.
+    */
+   for (i = 0; i < dirty->count; ) {
+      int ux1 = _ALLEGRO_MIN(x1, dirty->rects[i].x1);
+      int uy1 = _ALLEGRO_MIN(y1, dirty->rects[i].y1);
+      int ux2 = _ALLEGRO_MAX(x2, dirty->rects[i].x2);
+      int uy2 = _ALLEGRO_MAX(y2, dirty->rects[i].y2);
+      if (area(ux1, uy1, ux2, uy2) <= area(x1, y1, x2, y2) +
+            area(dirty->rects[i].x1, dirty->rects[i].y1,
+               dirty->rects[i].x2, dirty->rects[i].y2)) {
+         dirty->rects[i] = dirty->rects[--dirty->count];
+         x1 = ux1;
+         y1 = uy1;
+         x2 = ux2;
+         y2 = uy2;
+         i = 0;
+      }
+      else {
+         i++;
+      }
+   }
+
+   if (dirty->count < MAX_DIRTY_RECTS) {
+      i = dirty->count++;
+      dirty->rects[i].x1 = x1;
+      dirty->rects[i].y1 = y1;
+      dirty->rects[i].x2 = x2;
+      dirty->rects[i].y2 = y2;
+      return;
+   }
+
+   for (i = 0; i < dirty->count; i++) {
+      int ux1 = _ALLEGRO_MIN(x1, dirty->rects[i].x1);
+      int uy1 = _ALLEGRO_MIN(y1, dirty->rects[i].y1);
+      int ux2 = _ALLEGRO_MAX(x2, dirty->rects[i].x2);
+      int uy2 = _ALLEGRO_MAX(y2, dirty->rects[i].y2);
+      double growth = area(ux1, uy1, ux2, uy2) -
+         area(dirty->rects[i].x1, dirty->rects[i].y1,
+            dirty->rects[i].x2, dirty->rects[i].y2);
+      if (best < 0 || growth < least) {
+         best = i;
+         least = growth;
+      }
+   }
+
+   dirty->rects[best].x1 = _ALLEGRO_MIN(x1, dirty->rects[best].x1);
+   dirty->rects[best].y1 = _ALLEGRO_MIN(y1, dirty->rects[best].y1);
+   dirty->rects[best].x2 = _ALLEGRO_MAX(x2, dirty->rects[best].x2);
+   dirty->rects[best].y2 = _ALLEGRO_MAX(y2, dirty->rects[best].y2);
+}
+
+
+
+/* Adds a rectangle in coordinates of the parent bitmap, clipped to the
+ * given bounds.
+ */
+static void add_clipped_rect(ALLEGRO_BITMAP *parent, int x, int y, int w,
+   int h, int cx1, int cy1, int cx2, int cy2)
+{
+   _AL_DIRTY_RECTS *dirty = parent->dirty_rects;
+   int x1 = _ALLEGRO_MAX(x, cx1);
+   int y1 = _ALLEGRO_MAX(y, cy1);
+   int x2 = _ALLEGRO_MIN(x + w, cx2);
+   int y2 = _ALLEGRO_MIN(y + h, cy2);
+
+   if (x1 >= x2 || y1 >= y2)
+      return;
+
+   al_lock_mutex(dirty->mutex);
+   add_rect(dirty, x1, y1, x2, y2);
+   al_unlock_mutex(dirty->mutex);
+}
+
+
+
+/* _al_mark_bitmap_dirty:
+ *  Records that a region of the bitmap, in its own coordinates, has changed.
+ */
+void _al_mark_bitmap_dirty(ALLEGRO_BITMAP *bitmap, int x, int y, int w, int h)
+{
+   ALLEGRO_BITMAP *parent = bitmap->parent ? bitmap->parent : bitmap;
+
+   if (!parent->dirty_rects)
+      return;
+
+   if (bitmap->parent) {
+      x += bitmap->xofs;
+      y += bitmap->yofs;
+      add_clipped_rect(parent, x, y, w, h, bitmap->xofs, bitmap->yofs,
+         bitmap->xofs + bitmap->w, bitmap->yofs + bitmap->h);
+   }
+   else {
+      add_clipped_rect(parent, x, y, w, h, 0, 0, bitmap->w, bitmap->h);
+   }
+}
+
+
+
+/* _al_mark_target_dirty:
+ *  Records that the area from (x1, y1) to (x2, y2), before the current
+ *  transformation, may have been drawn to on the target bitmap.  This is
+ *  only needed for drawing which does not lock the bitmap; unlocking does
+ *  the same for the locked region.
+ */
+void _al_mark_target_dirty(float x1, float y1, float x2, float y2)
+{
+   ALLEGRO_BITMAP *target = al_get_target_bitmap();
+   const ALLEGRO_TRANSFORM *t;
+   float xs[4], ys[4];
+   float minx, miny, maxx, maxy;
+   int i;
+
+   if (!target)
+      return;
+   if (!(target->parent ? target->parent : target)->dirty_rects)
+      return;
+
+   t = &target->transform;
+   xs[0] = x1; ys[0] = y1;
+   xs[1] = x2; ys[1] = y1;
+   xs[2] = x2; ys[2] = y2;
+   xs[3] = x1; ys[3] = y2;
+   for (i = 0; i < 4; i++)
+      al_transform_coordinates(t, &xs[i], &ys[i]);
+
+   minx = maxx = xs[0];
+   miny = maxy = ys[0];
+   for (i = 1; i < 4; i++) {
+      minx = _ALLEGRO_MIN(minx, xs[i]);
+      miny = _ALLEGRO_MIN(miny, ys[i]);
+      maxx = _ALLEGRO_MAX(maxx, xs[i]);
+      maxy = _ALLEGRO_MAX(maxy, ys[i]);
+   }
+
+   /* Clip before converting to integers. NaN coordinates fail the
+    * comparisons and leave the whole clipping rectangle.
+    */
+   if (!(minx > target->cl))
+      minx = target->cl;
+   if (!(miny > target->ct))
+      miny = target->ct;
+   if (!(maxx < target->cr_excl))
+      maxx = target->cr_excl;
+   if (!(maxy < target->cb_excl))
+      maxy = target->cb_excl;
+
+   x1 = floorf(minx);
+   y1 = floorf(miny);
+   x2 = ceilf(maxx);
+   y2 = ceilf(maxy);
+   if (x1 >= x2 || y1 >= y2)
+      return;
+
+   _al_mark_bitmap_dirty(target, (int)x1, (int)y1, (int)(x2 - x1),
+      (int)(y2 - y1));
+}
+
+
+
+/* _al_destroy_dirty_rects:
+ *  Frees the dirty rectangles of a bitmap which is being destroyed.
+ */
+void _al_destroy_dirty_rects(ALLEGRO_BITMAP *bitmap)
+{
+   if (bitmap->dirty_rects) {
+      al_destroy_mutex(bitmap->dirty_rects->mutex);
+      al_free(bitmap->dirty_rects);
+      bitmap->dirty_rects = NULL;
+   }
+}
+
+
+
+/* Function: al_set_bitmap_dirty_tracking
+ */
+bool al_set_bitmap_dirty_tracking(ALLEGRO_BITMAP *bitmap, bool track)
+{
+   _AL_DIRTY_RECTS *dirty;
+   ASSERT(bitmap);
+
+   if (bitmap->parent)
+      bitmap = bitmap->parent;
+
+   if (!track) {
+      _al_destroy_dirty_rects(bitmap);
+      return true;
+   }
+
+   if (bitmap->dirty_rects)
+      return true;
+
+   dirty = al_calloc(1, sizeof(*dirty));
+   if (!dirty)
+      return false;
+   dirty->mutex = al_create_mutex();
+   if (!dirty->mutex) {
+      al_free(dirty);
+      return false;
+   }
+
+   bitmap->dirty_rects = dirty;
+   return true;
+}
+
+
+
+/* Function: al_get_bitmap_dirty_tracking
+ */
+bool al_get_bitmap_dirty_tracking(ALLEGRO_BITMAP *bitmap)
+{
+   ASSERT(bitmap);
+
+   if (bitmap->parent)
+      bitmap = bitmap->parent;
+
+   return bitmap->dirty_rects != NULL;
+}
+
+
+
+/* Function: al_add_bitmap_dirty_rect
+ */
+void al_add_bitmap_dirty_rect(ALLEGRO_BITMAP *bitmap,
+   int x, int y, int width, int height)
+{
+   ASSERT(bitmap);
+
+   _al_mark_bitmap_dirty(bitmap, x, y, width, height);
+}
+
+
+
+/* Function: al_get_bitmap_num_dirty_rects
+ */
+int al_get_bitmap_num_dirty_rects(ALLEGRO_BITMAP *bitmap)
+{
+   int count;
+   ASSERT(bitmap);
+
+   if (bitmap->parent)
+      bitmap = bitmap->parent;
+
+   if (!bitmap->dirty_rects)
+      return 0;
+
+   al_lock_mutex(bitmap->dirty_rects->mutex);
+   count = bitmap->dirty_rects->count;
+   al_unlock_mutex(bitmap->dirty_rects->mutex);
+
+   return count;
+}
+
+
+
+/* Function: al_get_bitmap_dirty_rect
+ */
+bool al_get_bitmap_dirty_rect(ALLEGRO_BITMAP *bitmap, int index,
+   int *x, int *y, int *width, int *height)
+{
+   _AL_DIRTY_RECTS *dirty;
+   bool ret = false;
+   ASSERT(bitmap);
+
+   if (bitmap->parent)
+      bitmap = bitmap->parent;
+
+   dirty = bitmap->dirty_rects;
+   if (!dirty)
+      return false;
+
+   al_lock_mutex(dirty->mutex);
+   if (index >= 0 && index < dirty->count) {
+      if (x) *x = dirty->rects[index].x1;
+      if (y) *y = dirty->rects[index].y1;
+      if (width) *width = dirty->rects[index].x2 - dirty->rects[index].x1;
+      if (height) *height = dirty->rects[index].y2 - dirty->rects[index].y1;
+      ret = true;
+   }
+   al_unlock_mutex(dirty->mutex);
+
+   return ret;
+}
+
+
+
+/* Function: al_clear_bitmap_dirty_rects
+ */
+void al_clear_bitmap_dirty_rects(ALLEGRO_BITMAP *bitmap)
+{
+   ASSERT(bitmap);
+
+   if (bitmap->parent)
+      bitmap = bitmap->parent;
+
+   if (bitmap->dirty_rects) {
+      al_lock_mutex(bitmap->dirty_rects->mutex);
+      bitmap->dirty_rects->count = 0;
+      al_unlock_mutex(bitmap->dirty_rects->mutex);
+   }
+}
+
+
+/* vim: set sts=3 sw=3 et: */
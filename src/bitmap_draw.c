@@ -53,6 +53,7 @@ static void _bitmap_drawer(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint,
          /* Compatible display bitmap, use full acceleration */
          bitmap->vt->draw_bitmap_region(bitmap, tint, sx, sy, sw, sh, flags);
       }
+      _al_mark_target_dirty(0, 0, sw, sh);
    }
 }
 
@@ -118,6 +119,69 @@ static void _draw_tinted_rotated_scaled_bitmap_region(ALLEGRO_BITMAP *bitmap,
 }
 
 
+/* _al_draw_tinted_bitmap_quads:
+ *  Draws several untransformed regions of the same bitmap with the same
+ *  tint, e.g. the glyphs of a string. The result is the same as calling
+ *  al_draw_tinted_bitmap_region for each quad, but the target, the source
+ *  and the blender are only examined once. The regions must lie within
+ *  the bitmap.
+ */
+void _al_draw_tinted_bitmap_quads(ALLEGRO_BITMAP *bitmap, ALLEGRO_COLOR tint,
+   const _AL_BITMAP_QUAD *quads, int num_quads)
+{
+   ALLEGRO_BITMAP *dest = al_get_target_bitmap();
+   ALLEGRO_BITMAP *parent = bitmap;
+   float xofs = 0, yofs = 0;
+   ALLEGRO_TRANSFORM backup;
+   int i;
+   ASSERT(bitmap);
+
+   if (num_quads <= 0)
+      return;
+
+   if (bitmap->parent) {
+      parent = bitmap->parent;
+      xofs = bitmap->xofs;
+      yofs = bitmap->yofs;
+   }
+
+   ASSERT(parent != dest && parent != dest->parent);
+
+   if (dest->flags & ALLEGRO_MEMORY_BITMAP) {
+      _al_draw_bitmap_quads_memory(parent, tint, xofs, yofs,
+         quads, num_quads);
+      return;
+   }
+
+   /* Held drawing on a display is transformed in software, so the quads
+    * can go straight to the bitmap driver with the translation folded into
+    * the target transformation. Otherwise take the general path.
+    */
+   if ((parent->flags & ALLEGRO_MEMORY_BITMAP) ||
+       !al_is_compatible_bitmap(parent) ||
+       !al_is_bitmap_drawing_held()) {
+      for (i = 0; i < num_quads; i++) {
+         const _AL_BITMAP_QUAD *q = &quads[i];
+         al_draw_tinted_bitmap_region(bitmap, tint, q->sx, q->sy, q->sw, q->sh,
+            q->dx, q->dy, 0);
+      }
+      return;
+   }
+
+   al_copy_transform(&backup, &dest->transform);
+   for (i = 0; i < num_quads; i++) {
+      const _AL_BITMAP_QUAD *q = &quads[i];
+      al_identity_transform(&dest->transform);
+      al_translate_transform(&dest->transform, q->dx, q->dy);
+      al_compose_transform(&dest->transform, &backup);
+      parent->vt->draw_bitmap_region(parent, tint,
+         q->sx + xofs, q->sy + yofs, q->sw, q->sh, 0);
+      _al_mark_target_dirty(0, 0, q->sw, q->sh);
+   }
+   al_copy_transform(&dest->transform, &backup);
+}
+
+
 /* Function: al_draw_tinted_bitmap_region
  */
 void al_draw_tinted_bitmap_region(ALLEGRO_BITMAP *bitmap,
@@ -17,8 +17,11 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_system.h"
+#include "allegro5/internal/aintern_tls.h"
 #include "allegro5/internal/aintern_vector.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 ALLEGRO_DEBUG_CHANNEL("bitmap")
@@ -33,6 +36,8 @@ typedef struct Handler
    ALLEGRO_IIO_SAVER_FUNCTION saver;
    ALLEGRO_IIO_FS_LOADER_FUNCTION fs_loader;
    ALLEGRO_IIO_FS_SAVER_FUNCTION fs_saver;
+   ALLEGRO_IIO_PROBER_FUNCTION prober;
+   ALLEGRO_IIO_STREAM_OPENER_FUNCTION stream_opener;
 } Handler;
 
 
@@ -65,6 +70,8 @@ static Handler *add_iio_table_f(const char *ext)
    ent->saver = NULL;
    ent->fs_loader = NULL;
    ent->fs_saver = NULL;
+   ent->prober = NULL;
+   ent->stream_opener = NULL;
 
    return ent;
 }
@@ -200,6 +207,64 @@ bool al_register_bitmap_saver_f(const char *extension,
 }
 
 
+/* Function: al_register_bitmap_prober
+ */
+bool al_register_bitmap_prober(const char *extension,
+   bool (*prober)(ALLEGRO_FILE *fp, ALLEGRO_BITMAP_INFO *info))
+{
+   Handler *ent;
+
+   ASSERT(extension);
+
+   if (strlen(extension) + 1 >= MAX_EXTENSION) {
+      return false;
+   }
+
+   ent = find_handler(extension);
+   if (!prober) {
+       if (!ent || !ent->prober) {
+         return false; /* Nothing to remove. */
+       }
+   }
+   else if (!ent) {
+       ent = add_iio_table_f(extension);
+   }
+
+   ent->prober = prober;
+
+   return true;
+}
+
+
+/* Function: al_register_bitmap_stream_opener
+ */
+bool al_register_bitmap_stream_opener(const char *extension,
+   ALLEGRO_BITMAP_STREAM *(*opener)(ALLEGRO_FILE *fp, int flags))
+{
+   Handler *ent;
+
+   ASSERT(extension);
+
+   if (strlen(extension) + 1 >= MAX_EXTENSION) {
+      return false;
+   }
+
+   ent = find_handler(extension);
+   if (!opener) {
+       if (!ent || !ent->stream_opener) {
+         return false; /* Nothing to remove. */
+       }
+   }
+   else if (!ent) {
+       ent = add_iio_table_f(extension);
+   }
+
+   ent->stream_opener = opener;
+
+   return true;
+}
+
+
 /* Function: al_load_bitmap
  */
 ALLEGRO_BITMAP *al_load_bitmap(const char *filename)
@@ -249,6 +314,236 @@ ALLEGRO_BITMAP *al_load_bitmap_flags(const char *filename, int flags)
 }
 
 
+/* _al_get_scaled_load_size:
+ *  Returns true if a bitmap of the given size, being loaded by
+ *  al_load_bitmap_scaled, must be reduced.  dw and dh receive the largest
+ *  size with the same aspect ratio that fits the requested maximum.
+ *  Loaders which can decode at a reduced size cheaply may use this.
+ */
+bool _al_get_scaled_load_size(int w, int h, int *dw, int *dh)
+{
+   int max_w, max_h;
+
+   _al_get_bitmap_load_size_hint(&max_w, &max_h);
+   if (max_w <= 0 || max_h <= 0)
+      return false;
+   if (w <= max_w && h <= max_h)
+      return false;
+
+   if ((int64_t)w * max_h > (int64_t)h * max_w) {
+      *dw = max_w;
+      *dh = ((int64_t)h * max_w + w / 2) / w;
+   }
+   else {
+      *dw = ((int64_t)w * max_h + h / 2) / h;
+      *dh = max_h;
+   }
+   if (*dw < 1)
+      *dw = 1;
+   if (*dh < 1)
+      *dh = 1;
+   return true;
+}
+
+
+/* box_filter:
+ *  Reduces src into dst by averaging each rectangle of source pixels which
+ *  maps to a destination pixel.  Premultiplied alpha is averaged correctly
+ *  as it is.
+ */
+static bool box_filter(ALLEGRO_BITMAP *src, ALLEGRO_BITMAP *dst)
+{
+   ALLEGRO_LOCKED_REGION *slr, *dlr;
+   const int sw = al_get_bitmap_width(src);
+   const int sh = al_get_bitmap_height(src);
+   const int dw = al_get_bitmap_width(dst);
+   const int dh = al_get_bitmap_height(dst);
+   uint64_t *sums;
+   int *xmap;
+   int x, y, sy, sy_end, i;
+
+   sums = al_malloc(dw * 4 * sizeof(*sums));
+   xmap = al_malloc(sw * sizeof(*xmap));
+   if (!sums || !xmap) {
+      al_free(sums);
+      al_free(xmap);
+      return false;
+   }
+
+   slr = al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_READONLY);
+   dlr = al_lock_bitmap(dst, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_WRITEONLY);
+   if (!slr || !dlr) {
+      if (slr)
+         al_unlock_bitmap(src);
+      if (dlr)
+         al_unlock_bitmap(dst);
+      al_free(sums);
+      al_free(xmap);
+      return false;
+   }
+
+   for (x = 0; x < sw; x++)
+      xmap[x] = (int64_t)x * dw / sw;
+
+   sy = 0;
+   for (y = 0; y < dh; y++) {
+      unsigned char *dp = (unsigned char *)dlr->data + y * dlr->pitch;
+      int64_t rows;
+
+      sy_end = (int64_t)(y + 1) * sh / dh;
+      if (sy_end <= sy)
+         sy_end = sy + 1;
+      rows = sy_end - sy;
+
+      memset(sums, 0, dw * 4 * sizeof(*sums));
+      for (; sy < sy_end; sy++) {
+         const unsigned char *sp =
+            (const unsigned char *)slr->data + sy * slr->pitch;
+         for (x = 0; x < sw; x++, sp += 4) {
+            uint64_t *sum = sums + xmap[x] * 4;
+            sum[0] += sp[0];
+            sum[1] += sp[1];
+            sum[2] += sp[2];
+            sum[3] += sp[3];
+         }
+      }
+
+      /* Source columns are split as evenly as the rows. */
+      for (x = 0, i = 0; x < dw; x++) {
+         int64_t n = 0;
+         while (i < sw && xmap[i] == x) {
+            n++;
+            i++;
+         }
+         n *= rows;
+         if (n == 0)
+            n = 1;
+         dp[0] = (sums[x * 4 + 0] + n / 2) / n;
+         dp[1] = (sums[x * 4 + 1] + n / 2) / n;
+         dp[2] = (sums[x * 4 + 2] + n / 2) / n;
+         dp[3] = (sums[x * 4 + 3] + n / 2) / n;
+         dp += 4;
+      }
+   }
+
+   al_unlock_bitmap(dst);
+   al_unlock_bitmap(src);
+   al_free(sums);
+   al_free(xmap);
+   return true;
+}
+
+
+/* Loads a bitmap with the given load function while the size hint is set,
+ * then reduces it if the loader did not.
+ */
+static ALLEGRO_BITMAP *load_scaled(
+   ALLEGRO_BITMAP *(*load)(void *data, int flags), void *data,
+   int max_w, int max_h, int flags)
+{
+   const int new_flags = al_get_new_bitmap_flags();
+   const bool want_memory = (new_flags & ALLEGRO_MEMORY_BITMAP) != 0;
+   ALLEGRO_BITMAP *bmp, *scaled;
+   int old_max_w, old_max_h;
+   int dw, dh;
+   bool reduce = false;
+   bool ok;
+   ASSERT(max_w > 0);
+   ASSERT(max_h > 0);
+
+   /* Decode into memory so that an oversized image does not need to be
+    * uploaded first.
+    */
+   if (!want_memory) {
+      al_set_new_bitmap_flags((new_flags & ~ALLEGRO_VIDEO_BITMAP) |
+         ALLEGRO_MEMORY_BITMAP);
+   }
+
+   _al_get_bitmap_load_size_hint(&old_max_w, &old_max_h);
+   _al_set_bitmap_load_size_hint(max_w, max_h);
+   bmp = load(data, flags & ~ALLEGRO_KEEP_INDEX);
+   if (bmp) {
+      reduce = _al_get_scaled_load_size(al_get_bitmap_width(bmp),
+         al_get_bitmap_height(bmp), &dw, &dh);
+   }
+   _al_set_bitmap_load_size_hint(old_max_w, old_max_h);
+
+   if (!want_memory)
+      al_set_new_bitmap_flags(new_flags);
+
+   if (!bmp)
+      return NULL;
+
+   if (!reduce) {
+      if (!want_memory)
+         al_convert_bitmap(bmp);
+      return bmp;
+   }
+
+   scaled = al_create_bitmap(dw, dh);
+   if (!scaled) {
+      al_destroy_bitmap(bmp);
+      return NULL;
+   }
+   ok = box_filter(bmp, scaled);
+   al_destroy_bitmap(bmp);
+   if (!ok) {
+      al_destroy_bitmap(scaled);
+      return NULL;
+   }
+   return scaled;
+}
+
+
+typedef struct LOAD_SCALED_FILE
+{
+   ALLEGRO_FILE *fp;
+   const char *ident;
+} LOAD_SCALED_FILE;
+
+
+static ALLEGRO_BITMAP *load_scaled_filename(void *data, int flags)
+{
+   return al_load_bitmap_flags((const char *)data, flags);
+}
+
+
+static ALLEGRO_BITMAP *load_scaled_file(void *data, int flags)
+{
+   LOAD_SCALED_FILE *lsf = data;
+   return al_load_bitmap_flags_f(lsf->fp, lsf->ident, flags);
+}
+
+
+/* Function: al_load_bitmap_scaled
+ */
+ALLEGRO_BITMAP *al_load_bitmap_scaled(const char *filename,
+   int max_w, int max_h, int flags)
+{
+   ASSERT(filename);
+
+   return load_scaled(load_scaled_filename, (void *)filename,
+      max_w, max_h, flags);
+}
+
+
+/* Function: al_load_bitmap_scaled_f
+ */
+ALLEGRO_BITMAP *al_load_bitmap_scaled_f(ALLEGRO_FILE *fp, const char *ident,
+   int max_w, int max_h, int flags)
+{
+   LOAD_SCALED_FILE lsf;
+   ASSERT(fp);
+   ASSERT(ident);
+
+   lsf.fp = fp;
+   lsf.ident = ident;
+   return load_scaled(load_scaled_file, &lsf, max_w, max_h, flags);
+}
+
+
 /* Function: al_save_bitmap
  */
 bool al_save_bitmap(const char *filename, ALLEGRO_BITMAP *bitmap)
@@ -315,4 +610,606 @@ bool al_save_bitmap_f(ALLEGRO_FILE *fp, const char *ident,
 }
 
 
+/* Function: al_probe_bitmap
+ */
+bool al_probe_bitmap(const char *filename, ALLEGRO_BITMAP_INFO *info)
+{
+   const char *ext;
+   ALLEGRO_FILE *fp;
+   bool ret;
+   ASSERT(filename);
+   ASSERT(info);
+
+   ext = strrchr(filename, '.');
+   if (!ext) {
+      ALLEGRO_WARN("Bitmap %s has no extension - "
+         "not even trying to probe it.\n", filename);
+      return false;
+   }
+
+   fp = al_fopen(filename, "rb");
+   if (!fp) {
+      ALLEGRO_WARN("Could not open %s.\n", filename);
+      return false;
+   }
+
+   ret = al_probe_bitmap_f(fp, ext, info);
+   al_fclose(fp);
+
+   return ret;
+}
+
+
+/* Function: al_probe_bitmap_f
+ */
+bool al_probe_bitmap_f(ALLEGRO_FILE *fp, const char *ident,
+   ALLEGRO_BITMAP_INFO *info)
+{
+   Handler *h;
+   int64_t pos;
+   bool ret;
+   ASSERT(fp);
+   ASSERT(ident);
+   ASSERT(info);
+
+   h = find_handler(ident);
+   if (!h || !h->prober) {
+      ALLEGRO_WARN("No prober for bitmap extension %s.\n", ident);
+      return false;
+   }
+
+   memset(info, 0, sizeof(*info));
+
+   pos = al_ftell(fp);
+   ret = h->prober(fp, info);
+   if (pos >= 0)
+      al_fseek(fp, pos, ALLEGRO_SEEK_SET);
+
+   return ret;
+}
+
+
+/* Bitmap streams hand out the rows of an image from top to bottom, a band
+ * at a time, so that images which would not fit into memory as a whole
+ * can be processed. The format driver decodes straight into the caller's
+ * buffer; this layer only keeps track of the position.
+ */
+struct ALLEGRO_BITMAP_STREAM
+{
+   const ALLEGRO_BITMAP_STREAM_INTERFACE *vt;
+   void *userdata;
+   int width;
+   int height;
+   int row;             /* next row to be read */
+   ALLEGRO_FILE *fp;    /* closed with the stream, if we opened it */
+   unsigned char *scratch;
+};
+
+
+/* Function: al_create_bitmap_stream
+ */
+ALLEGRO_BITMAP_STREAM *al_create_bitmap_stream(
+   const ALLEGRO_BITMAP_STREAM_INTERFACE *vt, void *userdata,
+   int width, int height)
+{
+   ALLEGRO_BITMAP_STREAM *stream;
+   ASSERT(vt);
+   ASSERT(width > 0);
+   ASSERT(height > 0);
+
+   stream = al_calloc(1, sizeof(*stream));
+   if (!stream) {
+      al_set_errno(ENOMEM);
+      return NULL;
+   }
+
+   stream->vt = vt;
+   stream->userdata = userdata;
+   stream->width = width;
+   stream->height = height;
+
+   return stream;
+}
+
+
+/* Function: al_get_bitmap_stream_userdata
+ */
+void *al_get_bitmap_stream_userdata(ALLEGRO_BITMAP_STREAM *stream)
+{
+   ASSERT(stream);
+   return stream->userdata;
+}
+
+
+/* Function: al_open_bitmap_stream
+ */
+ALLEGRO_BITMAP_STREAM *al_open_bitmap_stream(const char *filename, int flags)
+{
+   const char *ext;
+   ALLEGRO_FILE *fp;
+   ALLEGRO_BITMAP_STREAM *stream;
+   ASSERT(filename);
+
+   ext = strrchr(filename, '.');
+   if (!ext) {
+      ALLEGRO_WARN("Bitmap %s has no extension - "
+         "not even trying to stream it.\n", filename);
+      return NULL;
+   }
+
+   fp = al_fopen(filename, "rb");
+   if (!fp) {
+      ALLEGRO_WARN("Could not open %s.\n", filename);
+      return NULL;
+   }
+
+   stream = al_open_bitmap_stream_f(fp, ext, flags);
+   if (!stream) {
+      al_fclose(fp);
+      return NULL;
+   }
+
+   stream->fp = fp;
+   return stream;
+}
+
+
+/* Function: al_open_bitmap_stream_f
+ */
+ALLEGRO_BITMAP_STREAM *al_open_bitmap_stream_f(ALLEGRO_FILE *fp,
+   const char *ident, int flags)
+{
+   Handler *h;
+   ASSERT(fp);
+   ASSERT(ident);
+
+   h = find_handler(ident);
+   if (!h || !h->stream_opener) {
+      ALLEGRO_WARN("No stream opener for bitmap extension %s.\n", ident);
+      return NULL;
+   }
+
+   return h->stream_opener(fp, flags);
+}
+
+
+/* Function: al_get_bitmap_stream_width
+ */
+int al_get_bitmap_stream_width(ALLEGRO_BITMAP_STREAM *stream)
+{
+   ASSERT(stream);
+   return stream->width;
+}
+
+
+/* Function: al_get_bitmap_stream_height
+ */
+int al_get_bitmap_stream_height(ALLEGRO_BITMAP_STREAM *stream)
+{
+   ASSERT(stream);
+   return stream->height;
+}
+
+
+/* Function: al_get_bitmap_stream_position
+ */
+int al_get_bitmap_stream_position(ALLEGRO_BITMAP_STREAM *stream)
+{
+   ASSERT(stream);
+   return stream->row;
+}
+
+
+/* Function: al_read_bitmap_stream
+ */
+int al_read_bitmap_stream(ALLEGRO_BITMAP_STREAM *stream, void *buffer,
+   int pitch, int num_rows)
+{
+   int n;
+   ASSERT(stream);
+   ASSERT(buffer);
+   ASSERT(num_rows >= 0);
+
+   if (num_rows > stream->height - stream->row)
+      num_rows = stream->height - stream->row;
+   if (num_rows <= 0)
+      return 0;
+
+   n = stream->vt->bsi_read_rows(stream, buffer, pitch, num_rows);
+   if (n < num_rows) {
+      ALLEGRO_WARN("Decoding stopped at row %d.\n", stream->row + n);
+      /* Don't try to continue from inside a broken file. */
+      stream->height = stream->row + n;
+   }
+   stream->row += n;
+
+   return n;
+}
+
+
+/* Function: al_read_bitmap_stream_to_bitmap
+ */
+int al_read_bitmap_stream_to_bitmap(ALLEGRO_BITMAP_STREAM *stream,
+   ALLEGRO_BITMAP *bitmap)
+{
+   ALLEGRO_LOCKED_REGION *lr;
+   int w, num_rows;
+   int n = 0;
+   ASSERT(stream);
+   ASSERT(bitmap);
+
+   w = al_get_bitmap_width(bitmap);
+   num_rows = al_get_bitmap_height(bitmap);
+   if (w > stream->width)
+      w = stream->width;
+   if (num_rows > stream->height - stream->row)
+      num_rows = stream->height - stream->row;
+   if (num_rows <= 0)
+      return 0;
+
+   lr = al_lock_bitmap_region(bitmap, 0, 0, w, num_rows,
+      ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+   if (!lr) {
+      ALLEGRO_ERROR("Failed to lock the bitmap.\n");
+      return 0;
+   }
+
+   if (w == stream->width) {
+      n = al_read_bitmap_stream(stream, lr->data, lr->pitch, num_rows);
+   }
+   else {
+      /* The rows are wider than the bitmap, so they go through a row
+       * buffer and only the left part is kept.
+       */
+      if (!stream->scratch)
+         stream->scratch = al_malloc((size_t)stream->width * 4);
+      if (stream->scratch) {
+         for (n = 0; n < num_rows; n++) {
+            if (al_read_bitmap_stream(stream, stream->scratch, 0, 1) != 1)
+               break;
+            memcpy((char *)lr->data + n * lr->pitch, stream->scratch,
+               (size_t)w * 4);
+         }
+      }
+   }
+
+   al_unlock_bitmap(bitmap);
+
+   return n;
+}
+
+
+/* Function: al_close_bitmap_stream
+ */
+void al_close_bitmap_stream(ALLEGRO_BITMAP_STREAM *stream)
+{
+   if (!stream)
+      return;
+
+   stream->vt->bsi_close(stream);
+   if (stream->fp)
+      al_fclose(stream->fp);
+   al_free(stream->scratch);
+   al_free(stream);
+}
+
+
+/* Batches of bitmaps decoded by a pool of worker threads. Each worker
+ * takes the next file name under the mutex and decodes it without holding
+ * any lock. Results are passed to the callback on the worker thread and
+ * then emitted as user events.
+ *
+ * Events with a bitmap carry a destructor which gives the bytes of their
+ * bitmap back to the memory budget, if one is configured. Workers do not
+ * start a new file while the bitmaps not yet released by the user exceed
+ * it, unless a thread waits for the whole batch. Every such event holds a
+ * reference to the batch so the destructor can still run after
+ * al_destroy_bitmap_batch. The events that batch destruction discards from
+ * the queues never reached the user, so their bitmaps are destroyed too.
+ */
+struct ALLEGRO_BITMAP_BATCH
+{
+   ALLEGRO_EVENT_SOURCE es;
+   ALLEGRO_MUTEX *mutex;
+   ALLEGRO_COND *cond;
+   ALLEGRO_THREAD **threads;
+   int num_threads;
+   char **filenames;
+   int count;
+   int flags;
+   int new_bitmap_flags;
+   int new_bitmap_format;
+   void (*callback)(int index, ALLEGRO_BITMAP *bitmap, void *arg);
+   void *arg;
+   int next;         /* next file to be started */
+   int done;         /* files finished */
+   bool stop;
+   bool discarding;  /* destroying the event source */
+   int waiters;      /* threads in al_wait_for_bitmap_batch */
+   size_t budget;    /* 0 for unlimited */
+   size_t in_flight; /* bytes of bitmaps not yet released by the user */
+   int refcount;
+};
+
+
+static void free_bitmap_batch(ALLEGRO_BITMAP_BATCH *batch)
+{
+   int i;
+
+   if (batch->filenames) {
+      for (i = 0; i < batch->count; i++)
+         al_free(batch->filenames[i]);
+      al_free(batch->filenames);
+   }
+   al_free(batch->threads);
+   if (batch->cond)
+      al_destroy_cond(batch->cond);
+   if (batch->mutex)
+      al_destroy_mutex(batch->mutex);
+   al_free(batch);
+}
+
+
+static void unref_bitmap_batch(ALLEGRO_BITMAP_BATCH *batch)
+{
+   bool last;
+
+   al_lock_mutex(batch->mutex);
+   last = (--batch->refcount == 0);
+   al_unlock_mutex(batch->mutex);
+
+   if (last)
+      free_bitmap_batch(batch);
+}
+
+
+static void bitmap_loaded_dtor(ALLEGRO_USER_EVENT *event)
+{
+   ALLEGRO_BITMAP_BATCH *batch = (ALLEGRO_BITMAP_BATCH *)event->data4;
+   bool discarded;
+
+   al_lock_mutex(batch->mutex);
+   batch->in_flight -= (size_t)event->data3;
+   discarded = batch->discarding;
+   al_broadcast_cond(batch->cond);
+   al_unlock_mutex(batch->mutex);
+
+   if (discarded)
+      al_destroy_bitmap((ALLEGRO_BITMAP *)event->data2);
+
+   unref_bitmap_batch(batch);
+}
+
+
+static size_t bitmap_bytes(ALLEGRO_BITMAP *bitmap)
+{
+   return (size_t)al_get_bitmap_width(bitmap) * al_get_bitmap_height(bitmap)
+      * al_get_pixel_size(al_get_bitmap_format(bitmap));
+}
+
+
+static void *bitmap_batch_worker(ALLEGRO_THREAD *thread, void *arg)
+{
+   ALLEGRO_BITMAP_BATCH *batch = arg;
+   (void)thread;
+
+   /* The new bitmap settings are per thread. */
+   al_set_new_bitmap_flags(batch->new_bitmap_flags);
+   al_set_new_bitmap_format(batch->new_bitmap_format);
+
+   for (;;) {
+      ALLEGRO_BITMAP *bitmap;
+      ALLEGRO_EVENT event;
+      size_t bytes = 0;
+      int index;
+
+      al_lock_mutex(batch->mutex);
+      while (!batch->stop && batch->waiters == 0 && batch->budget > 0 &&
+            batch->in_flight > 0 && batch->in_flight >= batch->budget) {
+         al_wait_cond(batch->cond, batch->mutex);
+      }
+      if (batch->stop || batch->next >= batch->count) {
+         al_unlock_mutex(batch->mutex);
+         break;
+      }
+      index = batch->next++;
+      al_unlock_mutex(batch->mutex);
+
+      bitmap = al_load_bitmap_flags(batch->filenames[index], batch->flags);
+      if (bitmap)
+         bytes = bitmap_bytes(bitmap);
+
+      if (batch->callback)
+         batch->callback(index, bitmap, batch->arg);
+
+      /* The event's destructor may run as soon as it is emitted. */
+      if (bitmap) {
+         al_lock_mutex(batch->mutex);
+         batch->in_flight += bytes;
+         batch->refcount++;
+         al_unlock_mutex(batch->mutex);
+      }
+
+      event.user.type = ALLEGRO_EVENT_BITMAP_LOADED;
+      event.user.data1 = index;
+      event.user.data2 = (intptr_t)bitmap;
+      event.user.data3 = (intptr_t)bytes;
+      event.user.data4 = (intptr_t)batch;
+      al_emit_user_event(&batch->es, &event,
+         bitmap ? bitmap_loaded_dtor : NULL);
+
+      /* Only count the file once its event is queued, so that
+       * al_wait_for_bitmap_batch returns with all events available.
+       */
+      al_lock_mutex(batch->mutex);
+      batch->done++;
+      al_broadcast_cond(batch->cond);
+      al_unlock_mutex(batch->mutex);
+   }
+
+   return NULL;
+}
+
+
+static char *copy_string(const char *s)
+{
+   size_t size = strlen(s) + 1;
+   char *copy = al_malloc(size);
+   if (copy)
+      memcpy(copy, s, size);
+   return copy;
+}
+
+
+/* Function: al_load_bitmaps_async
+ */
+ALLEGRO_BITMAP_BATCH *al_load_bitmaps_async(const char * const *filenames,
+   int count, int flags, ALLEGRO_EVENT_QUEUE *queue,
+   void (*callback)(int index, ALLEGRO_BITMAP *bitmap, void *arg), void *arg)
+{
+   ALLEGRO_CONFIG *config = al_get_system_config();
+   ALLEGRO_BITMAP_BATCH *batch;
+   const char *value;
+   int num_threads;
+   int i;
+   ASSERT(filenames || count == 0);
+   ASSERT(count >= 0);
+
+   batch = al_calloc(1, sizeof(*batch));
+   if (!batch)
+      return NULL;
+
+   batch->mutex = al_create_mutex();
+   batch->cond = al_create_cond();
+   batch->filenames = al_calloc(count + 1, sizeof(char *));
+   if (!batch->mutex || !batch->cond || !batch->filenames)
+      goto error;
+
+   for (i = 0; i < count; i++) {
+      batch->filenames[i] = copy_string(filenames[i]);
+      if (!batch->filenames[i])
+         goto error;
+      batch->count++;
+   }
+
+   batch->flags = flags;
+   batch->new_bitmap_flags = (al_get_new_bitmap_flags()
+      & ~ALLEGRO_VIDEO_BITMAP) | ALLEGRO_MEMORY_BITMAP;
+   batch->new_bitmap_format = al_get_new_bitmap_format();
+   batch->callback = callback;
+   batch->arg = arg;
+   batch->refcount = 1;
+
+   num_threads = _al_get_num_cpus();
+   value = config ? al_get_config_value(config, "image", "async_threads") : NULL;
+   if (value && atoi(value) > 0)
+      num_threads = atoi(value);
+   if (num_threads > count)
+      num_threads = count;
+
+   value = config ? al_get_config_value(config, "image",
+      "async_memory_budget") : NULL;
+   if (value && atoi(value) > 0)
+      batch->budget = (size_t)atoi(value) * 1024 * 1024;
+
+   al_init_user_event_source(&batch->es);
+   if (queue)
+      al_register_event_source(queue, &batch->es);
+
+   batch->threads = al_calloc(num_threads + 1, sizeof(ALLEGRO_THREAD *));
+   if (!batch->threads) {
+      al_destroy_user_event_source(&batch->es);
+      goto error;
+   }
+   for (i = 0; i < num_threads; i++) {
+      batch->threads[i] = al_create_thread(bitmap_batch_worker, batch);
+      if (!batch->threads[i])
+         break;
+      batch->num_threads++;
+   }
+   if (batch->num_threads == 0 && count > 0) {
+      ALLEGRO_ERROR("Could not create any bitmap loading threads.\n");
+      al_destroy_user_event_source(&batch->es);
+      goto error;
+   }
+   for (i = 0; i < batch->num_threads; i++)
+      al_start_thread(batch->threads[i]);
+
+   ALLEGRO_DEBUG("Loading %d bitmaps with %d threads.\n", count,
+      batch->num_threads);
+
+   return batch;
+
+error:
+   free_bitmap_batch(batch);
+   return NULL;
+}
+
+
+/* Function: al_get_bitmap_batch_event_source
+ */
+ALLEGRO_EVENT_SOURCE *al_get_bitmap_batch_event_source(
+   ALLEGRO_BITMAP_BATCH *batch)
+{
+   ASSERT(batch);
+   return &batch->es;
+}
+
+
+/* Function: al_wait_for_bitmap_batch
+ */
+void al_wait_for_bitmap_batch(ALLEGRO_BITMAP_BATCH *batch)
+{
+   ASSERT(batch);
+
+   al_lock_mutex(batch->mutex);
+   /* The caller may not release any events before this returns, so the
+    * budget must not hold back the workers meanwhile.
+    */
+   batch->waiters++;
+   al_broadcast_cond(batch->cond);
+   /* Files not yet started when the batch was stopped never will be. */
+   while (batch->done < (batch->stop ? batch->next : batch->count))
+      al_wait_cond(batch->cond, batch->mutex);
+   batch->waiters--;
+   al_unlock_mutex(batch->mutex);
+}
+
+
+/* Function: al_destroy_bitmap_batch
+ */
+void al_destroy_bitmap_batch(ALLEGRO_BITMAP_BATCH *batch)
+{
+   int i;
+
+   if (!batch)
+      return;
+
+   al_lock_mutex(batch->mutex);
+   batch->stop = true;
+   al_broadcast_cond(batch->cond);
+   al_unlock_mutex(batch->mutex);
+
+   for (i = 0; i < batch->num_threads; i++)
+      al_destroy_thread(batch->threads[i]);
+   batch->num_threads = 0;
+
+   /* The destructors run while the event source is destroyed are those of
+    * events still queued, not of events the user took and is done with.
+    * Releasing events on another thread meanwhile is not supported.
+    */
+   al_lock_mutex(batch->mutex);
+   batch->discarding = true;
+   al_unlock_mutex(batch->mutex);
+
+   al_destroy_user_event_source(&batch->es);
+
+   al_lock_mutex(batch->mutex);
+   batch->discarding = false;
+   al_unlock_mutex(batch->mutex);
+
+   unref_bitmap_batch(batch);
+}
+
+
 /* vim: set sts=3 sw=3 et: */
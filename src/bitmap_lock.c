@@ -20,11 +20,161 @@
 #include "allegro5/internal/aintern_pixels.h"
 
 
+/* Returns true if the region locked by the given bitmap overlaps a region
+ * in coordinates of its parent.
+ */
+static bool lock_overlaps(ALLEGRO_BITMAP *locked,
+   int x, int y, int width, int height)
+{
+   int lx = locked->lock_x;
+   int ly = locked->lock_y;
+
+   if (locked->parent) {
+      lx += locked->xofs;
+      ly += locked->yofs;
+   }
+
+   return x < lx + locked->lock_w && lx < x + width &&
+      y < ly + locked->lock_h && ly < y + height;
+}
+
+
+
+/* Locks a region of a memory bitmap.  The lock is held by the sub-bitmap it
+ * was requested through, if any, so that several threads can lock disjoint
+ * regions of the same bitmap through their own sub-bitmaps.
+ */
+static ALLEGRO_LOCKED_REGION *lock_memory_region(ALLEGRO_BITMAP *bitmap,
+   ALLEGRO_BITMAP *sub, int x, int y, int width, int height,
+   int format, int flags)
+{
+   ALLEGRO_BITMAP *holder;
+   ALLEGRO_LOCKED_REGION *lr;
+   ALLEGRO_BITMAP *other;
+   unsigned char *memory;
+   int pitch;
+   int f = _al_get_real_pixel_format(al_get_current_display(), format);
+
+   if (f < 0) {
+      return NULL;
+   }
+
+   ASSERT(x+width <= bitmap->w);
+   ASSERT(y+height <= bitmap->h);
+
+   if (bitmap->lock_mutex)
+      al_lock_mutex(bitmap->lock_mutex);
+
+   holder = sub ? sub : bitmap;
+   if (holder->locked)
+      goto fail;
+
+   for (other = bitmap->first_lock; other; other = other->next_lock) {
+      if (lock_overlaps(other, x, y, width, height))
+         goto fail;
+   }
+
+   /* Pixels shared with a clone must be copied before writing. */
+   if (!(flags & ALLEGRO_LOCK_READONLY) && !_al_unshare_bitmap_memory(bitmap))
+      goto fail;
+
+   holder->lock_x = x - (holder->parent ? holder->xofs : 0);
+   holder->lock_y = y - (holder->parent ? holder->yofs : 0);
+   holder->lock_w = width;
+   holder->lock_h = height;
+   holder->lock_flags = flags;
+   holder->locked = true;
+   holder->next_lock = bitmap->first_lock;
+   bitmap->first_lock = holder;
+
+   memory = bitmap->memory;
+   pitch = bitmap->pitch;
+
+   if (bitmap->lock_mutex)
+      al_unlock_mutex(bitmap->lock_mutex);
+
+   lr = &holder->locked_region;
+   ASSERT(memory);
+   if (format == ALLEGRO_PIXEL_FORMAT_ANY || bitmap->format == format || f == bitmap->format) {
+      lr->data = memory + pitch * y + x * al_get_pixel_size(bitmap->format);
+      lr->format = bitmap->format;
+      lr->pitch = pitch;
+      lr->pixel_size = al_get_pixel_size(bitmap->format);
+   }
+   else {
+      lr->pitch = al_get_pixel_size(f) * width;
+      lr->data = al_malloc(lr->pitch*height);
+      lr->format = f;
+      lr->pixel_size = al_get_pixel_size(f);
+      if (!(flags & ALLEGRO_LOCK_WRITEONLY)) {
+         _al_convert_bitmap_data(
+            memory, bitmap->format, pitch,
+            lr->data, f, lr->pitch,
+            x, y, 0, 0, width, height);
+      }
+   }
+
+   return lr;
+
+fail:
+   if (bitmap->lock_mutex)
+      al_unlock_mutex(bitmap->lock_mutex);
+   return NULL;
+}
+
+
+
+static void unlock_memory_region(ALLEGRO_BITMAP *holder,
+   ALLEGRO_BITMAP *bitmap)
+{
+   ALLEGRO_LOCKED_REGION *lr = &holder->locked_region;
+   ALLEGRO_BITMAP **link;
+   int x = holder->lock_x + (holder->parent ? holder->xofs : 0);
+   int y = holder->lock_y + (holder->parent ? holder->yofs : 0);
+
+   if (!(holder->lock_flags & ALLEGRO_LOCK_READONLY))
+      _al_mark_bitmap_dirty(bitmap, x, y, holder->lock_w, holder->lock_h);
+
+   if (lr->format != 0 && lr->format != bitmap->format) {
+      if (!(holder->lock_flags & ALLEGRO_LOCK_READONLY)) {
+         _al_convert_bitmap_data(
+            lr->data, lr->format, lr->pitch,
+            bitmap->memory, bitmap->format, bitmap->pitch,
+            0, 0, x, y, holder->lock_w, holder->lock_h);
+      }
+      al_free(lr->data);
+   }
+
+   if (bitmap->lock_mutex)
+      al_lock_mutex(bitmap->lock_mutex);
+
+   for (link = &bitmap->first_lock; *link; link = &(*link)->next_lock) {
+      if (*link == holder) {
+         *link = holder->next_lock;
+         break;
+      }
+   }
+   holder->next_lock = NULL;
+   holder->locked = false;
+
+   if (!bitmap->first_lock && bitmap->old_shared) {
+      _al_release_shared_pixels(bitmap->old_shared);
+      bitmap->old_shared = NULL;
+   }
+
+   if (bitmap->lock_mutex)
+      al_unlock_mutex(bitmap->lock_mutex);
+}
+
+
+
 /* Function: al_lock_bitmap_region
  */
 ALLEGRO_LOCKED_REGION *al_lock_bitmap_region(ALLEGRO_BITMAP *bitmap,
    int x, int y, int width, int height, int format, int flags)
 {
+   ALLEGRO_BITMAP *sub = NULL;
+
    ASSERT(x >= 0);
    ASSERT(y >= 0);
    ASSERT(width >= 0);
@@ -34,14 +184,19 @@ ALLEGRO_LOCKED_REGION *al_lock_bitmap_region(ALLEGRO_BITMAP *bitmap,
    if (bitmap->parent) {
       x += bitmap->xofs;
       y += bitmap->yofs;
+      sub = bitmap;
       bitmap = bitmap->parent;
    }
 
+   if (bitmap->flags & ALLEGRO_MEMORY_BITMAP) {
+      return lock_memory_region(bitmap, sub, x, y, width, height,
+         format, flags);
+   }
+
    if (bitmap->locked)
       return NULL;
 
-   if (!(bitmap->flags & ALLEGRO_MEMORY_BITMAP) &&
-         !(flags & ALLEGRO_LOCK_READONLY))
+   if (!(flags & ALLEGRO_LOCK_READONLY))
       bitmap->dirty = true;
 
    ASSERT(x+width <= bitmap->w);
@@ -53,36 +208,8 @@ ALLEGRO_LOCKED_REGION *al_lock_bitmap_region(ALLEGRO_BITMAP *bitmap,
    bitmap->lock_h = height;
    bitmap->lock_flags = flags;
 
-   if (bitmap->flags & ALLEGRO_MEMORY_BITMAP) {
-      int f = _al_get_real_pixel_format(al_get_current_display(), format);
-      if (f < 0) {
-         return NULL;
-      }
-      ASSERT(bitmap->memory);
-      if (format == ALLEGRO_PIXEL_FORMAT_ANY || bitmap->format == format || f == bitmap->format) {
-         bitmap->locked_region.data = bitmap->memory
-            + bitmap->pitch * y + x * al_get_pixel_size(bitmap->format);
-         bitmap->locked_region.format = bitmap->format;
-         bitmap->locked_region.pitch = bitmap->pitch;
-         bitmap->locked_region.pixel_size = al_get_pixel_size(bitmap->format);
-      }
-      else {
-         bitmap->locked_region.pitch = al_get_pixel_size(f) * width;
-         bitmap->locked_region.data = al_malloc(bitmap->locked_region.pitch*height);
-         bitmap->locked_region.format = f;
-         bitmap->locked_region.pixel_size = al_get_pixel_size(f);
-         if (!(bitmap->lock_flags & ALLEGRO_LOCK_WRITEONLY)) {
-            _al_convert_bitmap_data(
-               bitmap->memory, bitmap->format, bitmap->pitch,
-               bitmap->locked_region.data, f, bitmap->locked_region.pitch,
-               x, y, 0, 0, width, height);
-         }
-      }
-   }
-   else {
-      if (!bitmap->vt->lock_region(bitmap, x, y, width, height, format, flags)) {
-         return NULL;
-      }
+   if (!bitmap->vt->lock_region(bitmap, x, y, width, height, format, flags)) {
+      return NULL;
    }
 
    bitmap->locked = true;
@@ -100,30 +227,65 @@ ALLEGRO_LOCKED_REGION *al_lock_bitmap(ALLEGRO_BITMAP *bitmap,
 }
 
 
+/* Returns the bitmap holding the lock that unlocking the given memory
+ * bitmap or sub-bitmap releases, or NULL.  A sub-bitmap releases its own
+ * lock, or else the one of its parent.  The parent releases its own lock,
+ * or else the one lock held through a sub-bitmap, as it did when locking a
+ * sub-bitmap locked its parent.
+ */
+static ALLEGRO_BITMAP *find_lock_holder(ALLEGRO_BITMAP *bitmap,
+   ALLEGRO_BITMAP *sub)
+{
+   ALLEGRO_BITMAP *holder;
+
+   if (sub && sub->locked)
+      return sub;
+   if (bitmap->locked)
+      return bitmap;
+   if (sub)
+      return NULL;
+
+   if (bitmap->lock_mutex)
+      al_lock_mutex(bitmap->lock_mutex);
+   holder = bitmap->first_lock;
+   /* With several locks there is no telling which one is meant, they must
+    * be unlocked through their sub-bitmaps.
+    */
+   ASSERT(!holder || !holder->next_lock);
+   if (holder && holder->next_lock)
+      holder = NULL;
+   if (bitmap->lock_mutex)
+      al_unlock_mutex(bitmap->lock_mutex);
+
+   return holder;
+}
+
+
 /* Function: al_unlock_bitmap
  */
 void al_unlock_bitmap(ALLEGRO_BITMAP *bitmap)
 {
+   ALLEGRO_BITMAP *sub = NULL;
+
    /* For sub-bitmaps */
    if (bitmap->parent) {
+      sub = bitmap;
       bitmap = bitmap->parent;
    }
 
-   if (!(bitmap->flags & ALLEGRO_MEMORY_BITMAP)) {
-      bitmap->vt->unlock_region(bitmap);
+   if (bitmap->flags & ALLEGRO_MEMORY_BITMAP) {
+      ALLEGRO_BITMAP *holder = find_lock_holder(bitmap, sub);
+      if (holder)
+         unlock_memory_region(holder, bitmap);
+      return;
    }
-   else {
-      if (bitmap->locked_region.format != 0 && bitmap->locked_region.format != bitmap->format) {
-         if (!(bitmap->lock_flags & ALLEGRO_LOCK_READONLY)) {
-            _al_convert_bitmap_data(
-               bitmap->locked_region.data, bitmap->locked_region.format, bitmap->locked_region.pitch,
-               bitmap->memory, bitmap->format, bitmap->pitch,
-               0, 0, bitmap->lock_x, bitmap->lock_y, bitmap->lock_w, bitmap->lock_h);
-         }
-         al_free(bitmap->locked_region.data);
-      }
+
+   if (!(bitmap->lock_flags & ALLEGRO_LOCK_READONLY)) {
+      _al_mark_bitmap_dirty(bitmap, bitmap->lock_x, bitmap->lock_y,
+         bitmap->lock_w, bitmap->lock_h);
    }
 
+   bitmap->vt->unlock_region(bitmap);
    bitmap->locked = false;
 }
 
@@ -132,6 +294,11 @@ void al_unlock_bitmap(ALLEGRO_BITMAP *bitmap)
  */
 bool al_is_bitmap_locked(ALLEGRO_BITMAP *bitmap)
 {
+   /* A memory bitmap is also locked while a region of it is locked through
+    * one of its sub-bitmaps.
+    */
+   if (!bitmap->parent && (bitmap->flags & ALLEGRO_MEMORY_BITMAP))
+      return bitmap->first_lock != NULL;
    return bitmap->locked;
 }
 
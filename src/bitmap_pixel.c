@@ -30,7 +30,8 @@ ALLEGRO_COLOR al_get_pixel(ALLEGRO_BITMAP *bitmap, int x, int y)
    char *data;
    ALLEGRO_COLOR color;
 
-   if (bitmap->parent) {
+   /* Sub-bitmaps of memory bitmaps may hold a lock themselves. */
+   if (bitmap->parent && !bitmap->locked) {
       x += bitmap->xofs;
       y += bitmap->yofs;
       bitmap = bitmap->parent;
@@ -82,7 +83,7 @@ void _al_put_pixel(ALLEGRO_BITMAP *bitmap, int x, int y, ALLEGRO_COLOR color)
    ALLEGRO_LOCKED_REGION *lr;
    char *data;
 
-   if (bitmap->parent) {
+   if (bitmap->parent && !bitmap->locked) {
        x += bitmap->xofs;
        y += bitmap->yofs;
        bitmap = bitmap->parent;
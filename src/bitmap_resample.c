@@ -0,0 +1,513 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Bitmap resampling and mipmap generation.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_system.h"
+
+ALLEGRO_DEBUG_CHANNEL("bitmap")
+
+/* The destination is processed in bands of this many rows, which are
+ * independent jobs for the worker threads.
+ */
+#define BAND_ROWS          32
+#define LINEAR_TABLE_SIZE  4096
+
+
+/* For each destination pixel along one axis, the source pixels which
+ * contribute to it and their weights, which add up to one.
+ */
+typedef struct RESAMPLE_AXIS {
+   int *first;
+   int *count;
+   float *weights;      /* max_count weights per destination pixel */
+   int max_count;
+} RESAMPLE_AXIS;
+
+
+typedef struct RESAMPLE {
+   const unsigned char *src;
+   int src_pitch;
+   int sw, sh;
+   unsigned char *dst;
+   int dst_pitch;
+   int dw, dh;
+   int flags;
+   RESAMPLE_AXIS xaxis, yaxis;
+   float to_linear[256];
+   float from_linear[LINEAR_TABLE_SIZE + 1];
+
+   int num_bands;
+} RESAMPLE;
+
+
+
+static float mitchell(float x)
+{
+   /* Mitchell-Netravali with B = C = 1/3. */
+   x = fabsf(x);
+   if (x < 1.0f)
+      return (7.0f * x * x * x - 12.0f * x * x + 16.0f / 3.0f) / 6.0f;
+   if (x < 2.0f)
+      return (-7.0f / 3.0f * x * x * x + 12.0f * x * x - 20.0f * x
+         + 32.0f / 3.0f) / 6.0f;
+   return 0.0f;
+}
+
+
+
+static float sinc(float x)
+{
+   if (x == 0.0f)
+      return 1.0f;
+   x *= ALLEGRO_PI;
+   return sinf(x) / x;
+}
+
+
+
+static float lanczos3(float x)
+{
+   if (fabsf(x) >= 3.0f)
+      return 0.0f;
+   return sinc(x) * sinc(x / 3.0f);
+}
+
+
+
+static float filter_support(int filter)
+{
+   switch (filter) {
+      case ALLEGRO_RESAMPLE_MITCHELL:
+         return 2.0f;
+      case ALLEGRO_RESAMPLE_LANCZOS:
+         return 3.0f;
+      default:
+         return 0.5f;
+   }
+}
+
+
+
+/* init_axis:
+ *  Works out the contributions for scaling src_size pixels to dst_size.
+ *  When reducing, the filter is stretched to cover all the source pixels
+ *  under a destination pixel.  The box filter weighs each source pixel by
+ *  how much of it is covered, so reducing by a whole factor averages the
+ *  pixels exactly.  Pixels beyond the edges repeat the edge pixels.
+ */
+static bool init_axis(RESAMPLE_AXIS *axis, int src_size, int dst_size,
+   int filter)
+{
+   const double scale = (double)src_size / dst_size;
+   const double fscale = (scale > 1.0) ? scale : 1.0;
+   const double support = filter_support(filter) * fscale;
+   float *w;
+   int d;
+
+   axis->max_count = (int)ceil(2.0 * support) + 2;
+   axis->first = al_malloc(dst_size * sizeof(*axis->first));
+   axis->count = al_malloc(dst_size * sizeof(*axis->count));
+   axis->weights = al_malloc((size_t)dst_size * axis->max_count *
+      sizeof(*axis->weights));
+   if (!axis->first || !axis->count || !axis->weights)
+      return false;
+
+   for (d = 0; d < dst_size; d++) {
+      const double center = (d + 0.5) * scale;
+      const int lo = (int)floor(center - support);
+      const int hi = (int)ceil(center + support);
+      int first = lo < 0 ? 0 : lo;
+      int last = hi - 1 >= src_size ? src_size - 1 : hi - 1;
+      float sum = 0.0f;
+      int i;
+
+      if (first > src_size - 1)
+         first = src_size - 1;
+      if (last < first)
+         last = first;
+
+      w = axis->weights + (size_t)d * axis->max_count;
+      memset(w, 0, axis->max_count * sizeof(*w));
+
+      for (i = lo; i < hi; i++) {
+         float weight;
+         int j;
+
+         if (filter == ALLEGRO_RESAMPLE_BOX) {
+            double a = (i > center - support) ? i : center - support;
+            double b = (i + 1 < center + support) ? i + 1 : center + support;
+            weight = (b > a) ? (float)(b - a) : 0.0f;
+         }
+         else {
+            float x = (float)((i + 0.5 - center) / fscale);
+            weight = (filter == ALLEGRO_RESAMPLE_LANCZOS)
+               ? lanczos3(x) : mitchell(x);
+         }
+
+         j = i < first ? first : i > last ? last : i;
+         w[j - first] += weight;
+         sum += weight;
+      }
+
+      /* Trim pixels which do not contribute. */
+      while (last > first && w[last - first] == 0.0f)
+         last--;
+      while (first < last && w[0] == 0.0f) {
+         memmove(w, w + 1, (last - first) * sizeof(*w));
+         w[last - first] = 0.0f;
+         first++;
+      }
+
+      axis->first[d] = first;
+      axis->count[d] = last - first + 1;
+      if (sum == 0.0f) {
+         w[0] = 1.0f;
+         axis->count[d] = 1;
+      }
+      else {
+         for (i = 0; i < axis->count[d]; i++)
+            w[i] /= sum;
+      }
+   }
+
+   return true;
+}
+
+
+
+static void free_axis(RESAMPLE_AXIS *axis)
+{
+   al_free(axis->first);
+   al_free(axis->count);
+   al_free(axis->weights);
+}
+
+
+
+static void init_tables(RESAMPLE *r)
+{
+   int i;
+
+   for (i = 0; i < 256; i++) {
+      float c = i / 255.0f;
+      r->to_linear[i] = (c <= 0.04045f)
+         ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+   }
+   for (i = 0; i <= LINEAR_TABLE_SIZE; i++) {
+      float c = (float)i / LINEAR_TABLE_SIZE;
+      r->from_linear[i] = (c <= 0.0031308f)
+         ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+   }
+}
+
+
+
+/* decode_row:
+ *  Converts a row of source pixels to premultiplied floats, in linear
+ *  light if requested.  Colours are weighed by their alpha either way, so
+ *  transparent pixels do not bleed into their neighbours.
+ */
+static void decode_row(const RESAMPLE *r, const unsigned char *p, float *out)
+{
+   const bool linear = (r->flags & ALLEGRO_RESAMPLE_LINEAR_LIGHT) != 0;
+   const bool premul = !(r->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   int x, i;
+
+   for (x = 0; x < r->sw; x++, p += 4, out += 4) {
+      const int a = p[3];
+      const float af = a / 255.0f;
+
+      if (!linear) {
+         const float f = premul ? 1.0f / 255.0f : af / 255.0f;
+         for (i = 0; i < 3; i++)
+            out[i] = p[i] * f;
+      }
+      else if (!premul) {
+         for (i = 0; i < 3; i++)
+            out[i] = r->to_linear[p[i]] * af;
+      }
+      else if (a == 0) {
+         out[0] = out[1] = out[2] = 0.0f;
+      }
+      else {
+         for (i = 0; i < 3; i++) {
+            int c = (p[i] * 255 + a / 2) / a;
+            out[i] = r->to_linear[c > 255 ? 255 : c] * af;
+         }
+      }
+      out[3] = af;
+   }
+}
+
+
+
+static unsigned char to_byte(float f)
+{
+   if (f <= 0.0f)
+      return 0;
+   if (f >= 1.0f)
+      return 255;
+   return (unsigned char)(f * 255.0f + 0.5f);
+}
+
+
+
+/* encode_row:
+ *  The inverse of decode_row.  Filters with negative lobes can overshoot,
+ *  so values are clamped.
+ */
+static void encode_row(const RESAMPLE *r, const float *in, unsigned char *p)
+{
+   const bool linear = (r->flags & ALLEGRO_RESAMPLE_LINEAR_LIGHT) != 0;
+   const bool premul = !(r->flags & ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+   int x, i;
+
+   for (x = 0; x < r->dw; x++, in += 4, p += 4) {
+      float a = in[3];
+
+      if (a > 1.0f)
+         a = 1.0f;
+      p[3] = to_byte(a);
+      if (a <= 0.0f) {
+         p[0] = p[1] = p[2] = 0;
+         continue;
+      }
+
+      if (!linear && premul) {
+         for (i = 0; i < 3; i++)
+            p[i] = to_byte(in[i]);
+         continue;
+      }
+
+      for (i = 0; i < 3; i++) {
+         float c = in[i] / a;
+         if (c > 1.0f)
+            c = 1.0f;
+         if (linear && c > 0.0f)
+            c = r->from_linear[(int)(c * LINEAR_TABLE_SIZE + 0.5f)];
+         p[i] = to_byte(premul ? c * a : c);
+      }
+   }
+}
+
+
+
+/* resample_band:
+ *  Produces a band of destination rows.  The source rows it needs are
+ *  first filtered horizontally, then combined vertically.
+ */
+static bool resample_band(RESAMPLE *r, int band)
+{
+   const int y0 = band * BAND_ROWS;
+   const int y1 = (y0 + BAND_ROWS < r->dh) ? y0 + BAND_ROWS : r->dh;
+   const int s0 = r->yaxis.first[y0];
+   const size_t dst_floats = (size_t)r->dw * 4;
+   int s1 = s0;
+   float *line, *rows, *out;
+   int x, y, sy, i, k;
+
+   for (y = y0; y < y1; y++) {
+      int end = r->yaxis.first[y] + r->yaxis.count[y];
+      if (end > s1)
+         s1 = end;
+   }
+
+   line = al_malloc(((size_t)r->sw * 4 + (size_t)(s1 - s0 + 1) * dst_floats)
+      * sizeof(float));
+   if (!line)
+      return false;
+   rows = line + (size_t)r->sw * 4;
+   out = rows + (size_t)(s1 - s0) * dst_floats;
+
+   for (sy = s0; sy < s1; sy++) {
+      float *h = rows + (size_t)(sy - s0) * dst_floats;
+
+      decode_row(r, r->src + (size_t)sy * r->src_pitch, line);
+      for (x = 0; x < r->dw; x++, h += 4) {
+         const float *w = r->xaxis.weights + (size_t)x * r->xaxis.max_count;
+         const float *p = line + (size_t)r->xaxis.first[x] * 4;
+         float sum[4] = {0, 0, 0, 0};
+
+         for (k = 0; k < r->xaxis.count[x]; k++, p += 4) {
+            for (i = 0; i < 4; i++)
+               sum[i] += w[k] * p[i];
+         }
+         for (i = 0; i < 4; i++)
+            h[i] = sum[i];
+      }
+   }
+
+   for (y = y0; y < y1; y++) {
+      const float *w = r->yaxis.weights + (size_t)y * r->yaxis.max_count;
+      const float *h = rows + (size_t)(r->yaxis.first[y] - s0) * dst_floats;
+      size_t j;
+
+      memset(out, 0, dst_floats * sizeof(float));
+      for (k = 0; k < r->yaxis.count[y]; k++, h += dst_floats) {
+         for (j = 0; j < dst_floats; j++)
+            out[j] += w[k] * h[j];
+      }
+      encode_row(r, out, r->dst + (size_t)y * r->dst_pitch);
+   }
+
+   al_free(line);
+   return true;
+}
+
+
+
+/* halve_box:
+ *  The common case of reducing premultiplied pixels to exactly half the
+ *  size with the box filter, in integers.  The result is the same as that
+ *  of resample_band.
+ */
+static bool halve_box(RESAMPLE *r, int band)
+{
+   const int y0 = band * BAND_ROWS;
+   const int y1 = (y0 + BAND_ROWS < r->dh) ? y0 + BAND_ROWS : r->dh;
+   int x, y, i;
+
+   for (y = y0; y < y1; y++) {
+      const unsigned char *p = r->src + (size_t)(2 * y) * r->src_pitch;
+      const unsigned char *q = p + r->src_pitch;
+      unsigned char *d = r->dst + (size_t)y * r->dst_pitch;
+
+      for (x = 0; x < r->dw; x++, p += 8, q += 8, d += 4) {
+         for (i = 0; i < 4; i++)
+            d[i] = (p[i] + p[i + 4] + q[i] + q[i + 4] + 2) >> 2;
+      }
+   }
+
+   return true;
+}
+
+
+
+static bool run_band(void *arg, int band)
+{
+   RESAMPLE *r = arg;
+
+   if ((r->flags & ALLEGRO_RESAMPLE_FILTER_MASK) == ALLEGRO_RESAMPLE_BOX &&
+         !(r->flags & (ALLEGRO_RESAMPLE_LINEAR_LIGHT |
+            ALLEGRO_NO_PREMULTIPLIED_ALPHA)) &&
+         r->sw == 2 * r->dw && r->sh == 2 * r->dh) {
+      return halve_box(r, band);
+   }
+   return resample_band(r, band);
+}
+
+
+
+/* Function: al_resample_bitmap
+ */
+bool al_resample_bitmap(ALLEGRO_BITMAP *dest, ALLEGRO_BITMAP *src, int flags)
+{
+   const int filter = flags & ALLEGRO_RESAMPLE_FILTER_MASK;
+   ALLEGRO_LOCKED_REGION *slr = NULL, *dlr = NULL;
+   RESAMPLE *r;
+   bool ret = false;
+   ASSERT(dest);
+   ASSERT(src);
+   ASSERT(dest != src);
+
+   if (filter != ALLEGRO_RESAMPLE_BOX && filter != ALLEGRO_RESAMPLE_MITCHELL &&
+         filter != ALLEGRO_RESAMPLE_LANCZOS) {
+      ALLEGRO_ERROR("Unknown resampling filter %d.\n", filter);
+      return false;
+   }
+
+   r = al_calloc(1, sizeof(*r));
+   if (!r)
+      return false;
+   r->flags = flags;
+   r->sw = al_get_bitmap_width(src);
+   r->sh = al_get_bitmap_height(src);
+   r->dw = al_get_bitmap_width(dest);
+   r->dh = al_get_bitmap_height(dest);
+   r->num_bands = (r->dh + BAND_ROWS - 1) / BAND_ROWS;
+
+   if (!init_axis(&r->xaxis, r->sw, r->dw, filter) ||
+       !init_axis(&r->yaxis, r->sh, r->dh, filter))
+      goto done;
+   if (flags & ALLEGRO_RESAMPLE_LINEAR_LIGHT)
+      init_tables(r);
+
+   slr = al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_READONLY);
+   if (!slr)
+      goto done;
+   dlr = al_lock_bitmap(dest, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+      ALLEGRO_LOCK_WRITEONLY);
+   if (!dlr)
+      goto done;
+
+   r->src = slr->data;
+   r->src_pitch = slr->pitch;
+   r->dst = dlr->data;
+   r->dst_pitch = dlr->pitch;
+
+   ret = _al_run_parallel(run_band, r, r->num_bands);
+
+done:
+   if (dlr)
+      al_unlock_bitmap(dest);
+   if (slr)
+      al_unlock_bitmap(src);
+   free_axis(&r->xaxis);
+   free_axis(&r->yaxis);
+   al_free(r);
+   return ret;
+}
+
+
+
+/* Function: al_create_mipmaps
+ */
+int al_create_mipmaps(ALLEGRO_BITMAP *bitmap, ALLEGRO_BITMAP **mipmaps,
+   int max_mipmaps, int flags)
+{
+   ALLEGRO_BITMAP *prev = bitmap;
+   int w = al_get_bitmap_width(bitmap);
+   int h = al_get_bitmap_height(bitmap);
+   int n = 0;
+   ASSERT(bitmap);
+   ASSERT(mipmaps || max_mipmaps == 0);
+
+   while (n < max_mipmaps && (w > 1 || h > 1)) {
+      ALLEGRO_BITMAP *mipmap;
+
+      w = (w > 1) ? w / 2 : 1;
+      h = (h > 1) ? h / 2 : 1;
+      mipmap = al_create_bitmap(w, h);
+      if (!mipmap)
+         break;
+      if (!al_resample_bitmap(mipmap, prev, flags)) {
+         al_destroy_bitmap(mipmap);
+         break;
+      }
+      mipmaps[n++] = mipmap;
+      prev = mipmap;
+   }
+
+   return n;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -188,6 +188,8 @@ void al_convert_bitmap(ALLEGRO_BITMAP *bitmap)
    bitmap->transform = clone->transform;
    bitmap->inverse_transform = clone->inverse_transform;
    bitmap->inverse_transform_dirty = clone->inverse_transform_dirty;
+   bitmap->dirty_rects = clone->dirty_rects;
+   clone->dirty_rects = NULL;
    
    al_destroy_bitmap(clone);
 }
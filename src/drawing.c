@@ -35,6 +35,8 @@ void al_clear_to_color(ALLEGRO_COLOR color)
       ASSERT(display);
       ASSERT(display->vt);
       display->vt->clear(display, &color);
+      _al_mark_bitmap_dirty(target, target->cl, target->ct,
+         target->cr_excl - target->cl, target->cb_excl - target->ct);
    }
 }
 
@@ -73,6 +75,7 @@ void al_draw_pixel(float x, float y, ALLEGRO_COLOR color)
       ASSERT(display);
       ASSERT(display->vt);
       display->vt->draw_pixel(display, x, y, &color);
+      _al_mark_target_dirty(x, y, x + 1, y + 1);
    }
 }
 
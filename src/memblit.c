@@ -19,6 +19,7 @@
 #include "allegro5/internal/aintern_blend.h"
 #include "allegro5/internal/aintern_convert.h"
 #include "allegro5/internal/aintern_memblit.h"
+#include "allegro5/internal/aintern_shader.h"
 #include "allegro5/internal/aintern_transform.h"
 #include "allegro5/internal/aintern_tri_soft.h"
 #include <math.h>
@@ -144,6 +145,7 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *src,
    al_get_separate_blender(&op, &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
 
    if (_AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED_TINT_WHITE &&
+      !_al_get_soft_shader(al_get_target_bitmap()) &&
       _al_transform_is_translation(al_get_current_transform(), &xtrans, &ytrans))
    {
       _al_draw_bitmap_region_memory_fast(src, sx, sy, sw, sh,
@@ -160,7 +162,8 @@ void _al_draw_bitmap_region_memory(ALLEGRO_BITMAP *src,
 }
 
 
-static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
+/* Draws one transformed quad from src, which must already be locked. */
+static void draw_transformed_quad_memory(ALLEGRO_BITMAP *src,
    ALLEGRO_COLOR tint,
    int sx, int sy, int sw, int sh, int dw, int dh,
    ALLEGRO_TRANSFORM* local_trans, int flags)
@@ -235,11 +238,19 @@ static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
    v[bl].v = sy + sh;
    v[bl].color = tint;
 
-   al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
-
    _al_triangle_2d(src, &v[tl], &v[tr], &v[br]);
    _al_triangle_2d(src, &v[tl], &v[br], &v[bl]);
+}
+
 
+static void _al_draw_transformed_bitmap_memory(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint,
+   int sx, int sy, int sw, int sh, int dw, int dh,
+   ALLEGRO_TRANSFORM* local_trans, int flags)
+{
+   al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+   draw_transformed_quad_memory(src, tint, sx, sy, sw, sh, dw, dh,
+      local_trans, flags);
    al_unlock_bitmap(src);
 }
 
@@ -259,6 +270,53 @@ static void _al_draw_transformed_scaled_bitmap_memory(
 }
 
 
+/* Draws many regions of one bitmap, checking the blender and transformation
+ * and locking the source only once. The result is the same as calling
+ * _al_draw_bitmap_region_memory for every quad under a transformation
+ * translated by the quad's destination.
+ */
+void _al_draw_bitmap_quads_memory(ALLEGRO_BITMAP *src,
+   ALLEGRO_COLOR tint, float xofs, float yofs,
+   const _AL_BITMAP_QUAD *quads, int num_quads)
+{
+   int op, src_mode, dst_mode;
+   int op_alpha, src_alpha, dst_alpha;
+   float xtrans, ytrans;
+   const ALLEGRO_TRANSFORM *trans = al_get_current_transform();
+   ALLEGRO_TRANSFORM local_trans;
+   int i;
+
+   ASSERT(src->parent == NULL);
+
+   al_get_separate_blender(&op, &src_mode, &dst_mode, &op_alpha, &src_alpha, &dst_alpha);
+
+   if (_AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED_TINT_WHITE &&
+      !_al_get_soft_shader(al_get_target_bitmap()) &&
+      _al_transform_is_translation(trans, &xtrans, &ytrans))
+   {
+      for (i = 0; i < num_quads; i++) {
+         const _AL_BITMAP_QUAD *q = &quads[i];
+         _al_draw_bitmap_region_memory_fast(src,
+            q->sx + xofs, q->sy + yofs, q->sw, q->sh,
+            q->dx + xtrans, q->dy + ytrans, 0);
+      }
+      return;
+   }
+
+   al_lock_bitmap(src, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+   for (i = 0; i < num_quads; i++) {
+      const _AL_BITMAP_QUAD *q = &quads[i];
+      al_identity_transform(&local_trans);
+      al_translate_transform(&local_trans, q->dx, q->dy);
+      al_compose_transform(&local_trans, trans);
+      draw_transformed_quad_memory(src, tint,
+         q->sx + xofs, q->sy + yofs, q->sw, q->sh, q->sw, q->sh,
+         &local_trans, 0);
+   }
+   al_unlock_bitmap(src);
+}
+
+
 static void _al_draw_bitmap_region_memory_fast(ALLEGRO_BITMAP *bitmap,
    int sx, int sy, int sw, int sh,
    int dx, int dy, int flags)
@@ -16,10 +16,32 @@
  */
 
 
+#include <stdlib.h>
+
 #include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_blend.h"
 #include "allegro5/internal/aintern_memdraw.h"
+#include "allegro5/internal/aintern_system.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+   #include <emmintrin.h>
+   #define STREAM_FILL
+#endif
+
+ALLEGRO_DEBUG_CHANNEL("memdraw")
+
+#define MIN_BAND_ROWS      16
+#define BANDS_PER_THREAD   4
+#define DEFAULT_MIN_PIXELS (512 * 512)
+
+/* Fills of at least this many bytes bypass the cache. They are too large
+ * to stay in it anyway, and writing them through it would evict whatever
+ * the program is about to draw with.
+ */
+#define STREAM_MIN_BYTES   (16 << 20)
 
 
 typedef struct {
@@ -27,6 +49,86 @@ typedef struct {
 } float4;
 
 
+/* Large fills are split into bands of rows, which are drawn by the worker
+ * threads as well as by the calling thread.
+ */
+typedef struct FILL_BANDS {
+   void (*proc)(void *arg, int y1, int y2);
+   void *arg;
+   ALLEGRO_STATE state;
+   int y1, y2;
+   int band_rows;
+} FILL_BANDS;
+
+
+static int fill_min_pixels = DEFAULT_MIN_PIXELS;
+
+
+
+static bool fill_band(void *arg, int band)
+{
+   FILL_BANDS *bands = arg;
+   int y1 = bands->y1 + band * bands->band_rows;
+   int y2 = _ALLEGRO_MIN(y1 + bands->band_rows, bands->y2);
+
+   /* The scanline drawers read the blender of the calling thread. */
+   al_restore_state(&bands->state);
+   bands->proc(bands->arg, y1, y2);
+   return true;
+}
+
+
+
+/* This is called in al_install_system. */
+void _al_init_fill_bands(void)
+{
+   ALLEGRO_CONFIG *config = al_get_system_config();
+   const char *value;
+
+   fill_min_pixels = DEFAULT_MIN_PIXELS;
+   value = config ? al_get_config_value(config, "graphics", "fill_threads_min_pixels") : NULL;
+   if (value)
+      fill_min_pixels = atoi(value);
+}
+
+
+
+/* _al_fill_bands:
+ *  Calls proc for the rows y1 to y2 (exclusive). If the rows are at least
+ *  width pixels wide on average and there are enough of them, they are
+ *  split into bands and proc is called for each band, on the worker threads
+ *  as well as this one. The bands must be independent of each other.
+ */
+void _al_fill_bands(int y1, int y2, int width,
+   void (*proc)(void *arg, int y1, int y2), void *arg)
+{
+   const int threads = _al_get_parallel_threads();
+   int rows = y2 - y1;
+   FILL_BANDS bands;
+
+   if (rows <= 0)
+      return;
+
+   if (threads < 2 || rows < 2 * MIN_BAND_ROWS ||
+         (double)rows * width < fill_min_pixels) {
+      proc(arg, y1, y2);
+      return;
+   }
+
+   bands.proc = proc;
+   bands.arg = arg;
+   al_store_state(&bands.state, ALLEGRO_STATE_BLENDER);
+   bands.y1 = y1;
+   bands.y2 = y2;
+   bands.band_rows = rows / (threads * BANDS_PER_THREAD);
+   if (bands.band_rows < MIN_BAND_ROWS)
+      bands.band_rows = MIN_BAND_ROWS;
+
+   _al_run_parallel(fill_band, &bands,
+      (rows + bands.band_rows - 1) / bands.band_rows);
+}
+
+
 void _al_draw_pixel_memory(ALLEGRO_BITMAP *bitmap, float x, float y,
    ALLEGRO_COLOR *color)
 {
@@ -43,59 +145,48 @@ void _al_draw_pixel_memory(ALLEGRO_BITMAP *bitmap, float x, float y,
 }
 
 
-/* Coordinates are inclusive full-pixel positions. So (0, 0, 0, 0) draws a
- * single pixel at 0/0.
- */
-static void _al_draw_filled_rectangle_memory_fast(int x1, int y1, int x2, int y2,
-   ALLEGRO_COLOR *color)
-{
-   ALLEGRO_BITMAP *bitmap;
-   ALLEGRO_LOCKED_REGION *lr;
-   int w, h;
-   int tmp;
-   int x, y;
-   unsigned char *line_ptr;
+typedef struct FILL_RECT {
+   unsigned char *data;    /* first row */
+   int pitch;
+   int pixel_size;
+   int w;
+   int pixel_value;
+   float4 pixel_value4;
+   bool stream;
+} FILL_RECT;
 
-   bitmap = al_get_target_bitmap();
 
-   /* Make sure it's top left first */
-   if (x1 > x2) {
-      tmp = x1;
-      x1 = x2;
-      x2 = tmp;
-   }
-   if (y1 > y2) {
-      tmp = y1;
-      y1 = y2;
-      y2 = tmp;
-   }
 
-   /* Do clipping */
-   if (x1 < bitmap->cl) x1 = bitmap->cl;
-   if (y1 < bitmap->ct) y1 = bitmap->ct;
-   if (x2 > bitmap->cr_excl - 1) x2 = bitmap->cr_excl - 1;
-   if (y2 > bitmap->cb_excl - 1) y2 = bitmap->cb_excl - 1;
+#ifdef STREAM_FILL
+static void stream_fill32(uint32_t *data, int w, uint32_t pixel_value)
+{
+   __m128i v = _mm_set1_epi32((int)pixel_value);
 
-   w = (x2 - x1) + 1;
-   h = (y2 - y1) + 1;
+   for (; w > 0 && ((uintptr_t)data & 15); w--)
+      *data++ = pixel_value;
+   for (; w >= 4; w -= 4, data += 4)
+      _mm_stream_si128((__m128i *)data, v);
+   for (; w > 0; w--)
+      *data++ = pixel_value;
+}
+#endif
 
-   if (w <= 0 || h <= 0)
-      return;
 
-   /* XXX what about pre-locked bitmaps? */
-   lr = al_lock_bitmap_region(bitmap, x1, y1, w, h, ALLEGRO_PIXEL_FORMAT_ANY, 0);
-   if (!lr)
-      return;
 
-   /* Write a single pixel so we can get the raw value. */
-   _al_put_pixel(bitmap, x1, y1, *color);
+/* Fills the rows y1 to y2 (exclusive), counted from the top of the
+ * rectangle.
+ */
+static void fill_rect_rows(void *arg, int y1, int y2)
+{
+   FILL_RECT *f = arg;
+   unsigned char *line_ptr = f->data + y1 * f->pitch;
+   int w = f->w;
+   int x, y;
 
-   /* Fill in the region. */
-   line_ptr = lr->data;
-   switch (lr->pixel_size) {
+   switch (f->pixel_size) {
       case 2: {
-         int pixel_value = bmp_read16(line_ptr);
-         for (y = y1; y < y1 + h; y++) {
+         int pixel_value = f->pixel_value;
+         for (y = y1; y < y2; y++) {
             if (pixel_value == 0) {    /* fast path */
                memset(line_ptr, 0, 2 * w);
             }
@@ -106,14 +197,14 @@ static void _al_draw_filled_rectangle_memory_fast(int x1, int y1, int x2, int y2
                   data++;
                }
             }
-            line_ptr += lr->pitch;
+            line_ptr += f->pitch;
          }
          break;
       }
 
       case 3: {
-         int pixel_value = READ3BYTES(line_ptr);
-         for (y = y1; y < y1 + h; y++) {
+         int pixel_value = f->pixel_value;
+         for (y = y1; y < y2; y++) {
             unsigned char *data = (unsigned char *)line_ptr;
             if (pixel_value == 0) {    /* fast path */
                memset(data, 0, 3 * w);
@@ -124,14 +215,24 @@ static void _al_draw_filled_rectangle_memory_fast(int x1, int y1, int x2, int y2
                   data += 3;
                }
             }
-            line_ptr += lr->pitch;
+            line_ptr += f->pitch;
          }
          break;
       }
 
       case 4: {
-         int pixel_value = bmp_read32(line_ptr);
-         for (y = y1; y < y1 + h; y++) {
+         int pixel_value = f->pixel_value;
+#ifdef STREAM_FILL
+         if (f->stream) {
+            for (y = y1; y < y2; y++) {
+               stream_fill32((uint32_t *)line_ptr, w, pixel_value);
+               line_ptr += f->pitch;
+            }
+            _mm_sfence();
+            break;
+         }
+#endif
+         for (y = y1; y < y2; y++) {
             uint32_t *data = (uint32_t *)line_ptr;
             /* Special casing pixel_value == 0 doesn't seem to make any
              * difference to speed, so don't bother.
@@ -140,22 +241,20 @@ static void _al_draw_filled_rectangle_memory_fast(int x1, int y1, int x2, int y2
                bmp_write32(data, pixel_value);
                data++;
             }
-            line_ptr += lr->pitch;
+            line_ptr += f->pitch;
          }
          break;
       }
 
       case sizeof(float4): {
-         float4 *data = (float4 *)line_ptr;
-         float4 pixel_value = *data;
-
-         for (y = y1; y < y1 + h; y++) {
-            data = (float4 *)line_ptr;
+         float4 pixel_value = f->pixel_value4;
+         for (y = y1; y < y2; y++) {
+            float4 *data = (float4 *)line_ptr;
             for (x = 0; x < w; x++) {
                *data = pixel_value;
                data++;
             }
-            line_ptr += lr->pitch;
+            line_ptr += f->pitch;
          }
          break;
       }
@@ -164,6 +263,79 @@ static void _al_draw_filled_rectangle_memory_fast(int x1, int y1, int x2, int y2
         ASSERT(false);
         break;
    }
+}
+
+
+
+/* Coordinates are inclusive full-pixel positions. So (0, 0, 0, 0) draws a
+ * single pixel at 0/0.
+ */
+static void _al_draw_filled_rectangle_memory_fast(int x1, int y1, int x2, int y2,
+   ALLEGRO_COLOR *color)
+{
+   ALLEGRO_BITMAP *bitmap;
+   ALLEGRO_LOCKED_REGION *lr;
+   FILL_RECT f;
+   int w, h;
+   int tmp;
+
+   bitmap = al_get_target_bitmap();
+
+   /* Make sure it's top left first */
+   if (x1 > x2) {
+      tmp = x1;
+      x1 = x2;
+      x2 = tmp;
+   }
+   if (y1 > y2) {
+      tmp = y1;
+      y1 = y2;
+      y2 = tmp;
+   }
+
+   /* Do clipping */
+   if (x1 < bitmap->cl) x1 = bitmap->cl;
+   if (y1 < bitmap->ct) y1 = bitmap->ct;
+   if (x2 > bitmap->cr_excl - 1) x2 = bitmap->cr_excl - 1;
+   if (y2 > bitmap->cb_excl - 1) y2 = bitmap->cb_excl - 1;
+
+   w = (x2 - x1) + 1;
+   h = (y2 - y1) + 1;
+
+   if (w <= 0 || h <= 0)
+      return;
+
+   /* XXX what about pre-locked bitmaps? */
+   lr = al_lock_bitmap_region(bitmap, x1, y1, w, h, ALLEGRO_PIXEL_FORMAT_ANY, 0);
+   if (!lr)
+      return;
+
+   /* Write a single pixel so we can get the raw value. */
+   _al_put_pixel(bitmap, x1, y1, *color);
+
+   f.data = lr->data;
+   f.pitch = lr->pitch;
+   f.pixel_size = lr->pixel_size;
+   f.w = w;
+   f.pixel_value = 0;
+   switch (lr->pixel_size) {
+      case 2:
+         f.pixel_value = bmp_read16(f.data);
+         break;
+      case 3:
+         f.pixel_value = READ3BYTES(f.data);
+         break;
+      case 4:
+         f.pixel_value = bmp_read32(f.data);
+         break;
+      case sizeof(float4):
+         f.pixel_value4 = *(float4 *)f.data;
+         break;
+   }
+   f.stream = ((double)w * h * lr->pixel_size >= STREAM_MIN_BYTES);
+
+   /* Fill in the region. */
+   _al_fill_bands(0, h, w, fill_rect_rows, &f);
 
    al_unlock_bitmap(bitmap);
 }
@@ -0,0 +1,245 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Worker threads for splitting internal work into parallel jobs.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_system.h"
+
+ALLEGRO_DEBUG_CHANNEL("system")
+
+#define MAX_PARALLEL_THREADS  8
+
+
+/* The workers are started by the first call with more than one job and
+ * then sleep on work_cond between calls. Only one call uses them at a
+ * time; a call from another thread meanwhile, or from one of the jobs,
+ * runs its jobs on the calling thread alone.
+ */
+static struct {
+   ALLEGRO_MUTEX *mutex;
+   ALLEGRO_COND *work_cond;
+   ALLEGRO_COND *done_cond;
+   ALLEGRO_THREAD *threads[MAX_PARALLEL_THREADS];
+   int max_threads;        /* including the calling thread */
+   int num_workers;
+   bool started;
+   bool busy;
+   bool quit;
+
+   /* The current call. */
+   unsigned generation;
+   bool (*proc)(void *arg, int job);
+   void *arg;
+   int num_jobs;
+   int next_job;
+   int jobs_done;
+   bool error;
+} pool;
+
+
+
+/* Called with the mutex held, returns with it held. */
+static void run_jobs(void)
+{
+   while (pool.next_job < pool.num_jobs) {
+      bool (*proc)(void *arg, int job) = pool.proc;
+      void *arg = pool.arg;
+      int job = pool.next_job++;
+      bool ok;
+
+      al_unlock_mutex(pool.mutex);
+      ok = proc(arg, job);
+      al_lock_mutex(pool.mutex);
+
+      if (!ok)
+         pool.error = true;
+      if (++pool.jobs_done == pool.num_jobs)
+         al_broadcast_cond(pool.done_cond);
+   }
+}
+
+
+
+static void *parallel_worker(ALLEGRO_THREAD *thread, void *arg)
+{
+   unsigned generation = 0;
+   (void)thread;
+   (void)arg;
+
+   al_lock_mutex(pool.mutex);
+   for (;;) {
+      while (!pool.quit && pool.generation == generation)
+         al_wait_cond(pool.work_cond, pool.mutex);
+      if (pool.quit)
+         break;
+      generation = pool.generation;
+      run_jobs();
+   }
+   al_unlock_mutex(pool.mutex);
+
+   return NULL;
+}
+
+
+
+/* Called with the mutex held. */
+static bool start_workers(void)
+{
+   int i;
+
+   if (!pool.started) {
+      pool.started = true;
+      for (i = 0; i < pool.max_threads - 1; i++) {
+         pool.threads[i] = al_create_thread(parallel_worker, NULL);
+         if (!pool.threads[i])
+            break;
+         al_start_thread(pool.threads[i]);
+      }
+      pool.num_workers = i;
+      ALLEGRO_DEBUG("Started %d worker threads.\n", i);
+   }
+
+   return pool.num_workers > 0;
+}
+
+
+
+static void shutdown_parallel(void)
+{
+   int i;
+
+   if (pool.mutex) {
+      al_lock_mutex(pool.mutex);
+      pool.quit = true;
+      al_broadcast_cond(pool.work_cond);
+      al_unlock_mutex(pool.mutex);
+
+      for (i = 0; i < pool.num_workers; i++)
+         al_destroy_thread(pool.threads[i]);
+   }
+
+   if (pool.done_cond)
+      al_destroy_cond(pool.done_cond);
+   if (pool.work_cond)
+      al_destroy_cond(pool.work_cond);
+   if (pool.mutex)
+      al_destroy_mutex(pool.mutex);
+   memset(&pool, 0, sizeof(pool));
+}
+
+
+
+/* _al_init_parallel:
+ *  Called in al_install_system. Reads the number of threads to use from
+ *  "[graphics] worker_threads".
+ */
+void _al_init_parallel(void)
+{
+   ALLEGRO_CONFIG *config = al_get_system_config();
+   const char *value;
+
+   memset(&pool, 0, sizeof(pool));
+
+   pool.max_threads = _al_get_num_cpus();
+   value = config ? al_get_config_value(config, "graphics", "worker_threads") : NULL;
+   if (value)
+      pool.max_threads = atoi(value);
+   if (pool.max_threads > MAX_PARALLEL_THREADS)
+      pool.max_threads = MAX_PARALLEL_THREADS;
+
+   if (pool.max_threads < 2)
+      return;
+
+   pool.mutex = al_create_mutex();
+   pool.work_cond = al_create_cond();
+   pool.done_cond = al_create_cond();
+   if (!pool.mutex || !pool.work_cond || !pool.done_cond) {
+      shutdown_parallel();
+      return;
+   }
+
+   _al_add_exit_func(shutdown_parallel, "shutdown_parallel");
+}
+
+
+
+/* _al_get_parallel_threads:
+ *  Returns how many threads, including the calling one, _al_run_parallel
+ *  may spread jobs over.
+ */
+int _al_get_parallel_threads(void)
+{
+   return pool.mutex ? pool.max_threads : 1;
+}
+
+
+
+/* _al_run_parallel:
+ *  Calls proc for each job number from 0 to num_jobs - 1, on the worker
+ *  threads as well as the calling thread, and returns when all are done.
+ *  The jobs must be independent of each other and must not rely on the
+ *  state of the calling thread. Returns false if any call failed.
+ *
+ *  If the workers are not available the jobs run in order on the calling
+ *  thread, stopping at the first failure.
+ */
+bool _al_run_parallel(bool (*proc)(void *arg, int job), void *arg,
+   int num_jobs)
+{
+   bool ok;
+   int i;
+
+   if (num_jobs <= 0)
+      return true;
+
+   if (pool.mutex && num_jobs > 1) {
+      al_lock_mutex(pool.mutex);
+      if (!pool.busy && start_workers()) {
+         pool.busy = true;
+         pool.proc = proc;
+         pool.arg = arg;
+         pool.num_jobs = num_jobs;
+         pool.next_job = 0;
+         pool.jobs_done = 0;
+         pool.error = false;
+         pool.generation++;
+         al_broadcast_cond(pool.work_cond);
+
+         run_jobs();
+         while (pool.jobs_done < pool.num_jobs)
+            al_wait_cond(pool.done_cond, pool.mutex);
+
+         ok = !pool.error;
+         pool.busy = false;
+         al_unlock_mutex(pool.mutex);
+         return ok;
+      }
+      al_unlock_mutex(pool.mutex);
+   }
+
+   for (i = 0; i < num_jobs; i++) {
+      if (!proc(arg, i))
+         return false;
+   }
+   return true;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -65,6 +65,9 @@ ALLEGRO_SHADER *al_create_shader(ALLEGRO_SHADER_PLATFORM platform)
       shader = _al_create_shader_hlsl(platform);
    }
 #endif
+   else if (platform == ALLEGRO_SHADER_SOFTWARE) {
+      shader = _al_create_shader_soft(platform);
+   }
 
    if (shader) {
       ASSERT(shader->platform);
@@ -156,8 +159,13 @@ bool al_use_shader(ALLEGRO_SHADER *shader)
       return false;
    }
    if (bmp->flags & ALLEGRO_MEMORY_BITMAP) {
-      ALLEGRO_WARN("Target bitmap is memory bitmap.\n");
-      return false;
+      /* Memory bitmaps are only drawn to by the software rasteriser. */
+      if (shader && shader->platform != ALLEGRO_SHADER_SOFTWARE) {
+         ALLEGRO_WARN("Target bitmap is memory bitmap.\n");
+         return false;
+      }
+      _al_set_bitmap_shader_field(bmp, shader);
+      return true;
    }
    ASSERT(bmp->display);
 
@@ -402,6 +410,9 @@ char const *al_get_default_shader_source(ALLEGRO_SHADER_PLATFORM platform,
 #endif
          break;
 
+      case ALLEGRO_SHADER_SOFTWARE:
+         break;
+
       case ALLEGRO_SHADER_AUTO:
          ASSERT(0);
    }
@@ -0,0 +1,266 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Software shader support.
+ *
+ *      See LICENSE.txt for copyright information.
+ */
+
+
+#include "allegro5/allegro.h"
+#include "allegro5/internal/aintern.h"
+#include "allegro5/internal/aintern_bitmap.h"
+#include "allegro5/internal/aintern_shader.h"
+
+ALLEGRO_DEBUG_CHANNEL("shader")
+
+#define DEFAULT_SPAN_LENGTH   64
+#define MAX_SPAN_LENGTH       256   /* PROGRAM_SPAN_MAX in tri_soft.c */
+
+
+typedef struct ALLEGRO_SHADER_SOFT_S ALLEGRO_SHADER_SOFT_S;
+
+struct ALLEGRO_SHADER_SOFT_S
+{
+   ALLEGRO_SHADER shader;
+   void (*callback)(ALLEGRO_SHADER_SPAN *span, void *user_data);
+   void *user_data;
+   int max_length;
+};
+
+
+static struct ALLEGRO_SHADER_INTERFACE shader_soft_vt;
+
+
+ALLEGRO_SHADER *_al_create_shader_soft(ALLEGRO_SHADER_PLATFORM platform)
+{
+   ALLEGRO_SHADER_SOFT_S *shader = al_calloc(1, sizeof(ALLEGRO_SHADER_SOFT_S));
+
+   if (!shader)
+      return NULL;
+
+   shader->shader.platform = platform;
+   shader->shader.vt = &shader_soft_vt;
+   shader->max_length = DEFAULT_SPAN_LENGTH;
+   _al_vector_init(&shader->shader.bitmaps, sizeof(ALLEGRO_BITMAP *));
+
+   return (ALLEGRO_SHADER *)shader;
+}
+
+
+static void set_log(ALLEGRO_SHADER *shader, const char *msg)
+{
+   al_ustr_free(shader->log);
+   shader->log = al_ustr_new(msg);
+}
+
+static bool soft_attach_shader_source(ALLEGRO_SHADER *shader,
+   ALLEGRO_SHADER_TYPE type, const char *source)
+{
+   (void)type;
+
+   if (!source)
+      return true;
+
+   set_log(shader,
+      "Software shaders have no source, use al_set_shader_span_callback");
+   return false;
+}
+
+static bool soft_build_shader(ALLEGRO_SHADER *shader)
+{
+   ALLEGRO_SHADER_SOFT_S *soft = (ALLEGRO_SHADER_SOFT_S *)shader;
+
+   if (!soft->callback) {
+      set_log(shader, "No span callback set");
+      return false;
+   }
+   return true;
+}
+
+static bool soft_use_shader(ALLEGRO_SHADER *shader, ALLEGRO_DISPLAY *display,
+   bool set_projview_matrix_from_display)
+{
+   (void)shader;
+   (void)display;
+   (void)set_projview_matrix_from_display;
+
+   ALLEGRO_WARN("Software shaders only work with memory bitmaps.\n");
+   return false;
+}
+
+static void soft_unuse_shader(ALLEGRO_SHADER *shader, ALLEGRO_DISPLAY *display)
+{
+   (void)shader;
+   (void)display;
+}
+
+static void soft_destroy_shader(ALLEGRO_SHADER *shader)
+{
+   al_free(shader);
+}
+
+/* The callback is given its parameters through the user data, so there
+ * are no named variables to set.
+ */
+static bool soft_set_shader_sampler(ALLEGRO_SHADER *shader,
+   const char *name, ALLEGRO_BITMAP *bitmap, int unit)
+{
+   (void)shader;
+   (void)name;
+   (void)bitmap;
+   (void)unit;
+   return false;
+}
+
+static bool soft_set_shader_matrix(ALLEGRO_SHADER *shader,
+   const char *name, ALLEGRO_TRANSFORM *matrix)
+{
+   (void)shader;
+   (void)name;
+   (void)matrix;
+   return false;
+}
+
+static bool soft_set_shader_int(ALLEGRO_SHADER *shader,
+   const char *name, int i)
+{
+   (void)shader;
+   (void)name;
+   (void)i;
+   return false;
+}
+
+static bool soft_set_shader_float(ALLEGRO_SHADER *shader,
+   const char *name, float f)
+{
+   (void)shader;
+   (void)name;
+   (void)f;
+   return false;
+}
+
+static bool soft_set_shader_int_vector(ALLEGRO_SHADER *shader,
+   const char *name, int elem_size, int *i, int num_elems)
+{
+   (void)shader;
+   (void)name;
+   (void)elem_size;
+   (void)i;
+   (void)num_elems;
+   return false;
+}
+
+static bool soft_set_shader_float_vector(ALLEGRO_SHADER *shader,
+   const char *name, int elem_size, float *f, int num_elems)
+{
+   (void)shader;
+   (void)name;
+   (void)elem_size;
+   (void)f;
+   (void)num_elems;
+   return false;
+}
+
+static bool soft_set_shader_bool(ALLEGRO_SHADER *shader,
+   const char *name, bool b)
+{
+   (void)shader;
+   (void)name;
+   (void)b;
+   return false;
+}
+
+static struct ALLEGRO_SHADER_INTERFACE shader_soft_vt =
+{
+   soft_attach_shader_source,
+   soft_build_shader,
+   soft_use_shader,
+   soft_unuse_shader,
+   soft_destroy_shader,
+   NULL, /* on_lost_device */
+   NULL, /* on_reset_device */
+   soft_set_shader_sampler,
+   soft_set_shader_matrix,
+   soft_set_shader_int,
+   soft_set_shader_float,
+   soft_set_shader_int_vector,
+   soft_set_shader_float_vector,
+   soft_set_shader_bool
+};
+
+
+/* _al_get_soft_shader:
+ *  Returns the software shader used when drawing to the bitmap, or NULL.
+ */
+ALLEGRO_SHADER *_al_get_soft_shader(ALLEGRO_BITMAP *target)
+{
+   ALLEGRO_SHADER *shader;
+
+   if (!target)
+      return NULL;
+   shader = target->shader;
+   if (!shader || shader->platform != ALLEGRO_SHADER_SOFTWARE)
+      return NULL;
+   if (!((ALLEGRO_SHADER_SOFT_S *)shader)->callback)
+      return NULL;
+   return shader;
+}
+
+
+/* _al_get_soft_shader_span_length:
+ *  Returns the most pixels the callback wants to be given at once, a
+ *  multiple of 8.
+ */
+int _al_get_soft_shader_span_length(ALLEGRO_SHADER *shader)
+{
+   return ((ALLEGRO_SHADER_SOFT_S *)shader)->max_length;
+}
+
+
+/* _al_run_soft_shader:
+ *  Calls the span callback. This can happen on several threads at once.
+ */
+void _al_run_soft_shader(ALLEGRO_SHADER *shader, ALLEGRO_SHADER_SPAN *span)
+{
+   ALLEGRO_SHADER_SOFT_S *soft = (ALLEGRO_SHADER_SOFT_S *)shader;
+
+   soft->callback(span, soft->user_data);
+}
+
+
+/* Function: al_set_shader_span_callback
+ */
+bool al_set_shader_span_callback(ALLEGRO_SHADER *shader,
+   void (*callback)(ALLEGRO_SHADER_SPAN *span, void *user_data),
+   void *user_data, int max_length)
+{
+   ALLEGRO_SHADER_SOFT_S *soft = (ALLEGRO_SHADER_SOFT_S *)shader;
+   ASSERT(shader);
+
+   if (shader->platform != ALLEGRO_SHADER_SOFTWARE) {
+      ALLEGRO_WARN("Not a software shader.\n");
+      return false;
+   }
+
+   if (max_length <= 0)
+      max_length = DEFAULT_SPAN_LENGTH;
+   max_length = (max_length + 7) & ~7;
+   if (max_length > MAX_SPAN_LENGTH)
+      max_length = MAX_SPAN_LENGTH;
+
+   soft->callback = callback;
+   soft->user_data = user_data;
+   soft->max_length = max_length;
+   return true;
+}
+
+
+/* vim: set sts=3 sw=3 et: */
@@ -25,6 +25,7 @@
 #include "allegro5/internal/aintern_debug.h"
 #include "allegro5/internal/aintern_dtor.h"
 #include "allegro5/internal/aintern_exitfunc.h"
+#include "allegro5/internal/aintern_memdraw.h"
 #include "allegro5/internal/aintern_pixels.h"
 #include "allegro5/internal/aintern_system.h"
 #include "allegro5/internal/aintern_thread.h"
@@ -32,6 +33,10 @@
 #include "allegro5/internal/aintern_tls.h"
 #include "allegro5/internal/aintern_vector.h"
 
+#ifdef ALLEGRO_HAVE_SYSCONF
+   #include <unistd.h>
+#endif
+
 ALLEGRO_DEBUG_CHANNEL("system")
 
 static ALLEGRO_SYSTEM *active_sysdrv = NULL;
@@ -269,6 +274,10 @@ bool al_install_system(int version, int (*atexit_ptr)(void (*)(void)))
    
    _al_init_convert_bitmap_list();
 
+   _al_init_parallel();
+
+   _al_init_fill_bands();
+
    _al_init_timers();
 
    if (atexit_ptr && atexit_virgin) {
@@ -461,4 +470,23 @@ void _al_close_library(void *library)
       active_sysdrv->vt->close_library(library);
 }
 
+
+/* _al_get_num_cpus:
+ *  Returns the number of processors available, or 1 if unknown.
+ */
+int _al_get_num_cpus(void)
+{
+#if defined(ALLEGRO_HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+   if (n > 0)
+      return n;
+#elif defined(ALLEGRO_WINDOWS)
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   if (info.dwNumberOfProcessors > 0)
+      return info.dwNumberOfProcessors;
+#endif
+   return 1;
+}
+
 /* vim: set sts=3 sw=3 et: */
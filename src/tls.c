@@ -87,6 +87,10 @@ typedef struct thread_local_state {
    int new_bitmap_format;
    int new_bitmap_flags;
 
+   /* Maximum size requested by al_load_bitmap_scaled */
+   int load_max_width;
+   int load_max_height;
+
    /* Files */
    const ALLEGRO_FILE_INTERFACE *new_file_interface;
    const ALLEGRO_FS_INTERFACE *fs_interface;
@@ -853,4 +857,30 @@ int *_al_tls_get_dtor_owner_count(void)
 
 
 
+void _al_set_bitmap_load_size_hint(int max_w, int max_h)
+{
+   thread_local_state *tls;
+
+   if ((tls = tls_get()) == NULL)
+      return;
+   tls->load_max_width = max_w;
+   tls->load_max_height = max_h;
+}
+
+
+
+void _al_get_bitmap_load_size_hint(int *max_w, int *max_h)
+{
+   thread_local_state *tls;
+
+   if ((tls = tls_get()) == NULL) {
+      *max_w = *max_h = 0;
+      return;
+   }
+   *max_w = tls->load_max_width;
+   *max_h = tls->load_max_height;
+}
+
+
+
 /* vim: set sts=3 sw=3 et: */
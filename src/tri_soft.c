@@ -21,8 +21,11 @@
 #include "allegro5/internal/aintern.h"
 #include "allegro5/internal/aintern_bitmap.h"
 #include "allegro5/internal/aintern_blend.h"
+#include "allegro5/internal/aintern_memdraw.h"
 #include "allegro5/internal/aintern_pixels.h"
+#include "allegro5/internal/aintern_shader.h"
 #include "allegro5/internal/aintern_tri_soft.h"
+#include <limits.h>
 #include <math.h>
 
 ALLEGRO_DEBUG_CHANNEL("tri_soft")
@@ -404,13 +407,145 @@ static void shader_texture_grad_any_step(uintptr_t state, int minor)
 }
 
 
+/*
+The *_draw_program routines collect the shaded pixels of a scanline into
+spans and pass them to the software shader of the target, which replaces
+the colors. The spans are then blended like the ones of the *_draw_shade
+routines. The arrays given to the callback are 32 byte aligned and padded
+with zeroes to a multiple of 8 pixels.
+*/
+#define PROGRAM_SPAN_MAX 256
+
+typedef struct {
+   ALLEGRO_SHADER_SPAN span;
+   ALLEGRO_SHADER *shader;
+   int max_length;
+   int format;
+   uint8_t *dst;
+   float *u, *v;
+   bool blend;
+   int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
+   float storage[6 * PROGRAM_SPAN_MAX + 8];
+} program_span;
+
+/*
+drawn_target is the bitmap being drawn to, target the one which is locked,
+x and y are relative to its locked region.
+*/
+static void program_span_init(program_span *p, ALLEGRO_BITMAP *drawn_target,
+   ALLEGRO_BITMAP *target, ALLEGRO_BITMAP *texture, int format,
+   uint8_t *dst, int x, int y)
+{
+   int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
+   float *base = (float *)(((uintptr_t)p->storage + 31) & ~(uintptr_t)31);
+
+   p->shader = _al_get_soft_shader(drawn_target);
+   ASSERT(p->shader);
+   p->max_length = _al_get_soft_shader_span_length(p->shader);
+   ASSERT(p->max_length <= PROGRAM_SPAN_MAX);
+   p->format = format;
+   p->dst = dst;
+
+   p->span.x = x + target->lock_x;
+   p->span.y = y + target->lock_y;
+   if (target != drawn_target) {
+      p->span.x -= drawn_target->xofs;
+      p->span.y -= drawn_target->yofs;
+   }
+   p->span.length = 0;
+   p->span.r = base;
+   p->span.g = base + p->max_length;
+   p->span.b = base + 2 * p->max_length;
+   p->span.a = base + 3 * p->max_length;
+   p->u = base + 4 * p->max_length;
+   p->v = base + 5 * p->max_length;
+   p->span.u = p->u;
+   p->span.v = p->v;
+   p->span.texture = texture;
+
+   al_get_separate_blender(&op, &src_mode, &dst_mode,
+      &op_alpha, &src_alpha, &dst_alpha);
+   p->blend = !(_AL_DEST_IS_ZERO && _AL_SRC_NOT_MODIFIED);
+   p->op = op;
+   p->src_mode = src_mode;
+   p->dst_mode = dst_mode;
+   p->op_alpha = op_alpha;
+   p->src_alpha = src_alpha;
+   p->dst_alpha = dst_alpha;
+}
+
+static void program_span_flush(program_span *p)
+{
+   ALLEGRO_SHADER_SPAN *span = &p->span;
+   const int n = span->length;
+   const int format = p->format;
+   uint8_t *dst = p->dst;
+   int i;
+
+   if (n == 0)
+      return;
+
+   for (i = n; i & 7; i++) {
+      span->r[i] = span->g[i] = span->b[i] = span->a[i] = 0;
+      p->u[i] = p->v[i] = 0;
+   }
+
+   _al_run_soft_shader(p->shader, span);
+
+   for (i = 0; i < n; i++) {
+      ALLEGRO_COLOR src_color;
+      src_color.r = _ALLEGRO_CLAMP(0.0f, span->r[i], 1.0f);
+      src_color.g = _ALLEGRO_CLAMP(0.0f, span->g[i], 1.0f);
+      src_color.b = _ALLEGRO_CLAMP(0.0f, span->b[i], 1.0f);
+      src_color.a = _ALLEGRO_CLAMP(0.0f, span->a[i], 1.0f);
+
+      if (p->blend) {
+         ALLEGRO_COLOR dst_color;
+         ALLEGRO_COLOR result;
+         _AL_INLINE_GET_PIXEL(format, dst, dst_color, false);
+         _al_blend_inline(&src_color, &dst_color, p->op, p->src_mode,
+            p->dst_mode, p->op_alpha, p->src_alpha, p->dst_alpha, &result);
+         _AL_INLINE_PUT_PIXEL(format, dst, result, true);
+      }
+      else {
+         _AL_INLINE_PUT_PIXEL(format, dst, src_color, true);
+      }
+   }
+
+   p->dst = dst;
+   span->x += n;
+   span->length = 0;
+}
+
+static _AL_ALWAYS_INLINE void program_span_put(program_span *p,
+   ALLEGRO_COLOR color, float u, float v)
+{
+   const int i = p->span.length++;
+
+   p->span.r[i] = color.r;
+   p->span.g[i] = color.g;
+   p->span.b[i] = color.b;
+   p->span.a[i] = color.a;
+   p->u[i] = u;
+   p->v[i] = v;
+
+   if (p->span.length == p->max_length)
+      program_span_flush(p);
+}
+
+
 /* Include generated routines. */
 #include "scanline_drawers.inc"
 
 
+/*
+Only the rows from min_y to max_y (exclusive) are drawn, the ones above are
+still stepped through. init may be NULL if the state is already initialized.
+*/
 static void triangle_stepper(uintptr_t state,
    shader_init init, shader_first first, shader_step step, shader_draw draw,
-   ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3)
+   ALLEGRO_VERTEX* vtx1, ALLEGRO_VERTEX* vtx2, ALLEGRO_VERTEX* vtx3,
+   int min_y, int max_y)
 {
    float Coords[6] = {vtx1->x - 0.5f, vtx1->y + 0.5f, vtx2->x - 0.5f, vtx2->y + 0.5f, vtx3->x - 0.5f, vtx3->y + 0.5f};
    float *V1 = Coords, *V2 = &Coords[2], *V3 = &Coords[4], *s;
@@ -464,6 +599,15 @@ static void triangle_stepper(uintptr_t state,
    if (cur_y == end_y)
       return;
 
+   /*
+   Stopping early at max_y is fine, since the second segment is skipped if
+   the first one reaches it
+   */
+   if (end_y > max_y)
+      end_y = max_y;
+   if (mid_y > end_y)
+      mid_y = end_y;
+
    /*
    As per definition, we take the ceiling
    */
@@ -487,7 +631,8 @@ static void triangle_stepper(uintptr_t state,
    else
       major_on_the_left = 0;
 
-   init(state, vtx1, vtx2, vtx3);
+   if (init)
+      init(state, vtx1, vtx2, vtx3);
 
    /*
    Do the first segment, if it exists
@@ -554,7 +699,7 @@ static void triangle_stepper(uintptr_t state,
 
          first(state, left_x, cur_y, left_step, left_step - 1);
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -590,7 +735,7 @@ static void triangle_stepper(uintptr_t state,
             right_x -= 1;
          }
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -644,7 +789,7 @@ static void triangle_stepper(uintptr_t state,
 
          first(state, left_x, cur_y, left_step, left_step - 1);
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -672,7 +817,7 @@ static void triangle_stepper(uintptr_t state,
             right_x -= 1;
          }
 
-         if (right_x >= left_x) {
+         if (right_x >= left_x && cur_y >= min_y) {
             draw(state, left_x, cur_y, right_x);
          }
 
@@ -683,6 +828,43 @@ static void triangle_stepper(uintptr_t state,
    }
 }
 
+/*
+Large triangles are drawn in bands of rows on several threads. Each band
+steps through the triangle from the top with its own copy of the shader
+state, and only draws its own rows.
+*/
+typedef struct {
+   ALLEGRO_VERTEX *v1, *v2, *v3;
+   uintptr_t state;
+   size_t state_size;
+   shader_first first;
+   shader_step step;
+   shader_draw draw;
+} triangle_bands;
+
+typedef union {
+   state_solid_any_2d solid;
+   state_grad_any_2d grad;
+   state_texture_solid_any_2d texture_solid;
+   state_texture_grad_any_2d texture_grad;
+} any_state;
+
+static void triangle_band(void *arg, int y1, int y2)
+{
+   triangle_bands *t = arg;
+   any_state state;
+
+   ASSERT(t->state_size <= sizeof(state));
+   memcpy(&state, (void *)t->state, t->state_size);
+   triangle_stepper((uintptr_t)&state, NULL, t->first, t->step, t->draw,
+      t->v1, t->v2, t->v3, y1, y2);
+}
+
+static void draw_soft_triangle(
+   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3,
+   uintptr_t state, size_t state_size,
+   shader_init init, shader_first first, shader_step step, shader_draw draw);
+
 /*
 This one will check to see what exactly we need to draw...
 I.e. this will call all of the actual renderers and set the appropriate callbacks
@@ -691,6 +873,7 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
 {
    int shade = 1;
    int grad = 1;
+   int program = 0;
    int op, src_mode, dst_mode, op_alpha, src_alpha, dst_alpha;
    ALLEGRO_COLOR v1c, v2c, v3c;
 
@@ -710,15 +893,39 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
       grad = 0;
    }
 
-   if (texture) {
+   if (_al_get_soft_shader(al_get_target_bitmap())) {
+      program = 1;
+   }
+
+   if (program) {
+      if (texture) {
+         if (grad) {
+            state_texture_grad_any_2d state;
+            state.solid.texture = texture;
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_program);
+         } else {
+            state_texture_solid_any_2d state;
+            state.texture = texture;
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_program);
+         }
+      } else {
+         if (grad) {
+            state_grad_any_2d state;
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_program);
+         } else {
+            state_solid_any_2d state;
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_program);
+         }
+      }
+   } else if (texture) {
       if (grad) {
          state_texture_grad_any_2d state;
          state.solid.texture = texture;
 
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_shade);
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_opaque);
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_grad_any_init, shader_texture_grad_any_first, shader_texture_grad_any_step, shader_texture_grad_any_draw_opaque);
          }
       } else {
          int white = 0;
@@ -730,15 +937,15 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
          state.texture = texture;
          if (shade) {
             if (white) {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_white);
+               draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade_white);
             } else {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade);
+               draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_shade);
             }
          } else {
             if (white) {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque_white);
+               draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque_white);
             } else {
-               _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque);
+               draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_texture_solid_any_init, shader_texture_solid_any_first, shader_texture_solid_any_step, shader_texture_solid_any_draw_opaque);
             }
          }
       }
@@ -746,16 +953,16 @@ void _al_triangle_2d(ALLEGRO_BITMAP* texture, ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX
       if (grad) {
          state_grad_any_2d state;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_shade);
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_opaque);
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_grad_any_init, shader_grad_any_first, shader_grad_any_step, shader_grad_any_draw_opaque);
          }
       } else {
          state_solid_any_2d state;
          if (shade) {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_shade);
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_shade);
          } else {
-            _al_draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_opaque);
+            draw_soft_triangle(v1, v2, v3, (uintptr_t)&state, sizeof(state), shader_solid_any_init, shader_solid_any_first, shader_solid_any_step, shader_solid_any_draw_opaque);
          }
       }
    }
@@ -772,12 +979,14 @@ static int bitmap_region_is_locked(ALLEGRO_BITMAP* bmp, int x1, int y1, int w, i
    return 0;
 }
 
-void _al_draw_soft_triangle(
-   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3, uintptr_t state,
-   void (*init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
-   void (*first)(uintptr_t, int, int, int, int),
-   void (*step)(uintptr_t, int),
-   void (*draw)(uintptr_t, int, int, int))
+/*
+The state of the shaders of other modules has an unknown size, so they are
+never drawn in bands (state_size is 0).
+*/
+static void draw_soft_triangle(
+   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3,
+   uintptr_t state, size_t state_size,
+   shader_init init, shader_first first, shader_step step, shader_draw draw)
 {
    /*
    ALLEGRO_VERTEX copy_v1, copy_v2; <- may be needed for clipping later on
@@ -837,10 +1046,41 @@ void _al_draw_soft_triangle(
       need_unlock = 1;
    }
 
-   triangle_stepper(state, init, first, step, draw, v1, v2, v3);
+   if (state_size > 0) {
+      triangle_bands t;
+
+      /* The state is set up on this thread, which has the target bitmap. */
+      init(state, v1, v2, v3);
+
+      t.v1 = v1;
+      t.v2 = v2;
+      t.v3 = v3;
+      t.state = state;
+      t.state_size = state_size;
+      t.first = first;
+      t.step = step;
+      t.draw = draw;
+      /* The stepper counts rows from 1, see the drawers. */
+      _al_fill_bands(min_y + 1, max_y + 1, (max_x - min_x) / 2,
+         triangle_band, &t);
+   }
+   else {
+      triangle_stepper(state, init, first, step, draw, v1, v2, v3,
+         INT_MIN, INT_MAX);
+   }
 
    if (need_unlock)
       al_unlock_bitmap(target);
 }
 
+void _al_draw_soft_triangle(
+   ALLEGRO_VERTEX* v1, ALLEGRO_VERTEX* v2, ALLEGRO_VERTEX* v3, uintptr_t state,
+   void (*init)(uintptr_t, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*, ALLEGRO_VERTEX*),
+   void (*first)(uintptr_t, int, int, int, int),
+   void (*step)(uintptr_t, int),
+   void (*draw)(uintptr_t, int, int, int))
+{
+   draw_soft_triangle(v1, v2, v3, state, 0, init, first, step, draw);
+}
+
 /* vim: set sts=3 sw=3 et: */
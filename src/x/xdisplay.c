@@ -405,6 +405,10 @@ static ALLEGRO_DISPLAY_XGLX *xdpy_create_display_locked(
    vsync_setting = xdpy_swap_control(display, vsync_setting);
    display->extra_settings.settings[ALLEGRO_VSYNC] = vsync_setting;
 
+   display->extra_settings.settings[ALLEGRO_UPDATE_DISPLAY_REGION] =
+      !display->extra_settings.settings[ALLEGRO_SINGLE_BUFFER] &&
+      display->ogl_extras->extension_list->ALLEGRO_GLX_MESA_copy_sub_buffer;
+
    d->invisible_cursor = None; /* Will be created on demand. */
    d->current_cursor = None; /* Initially, we use the root cursor. */
    d->cursor_hidden = false;
@@ -710,11 +714,20 @@ static void xdpy_flip_display(ALLEGRO_DISPLAY *d)
 static void xdpy_update_display_region(ALLEGRO_DISPLAY *d, int x, int y,
    int w, int h)
 {
-   (void)x;
-   (void)y;
-   (void)w;
-   (void)h;
-   xdpy_flip_display(d);
+   ALLEGRO_SYSTEM_XGLX *system = (ALLEGRO_SYSTEM_XGLX *)al_get_system_driver();
+   ALLEGRO_DISPLAY_XGLX *glx = (ALLEGRO_DISPLAY_XGLX *)d;
+
+   if (!d->extra_settings.settings[ALLEGRO_UPDATE_DISPLAY_REGION]) {
+      xdpy_flip_display(d);
+      return;
+   }
+
+   /* Copies the region to the front buffer and leaves the back buffer
+    * as it is, so the rest of it can be kept for the next frame.
+    * GLX counts rows from the bottom.
+    */
+   glXCopySubBufferMESA(system->gfxdisplay, glx->glxwindow,
+      x, d->h - y - h, w, h);
 }
 
 
@@ -8,6 +8,7 @@
 #include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_color.h>
 #include <allegro5/allegro_image.h>
@@ -18,6 +19,7 @@
 #define MAX_BITMAPS  128
 #define MAX_TRANS    8
 #define MAX_FONTS    16
+#define MAX_STREAMS  4
 #define MAX_VERTICES 100
 #define MAX_POLYGONS 8
 
@@ -49,6 +51,16 @@ typedef struct {
    ALLEGRO_FONT   *font;
 } NamedFont;
 
+typedef struct {
+   ALLEGRO_USTR   *name;
+   ALLEGRO_BITMAP_STREAM *stream;
+} NamedStream;
+
+typedef struct {
+   float          f[6];
+   ALLEGRO_COLOR  color;
+} Shape;
+
 int               argc;
 char              **argv;
 ALLEGRO_DISPLAY   *display;
@@ -57,10 +69,16 @@ Bitmap            bitmaps[MAX_BITMAPS];
 LockRegion        lock_region;
 Transform         transforms[MAX_TRANS];
 NamedFont         fonts[MAX_FONTS];
+NamedStream       streams[MAX_STREAMS];
+ALLEGRO_SHADER    *span_shader;
 ALLEGRO_VERTEX    vertices[MAX_VERTICES];
 float             simple_vertices[2 * MAX_VERTICES];
 int               num_simple_vertices;
 int               vertex_counts[MAX_POLYGONS];
+int               indices[MAX_VERTICES];
+int               num_indices;
+Shape             shapes[MAX_VERTICES];
+int               num_shapes;
 int               num_global_bitmaps;
 float             delay = 0.0;
 bool              save_outputs = false;
@@ -148,6 +166,279 @@ static ALLEGRO_BITMAP *load_relative_bitmap(char const *filename, int flags)
    return bmp;
 }
 
+/* Loads count bitmaps with al_load_bitmaps_async, alternating between two
+ * files, and draws them in a grid of 160x120 cells by their index. All
+ * events must be queued once al_wait_for_bitmap_batch returns.
+ */
+static void load_bitmaps_async(char const *filename1, char const *filename2,
+   int count)
+{
+   char const *filenames[16];
+   bool seen[16];
+   ALLEGRO_EVENT_QUEUE *queue;
+   ALLEGRO_BITMAP_BATCH *batch;
+   ALLEGRO_EVENT event;
+   ALLEGRO_BITMAP *bmp;
+   int index;
+   int i;
+
+   if (count < 0 || count > 16)
+      error("bad async bitmap count %d", count);
+   for (i = 0; i < count; i++) {
+      filenames[i] = (i % 2) ? filename2 : filename1;
+      seen[i] = false;
+   }
+
+   queue = al_create_event_queue();
+   batch = al_load_bitmaps_async(filenames, count, 0, queue, NULL, NULL);
+   if (!batch)
+      error("failed to start loading bitmaps");
+   al_wait_for_bitmap_batch(batch);
+
+   for (i = 0; i < count; i++) {
+      if (!al_get_next_event(queue, &event))
+         error("only %d of %d bitmap events after waiting", i, count);
+      if (event.type != ALLEGRO_EVENT_BITMAP_LOADED)
+         error("unexpected event type %d", event.type);
+      index = event.user.data1;
+      bmp = (ALLEGRO_BITMAP *)event.user.data2;
+      if (index < 0 || index >= count || seen[index])
+         error("bad bitmap event index %d", index);
+      if (!bmp)
+         error("failed to load %s", filenames[index]);
+      seen[index] = true;
+      al_draw_scaled_bitmap(bmp, 0, 0,
+         al_get_bitmap_width(bmp), al_get_bitmap_height(bmp),
+         (index % 4) * 160, (index / 4) * 120, 160, 120, 0);
+      al_destroy_bitmap(bmp);
+      al_unref_user_event(&event.user);
+   }
+   if (!al_is_event_queue_empty(queue))
+      error("too many bitmap events");
+
+   al_destroy_bitmap_batch(batch);
+   al_destroy_event_queue(queue);
+}
+
+static unsigned char *flipped_pixels;
+
+static void free_pixels(void *pixels)
+{
+   al_free(pixels);
+}
+
+/* Flipped pixels are passed by their top row, which is not the start of
+ * the buffer.
+ */
+static void free_flipped_pixels(void *pixels)
+{
+   (void)pixels;
+   al_free(flipped_pixels);
+   flipped_pixels = NULL;
+}
+
+/* Copies the pixels of src into a buffer owned by a new bitmap, stored
+ * bottom row first if flipped so that the pitch is negative.
+ */
+static ALLEGRO_BITMAP *bitmap_from_pixels(ALLEGRO_BITMAP *src, bool flipped)
+{
+   const int w = al_get_bitmap_width(src);
+   const int h = al_get_bitmap_height(src);
+   const int format = al_get_bitmap_format(src);
+   const int row_size = w * al_get_pixel_size(format);
+   ALLEGRO_LOCKED_REGION *lr;
+   ALLEGRO_BITMAP *bmp;
+   unsigned char *pixels;
+   unsigned char *top;
+   int pitch;
+   int y;
+
+   if (flipped && flipped_pixels)
+      error("only one flipped bitmap at a time");
+   pixels = al_malloc(row_size * h);
+   if (!pixels)
+      error("out of memory");
+   if (flipped)
+      flipped_pixels = pixels;
+   top = flipped ? pixels + row_size * (h - 1) : pixels;
+   pitch = flipped ? -row_size : row_size;
+
+   lr = al_lock_bitmap(src, format, ALLEGRO_LOCK_READONLY);
+   if (!lr)
+      error("failed to lock bitmap");
+   for (y = 0; y < h; y++) {
+      memcpy(top + y * pitch, (char *)lr->data + y * lr->pitch, row_size);
+   }
+   al_unlock_bitmap(src);
+
+   bmp = al_create_bitmap_from_pixels(w, h, format, top, pitch,
+      flipped ? free_flipped_pixels : free_pixels);
+   if (!bmp)
+      error("failed to create bitmap from pixels");
+   return bmp;
+}
+
+/* Span callbacks for software shaders. */
+static void invert_span(ALLEGRO_SHADER_SPAN *span, void *user_data)
+{
+   int i;
+   (void)user_data;
+
+   for (i = 0; i < span->length; i++) {
+      span->r[i] = span->a[i] - span->r[i];
+      span->g[i] = span->a[i] - span->g[i];
+      span->b[i] = span->a[i] - span->b[i];
+   }
+}
+
+/* Darkens every other 8x8 cell, so spans drawn in the wrong place show. */
+static void checker_span(ALLEGRO_SHADER_SPAN *span, void *user_data)
+{
+   int i;
+   (void)user_data;
+
+   for (i = 0; i < span->length; i++) {
+      if ((((span->x + i) >> 3) + (span->y >> 3)) & 1) {
+         span->r[i] *= 0.25f;
+         span->g[i] *= 0.25f;
+         span->b[i] *= 0.25f;
+      }
+   }
+}
+
+static void use_span_shader(char const *name, int max_length)
+{
+   void (*callback)(ALLEGRO_SHADER_SPAN *span, void *user_data);
+
+   if (streq(name, "invert"))
+      callback = invert_span;
+   else if (streq(name, "checker"))
+      callback = checker_span;
+   else
+      error("unknown span callback %s", name);
+
+   if (!span_shader) {
+      span_shader = al_create_shader(ALLEGRO_SHADER_SOFTWARE);
+      if (!span_shader)
+         error("failed to create software shader");
+   }
+   if (!al_set_shader_span_callback(span_shader, callback, NULL, max_length))
+      error("failed to set span callback");
+   if (!al_build_shader(span_shader))
+      error("failed to build software shader");
+   if (!al_use_shader(span_shader))
+      error("failed to use software shader");
+}
+
+static void draw_mipmaps(ALLEGRO_BITMAP *bmp, int max, int flags)
+{
+   ALLEGRO_BITMAP *mipmaps[16];
+   int w = al_get_bitmap_width(bmp);
+   int h = al_get_bitmap_height(bmp);
+   int x = 0;
+   int n;
+   int i;
+
+   if (max < 0 || max > 16)
+      error("bad mipmap count %d", max);
+   n = al_create_mipmaps(bmp, mipmaps, max, flags);
+
+   for (i = 0; i < n; i++) {
+      w = (w > 1) ? w / 2 : 1;
+      h = (h > 1) ? h / 2 : 1;
+      if (al_get_bitmap_width(mipmaps[i]) != w ||
+            al_get_bitmap_height(mipmaps[i]) != h)
+         error("mipmap %d has the wrong size", i);
+      al_draw_bitmap(mipmaps[i], x, 0, 0);
+      x += w;
+      al_destroy_bitmap(mipmaps[i]);
+   }
+   if (n < max && (w > 1 || h > 1))
+      error("only %d of %d mipmaps created", n, max);
+}
+
+static void add_dirty_grid(ALLEGRO_BITMAP *bmp, int n)
+{
+   int i;
+
+   for (i = 0; i < n; i++)
+      al_add_bitmap_dirty_rect(bmp, (i % 8) * 40, (i / 8) * 40, 10, 10);
+}
+
+static void draw_dirty_rects(ALLEGRO_BITMAP *bmp, int num, ALLEGRO_COLOR color)
+{
+   int n = al_get_bitmap_num_dirty_rects(bmp);
+   int x, y, w, h;
+   int i;
+
+   if (n != num)
+      error("expected %d dirty rectangles, got %d", num, n);
+
+   for (i = 0; i < n; i++) {
+      if (!al_get_bitmap_dirty_rect(bmp, i, &x, &y, &w, &h))
+         error("failed to get dirty rectangle %d", i);
+      al_draw_filled_rectangle(x, y, x + w, y + h, color);
+   }
+}
+
+/* Probes the file both by name and as a stream, which must be left at
+ * the position it was at.
+ */
+static void check_probe(char const *filename, int w, int h, int channels,
+   int bpp, bool palette, bool alpha)
+{
+   ALLEGRO_BITMAP_INFO info;
+   ALLEGRO_BITMAP_INFO info_f;
+   ALLEGRO_FILE *fp;
+
+   if (!al_probe_bitmap(filename, &info))
+      error("failed to probe %s", filename);
+   if (info.width != w || info.height != h || info.channels != channels ||
+         info.bits_per_pixel != bpp || info.has_palette != palette ||
+         info.has_alpha != alpha) {
+      error("probed %s as %dx%d, %d channels, %d bpp, palette %d, alpha %d",
+         filename, info.width, info.height, info.channels,
+         info.bits_per_pixel, info.has_palette, info.has_alpha);
+   }
+
+   fp = al_fopen(filename, "rb");
+   if (!fp)
+      error("failed to open %s", filename);
+   if (!al_probe_bitmap_f(fp, strrchr(filename, '.'), &info_f))
+      error("failed to probe %s as a stream", filename);
+   if (info_f.width != w || info_f.height != h ||
+         info_f.channels != channels || info_f.bits_per_pixel != bpp)
+      error("probing %s as a stream gave different results", filename);
+   if (al_ftell(fp) != 0)
+      error("probing %s moved the stream", filename);
+   al_fclose(fp);
+}
+
+static void check_probe_fails(char const *filename)
+{
+   ALLEGRO_BITMAP_INFO info;
+
+   if (al_probe_bitmap(filename, &info))
+      error("probing %s did not fail", filename);
+}
+
+/* Writes the first bytes of one file to another, for testing truncated
+ * or mislabelled files.
+ */
+static void copy_file_head(char const *src, char const *dst, int bytes)
+{
+   ALLEGRO_FILE *in = al_fopen(src, "rb");
+   ALLEGRO_FILE *out = al_fopen(dst, "wb");
+   int c;
+
+   if (!in || !out)
+      error("failed to copy %s to %s", src, dst);
+   while (bytes-- > 0 && (c = al_fgetc(in)) != EOF)
+      al_fputc(out, c);
+   al_fclose(in);
+   al_fclose(out);
+}
+
 static void load_bitmaps(ALLEGRO_CONFIG const *cfg, const char *section,
    BmpType bmp_type, int flags)
 {
@@ -287,6 +578,21 @@ static int get_draw_bitmap_flag(char const *value)
    return atoi(value);
 }
 
+static int get_resample_flags(char const *value)
+{
+   int flags = 0;
+
+   if (strstr(value, "ALLEGRO_RESAMPLE_MITCHELL"))
+      flags |= ALLEGRO_RESAMPLE_MITCHELL;
+   if (strstr(value, "ALLEGRO_RESAMPLE_LANCZOS"))
+      flags |= ALLEGRO_RESAMPLE_LANCZOS;
+   if (strstr(value, "ALLEGRO_RESAMPLE_LINEAR_LIGHT"))
+      flags |= ALLEGRO_RESAMPLE_LINEAR_LIGHT;
+   if (strstr(value, "ALLEGRO_NO_PREMULTIPLIED_ALPHA"))
+      flags |= ALLEGRO_NO_PREMULTIPLIED_ALPHA;
+   return flags;
+}
+
 static int get_blender_op(char const *value)
 {
    return streq(value, "ALLEGRO_ADD") ? ALLEGRO_ADD
@@ -470,6 +776,34 @@ static ALLEGRO_FONT *get_font(char const *name)
    return NULL;
 }
 
+static ALLEGRO_BITMAP_STREAM **reserve_local_stream(const char *name)
+{
+   int i;
+
+   for (i = 0; i < MAX_STREAMS; i++) {
+      if (!streams[i].name) {
+         streams[i].name = al_ustr_new(name);
+         return &streams[i].stream;
+      }
+   }
+
+   error("stream limit reached");
+   return NULL;
+}
+
+static ALLEGRO_BITMAP_STREAM *get_stream(char const *name)
+{
+   int i;
+
+   for (i = 0; i < MAX_STREAMS; i++) {
+      if (streams[i].name && streq(al_cstr(streams[i].name), name))
+         return streams[i].stream;
+   }
+
+   error("undefined stream: %s", name);
+   return NULL;
+}
+
 static int get_font_align(char const *value)
 {
    return streq(value, "ALLEGRO_ALIGN_LEFT") ? ALLEGRO_ALIGN_LEFT
@@ -571,6 +905,105 @@ static void fill_vertex_counts(ALLEGRO_CONFIG const *cfg, char const *name)
 #undef MAXBUF
 }
 
+/* Each line is a comma separated list of indices, such as one triangle. */
+static void fill_indices(ALLEGRO_CONFIG const *cfg, char const *name)
+{
+#define MAXBUF    80
+
+   char const *value;
+   char buf[MAXBUF];
+   char *end;
+   long index;
+   int i;
+
+   memset(indices, 0, sizeof(indices));
+   num_indices = 0;
+
+   for (i = 0; num_indices < MAX_VERTICES; i++) {
+      sprintf(buf, "i%d", i);
+      value = al_get_config_value(cfg, name, buf);
+      if (!value)
+         break;
+
+      while (num_indices < MAX_VERTICES) {
+         index = strtol(value, &end, 10);
+         if (end == value)
+            break;
+         indices[num_indices++] = index;
+         value = end;
+         while (isspace(*value) || *value == ',')
+            value++;
+      }
+   }
+
+#undef MAXBUF
+}
+
+/* Each line is up to six comma separated numbers, a semicolon and a color. */
+static void fill_shapes(ALLEGRO_CONFIG const *cfg, char const *name)
+{
+#define MAXBUF    80
+
+   char const *value;
+   char buf[MAXBUF];
+   char *end;
+   int i, j;
+
+   memset(shapes, 0, sizeof(shapes));
+
+   for (i = 0; i < MAX_VERTICES; i++) {
+      sprintf(buf, "s%d", i);
+      value = al_get_config_value(cfg, name, buf);
+      if (!value)
+         break;
+
+      for (j = 0; j < 6; j++) {
+         shapes[i].f[j] = strtod(value, &end);
+         if (end == value)
+            break;
+         value = end;
+         while (*value == ' ' || *value == ',')
+            value++;
+      }
+      if (*value == ';' && sscanf(value + 1, " %s", buf) == 1) {
+         shapes[i].color = get_color(buf);
+      }
+   }
+
+   num_shapes = i;
+
+#undef MAXBUF
+}
+
+static void fill_rectangles(ALLEGRO_CONFIG const *cfg, char const *name,
+   ALLEGRO_PRIM_RECTANGLE *rects)
+{
+   int i;
+
+   fill_shapes(cfg, name);
+   for (i = 0; i < num_shapes; i++) {
+      rects[i].x1 = shapes[i].f[0];
+      rects[i].y1 = shapes[i].f[1];
+      rects[i].x2 = shapes[i].f[2];
+      rects[i].y2 = shapes[i].f[3];
+      rects[i].color = shapes[i].color;
+   }
+}
+
+static void fill_circles(ALLEGRO_CONFIG const *cfg, char const *name,
+   ALLEGRO_PRIM_CIRCLE *circles)
+{
+   int i;
+
+   fill_shapes(cfg, name);
+   for (i = 0; i < num_shapes; i++) {
+      circles[i].cx = shapes[i].f[0];
+      circles[i].cy = shapes[i].f[1];
+      circles[i].r = shapes[i].f[2];
+      circles[i].color = shapes[i].color;
+   }
+}
+
 static int get_prim_type(char const *value)
 {
    return streq(value, "ALLEGRO_PRIM_POINT_LIST") ? ALLEGRO_PRIM_POINT_LIST
@@ -909,6 +1342,19 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          continue;
       }
 
+      if (SCAN("use_span_shader", 2)) {
+         use_span_shader(V(0), I(1));
+         continue;
+      }
+
+      if (SCAN("al_use_shader", 1)) {
+         if (!streq(V(0), "NULL"))
+            error("only al_use_shader(NULL) is supported");
+         if (!al_use_shader(NULL))
+            error("al_use_shader(NULL) failed");
+         continue;
+      }
+
       if (SCAN("al_set_clipping_rectangle", 4)) {
          al_set_clipping_rectangle(I(0), I(1), I(2), I(3));
          continue;
@@ -1050,6 +1496,18 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          continue;
       }
 
+      if (SCANLVAL("al_clone_bitmap", 1)) {
+         ALLEGRO_BITMAP **bmp = reserve_local_bitmap(lval, bmp_type);
+         (*bmp) = al_clone_bitmap(B(0));
+         continue;
+      }
+
+      if (SCANLVAL("bitmap_from_pixels", 2)) {
+         ALLEGRO_BITMAP **bmp = reserve_local_bitmap(lval, bmp_type);
+         (*bmp) = bitmap_from_pixels(B(0), get_bool(V(1)));
+         continue;
+      }
+
       if (SCANLVAL("al_load_bitmap", 1)) {
          ALLEGRO_BITMAP **bmp = reserve_local_bitmap(lval, bmp_type);
          (*bmp) = load_relative_bitmap(V(0), 0);
@@ -1060,6 +1518,31 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          (*bmp) = load_relative_bitmap(V(0), get_load_bitmap_flag(V(1)));
          continue;
       }
+      if (SCANLVAL("al_load_bitmap_scaled", 4)) {
+         ALLEGRO_BITMAP **bmp = reserve_local_bitmap(lval, bmp_type);
+         (*bmp) = al_load_bitmap_scaled(V(0), I(1), I(2),
+            get_load_bitmap_flag(V(3)));
+         if (!(*bmp)) {
+            error("failed to load %s", V(0));
+         }
+         continue;
+      }
+      if (SCANLVAL("al_open_bitmap_stream", 2)) {
+         ALLEGRO_BITMAP_STREAM **stream = reserve_local_stream(lval);
+         (*stream) = al_open_bitmap_stream(V(0), get_load_bitmap_flag(V(1)));
+         if (!(*stream)) {
+            error("failed to open stream %s", V(0));
+         }
+         continue;
+      }
+      if (SCAN("load_bitmaps_async", 3)) {
+         load_bitmaps_async(V(0), V(1), I(2));
+         continue;
+      }
+      if (SCAN("al_read_bitmap_stream_to_bitmap", 2)) {
+         al_read_bitmap_stream_to_bitmap(get_stream(V(0)), B(1));
+         continue;
+      }
       if (SCAN("al_save_bitmap", 2)) {
          if (!al_save_bitmap(V(0), B(1))) {
             error("failed to save %s", V(0));
@@ -1067,6 +1550,36 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          continue;
       }
 
+      if (SCAN("check_probe", 7)) {
+         check_probe(V(0), I(1), I(2), I(3), I(4), get_bool(V(5)),
+            get_bool(V(6)));
+         continue;
+      }
+
+      if (SCAN("check_probe_fails", 1)) {
+         check_probe_fails(V(0));
+         continue;
+      }
+
+      if (SCAN("copy_file_head", 3)) {
+         copy_file_head(V(0), V(1), I(2));
+         continue;
+      }
+
+      /* Only the system configuration can be changed. */
+      if (SCAN("al_set_config_value", 4)) {
+         if (!streq(V(0), "system"))
+            error("unknown config %s", V(0));
+         al_set_config_value(al_get_system_config(), V(1), V(2), V(3));
+         continue;
+      }
+      if (SCAN("al_remove_config_key", 3)) {
+         if (!streq(V(0), "system"))
+            error("unknown config %s", V(0));
+         al_remove_config_key(al_get_system_config(), V(1), V(2));
+         continue;
+      }
+
       if (SCAN("al_hold_bitmap_drawing", 1)) {
          al_hold_bitmap_drawing(get_bool(V(0)));
          continue;
@@ -1109,6 +1622,44 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          continue;
       }
 
+      if (SCAN("al_resample_bitmap", 3)) {
+         if (!al_resample_bitmap(B(0), B(1), get_resample_flags(V(2)))) {
+            error("failed to resample %s", V(1));
+         }
+         continue;
+      }
+
+      if (SCAN("draw_mipmaps", 3)) {
+         draw_mipmaps(B(0), I(1), get_resample_flags(V(2)));
+         continue;
+      }
+
+      /* Dirty rectangles */
+      if (SCAN("al_set_bitmap_dirty_tracking", 2)) {
+         al_set_bitmap_dirty_tracking(B(0), get_bool(V(1)));
+         continue;
+      }
+
+      if (SCAN("al_add_bitmap_dirty_rect", 5)) {
+         al_add_bitmap_dirty_rect(B(0), I(1), I(2), I(3), I(4));
+         continue;
+      }
+
+      if (SCAN("al_clear_bitmap_dirty_rects", 1)) {
+         al_clear_bitmap_dirty_rects(B(0));
+         continue;
+      }
+
+      if (SCAN("add_dirty_grid", 2)) {
+         add_dirty_grid(B(0), I(1));
+         continue;
+      }
+
+      if (SCAN("draw_dirty_rects", 3)) {
+         draw_dirty_rects(B(0), I(1), C(2));
+         continue;
+      }
+
       /* Locking */
       if (SCAN("al_lock_bitmap", 3)) {
          ALLEGRO_BITMAP *bmp = B(0);
@@ -1155,6 +1706,11 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
             get_font_align(V(6)), V(7));
          continue;
       }
+      if (SCAN("al_draw_multiline_text", 8)) {
+         al_draw_multiline_text(get_font(V(0)), C(1), F(2), F(3), F(4), F(5),
+            get_font_align(V(6)), V(7));
+         continue;
+      }
       if (SCANLVAL("al_get_text_width", 2)) {
          int w = al_get_text_width(get_font(V(0)), V(1));
          set_config_int(cfg, testname, lval, w);
@@ -1184,6 +1740,15 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          set_config_int(cfg, testname, V(5), bbh);
          continue;
       }
+      if (SCANLVAL("al_get_multiline_text_dimensions", 6)) {
+         int bbw, bbh;
+         int n = al_get_multiline_text_dimensions(get_font(V(0)), F(1), F(2),
+            V(3), &bbw, &bbh);
+         set_config_int(cfg, testname, lval, n);
+         set_config_int(cfg, testname, V(4), bbw);
+         set_config_int(cfg, testname, V(5), bbh);
+         continue;
+      }
 
       /* Primitives */
       if (SCAN("al_draw_line", 6)) {
@@ -1263,6 +1828,57 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          al_draw_prim(vertices, NULL, B(2), I(3), I(4), get_prim_type(V(5)));
          continue;
       }
+      if (SCAN("al_draw_vertex_buffer", 5)) {
+         ALLEGRO_VERTEX_BUFFER *vb;
+         fill_vertices(cfg, V(0));
+         vb = al_create_vertex_buffer(NULL, vertices, I(3), false, 0);
+         al_draw_vertex_buffer(vb, B(1), I(2), I(3), get_prim_type(V(4)));
+         al_destroy_vertex_buffer(vb);
+         continue;
+      }
+      if (SCAN("al_draw_indexed_prim", 6)) {
+         fill_vertices(cfg, V(0));
+         fill_indices(cfg, V(3));
+         /* decl arg is ignored */
+         al_draw_indexed_prim(vertices, NULL, B(2), indices, I(4),
+            get_prim_type(V(5)));
+         continue;
+      }
+      if (SCAN("al_draw_indexed_buffer", 6)) {
+         ALLEGRO_VERTEX_BUFFER *vb;
+         ALLEGRO_INDEX_BUFFER *ib;
+         uint16_t *idx;
+         int i;
+         fill_vertices(cfg, V(0));
+         fill_indices(cfg, V(2));
+         vb = al_create_vertex_buffer(NULL, vertices, MAX_VERTICES, false, 0);
+         ib = al_create_index_buffer(sizeof(uint16_t), NULL, num_indices, 0);
+         idx = al_lock_index_buffer(ib, 0, num_indices, ALLEGRO_LOCK_WRITEONLY);
+         for (i = 0; i < num_indices; i++)
+            idx[i] = indices[i];
+         al_unlock_index_buffer(ib);
+         al_draw_indexed_buffer(vb, B(1), ib, I(3), I(4), get_prim_type(V(5)));
+         al_destroy_index_buffer(ib);
+         al_destroy_vertex_buffer(vb);
+         continue;
+      }
+      /* Draws a vertex buffer, rewrites some of its vertices with those of
+       * a second set and draws it again.
+       */
+      if (SCAN("al_draw_relocked_vertex_buffer", 8)) {
+         ALLEGRO_VERTEX_BUFFER *vb;
+         ALLEGRO_VERTEX *v;
+         fill_vertices(cfg, V(0));
+         vb = al_create_vertex_buffer(NULL, vertices, I(4), false, 0);
+         al_draw_vertex_buffer(vb, B(2), I(3), I(4), get_prim_type(V(5)));
+         fill_vertices(cfg, V(1));
+         v = al_lock_vertex_buffer(vb, I(6), I(7), ALLEGRO_LOCK_WRITEONLY);
+         memcpy(v, vertices + I(6), I(7) * sizeof(ALLEGRO_VERTEX));
+         al_unlock_vertex_buffer(vb);
+         al_draw_vertex_buffer(vb, B(2), I(3), I(4), get_prim_type(V(5)));
+         al_destroy_vertex_buffer(vb);
+         continue;
+      }
 
       /* Keep 5.0 and 5.1 functions separate for easier merging. */
 
@@ -1274,6 +1890,17 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
             C(3), F(4), F(5));
          continue;
       }
+      if (SCAN("al_draw_stroke_mesh", 6)) {
+         ALLEGRO_STROKE_MESH *mesh;
+         fill_simple_vertices(cfg, V(0));
+         mesh = al_create_stroke_mesh();
+         al_add_polyline_to_stroke_mesh(mesh, simple_vertices,
+            2 * sizeof(float), num_simple_vertices, get_line_join(V(1)),
+            get_line_cap(V(2)), F(4), F(5));
+         al_draw_stroke_mesh(mesh, C(3));
+         al_destroy_stroke_mesh(mesh);
+         continue;
+      }
       if (SCAN("al_draw_polygon", 5)) {
          fill_simple_vertices(cfg, V(0));
          al_draw_polygon(simple_vertices, num_simple_vertices,
@@ -1292,6 +1919,61 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
          continue;
       }
 
+      if (SCAN("al_draw_lines", 2)) {
+         ALLEGRO_PRIM_LINE lines[MAX_VERTICES];
+         int i;
+         fill_shapes(cfg, V(0));
+         for (i = 0; i < num_shapes; i++) {
+            lines[i].x1 = shapes[i].f[0];
+            lines[i].y1 = shapes[i].f[1];
+            lines[i].x2 = shapes[i].f[2];
+            lines[i].y2 = shapes[i].f[3];
+            lines[i].color = shapes[i].color;
+         }
+         al_draw_lines(lines, num_shapes, F(1));
+         continue;
+      }
+      if (SCAN("al_draw_rectangles", 2)) {
+         ALLEGRO_PRIM_RECTANGLE rects[MAX_VERTICES];
+         fill_rectangles(cfg, V(0), rects);
+         al_draw_rectangles(rects, num_shapes, F(1));
+         continue;
+      }
+      if (SCAN("al_draw_filled_rectangles", 1)) {
+         ALLEGRO_PRIM_RECTANGLE rects[MAX_VERTICES];
+         fill_rectangles(cfg, V(0), rects);
+         al_draw_filled_rectangles(rects, num_shapes);
+         continue;
+      }
+      if (SCAN("al_draw_circles", 2)) {
+         ALLEGRO_PRIM_CIRCLE circles[MAX_VERTICES];
+         fill_circles(cfg, V(0), circles);
+         al_draw_circles(circles, num_shapes, F(1));
+         continue;
+      }
+      if (SCAN("al_draw_filled_circles", 1)) {
+         ALLEGRO_PRIM_CIRCLE circles[MAX_VERTICES];
+         fill_circles(cfg, V(0), circles);
+         al_draw_filled_circles(circles, num_shapes);
+         continue;
+      }
+      if (SCAN("al_draw_filled_rounded_rectangles", 1)) {
+         ALLEGRO_PRIM_ROUNDED_RECTANGLE rects[MAX_VERTICES];
+         int i;
+         fill_shapes(cfg, V(0));
+         for (i = 0; i < num_shapes; i++) {
+            rects[i].x1 = shapes[i].f[0];
+            rects[i].y1 = shapes[i].f[1];
+            rects[i].x2 = shapes[i].f[2];
+            rects[i].y2 = shapes[i].f[3];
+            rects[i].rx = shapes[i].f[4];
+            rects[i].ry = shapes[i].f[5];
+            rects[i].color = shapes[i].color;
+         }
+         al_draw_filled_rounded_rectangles(rects, num_shapes);
+         continue;
+      }
+
       error("statement didn't scan: %s", stmt);
    }
 
@@ -1338,12 +2020,26 @@ static void do_test(ALLEGRO_CONFIG *cfg, char const *testname,
       }
    }
 
+   /* Close streams. */
+   for (i = 0; i < MAX_STREAMS; i++) {
+      if (streams[i].name) {
+         al_ustr_free(streams[i].name);
+         streams[i].name = NULL;
+         al_close_bitmap_stream(streams[i].stream);
+         streams[i].stream = NULL;
+      }
+   }
+
    /* Free transform names. */
    for (i = 0; i < MAX_TRANS; i++) {
       al_ustr_free(transforms[i].name);
       transforms[i].name = NULL;
    }
 
+   /* Bitmaps stop using the shader when it is destroyed. */
+   al_destroy_shader(span_shader);
+   span_shader = NULL;
+
 #undef MAXBUF
 }
 